@@ -0,0 +1,40 @@
+#include "bench_harness.h"
+#include "functions.h"
+
+// One call of a builtin on fixed arguments, result freed
+typedef struct {
+    const Builtin *builtin;
+    Value *args[3];
+    int count;
+} Call;
+
+static void call_builtin(long iterations, void *context) {
+    Call *call = (Call*)context;
+    for (long i = 0; i < iterations; i++) {
+        Value *result = call->builtin->fn(call->args, call->count);
+        BENCH_KEEP(result);
+        free_value(result);
+    }
+}
+
+static void bench_call(const char *name, const char *builtin, Value *a, Value *b, Value *c) {
+    Call call = {find_builtin(builtin), {a, b, c}, (a != NULL) + (b != NULL) + (c != NULL)};
+    RUN_BENCH(name, call_builtin, &call);
+    for (int i = 0; i < call.count; i++) free_value(call.args[i]);
+}
+
+int main() {
+    bench_pin();
+    // One per family: arithmetic, comparison, rounding, Text, conditional
+    bench_call("builtins/ADD", "ADD", value_from_num(1.5), value_from_num(2.25), NULL);
+    bench_call("builtins/SQRT", "SQRT", value_from_num(2), NULL, NULL);
+    bench_call("builtins/LT", "LT", value_from_num(1), value_from_num(2), NULL);
+    bench_call("builtins/FLOOR", "FLOOR", value_from_num(2.5), NULL, NULL);
+    bench_call("builtins/CONCAT", "CONCAT", value_from_str("hello, "), value_from_str("world"), NULL);
+    bench_call("builtins/FIND", "FIND", value_from_str("The quick brown fox jumps over the lazy dog"),
+               value_from_str("lazy"), NULL);
+    bench_call("builtins/SUBSTR", "SUBSTR", value_from_str("The quick brown fox"), value_from_num(4),
+               value_from_num(5));
+    bench_call("builtins/IF", "IF", value_from_num(1), value_from_num(2), value_from_num(3));
+    return 0;
+}
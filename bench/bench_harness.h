@@ -0,0 +1,85 @@
+// bench_harness.h
+
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Every benchmark is timed BENCH_REPETITIONS times, each repetition running
+// enough iterations to take at least BENCH_MIN_NS
+#define BENCH_REPETITIONS 15
+#define BENCH_MIN_NS 10000000L
+
+// Runs a benchmark body the given number of times
+typedef void (*bench_fn)(long iterations, void *context);
+
+// Keeps a result alive without the optimizer seeing through it
+#define BENCH_KEEP(x) __asm__ volatile("" : : "g"(x) : "memory")
+
+static inline long bench_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Stay on the CPU the process started on, so repetitions are not spread
+// over cores with different caches and clocks
+static inline void bench_pin() {
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu >= 0) CPU_SET(cpu, &set);
+    if (cpu < 0 || sched_setaffinity(0, sizeof(set), &set) != 0) {
+        fprintf(stderr, "Benchmarks: could not pin to a CPU, results may be noisier.\n");
+    }
+#endif
+}
+
+static int bench_compare_ns(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Prints one tab separated line to stdout: name, median, mean, standard
+// deviation and minimum in nanoseconds per operation, iterations per
+// repetition and repetitions. A summary goes to stderr.
+static inline void run_bench(const char *name, bench_fn fn, void *context) {
+    // Warm up and find an iteration count long enough to time
+    long iterations = 1;
+    for (;;) {
+        long start = bench_now_ns();
+        fn(iterations, context);
+        if (bench_now_ns() - start >= BENCH_MIN_NS || iterations >= (1L << 40)) break;
+        iterations *= 2;
+    }
+
+    double ns[BENCH_REPETITIONS];
+    double sum = 0;
+    for (int r = 0; r < BENCH_REPETITIONS; r++) {
+        long start = bench_now_ns();
+        fn(iterations, context);
+        ns[r] = (double)(bench_now_ns() - start) / iterations;
+        sum += ns[r];
+    }
+    double mean = sum / BENCH_REPETITIONS;
+    double variance = 0;
+    for (int r = 0; r < BENCH_REPETITIONS; r++) variance += (ns[r] - mean) * (ns[r] - mean);
+    double stddev = sqrt(variance / (BENCH_REPETITIONS - 1));
+    qsort(ns, BENCH_REPETITIONS, sizeof(double), bench_compare_ns);
+    double median = ns[BENCH_REPETITIONS / 2];
+
+    printf("%s\t%.2f\t%.2f\t%.2f\t%.2f\t%ld\t%d\n", name, median, mean, stddev, ns[0], iterations, BENCH_REPETITIONS);
+    fflush(stdout);
+    fprintf(stderr, "%-36s %12.2f ns/op  +/- %5.1f%%\n", name, median, mean > 0 ? 100 * stddev / mean : 0);
+}
+
+#define RUN_BENCH(name, fn, context) run_bench(name, fn, context)
+
+#endif
@@ -0,0 +1,76 @@
+#include "bench_harness.h"
+#include "hashmap.h"
+#include <stdio.h>
+
+// Sizes are the variable counts of small, typical and generated programs
+static const int sizes[] = {8, 64, 1024, 16384};
+
+typedef struct {
+    int size;
+    char **keys;
+    struct hashmap *map;
+} MapContext;
+
+static MapContext make_context(int size) {
+    MapContext context = {size, malloc(size * sizeof(char*)), NULL};
+    for (int i = 0; i < size; i++) {
+        context.keys[i] = malloc(32);
+        snprintf(context.keys[i], 32, "variable_%d", i);
+    }
+    return context;
+}
+
+static struct hashmap *filled_map(MapContext *context) {
+    struct hashmap *map = hashmap_new(16, 4, hash_string);
+    for (int i = 0; i < context->size; i++) hashmap_insert(map, context->keys[i], context->keys[i]);
+    return map;
+}
+
+// Fills a map from empty, so growth is included
+static void insert_all(long iterations, void *context) {
+    MapContext *map_context = (MapContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        struct hashmap *map = hashmap_new(16, 4, hash_string);
+        for (int k = 0; k < map_context->size; k++) {
+            hashmap_insert(map, map_context->keys[k], map_context->keys[k]);
+        }
+        BENCH_KEEP(map);
+        free_hashmap(map, NULL);
+    }
+}
+
+static void lookup_hit(long iterations, void *context) {
+    MapContext *map_context = (MapContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        void *value = hashmap_lookup(map_context->map, map_context->keys[i % map_context->size]);
+        BENCH_KEEP(value);
+    }
+}
+
+static void lookup_miss(long iterations, void *context) {
+    MapContext *map_context = (MapContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        void *value = hashmap_lookup(map_context->map, "missing_variable");
+        BENCH_KEEP(value);
+    }
+}
+
+int main() {
+    bench_pin();
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        MapContext context = make_context(sizes[s]);
+        context.map = filled_map(&context);
+        char name[64];
+        // Inserting is reported per map, not per key
+        snprintf(name, sizeof(name), "hashmap/insert_%d", sizes[s]);
+        RUN_BENCH(name, insert_all, &context);
+        snprintf(name, sizeof(name), "hashmap/lookup_hit_%d", sizes[s]);
+        RUN_BENCH(name, lookup_hit, &context);
+        snprintf(name, sizeof(name), "hashmap/lookup_miss_%d", sizes[s]);
+        RUN_BENCH(name, lookup_miss, &context);
+        free_hashmap(context.map, NULL);
+        for (int i = 0; i < sizes[s]; i++) free(context.keys[i]);
+        free(context.keys);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "bench_harness.h"
+#include "lexer.h"
+#include "util.h"
+
+static void lex_var_name(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        consume_name_result result = consume_var_name((char*)context);
+        BENCH_KEEP(result.next_input);
+        xfree(result.name);
+    }
+}
+
+static void lex_func_name(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        consume_name_result result = consume_func_name((char*)context);
+        BENCH_KEEP(result.next_input);
+        xfree(result.name);
+    }
+}
+
+static void lex_str_literal(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        consume_name_result result = consume_str_literal((char*)context);
+        BENCH_KEEP(result.next_input);
+        xfree(result.name);
+    }
+}
+
+static void lex_num_literal(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        consume_num_result result = consume_num_literal((char*)context);
+        BENCH_KEEP(result.number);
+    }
+}
+
+static void lex_jump_literal(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        consume_jump_result result = consume_jump_literal((char*)context);
+        BENCH_KEEP(result.lines);
+    }
+}
+
+static void lex_arrows(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        consume_arrow_result right = consume_right_arrow((char*)context);
+        consume_arrow_result left = consume_left_arrow(right.next_input);
+        BENCH_KEEP(left.success);
+    }
+}
+
+int main() {
+    bench_pin();
+    RUN_BENCH("lexer/var_name", lex_var_name, "running_total_of_values -> x");
+    RUN_BENCH("lexer/func_name", lex_func_name, "CONCAT <- [a, b]");
+    RUN_BENCH("lexer/str_literal", lex_str_literal, "\"The quick brown fox jumps over the lazy dog\"");
+    RUN_BENCH("lexer/num_literal", lex_num_literal, "-12345.6789 -> x");
+    RUN_BENCH("lexer/jump_literal", lex_jump_literal, "12<=");
+    RUN_BENCH("lexer/arrows", lex_arrows, "-> <- x");
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "bench_harness.h"
+#include "list.h"
+
+#define LIST_LENGTH 1000
+
+// Builds a list of LIST_LENGTH items, growth included; reported per list
+static void append_items(long iterations, void *context) {
+    (void)context;
+    for (long i = 0; i < iterations; i++) {
+        struct list *xs = list_new(4);
+        for (int k = 0; k < LIST_LENGTH; k++) list_append(xs, xs);
+        BENCH_KEEP(xs);
+        free_list(xs);
+    }
+}
+
+static void prepend_items(long iterations, void *context) {
+    (void)context;
+    for (long i = 0; i < iterations; i++) {
+        struct list *xs = list_new(4);
+        for (int k = 0; k < LIST_LENGTH; k++) list_prepend(xs, xs);
+        BENCH_KEEP(xs);
+        free_list(xs);
+    }
+}
+
+static void get_items(long iterations, void *context) {
+    struct list *xs = (struct list*)context;
+    for (long i = 0; i < iterations; i++) {
+        void *x = list_get(xs, (int)(i % LIST_LENGTH));
+        BENCH_KEEP(x);
+    }
+}
+
+int main() {
+    bench_pin();
+    struct list *xs = list_new(LIST_LENGTH);
+    for (int k = 0; k < LIST_LENGTH; k++) list_append(xs, xs);
+    RUN_BENCH("list/append_1000", append_items, NULL);
+    RUN_BENCH("list/prepend_1000", prepend_items, NULL);
+    RUN_BENCH("list/get", get_items, xs);
+    free_list(xs);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include "bench_harness.h"
+#include "parser.h"
+
+static void parse_line(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        parse_statement_result result = parse_statement((char*)context);
+        BENCH_KEEP(result.stmt);
+        if (result.success) free_statement(result.stmt);
+    }
+}
+
+int main() {
+    bench_pin();
+    RUN_BENCH("parser/literal", parse_line, "42");
+    RUN_BENCH("parser/assignment", parse_line, "(counter -> ADD <- 1) -> counter");
+    RUN_BENCH("parser/nested_calls", parse_line, "((a -> MUL <- b) -> ADD <- (c -> DIV <- (d -> SUB <- 1))) -> e");
+    RUN_BENCH("parser/jump_if", parse_line, "JUMP_IF <- [(i -> LT <- 100), 3<=, =>1]");
+    RUN_BENCH("parser/text_call", parse_line, "(greeting -> CONCAT <- \", world\") -> message");
+    RUN_BENCH("parser/syntax_error", parse_line, "(counter -> ADD <- 1 -> counter");
+    return 0;
+}
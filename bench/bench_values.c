@@ -0,0 +1,47 @@
+#include "bench_harness.h"
+#include "interpreter.h"
+
+static void num_value(long iterations, void *context) {
+    (void)context;
+    for (long i = 0; i < iterations; i++) {
+        Value *v = value_from_num((double)i);
+        BENCH_KEEP(v);
+        free_value(v);
+    }
+}
+
+static void str_value(long iterations, void *context) {
+    for (long i = 0; i < iterations; i++) {
+        Value *v = value_from_str((char*)context);
+        BENCH_KEEP(v);
+        free_value(v);
+    }
+}
+
+static void jump_value(long iterations, void *context) {
+    (void)context;
+    for (long i = 0; i < iterations; i++) {
+        Value *v = value_from_jump(3, JUMP_BACKWARD);
+        BENCH_KEEP(v);
+        free_value(v);
+    }
+}
+
+static void none_value(long iterations, void *context) {
+    (void)context;
+    for (long i = 0; i < iterations; i++) {
+        Value *v = value_from_none();
+        BENCH_KEEP(v);
+        free_value(v);
+    }
+}
+
+int main() {
+    bench_pin();
+    RUN_BENCH("values/num", num_value, NULL);
+    RUN_BENCH("values/str_short", str_value, "pinch");
+    RUN_BENCH("values/str_long", str_value, "The quick brown fox jumps over the lazy dog, twice over and then some more.");
+    RUN_BENCH("values/jump", jump_value, NULL);
+    RUN_BENCH("values/none", none_value, NULL);
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Generated by pinch --emit-c from /tmp/loop.pinch
+// Build with the interpreter objects, e.g. make native PROG=/tmp/loop.pinch
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "interpreter.h"
+#include "functions.h"
+
+static void halt(int number) {
+    fprintf(stderr, "Execution halted at statement %d.\n", number);
+    exit(EXIT_SUCCESS);
+}
+
+static void undefined(const char *name, int number) {
+    fprintf(stderr, "Runtime Error: Undefined variable '%s'.\n", name);
+    halt(number);
+}
+
+static inline double num_var(double value, bool defined, const char *name, int number) {
+    if (!defined) undefined(name, number);
+    return value;
+}
+
+static inline Value *box_var(Value *value, const char *name, int number) {
+    if (value == NULL) undefined(name, number);
+    return copy_value(value);
+}
+
+// Call a builtin on owned arguments, halting if it reports an error
+static inline Value *call(builtin_fn fn, Value **args, int count, int number) {
+    Value *result = fn(args, count);
+    for (int i = 0; i < count; i++) free_value(args[i]);
+    if (result->type == VALUE_ERROR) halt(number);
+    return result;
+}
+
+// Let a builtin report why it rejects unboxed Number arguments
+static void reject(builtin_fn fn, double a, double b, int count, int number) {
+    Value *args[2] = {value_from_num(a), value_from_num(b)};
+    call(fn, args, count, number);
+    halt(number);
+}
+
+static inline double unbox_num(Value *value) {
+    double num = value->data.num;
+    free_value(value);
+    return num;
+}
+
+static inline void check_none(Value *value, const char *name, int number) {
+    if (value->type == VALUE_NONE) {
+        fprintf(stderr, "Runtime Error: Assigning none value to variable '%s'.\n", name);
+        halt(number);
+    }
+}
+
+static inline void assign(Value **var, Value *value, const char *name, int number) {
+    check_none(value, name, number);
+    free_value(*var);
+    *var = value;
+}
+
+static inline void print_num(double num) {
+    Value value = {.type = VALUE_NUM, .data.num = num};
+    print_value(&value);
+}
+
+static inline void print_boxed(Value *value) {
+    print_value(value);
+    free_value(value);
+}
+
+static Value *unknown(const char *name, int number) {
+    fprintf(stderr, "Runtime Error: Unknown function '%s'.\n", name);
+    halt(number);
+    return NULL;
+}
+
+static inline double jump_if_cond(Value *cond, int number) {
+    if (cond->type != VALUE_NUM) {
+        fprintf(stderr, "Runtime Error: JUMP_IF expects 3 arguments [Number, Jump, Jump].\n");
+        halt(number);
+    }
+    return unbox_num(cond);
+}
+
+// Jumps by computed amounts move pc like the interpreter's program counter
+static Value *jump(Value **args, int count, int *pc, int number) {
+    if (count != 1 || args[0]->type != VALUE_JUMP) {
+        fprintf(stderr, "Runtime Error: JUMP expects 1 argument Jump.\n");
+        halt(number);
+    }
+    *pc += args[0]->data.jump.type == JUMP_FORWARD ? args[0]->data.jump.lines : -args[0]->data.jump.lines;
+    (*pc)--;
+    for (int i = 0; i < count; i++) free_value(args[i]);
+    return value_from_none();
+}
+
+static Value *jump_if(Value **args, int count, int *pc, int number) {
+    if (count != 3 || args[0]->type != VALUE_NUM || args[1]->type != VALUE_JUMP) {
+        fprintf(stderr, "Runtime Error: JUMP_IF expects 3 arguments [Number, Jump, Jump].\n");
+        halt(number);
+    }
+    Value *taken = args[0]->data.num >= 0.5 ? args[1] : args[2];
+    *pc += taken->data.jump.type == JUMP_FORWARD ? taken->data.jump.lines : -taken->data.jump.lines;
+    (*pc)--;
+    for (int i = 0; i < count; i++) free_value(args[i]);
+    return value_from_none();
+}
+
+int main(void) {
+    double v0 = 0;
+    bool d0 = false;
+    double v1 = 0;
+    bool d1 = false;
+
+    {
+        double t0 = 0.0;
+        v0 = t0;
+        d0 = true;
+    }
+    {
+        double t1 = 0.0;
+        v1 = t1;
+        d1 = true;
+    }
+s2:
+    {
+        double t2 = num_var(v1, d1, "acc", 3);
+        double t3 = num_var(v0, d0, "i", 3);
+        double t4 = t2 + t3;
+        v1 = t4;
+        d1 = true;
+    }
+    {
+        double t5 = num_var(v0, d0, "i", 4);
+        double t6 = 1.0;
+        double t7 = t5 + t6;
+        v0 = t7;
+        d0 = true;
+    }
+    {
+        double t8 = num_var(v0, d0, "i", 5);
+        double t9 = 3000000.0;
+        double t10 = t8 < t9 ? 1.0 : 0.0;
+        if (t10 >= 0.5) goto s2;
+        goto s5;
+    }
+s5:
+    {
+        double t11 = num_var(v1, d1, "acc", 6);
+        print_num(t11);
+    }
+    return EXIT_SUCCESS;
+}
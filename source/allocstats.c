@@ -0,0 +1,284 @@
+// Logic for counting allocations by the site that made them
+
+#include "allocstats.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Both tables are open-addressed with linear probing and kept at most half
+// full. Their memory comes from malloc directly, since xalloc reports here.
+#define INITIAL_BLOCKS 4096
+#define INITIAL_SITES 256
+
+typedef struct {
+    const char *message;    // NULL for an empty slot
+    long allocations[ALLOC_PHASES];
+    size_t bytes[ALLOC_PHASES];
+    long live;
+    size_t live_bytes;
+} Site;
+
+typedef struct {
+    void *mem;              // NULL for an empty slot
+    size_t size;
+    int site;
+} Block;
+
+bool alloc_tracking = false;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static AllocPhase phase = ALLOC_PHASE_OTHER;
+static AllocTotals totals;
+static Site *sites = NULL;
+static int site_capacity = 0;
+static int site_count = 0;
+static Block *blocks = NULL;
+static size_t block_capacity = 0;
+static size_t block_count = 0;
+static bool untracked = false;  // A table could not grow, counts are incomplete
+
+static size_t hash_pointer(const void *p, size_t capacity) {
+    return (size_t)(((uintptr_t)p >> 4) * 0x9E3779B97F4A7C15ULL) & (capacity - 1);
+}
+
+void track_allocations() {
+    pthread_mutex_lock(&lock);
+    if (blocks == NULL) {
+        blocks = calloc(INITIAL_BLOCKS, sizeof(Block));
+        sites = calloc(INITIAL_SITES, sizeof(Site));
+        if (blocks != NULL && sites != NULL) {
+            block_capacity = INITIAL_BLOCKS;
+            site_capacity = INITIAL_SITES;
+            __atomic_store_n(&alloc_tracking, true, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+AllocPhase set_alloc_phase(AllocPhase next) {
+    pthread_mutex_lock(&lock);
+    AllocPhase previous = phase;
+    phase = next;
+    pthread_mutex_unlock(&lock);
+    return previous;
+}
+
+// ---------------------------------------------------------
+// TABLES
+// ---------------------------------------------------------
+
+static bool grow_sites() {
+    Site *grown = calloc(2 * site_capacity, sizeof(Site));
+    if (grown == NULL) return false;
+    for (int i = 0; i < site_capacity; i++) {
+        if (sites[i].message == NULL) continue;
+        size_t slot = hash_pointer(sites[i].message, 2 * site_capacity);
+        while (grown[slot].message != NULL) slot = (slot + 1) & (2 * site_capacity - 1);
+        grown[slot] = sites[i];
+    }
+    free(sites);
+    sites = grown;
+    site_capacity *= 2;
+    return true;
+}
+
+// Sites are keyed by the message pointer; identical messages from different
+// places are merged in the report
+static int find_site(const char *message) {
+    if (2 * (site_count + 1) > site_capacity && !grow_sites()) return -1;
+    size_t slot = hash_pointer(message, site_capacity);
+    while (sites[slot].message != NULL && sites[slot].message != message) {
+        slot = (slot + 1) & (site_capacity - 1);
+    }
+    if (sites[slot].message == NULL) {
+        sites[slot].message = message;
+        site_count++;
+    }
+    return (int)slot;
+}
+
+static void insert_block(Block *table, size_t capacity, Block block) {
+    size_t slot = hash_pointer(block.mem, capacity);
+    while (table[slot].mem != NULL) slot = (slot + 1) & (capacity - 1);
+    table[slot] = block;
+}
+
+static bool grow_blocks() {
+    Block *grown = calloc(2 * block_capacity, sizeof(Block));
+    if (grown == NULL) return false;
+    for (size_t i = 0; i < block_capacity; i++) {
+        if (blocks[i].mem != NULL) insert_block(grown, 2 * block_capacity, blocks[i]);
+    }
+    free(blocks);
+    blocks = grown;
+    block_capacity *= 2;
+    return true;
+}
+
+// Remove the block at slot, moving later blocks of its probe run back so
+// lookups never stop at the hole
+static void delete_block(size_t slot) {
+    size_t mask = block_capacity - 1;
+    size_t next = (slot + 1) & mask;
+    while (blocks[next].mem != NULL) {
+        size_t home = hash_pointer(blocks[next].mem, block_capacity);
+        // Move the block if its home does not lie cyclically in (slot, next]
+        bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+        if (!stays) {
+            blocks[slot] = blocks[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    blocks[slot].mem = NULL;
+}
+
+// ---------------------------------------------------------
+// COUNTING
+// ---------------------------------------------------------
+
+void alloc_stats_add(void *mem, size_t size, const char *message) {
+    pthread_mutex_lock(&lock);
+    int site = find_site(message);
+    if (site < 0 || (2 * (block_count + 1) > block_capacity && !grow_blocks())) {
+        untracked = true;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    insert_block(blocks, block_capacity, (Block){mem, size, site});
+    block_count++;
+
+    sites[site].allocations[phase]++;
+    sites[site].bytes[phase] += size;
+    sites[site].live++;
+    sites[site].live_bytes += size;
+
+    totals.allocations++;
+    totals.bytes += size;
+    totals.live_bytes += size;
+    totals.phase_allocations[phase]++;
+    totals.phase_bytes[phase] += size;
+    if (totals.live_bytes > totals.peak_bytes) totals.peak_bytes = totals.live_bytes;
+    if (totals.live_bytes > totals.phase_peak_bytes[phase]) totals.phase_peak_bytes[phase] = totals.live_bytes;
+    pthread_mutex_unlock(&lock);
+}
+
+void alloc_stats_remove(void *mem) {
+    pthread_mutex_lock(&lock);
+    size_t slot = hash_pointer(mem, block_capacity);
+    while (blocks[slot].mem != NULL && blocks[slot].mem != mem) {
+        slot = (slot + 1) & (block_capacity - 1);
+    }
+    // Blocks from before tracking started are not in the table
+    if (blocks[slot].mem != NULL) {
+        Block block = blocks[slot];
+        delete_block(slot);
+        block_count--;
+        sites[block.site].live--;
+        sites[block.site].live_bytes -= block.size;
+        totals.frees++;
+        totals.live_bytes -= block.size;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+AllocTotals alloc_totals() {
+    pthread_mutex_lock(&lock);
+    AllocTotals copy = totals;
+    pthread_mutex_unlock(&lock);
+    return copy;
+}
+
+// ---------------------------------------------------------
+// REPORT
+// ---------------------------------------------------------
+
+// The part of a message that names the site: "while parsing factor" for
+// "Interpreter Error: Fail to allocate memory while parsing factor.\n"
+static void site_name(const char *message, char *name, size_t size) {
+    const char *prefixes[] = {"Interpreter Error: Fail to allocate memory ", "Interpreter Error: Failed to allocate memory ",
+                              "Runtime Error: Memory allocation failed "};
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        if (strncmp(message, prefixes[i], strlen(prefixes[i])) == 0) {
+            message += strlen(prefixes[i]);
+            break;
+        }
+    }
+    size_t length = strcspn(message, "\n");
+    if (length > 0 && message[length - 1] == '.') length--;
+    if (length >= size) length = size - 1;
+    memcpy(name, message, length);
+    name[length] = '\0';
+}
+
+static long site_allocations(const Site *site) {
+    long count = 0;
+    for (int p = 0; p < ALLOC_PHASES; p++) count += site->allocations[p];
+    return count;
+}
+
+static int compare_allocations(const void *a, const void *b) {
+    long x = site_allocations((const Site*)a);
+    long y = site_allocations((const Site*)b);
+    return x != y ? (x < y ? 1 : -1) : 0;
+}
+
+// Fold sites with the same message into the first of them
+static int merge_sites(Site *merged) {
+    int count = 0;
+    for (int i = 0; i < site_capacity; i++) {
+        if (sites[i].message == NULL) continue;
+        int into = 0;
+        while (into < count && strcmp(merged[into].message, sites[i].message) != 0) into++;
+        if (into == count) {
+            merged[count++] = sites[i];
+            continue;
+        }
+        for (int p = 0; p < ALLOC_PHASES; p++) {
+            merged[into].allocations[p] += sites[i].allocations[p];
+            merged[into].bytes[p] += sites[i].bytes[p];
+        }
+        merged[into].live += sites[i].live;
+        merged[into].live_bytes += sites[i].live_bytes;
+    }
+    return count;
+}
+
+void print_alloc_stats(FILE *out, int shown) {
+    pthread_mutex_lock(&lock);
+    Site *merged = calloc(site_count + 1, sizeof(Site));
+    int count = merged != NULL ? merge_sites(merged) : 0;
+    AllocTotals all = totals;
+    bool incomplete = untracked;
+    pthread_mutex_unlock(&lock);
+
+    fprintf(out, "Allocations: %ld allocation(s) of %zu bytes, %ld freed, peak %zu bytes live, %zu bytes still live.\n",
+            all.allocations, all.bytes, all.frees, all.peak_bytes, all.live_bytes);
+    const char *phase_names[ALLOC_PHASES] = {"other", "load", "execute"};
+    for (int p = 0; p < ALLOC_PHASES; p++) {
+        fprintf(out, "Allocations: %-7s %10ld allocation(s) of %12zu bytes, peak %zu bytes live.\n",
+                phase_names[p], all.phase_allocations[p], all.phase_bytes[p], all.phase_peak_bytes[p]);
+    }
+    if (incomplete) {
+        fprintf(out, "Allocations: some allocations could not be tracked.\n");
+    }
+
+    qsort(merged, count, sizeof(Site), compare_allocations);
+    fprintf(out, "%12s %14s %10s %12s %12s %12s   %s\n",
+            "allocations", "bytes", "live", "live bytes", "load", "execute", "site");
+    for (int i = 0; i < count && i < shown; i++) {
+        Site *site = &merged[i];
+        char name[96];
+        site_name(site->message, name, sizeof(name));
+        size_t bytes = 0;
+        for (int p = 0; p < ALLOC_PHASES; p++) bytes += site->bytes[p];
+        fprintf(out, "%12ld %14zu %10ld %12zu %12ld %12ld   %s\n", site_allocations(site), bytes,
+                site->live, site->live_bytes, site->allocations[ALLOC_PHASE_LOAD],
+                site->allocations[ALLOC_PHASE_EXECUTE], name);
+    }
+    if (count > shown) {
+        fprintf(out, "Allocations: %d more site(s).\n", count - shown);
+    }
+    free(merged);
+}
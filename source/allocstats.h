@@ -0,0 +1,55 @@
+// allocstats.h
+
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Allocation sites listed in a report
+#define ALLOC_STATS_REPORT_SITES 20
+
+// What the process is doing while it allocates
+typedef enum {
+    ALLOC_PHASE_OTHER,      // Start-up, the command line, teardown
+    ALLOC_PHASE_LOAD,       // Reading, parsing and preparing programs
+    ALLOC_PHASE_EXECUTE,    // Running them
+    ALLOC_PHASES
+} AllocPhase;
+
+typedef struct {
+    long allocations;
+    long frees;
+    size_t bytes;           // Requested by every allocation so far
+    size_t live_bytes;
+    size_t peak_bytes;      // Most bytes live at once
+    long phase_allocations[ALLOC_PHASES];
+    size_t phase_bytes[ALLOC_PHASES];
+    size_t phase_peak_bytes[ALLOC_PHASES];
+} AllocTotals;
+
+// Count every xalloc and xfree from now on, on all threads, by site: the
+// message the allocation would fail with. Blocks allocated before tracking
+// started are not counted when they are freed.
+void track_allocations();
+
+extern bool alloc_tracking;     // Only written by track_allocations
+
+static inline bool tracking_allocations() {
+    return __atomic_load_n(&alloc_tracking, __ATOMIC_RELAXED);
+}
+
+// Called by xalloc and xfree while tracking
+void alloc_stats_add(void *mem, size_t size, const char *site);
+void alloc_stats_remove(void *mem);
+
+// Attribute the allocations that follow to a phase. Returns the phase before.
+AllocPhase set_alloc_phase(AllocPhase phase);
+
+AllocTotals alloc_totals();
+
+// Totals, the phase breakdown and the sites that allocated most often
+void print_alloc_stats(FILE *out, int sites);
+
+#endif
@@ -0,0 +1,300 @@
+// Static analysis shared by the program optimisation passes
+
+#include "analysis.h"
+#include "functions.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// ---------------------------------------------------------
+// VARIABLE TABLE
+// ---------------------------------------------------------
+
+static void var_table_add(VarTable *vars, char *name) {
+    if (hashmap_lookup(vars->index, name) != NULL) return;
+
+    // Resize the name array if hit capacity
+    if (vars->count >= vars->capacity) {
+        vars->capacity *= 2;
+        char **new_names = xalloc(vars->capacity * sizeof(char*), "Interpreter Error: Fail to allocate memory for variable table.\n");
+        for (int i = 0; i < vars->count; i++) {
+            new_names[i] = vars->names[i];
+        }
+        xfree(vars->names);
+        vars->names = new_names;
+    }
+
+    char *key = xalloc(strlen(name) + 1, "Interpreter Error: Fail to allocate memory for variable table.\n");
+    strcpy(key, name);
+    int *position = xalloc(sizeof(int), "Interpreter Error: Fail to allocate memory for variable table.\n");
+    *position = vars->count;
+    vars->names[vars->count++] = key;
+    hashmap_insert(vars->index, key, position);
+}
+
+static void var_table_add_factors(VarTable *vars, Factors *factors);
+
+static void var_table_add_factor(VarTable *vars, Factor *factor) {
+    if (factor->type == FACTOR_VAR) {
+        var_table_add(vars, factor->data.var);
+    } else if (factor->type == FACTOR_FUNC) {
+        var_table_add_factors(vars, factor->data.func->factors);
+    }
+}
+
+static void var_table_add_factors(VarTable *vars, Factors *factors) {
+    for (int i = 0; i < factors->count; i++) {
+        var_table_add_factor(vars, factors->items[i]);
+    }
+}
+
+VarTable *var_table_build(Statement **statements, int stmt_count) {
+    VarTable *vars = xalloc(sizeof(VarTable), "Interpreter Error: Fail to allocate memory for variable table.\n");
+    vars->count = 0;
+    vars->capacity = 16;
+    vars->names = xalloc(vars->capacity * sizeof(char*), "Interpreter Error: Fail to allocate memory for variable table.\n");
+    vars->index = hashmap_new(16, 5, hash_string);
+
+    for (int i = 0; i < stmt_count; i++) {
+        Statement *stmt = statements[i];
+        switch (stmt->type) {
+            case PINCH_VAR:
+                var_table_add_factors(vars, stmt->content.pinch_var->factors);
+                var_table_add(vars, stmt->content.pinch_var->name);
+                break;
+            case PINCH_FUNC_S:
+                var_table_add_factors(vars, stmt->content.pinch_func->factors);
+                break;
+            case FACTOR:
+                var_table_add_factor(vars, stmt->content.factor);
+                break;
+        }
+    }
+    return vars;
+}
+
+// Returns the position of name in the table, or -1 if it is not used
+int var_table_index(VarTable *vars, char *name) {
+    int *position = hashmap_lookup(vars->index, name);
+    return position ? *position : -1;
+}
+
+static void free_index_entry(void *name, void *position) {
+    xfree(name);
+    xfree(position);
+}
+
+void free_var_table(VarTable *vars) {
+    if (vars == NULL) return;
+    free_hashmap(vars->index, free_index_entry);
+    xfree(vars->names);
+    xfree(vars);
+}
+
+// ---------------------------------------------------------
+// TYPE INFERENCE
+// ---------------------------------------------------------
+
+// VALUE_NONE is the bottom of the lattice (no value) and VALUE_ANY the top
+ValueType join_types(ValueType a, ValueType b) {
+    if (a == VALUE_NONE) return b;
+    if (b == VALUE_NONE) return a;
+    if (a == b) return a;
+    return VALUE_ANY;
+}
+
+// Type of the value a factor evaluates to. VALUE_NONE means evaluation can
+// never produce a value: it either fails or the function returns nothing.
+ValueType infer_factor_type(Factor *factor, VarTable *vars, ValueType *var_types) {
+    switch (factor->type) {
+        case FACTOR_NUM:
+            return VALUE_NUM;
+        case FACTOR_STR:
+            return VALUE_STR;
+        case FACTOR_JUMP:
+            return VALUE_JUMP;
+        case FACTOR_VAR: {
+            int idx = var_table_index(vars, factor->data.var);
+            return idx >= 0 ? var_types[idx] : VALUE_ANY;
+        }
+        case FACTOR_FUNC: {
+            Pinch_Func *func = factor->data.func;
+
+            if (strcmp(func->name, "IF") == 0) {
+                if (func->factors->count != 3) return VALUE_NONE;
+                return join_types(infer_factor_type(func->factors->items[1], vars, var_types),
+                                  infer_factor_type(func->factors->items[2], vars, var_types));
+            }
+
+            // JUMP, JUMP_IF, SLEEP and unknown functions never yield a value
+            const Builtin *builtin = find_builtin(func->name);
+            return builtin != NULL ? builtin->result : VALUE_NONE;
+        }
+    }
+    return VALUE_ANY;
+}
+
+// Least fixpoint of the assignment equations, starting from VALUE_NONE
+ValueType *infer_var_types(Statement **statements, int stmt_count, VarTable *vars) {
+    ValueType *var_types = xalloc((vars->count + 1) * sizeof(ValueType), "Interpreter Error: Fail to allocate memory for type inference.\n");
+    for (int i = 0; i < vars->count; i++) {
+        var_types[i] = VALUE_NONE;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < stmt_count; i++) {
+            if (statements[i]->type != PINCH_VAR) continue;
+
+            Pinch_Var *var = statements[i]->content.pinch_var;
+            int idx = var_table_index(vars, var->name);
+            ValueType assigned = infer_factor_type(var->factors->items[0], vars, var_types);
+            ValueType joined = join_types(var_types[idx], assigned);
+
+            if (joined != var_types[idx]) {
+                var_types[idx] = joined;
+                changed = true;
+            }
+        }
+    }
+    return var_types;
+}
+
+// Whether evaluating a call can neither fail nor have side effects, given
+// that every variable it reads is already defined
+bool is_total_builtin_call(Pinch_Func *func, VarTable *vars, ValueType *var_types) {
+    Factors *args = func->factors;
+
+    for (int i = 0; i < args->count; i++) {
+        Factor *arg = args->items[i];
+        if (arg->type == FACTOR_FUNC && !is_total_builtin_call(arg->data.func, vars, var_types)) {
+            return false;
+        }
+    }
+
+    // IF itself only fails on a non-Number condition or a none-valued branch
+    if (strcmp(func->name, "IF") == 0) {
+        return args->count == 3 &&
+               infer_factor_type(args->items[0], vars, var_types) == VALUE_NUM &&
+               infer_factor_type(args->items[1], vars, var_types) != VALUE_NONE &&
+               infer_factor_type(args->items[2], vars, var_types) != VALUE_NONE;
+    }
+
+    const Builtin *builtin = find_builtin(func->name);
+    if (builtin == NULL || args->count != builtin->arity) return false;
+
+    for (int i = 0; i < args->count; i++) {
+        if (infer_factor_type(args->items[i], vars, var_types) != builtin->params[i]) {
+            return false;
+        }
+    }
+
+    if (builtin->total) return true;
+
+    // DIV and MOD only fail on a zero divisor, which a literal rules out
+    if (strcmp(func->name, "DIV") == 0 || strcmp(func->name, "MOD") == 0) {
+        Factor *divisor = args->items[1];
+        return divisor->type == FACTOR_NUM && divisor->data.num != 0;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------
+// CONTROL FLOW
+// ---------------------------------------------------------
+
+bool is_jump_func(Pinch_Func *func) {
+    return strcmp(func->name, "JUMP") == 0 || strcmp(func->name, "JUMP_IF") == 0;
+}
+
+static bool contains_jump(Factors *factors) {
+    for (int i = 0; i < factors->count; i++) {
+        Factor *f = factors->items[i];
+        if (f->type == FACTOR_FUNC && (is_jump_func(f->data.func) || contains_jump(f->data.func->factors))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether running the statement may move the program counter
+bool statement_has_jump(Statement *stmt) {
+    switch (stmt->type) {
+        case PINCH_VAR:
+            return contains_jump(stmt->content.pinch_var->factors);
+        case FACTOR:
+            return stmt->content.factor->type == FACTOR_FUNC &&
+                   (is_jump_func(stmt->content.factor->data.func) ||
+                    contains_jump(stmt->content.factor->data.func->factors));
+        case PINCH_FUNC_S:
+            return is_jump_func(stmt->content.pinch_func) || contains_jump(stmt->content.pinch_func->factors);
+    }
+    return false;
+}
+
+// Statement a jump literal leads to from statement from, or stmt_count if
+// the jump leaves the program space and so terminates it
+int jump_target(int from, Factor *jump, int stmt_count) {
+    int target = jump->data.jump.type == JUMP_FORWARD
+                     ? from + jump->data.jump.lines
+                     : from - jump->data.jump.lines;
+    return (target < 0 || target >= stmt_count) ? stmt_count : target;
+}
+
+ControlFlow *control_flow_build(Statement **statements, int stmt_count) {
+    ControlFlow *cfg = xalloc(sizeof(ControlFlow), "Interpreter Error: Fail to allocate memory for control flow.\n");
+    cfg->stmt_count = stmt_count;
+    cfg->resolved = true;
+    cfg->succ = xalloc((2 * stmt_count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for control flow.\n");
+
+    for (int i = 0; i < stmt_count; i++) {
+        Statement *stmt = statements[i];
+        int *succ = &cfg->succ[2 * i];
+        succ[0] = i + 1;
+        succ[1] = -1;
+
+        switch (stmt->type) {
+            case PINCH_VAR:
+                if (contains_jump(stmt->content.pinch_var->factors)) cfg->resolved = false;
+                break;
+            case FACTOR:
+                if (stmt->content.factor->type == FACTOR_FUNC &&
+                    (is_jump_func(stmt->content.factor->data.func) ||
+                     contains_jump(stmt->content.factor->data.func->factors))) {
+                    cfg->resolved = false;
+                }
+                break;
+            case PINCH_FUNC_S: {
+                Pinch_Func *func = stmt->content.pinch_func;
+                Factors *args = func->factors;
+
+                if (contains_jump(args)) {
+                    cfg->resolved = false;
+                } else if (strcmp(func->name, "JUMP") == 0) {
+                    if (args->count == 1 && args->items[0]->type == FACTOR_JUMP) {
+                        succ[0] = jump_target(i, args->items[0], stmt_count);
+                    } else {
+                        cfg->resolved = false;
+                    }
+                } else if (strcmp(func->name, "JUMP_IF") == 0) {
+                    if (args->count == 3 && args->items[1]->type == FACTOR_JUMP &&
+                        args->items[2]->type == FACTOR_JUMP) {
+                        succ[0] = jump_target(i, args->items[1], stmt_count);
+                        succ[1] = jump_target(i, args->items[2], stmt_count);
+                    } else {
+                        cfg->resolved = false;
+                    }
+                }
+                break;
+            }
+        }
+    }
+    return cfg;
+}
+
+void free_control_flow(ControlFlow *cfg) {
+    if (cfg == NULL) return;
+    xfree(cfg->succ);
+    xfree(cfg);
+}
@@ -0,0 +1,43 @@
+// analysis.h
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "parser.h"
+#include "interpreter.h"
+
+// Dense numbering of every variable name that appears in a program
+typedef struct {
+    int count;
+    int capacity;
+    char **names;
+    struct hashmap *index;  // name -> int* position in names
+} VarTable;
+
+VarTable *var_table_build(Statement **statements, int stmt_count);
+int var_table_index(VarTable *vars, char *name);
+void free_var_table(VarTable *vars);
+
+// Static type inference over whole programs. Every variable gets the join of
+// the types of all values ever assigned to it: VALUE_NONE when it is never
+// assigned a value, VALUE_ANY when it may hold values of different types.
+ValueType *infer_var_types(Statement **statements, int stmt_count, VarTable *vars);
+ValueType infer_factor_type(Factor *factor, VarTable *vars, ValueType *var_types);
+ValueType join_types(ValueType a, ValueType b);
+bool is_total_builtin_call(Pinch_Func *func, VarTable *vars, ValueType *var_types);
+
+// Successors of every statement, derived from the jump literals passed to
+// JUMP and JUMP_IF. A successor equal to stmt_count means the program ends.
+typedef struct {
+    int stmt_count;
+    bool resolved;  // False if some jump cannot be followed statically
+    int *succ;      // Two entries per statement, -1 when unused
+} ControlFlow;
+
+ControlFlow *control_flow_build(Statement **statements, int stmt_count);
+void free_control_flow(ControlFlow *cfg);
+bool is_jump_func(Pinch_Func *func);
+bool statement_has_jump(Statement *stmt);
+int jump_target(int from, Factor *jump, int stmt_count);
+
+#endif
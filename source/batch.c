@@ -0,0 +1,277 @@
+// Logic for running one program over a stream of input records
+
+#include "batch.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A program ready to run records on a state of its own
+typedef struct {
+    Program *program;
+    PreparedProgram *prepared;
+    MachineState *state;
+} Runner;
+
+static void runner_init(Runner *runner, Program *program, const BatchOptions *options) {
+    runner->program = program;
+    runner->prepared = prepare_program(options->engine, program, &options->engine_options);
+    runner->state = options->new_state(options->state_context);
+}
+
+static void runner_free(Runner *runner) {
+    free_state(runner->state);
+    free_prepared(runner->prepared);
+}
+
+// Resetting keeps the variable table's buckets and restarts RAND, so every
+// record sees the same fresh state whichever worker runs it
+static bool run_record(Runner *runner, const char *record, long number) {
+    MachineState *state = runner->state;
+    reset_machine_state(state);
+    assign_variable(state, BATCH_RECORD_VARIABLE, value_from_str((char*)record));
+    if (run_program(runner->prepared, state)) return true;
+
+    FILE *previous = redirect_errors(state->errors);
+    if (state->program_counter >= 0 && state->program_counter < runner->program->stmt_count) {
+        report_error("Execution halted at statement %d of record %ld.\n",
+                     runner->program->statements[state->program_counter]->number, number);
+    }
+    redirect_errors(previous);
+    return false;
+}
+
+// Read the next record without its newline. Returns false at the end of input.
+static bool read_record(FILE *in, char **line, size_t *capacity) {
+    ssize_t length = getline(line, capacity, in);
+    if (length < 0) return false;
+    if (length > 0 && (*line)[length - 1] == '\n') (*line)[length - 1] = '\0';
+    return true;
+}
+
+// ---------------------------------------------------------
+// ONE WORKER
+// ---------------------------------------------------------
+
+static bool run_sequentially(Program *program, const BatchOptions *options, FILE *in, FILE *out, FILE *err, BatchStats *stats) {
+    Runner runner;
+    runner_init(&runner, program, options);
+    runner.state->output = out;
+    runner.state->errors = err;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    while (read_record(in, &line, &capacity)) {
+        stats->records++;
+        if (!run_record(&runner, line, stats->records)) stats->failed++;
+    }
+    free(line); // Allocated by getline
+
+    runner.state->output = NULL;
+    runner.state->errors = NULL;
+    runner_free(&runner);
+    return stats->failed == 0;
+}
+
+// ---------------------------------------------------------
+// SEVERAL WORKERS
+// ---------------------------------------------------------
+
+// The reader fills chunks in order, workers take them in order, and the
+// reader writes each one out in order once it is done. A chunk slot is only
+// refilled after it has been written, so memory stays bounded.
+typedef struct {
+    char *text;             // Records, each terminated by '\0'
+    size_t length;
+    size_t capacity;
+    int count;
+    long first;             // Number of the first record, counting from 1
+    bool done;
+    long failed;
+    char *output;           // Allocated by open_memstream
+    size_t output_length;
+    char *errors;
+    size_t errors_length;
+} Chunk;
+
+typedef struct {
+    Program *program;
+    const BatchOptions *options;
+    Chunk *chunks;
+    int slots;
+    long filled;            // Chunks handed to the workers so far
+    long taken;             // Chunks a worker has started on
+    bool finished;          // No chunks will be filled any more
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} Pipeline;
+
+static void append_record(Chunk *chunk, const char *record) {
+    size_t length = strlen(record) + 1;
+    if (chunk->length + length > chunk->capacity) {
+        size_t capacity = chunk->capacity * 2 > chunk->length + length ? chunk->capacity * 2 : chunk->length + length;
+        char *text = xalloc(capacity, "Interpreter Error: Fail to allocate memory for records.\n");
+        memcpy(text, chunk->text, chunk->length);
+        xfree(chunk->text);
+        chunk->text = text;
+        chunk->capacity = capacity;
+    }
+    memcpy(chunk->text + chunk->length, record, length);
+    chunk->length += length;
+    chunk->count++;
+}
+
+static void run_chunk(Runner *runner, Chunk *chunk) {
+    MachineState *state = runner->state;
+    state->output = open_memstream(&chunk->output, &chunk->output_length);
+    state->errors = open_memstream(&chunk->errors, &chunk->errors_length);
+
+    const char *record = chunk->text;
+    for (int i = 0; i < chunk->count; i++) {
+        if (!run_record(runner, record, chunk->first + i)) chunk->failed++;
+        record += strlen(record) + 1;
+    }
+
+    fclose(state->output);
+    fclose(state->errors);
+    state->output = NULL;
+    state->errors = NULL;
+}
+
+static void *run_worker(void *arg) {
+    Pipeline *pipeline = (Pipeline*)arg;
+    Runner runner;
+    pthread_mutex_lock(&pipeline->lock);
+    Program *program = copy_program(pipeline->program);
+    pthread_mutex_unlock(&pipeline->lock);
+    runner_init(&runner, program, pipeline->options);
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (true) {
+        while (pipeline->taken >= pipeline->filled && !pipeline->finished) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        if (pipeline->taken >= pipeline->filled) break;
+        Chunk *chunk = &pipeline->chunks[pipeline->taken++ % pipeline->slots];
+        pthread_mutex_unlock(&pipeline->lock);
+
+        run_chunk(&runner, chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->done = true;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+
+    runner_free(&runner);
+    free_program(program);
+    return NULL;
+}
+
+// Wait for a chunk and write it out
+static void write_chunk(Pipeline *pipeline, Chunk *chunk, FILE *out, FILE *err, BatchStats *stats) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (!chunk->done) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+
+    fwrite(chunk->output, 1, chunk->output_length, out);
+    fwrite(chunk->errors, 1, chunk->errors_length, err);
+    free(chunk->output);
+    free(chunk->errors);
+    chunk->output = NULL;
+    chunk->errors = NULL;
+    stats->failed += chunk->failed;
+}
+
+static bool run_pipeline(Program *program, const BatchOptions *options, FILE *in, FILE *out, FILE *err, BatchStats *stats) {
+    Pipeline pipeline;
+    pipeline.program = program;
+    pipeline.options = options;
+    pipeline.slots = options->workers * 2;
+    pipeline.chunks = xalloc(pipeline.slots * sizeof(Chunk), "Interpreter Error: Fail to allocate memory for records.\n");
+    for (int i = 0; i < pipeline.slots; i++) {
+        Chunk *chunk = &pipeline.chunks[i];
+        chunk->capacity = 4096;
+        chunk->text = xalloc(chunk->capacity, "Interpreter Error: Fail to allocate memory for records.\n");
+        chunk->output = NULL;
+        chunk->errors = NULL;
+    }
+    pipeline.filled = 0;
+    pipeline.taken = 0;
+    pipeline.finished = false;
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    pthread_t threads[options->workers];
+    int started = 0;
+    for (int i = 0; i < options->workers; i++) {
+        if (pthread_create(&threads[started], NULL, run_worker, &pipeline) == 0) started++;
+    }
+
+    char *line = NULL;
+    size_t capacity = 0;
+    bool more = started > 0;
+    long sequence = 0;
+    long written = 0;
+    while (more) {
+        Chunk *chunk = &pipeline.chunks[sequence % pipeline.slots];
+        if (sequence >= pipeline.slots) {
+            write_chunk(&pipeline, chunk, out, err, stats);
+            written++;
+        }
+
+        chunk->length = 0;
+        chunk->count = 0;
+        chunk->first = stats->records + 1;
+        chunk->done = false;
+        chunk->failed = 0;
+        while (chunk->count < BATCH_CHUNK_RECORDS && (more = read_record(in, &line, &capacity))) {
+            append_record(chunk, line);
+        }
+        if (chunk->count == 0) break;
+        stats->records += chunk->count;
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.filled = ++sequence;
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+
+    // Chunks still in flight, oldest first
+    for (; written < sequence; written++) {
+        write_chunk(&pipeline, &pipeline.chunks[written % pipeline.slots], out, err, stats);
+    }
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.finished = true;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(line); // Allocated by getline
+    for (int i = 0; i < pipeline.slots; i++) {
+        xfree(pipeline.chunks[i].text);
+    }
+    xfree(pipeline.chunks);
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+
+    // No worker could be started
+    if (started == 0) {
+        return run_sequentially(program, options, in, out, err, stats);
+    }
+    return stats->failed == 0;
+}
+
+bool batch_run(Program *program, const BatchOptions *options, FILE *in, FILE *out, FILE *err, BatchStats *stats) {
+    stats->records = 0;
+    stats->failed = 0;
+    if (options->workers <= 1) {
+        return run_sequentially(program, options, in, out, err, stats);
+    }
+    return run_pipeline(program, options, in, out, err, stats);
+}
@@ -0,0 +1,36 @@
+// batch.h
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "engine.h"
+
+// Variable every record is bound to before the program runs
+#define BATCH_RECORD_VARIABLE "line"
+
+// Records handed to a worker at a time. Output is written a chunk at a time,
+// so every chunk stays in the same order as its records.
+#define BATCH_CHUNK_RECORDS 256
+
+typedef MachineState *(*state_factory)(void *context);
+
+typedef struct {
+    const Engine *engine;
+    EngineOptions engine_options;
+    int workers;                // Threads running records, 1 runs them on the calling thread
+    state_factory new_state;    // Creates the state of each worker
+    void *state_context;
+} BatchOptions;
+
+typedef struct {
+    long records;
+    long failed;
+} BatchStats;
+
+// Run the program once per line of in, with the line (without its newline)
+// in BATCH_RECORD_VARIABLE and every other variable forgotten. Output goes to
+// out in record order; a failing record is reported on err and the next one
+// runs as usual. Returns false if any record failed.
+bool batch_run(Program *program, const BatchOptions *options, FILE *in, FILE *out, FILE *err, BatchStats *stats);
+
+#endif
@@ -0,0 +1,444 @@
+// Logic for loading, preparing and running programs on an execution engine
+
+#include "engine.h"
+#include "jit.h"
+#include "memo.h"
+#include "metrics.h"
+#include "trace.h"
+#include "sampler.h"
+#include "perfcounters.h"
+#include "optimizer.h"
+#include "parallel.h"
+#include "profile.h"
+#include "threadpool.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------
+// LOAD
+// ---------------------------------------------------------
+
+static Program *new_program(int capacity) {
+    Program *program = xalloc(sizeof(Program), "Interpreter Error: Fail to allocate memory for program.\n");
+    program->statements = xalloc(capacity * sizeof(Statement*), "Interpreter Error: Fail to allocate memory for statements.\n");
+    program->stmt_count = 0;
+    program->interactive = false;
+    return program;
+}
+
+static Program *parse_program(const char *source_code) {
+    int capacity = 64; // Initial array capacity
+    Program *program = new_program(capacity);
+
+    int physical_line = 1;
+    const char *current_pos = source_code;
+
+    // Traverse the source string line by line
+    while (*current_pos != '\0') {
+        const char *newline = strchr(current_pos, '\n');
+        int len = newline ? (newline - current_pos) : (int)strlen(current_pos);
+
+        char *line_buf = xalloc(len + 2, "Interpreter Error: Fail to allocate memory for a line of code.\n");
+        strncpy(line_buf, current_pos, len);
+        line_buf[len] = '\n';
+        line_buf[len + 1] = '\0';
+
+        // Check if the line is just empty whitespace
+        bool is_empty = true;
+        for (int i = 0; i < len; i++) {
+            if (line_buf[i] != ' ' && line_buf[i] != '\t' && line_buf[i] != '\r') {
+                is_empty = false;
+                break;
+            }
+        }
+
+        if (!is_empty) {
+            parse_statement_result res = parse_statement(line_buf);
+
+            if (!res.success) {
+                report_error("Syntax Error on line %d.\n", physical_line);
+                xfree(line_buf);
+                free_program(program);
+                return NULL; // Stop parsing on first error
+            }
+
+            // Resize the dynamic array if hit capacity
+            if (program->stmt_count >= capacity) {
+                capacity *= 2;
+                Statement **new_stmts = xalloc(capacity * sizeof(Statement*), "Interpreter Error: Fail to allocate memory for statements.\n");
+                for (int i = 0; i < program->stmt_count; i++) {
+                    new_stmts[i] = program->statements[i];
+                }
+                xfree(program->statements);
+                program->statements = new_stmts;
+            }
+            res.stmt->number = program->stmt_count + 1;
+            res.stmt->line = physical_line;
+            program->statements[program->stmt_count++] = res.stmt;
+        }
+
+        xfree(line_buf);
+
+        if (!newline) break;
+        current_pos = newline + 1;
+        physical_line++;
+    }
+    return program;
+}
+
+Program *load_program(const char *source_code) {
+    AllocRecovery recovery;
+    if (setjmp(recovery.env) != 0) {
+        report_error("%s", recovery.message);
+        return NULL;
+    }
+    push_alloc_recovery(&recovery);
+    Program *program = parse_program(source_code);
+    pop_alloc_recovery(&recovery);
+    return program;
+}
+
+// Wrap a single REPL line, which then belongs to the program
+Program *program_from_statement(Statement *stmt) {
+    Program *program = new_program(1);
+    program->statements[0] = stmt;
+    program->stmt_count = 1;
+    program->interactive = true;
+    return program;
+}
+
+// The interpreter rewrites call nodes as it runs them, so every thread running
+// the same program works on a copy of its own
+Program *copy_program(Program *program) {
+    Program *copy = new_program(program->stmt_count > 0 ? program->stmt_count : 1);
+    for (int i = 0; i < program->stmt_count; i++) {
+        copy->statements[i] = copy_statement(program->statements[i]);
+    }
+    copy->stmt_count = program->stmt_count;
+    copy->interactive = program->interactive;
+    return copy;
+}
+
+void free_program(Program *program) {
+    if (program == NULL) return;
+    for (int i = 0; i < program->stmt_count; i++) {
+        free_statement(program->statements[i]);
+    }
+    xfree(program->statements);
+    xfree(program);
+}
+
+// ---------------------------------------------------------
+// MACHINE STATE
+// ---------------------------------------------------------
+
+static struct hashmap *create_var_hashmap() {
+    // 16 initial buckets, 5 elements per bucket initial capacity
+    return hashmap_new(16, 5, hash_string);
+}
+
+static void free_variable(void *name, void *value) {
+    xfree(name);
+    free_value((Value*)value);
+}
+
+MachineState *new_machine_state() {
+    MachineState *state = xalloc(sizeof(MachineState), "Interpreter Error: Fail to allocate memory for MachineState.\n");
+    state->program_counter = 0;
+    state->statements = NULL;
+    state->stmt_count = 0;
+    state->variables = create_var_hashmap();
+    state->memo = NULL;
+    state->arg_pool = NULL;
+    state->arg_min_cost = PARALLEL_ARG_MIN_COST;
+    state->metrics = NULL;
+    state->counters = NULL;
+    state->output = NULL;
+    state->errors = NULL;
+    state->random_state = RANDOM_SEED;
+    state->interrupted = false;
+    return state;
+}
+
+// Forget every variable and restart RAND so the state can run a program from
+// scratch. Memoised results only depend on their arguments and are kept, as
+// are the thread pool, the streams and the variable table's buckets.
+void reset_machine_state(MachineState *state) {
+    hashmap_clear(state->variables, free_variable);
+    state->program_counter = 0;
+    state->random_state = RANDOM_SEED;
+    __atomic_store_n(&state->interrupted, false, __ATOMIC_RELAXED);
+}
+
+void interrupt_run(MachineState *state) {
+    __atomic_store_n(&state->interrupted, true, __ATOMIC_RELAXED);
+}
+
+// Statements belong to the Program the state ran, not to the state
+void free_state(MachineState *state) {
+    if (state == NULL) return;
+    free_hashmap(state->variables, free_variable);
+    free_memo(state->memo);
+    free_pool(state->arg_pool);
+    free_metrics(state->metrics);
+    xfree(state);
+}
+
+// ---------------------------------------------------------
+// SNAPSHOTS
+// ---------------------------------------------------------
+
+struct Snapshot {
+    int count;
+    char **names;
+    Value **values;         // Copies share their Text with the state
+    int program_counter;
+    uint64_t random_state;
+};
+
+static void snapshot_variable(void *name, void *value, void *context) {
+    Snapshot *snapshot = (Snapshot*)context;
+    snapshot->names[snapshot->count] = xalloc(strlen((char*)name) + 1, "Interpreter Error: Fail to allocate memory for snapshot.\n");
+    strcpy(snapshot->names[snapshot->count], (char*)name);
+    snapshot->values[snapshot->count] = copy_value((Value*)value);
+    snapshot->count++;
+}
+
+Snapshot *snapshot_state(MachineState *state) {
+    Snapshot *snapshot = xalloc(sizeof(Snapshot), "Interpreter Error: Fail to allocate memory for snapshot.\n");
+    int size = state->variables->size;
+    snapshot->count = 0;
+    snapshot->names = xalloc((size + 1) * sizeof(char*), "Interpreter Error: Fail to allocate memory for snapshot.\n");
+    snapshot->values = xalloc((size + 1) * sizeof(Value*), "Interpreter Error: Fail to allocate memory for snapshot.\n");
+    hashmap_each(state->variables, snapshot_variable, snapshot);
+    snapshot->program_counter = state->program_counter;
+    snapshot->random_state = state->random_state;
+    return snapshot;
+}
+
+void restore_state(MachineState *state, const Snapshot *snapshot) {
+    hashmap_clear(state->variables, free_variable);
+    for (int i = 0; i < snapshot->count; i++) {
+        assign_variable(state, snapshot->names[i], copy_value(snapshot->values[i]));
+    }
+    state->program_counter = snapshot->program_counter;
+    state->random_state = snapshot->random_state;
+}
+
+void free_snapshot(Snapshot *snapshot) {
+    if (snapshot == NULL) return;
+    for (int i = 0; i < snapshot->count; i++) {
+        xfree(snapshot->names[i]);
+        free_value(snapshot->values[i]);
+    }
+    xfree(snapshot->names);
+    xfree(snapshot->values);
+    xfree(snapshot);
+}
+
+static void fork_variable(void *name, void *value, void *context) {
+    assign_variable((MachineState*)context, (char*)name, copy_value((Value*)value));
+}
+
+MachineState *fork_state(MachineState *state) {
+    MachineState *fork = new_machine_state();
+    hashmap_each(state->variables, fork_variable, fork);
+    fork->program_counter = state->program_counter;
+    fork->random_state = state->random_state;
+    fork->arg_min_cost = state->arg_min_cost;
+    fork->counters = state->counters;
+    fork->output = state->output;
+    fork->errors = state->errors;
+    return fork;
+}
+
+// ---------------------------------------------------------
+// ENGINES
+// ---------------------------------------------------------
+
+// Tree-walking interpreter: one statement at a time
+static void *tree_prepare(Program *program, const EngineOptions *options) {
+    (void)program;
+    (void)options;
+    return NULL;
+}
+
+static bool tree_run(void *data, Program *program, MachineState *state) {
+    (void)data;
+    while (state->program_counter >= 0 && state->program_counter < program->stmt_count) {
+        Statement *current_stmt = program->statements[state->program_counter];
+        if (!interpret_line(current_stmt, state, program->interactive)) {
+            return false;
+        }
+        state->program_counter++;
+    }
+    return true;
+}
+
+static void tree_release(void *data, const EngineOptions *options) {
+    (void)data;
+    (void)options;
+}
+
+// Tree-walking interpreter that compiles hot numeric loops to native code
+static void *jit_prepare(Program *program, const EngineOptions *options) {
+    (void)options;
+    return jit_new(program->statements, program->stmt_count);
+}
+
+static bool jit_run(void *data, Program *program, MachineState *state) {
+    JitState *jit = (JitState*)data;
+    while (state->program_counter >= 0 && state->program_counter < program->stmt_count) {
+        int from = state->program_counter;
+        if (!interpret_line(program->statements[from], state, program->interactive)) {
+            return false;
+        }
+        state->program_counter++;
+
+        // Loops are found through the backward jumps that close them. Native
+        // code counts what it runs but does not time, trace or sample it, so
+        // loops stay interpreted while they are being observed that way.
+        if (jit != NULL && state->program_counter <= from && state->metrics == NULL
+            && !tracing() && !sampling() && !perf_per_builtin()) {
+            jit_backward_jump(jit, state, from);
+        }
+    }
+    return true;
+}
+
+static void jit_release(void *data, const EngineOptions *options) {
+    JitState *jit = (JitState*)data;
+    if (options->stats) {
+        print_jit_stats(jit);
+    }
+    free_jit(jit);
+}
+
+// Tree-walking interpreter that runs independent statements of jump-free
+// blocks on a thread pool
+static void *parallel_prepare(Program *program, const EngineOptions *options) {
+    return parallel_new(program->statements, program->stmt_count, options->threads, options->parallel_min_ns);
+}
+
+static bool parallel_engine_run(void *data, Program *program, MachineState *state) {
+    return parallel_run((ParallelState*)data, state, program->interactive);
+}
+
+static void parallel_release(void *data, const EngineOptions *options) {
+    ParallelState *parallel = (ParallelState*)data;
+    if (options->stats) {
+        print_parallel_stats(parallel);
+    }
+    free_parallel(parallel);
+}
+
+// Tree-walking interpreter that counts and times every statement; its stats
+// are the hottest lines
+static void *profile_prepare(Program *program, const EngineOptions *options) {
+    (void)options;
+    return profile_new(program->statements, program->stmt_count);
+}
+
+static bool profile_engine_run(void *data, Program *program, MachineState *state) {
+    return profile_run((Profile*)data, state, program->interactive);
+}
+
+static void profile_release(void *data, const EngineOptions *options) {
+    Profile *profile = (Profile*)data;
+    if (options->stats) {
+        print_profile(stderr, profile, PROFILE_REPORT_LINES);
+    }
+    free_profile(profile);
+}
+
+static const Engine engines[] = {
+    {"tree", "tree-walking interpreter", tree_prepare, tree_run, tree_release},
+    {"jit", "interpreter with native code for hot numeric loops", jit_prepare, jit_run, jit_release},
+    {"parallel", "interpreter running independent statements on a thread pool", parallel_prepare, parallel_engine_run, parallel_release},
+    {"profile", "interpreter timing every statement, reports the hottest lines", profile_prepare, profile_engine_run, profile_release},
+};
+
+#define DEFAULT_ENGINE "jit"
+
+int engine_count() {
+    return sizeof(engines) / sizeof(engines[0]);
+}
+
+const Engine *engine_at(int index) {
+    return &engines[index];
+}
+
+// Look up an engine by name, NULL if there is none
+const Engine *find_engine(const char *name) {
+    for (int i = 0; i < engine_count(); i++) {
+        if (strcmp(engines[i].name, name) == 0) {
+            return &engines[i];
+        }
+    }
+    return NULL;
+}
+
+const Engine *default_engine() {
+    return find_engine(DEFAULT_ENGINE);
+}
+
+void print_engines(FILE *out) {
+    fprintf(out, "Available engines:\n");
+    for (int i = 0; i < engine_count(); i++) {
+        fprintf(out, "  %-8s %s%s\n", engines[i].name, engines[i].description,
+                strcmp(engines[i].name, DEFAULT_ENGINE) == 0 ? " (default)" : "");
+    }
+}
+
+// ---------------------------------------------------------
+// PREPARE AND RUN
+// ---------------------------------------------------------
+
+PreparedProgram *prepare_program(const Engine *engine, Program *program, const EngineOptions *options) {
+    if (options->optimize && !program->interactive) {
+        OptimizerReport report = {0};
+        simplify_program(program->statements, program->stmt_count, &report);
+        eliminate_dead_code(program->statements, &program->stmt_count, &report);
+        if (options->opt_report) {
+            print_optimizer_report(&report);
+        }
+    }
+
+    PreparedProgram *prepared = xalloc(sizeof(PreparedProgram), "Interpreter Error: Fail to allocate memory for program.\n");
+    prepared->engine = engine;
+    prepared->program = program;
+    prepared->options = *options;
+    prepared->data = engine->prepare(program, options);
+    return prepared;
+}
+
+// The program itself stays with the caller
+void free_prepared(PreparedProgram *prepared) {
+    if (prepared == NULL) return;
+    prepared->engine->release(prepared->data, &prepared->options);
+    xfree(prepared);
+}
+
+bool run_program(PreparedProgram *prepared, MachineState *state) {
+    state->statements = prepared->program->statements;
+    state->stmt_count = prepared->program->stmt_count;
+
+    // Errors, RAND and allocation failures are tracked per thread, so every
+    // thread can run its own program on its own state
+    MachineState *previous_state = bind_machine_state(state);
+    FILE *previous_errors = redirect_errors(state->errors);
+    AllocRecovery recovery;
+    bool success;
+    if (setjmp(recovery.env) == 0) {
+        push_alloc_recovery(&recovery);
+        success = prepared->engine->run(prepared->data, prepared->program, state);
+        pop_alloc_recovery(&recovery);
+    } else {
+        report_error("%s", recovery.message);
+        success = false;
+    }
+    redirect_errors(previous_errors);
+    bind_machine_state(previous_state);
+    return success;
+}
@@ -0,0 +1,91 @@
+// engine.h
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdio.h>
+#include "interpreter.h"
+
+// A parsed program, shared by every engine that runs it
+typedef struct {
+    Statement **statements;
+    int stmt_count;
+    bool interactive;   // A REPL line: JUMP and JUMP_IF are rejected
+} Program;
+
+typedef struct {
+    bool optimize;      // Run the optimisation passes while preparing
+    bool opt_report;    // Print how many rewrites each pass applied
+    bool stats;         // Print engine counters when the program is released
+    int threads;        // Worker threads of the parallel engine, 0 for one per processor
+    long parallel_min_ns;   // Parallel engine: blocks faster than this stay sequential
+} EngineOptions;
+
+// An execution strategy. prepare returns engine data for one program (or
+// NULL if the engine needs none), run executes it from the program counter
+// of the state until it ends or fails, release frees the engine data.
+typedef struct {
+    const char *name;
+    const char *description;
+    void *(*prepare)(Program *program, const EngineOptions *options);
+    bool (*run)(void *data, Program *program, MachineState *state);
+    void (*release)(void *data, const EngineOptions *options);
+} Engine;
+
+typedef struct {
+    const Engine *engine;
+    Program *program;
+    EngineOptions options;
+    void *data;
+} PreparedProgram;
+
+// Load: parse source text, reporting the first syntax error. NULL on failure.
+// Errors go to the calling thread's error stream (see redirect_errors).
+Program *load_program(const char *source_code);
+Program *program_from_statement(Statement *stmt);
+Program *copy_program(Program *program);
+void free_program(Program *program);
+
+// Prepare: optimise if requested and let the engine analyse the program
+PreparedProgram *prepare_program(const Engine *engine, Program *program, const EngineOptions *options);
+void free_prepared(PreparedProgram *prepared);
+
+// Run: returns false when a statement fails, leaving the program counter on it.
+// Output and errors go to the state's streams and RAND draws from the state,
+// so different threads may run programs at the same time as long as each
+// Program and MachineState is used by one thread at a time. Running out of
+// memory fails the run instead of ending the process.
+bool run_program(PreparedProgram *prepared, MachineState *state);
+
+MachineState *new_machine_state();
+void reset_machine_state(MachineState *state);
+void free_state(MachineState *state);
+
+// The variables, program counter and RAND state of a MachineState. Taking or
+// restoring a snapshot costs one step per variable whatever the variables
+// hold: Text is shared between the state and its snapshots, not copied.
+// A snapshot may be restored into any state, any number of times.
+typedef struct Snapshot Snapshot;
+Snapshot *snapshot_state(MachineState *state);
+void restore_state(MachineState *state, const Snapshot *snapshot);
+void free_snapshot(Snapshot *snapshot);
+
+// A new state with the variables, program counter, RAND state and streams of
+// another, at one step per variable like a snapshot. The memo cache and
+// argument pool are not carried over.
+MachineState *fork_state(MachineState *state);
+
+// Make a run of the state, on any thread, fail at its next statement with
+// "Execution interrupted". Native loops check in every JIT_ENTRY_BUDGET
+// iterations. The request stands until the state is reset.
+void interrupt_run(MachineState *state);
+
+// Registry of backends. The default is the JIT engine, which interprets
+// everything it cannot compile.
+const Engine *find_engine(const char *name);
+const Engine *default_engine();
+int engine_count();
+const Engine *engine_at(int index);
+void print_engines(FILE *out);
+
+#endif
@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include "functions.h"
 #include "util.h" 
+#include "trace.h"
 
 // functions.c
 
@@ -16,7 +17,7 @@
 Value* create_type_error(char *func_name, char *expected, char *actual) {
     Value *v = value_from_error();
     
-    fprintf(stderr, "Runtime Error: Function %s expected %s, got type %s.\n", func_name, expected, actual);
+    report_error("Runtime Error: Function %s expected %s, got type %s.\n", func_name, expected, actual);
     return v;
 }
 
@@ -24,8 +25,8 @@ Value* create_type_error(char *func_name, char *expected, char *actual) {
 Value* validate_args(char *func_name, Value **args, int actual_count, int expected_count, ...) {
     // 1. Check Argument Count
     if (actual_count != expected_count) {
-        fprintf(stderr, "Runtime Error: Function %s expected %d arguments, got %d.\n", 
-                func_name, expected_count, actual_count);
+        report_error("Runtime Error: Function %s expected %d arguments, got %d.\n",
+                      func_name, expected_count, actual_count);
         return value_from_error();
     }
 
@@ -97,7 +98,7 @@ Value* DIV(Value **args, int count) {
     if (err) return err;
 
     if (args[1]->data.num == 0) {
-        fprintf(stderr, "Runtime Error: Division by zero.\n");
+        report_error("Runtime Error: Division by zero.\n");
         return value_from_error();
     }
 
@@ -110,7 +111,7 @@ Value* MOD(Value **args, int count) {
     if (err) return err;
 
     if (args[1]->data.num == 0) {
-        fprintf(stderr, "Runtime Error [MOD]: Division by zero.\n");
+        report_error("Runtime Error [MOD]: Division by zero.\n");
         return value_from_error();
     }
 
@@ -137,7 +138,7 @@ Value* SQRT(Value **args, int count) {
     if (err) return err;
 
     if (args[0]->data.num < 0) {
-        fprintf(stderr, "Runtime Error: Square root of negative number.\n");
+        report_error("Runtime Error: Square root of negative number.\n");
         return value_from_error();
     }
 
@@ -213,7 +214,7 @@ Value* RAND(Value **args, int count) {
     if (err) return err;
     
     // Returns double between 0.0 and 1.0
-    return value_from_num((double)rand() / (double)RAND_MAX);
+    return value_from_num(random_number());
 }
 
 // ---------------------------------------------------------
@@ -305,7 +306,7 @@ Value* SUBSTR(Value **args, int count) {
         length = source_len - start;
     }
 
-    char *sub = xalloc(length + 1, "Interpreter Error: Fail to allocate memory.\n");
+    char *sub = xalloc(length + 1, "Runtime Error: Memory allocation failed for SUBSTR.");
     strncpy(sub, source + start, length);
     sub[length] = '\0';
 
@@ -385,7 +386,84 @@ Value* SLEEP(Value **args, int count) {
 
     double seconds = args[0]->data.num;
     useconds_t usec = (useconds_t)(seconds * 1000000);
+    int64_t start = tracing() ? trace_begin() : -1;
     usleep(usec);
+    trace_wait_end(start);
 
     return value_from_none();
 }
+
+// ---------------------------------------------------------
+// FUNCTION REGISTRY
+// ---------------------------------------------------------
+
+static const Builtin builtins[] = {
+    {"ADD", ADD, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_ADD},
+    {"SUB", SUB, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_SUB},
+    {"MUL", MUL, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_MUL},
+    {"DIV", DIV, VALUE_NUM, false, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_DIV},
+    {"MOD", MOD, VALUE_NUM, false, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_MOD},
+    {"POW", POW, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_POW},
+    {"ABS", ABS, VALUE_NUM, true, true, 1, {VALUE_NUM}, NUM_OP_NONE},
+    {"SQRT", SQRT, VALUE_NUM, false, true, 1, {VALUE_NUM}, NUM_OP_NONE},
+    {"EQ", EQ, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_EQ},
+    {"NEQ", NEQ, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_NEQ},
+    {"GT", GT, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_GT},
+    {"LT", LT, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_LT},
+    {"GTE", GTE, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_GTE},
+    {"LTE", LTE, VALUE_NUM, true, true, 2, {VALUE_NUM, VALUE_NUM}, NUM_OP_LTE},
+    {"FLOOR", FLOOR, VALUE_NUM, true, true, 1, {VALUE_NUM}, NUM_OP_NONE},
+    {"CEIL", CEIL, VALUE_NUM, true, true, 1, {VALUE_NUM}, NUM_OP_NONE},
+    {"ROUND", ROUND, VALUE_NUM, true, true, 1, {VALUE_NUM}, NUM_OP_NONE},
+    {"RAND", RAND, VALUE_NUM, false, false, 0, {0}, NUM_OP_NONE},
+
+    {"UPPER", UPPER, VALUE_STR, true, true, 1, {VALUE_STR}, NUM_OP_NONE},
+    {"LOWER", LOWER, VALUE_STR, true, true, 1, {VALUE_STR}, NUM_OP_NONE},
+    {"CONCAT", CONCAT, VALUE_STR, true, true, 2, {VALUE_STR, VALUE_STR}, NUM_OP_NONE},
+    {"LEN", LEN, VALUE_NUM, true, true, 1, {VALUE_STR}, NUM_OP_NONE},
+    {"SUBSTR", SUBSTR, VALUE_STR, true, true, 3, {VALUE_STR, VALUE_NUM, VALUE_NUM}, NUM_OP_NONE},
+    {"CONTAINS", CONTAINS, VALUE_NUM, true, true, 2, {VALUE_STR, VALUE_STR}, NUM_OP_NONE},
+    {"FIND", FIND, VALUE_NUM, true, true, 2, {VALUE_STR, VALUE_STR}, NUM_OP_NONE},
+    {"STR_EQ", STR_EQ, VALUE_NUM, true, true, 2, {VALUE_STR, VALUE_STR}, NUM_OP_NONE},
+
+    {"IF", IF, VALUE_ANY, true, true, 3, {VALUE_NUM, VALUE_ANY, VALUE_ANY}, NUM_OP_NONE},
+    {"SLEEP", SLEEP, VALUE_NONE, false, false, 1, {VALUE_NUM}, NUM_OP_NONE},
+};
+
+int builtin_count() {
+    return sizeof(builtins) / sizeof(builtins[0]);
+}
+
+const Builtin *builtin_at(int index) {
+    return &builtins[index];
+}
+
+// Look up an in-built function by name, NULL if there is none
+const Builtin *find_builtin(const char *name) {
+    for (int i = 0; i < builtin_count(); i++) {
+        if (strcmp(name, builtins[i].name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+// Same results as the boxed functions above, minus argument validation
+double apply_num_op(num_op op, double a, double b) {
+    switch (op) {
+        case NUM_OP_ADD: return a + b;
+        case NUM_OP_SUB: return a - b;
+        case NUM_OP_MUL: return a * b;
+        case NUM_OP_DIV: return a / b;
+        case NUM_OP_MOD: return fmod(a, b);
+        case NUM_OP_POW: return pow(a, b);
+        case NUM_OP_EQ:  return (a == b) ? 1.0 : 0.0;
+        case NUM_OP_NEQ: return (a != b) ? 1.0 : 0.0;
+        case NUM_OP_GT:  return (a > b) ? 1.0 : 0.0;
+        case NUM_OP_LT:  return (a < b) ? 1.0 : 0.0;
+        case NUM_OP_GTE: return (a >= b) ? 1.0 : 0.0;
+        case NUM_OP_LTE: return (a <= b) ? 1.0 : 0.0;
+        case NUM_OP_NONE: break;
+    }
+    return 0;
+}
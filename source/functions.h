@@ -6,6 +6,45 @@
 #include "interpreter.h"
 #include "util.h"
 
+typedef Value* (*builtin_fn)(Value **args, int count);
+
+// Binary Number operations the interpreter can apply without boxing
+typedef enum {
+    NUM_OP_NONE,
+    NUM_OP_ADD,
+    NUM_OP_SUB,
+    NUM_OP_MUL,
+    NUM_OP_DIV,
+    NUM_OP_MOD,
+    NUM_OP_POW,
+    NUM_OP_EQ,
+    NUM_OP_NEQ,
+    NUM_OP_GT,
+    NUM_OP_LT,
+    NUM_OP_GTE,
+    NUM_OP_LTE
+} num_op;
+
+// An in-built function and its signature. JUMP and JUMP_IF act on the
+// machine state and are implemented by the interpreter instead.
+typedef struct Builtin {
+    char *name;
+    builtin_fn fn;
+    ValueType result;       // VALUE_NONE if nothing is returned
+    bool total;             // Cannot fail or have side effects on well-typed arguments
+    bool pure;              // Result depends only on the arguments, so it may be memoised
+    int arity;
+    ValueType params[3];
+    num_op op;              // Unboxed equivalent, NUM_OP_NONE if there is none
+} Builtin;
+
+const Builtin *find_builtin(const char *name);
+
+// Every in-built function in a fixed order, for tables indexed by builtin
+int builtin_count();
+const Builtin *builtin_at(int index);
+double apply_num_op(num_op op, double a, double b);
+
 Value* ADD(Value **args, int count);
 Value* SUB(Value **args, int count);
 Value* MUL(Value **args, int count);
@@ -39,14 +39,18 @@ static void bucket_insert(struct list *buckets, hashfun hashfun,
 static void resize(struct hashmap *kvs) {
     kvs->bucket_size *= 2;
     struct list *new_buckets = list_new(kvs->bucket_size);
+    int bucket_capacity = ((struct list*)list_get(kvs->buckets, 0))->capacity;
+    for (int i = 0; i < kvs->bucket_size; i++) {
+        list_append(new_buckets, list_new(bucket_capacity));
+    }
     for (int i = 0; i < kvs->buckets->length; i++) {
         struct list *bucket = list_get(kvs->buckets, i);
         for (int j = 0; j < bucket->length; j++) {
             bucket_insert(new_buckets, kvs->hashfun, list_get(bucket, j));
         }
-        xfree(bucket);
+        free_list(bucket);
     }
-    xfree(kvs->buckets);
+    free_list(kvs->buckets);
     kvs->buckets = new_buckets;
 }
 
@@ -74,11 +78,20 @@ static struct pair *hashmap_find(struct hashmap *kvs, void *k) {
     return NULL;
 }
 
+// The pair is removed from its bucket, not only freed, so later lookups in
+// the bucket never see it
 void hashmap_delete(struct hashmap *kvs, void *k) {
-    struct pair *kv = hashmap_find(kvs, k);
-    if (kv != NULL) {
-        xfree(kv);
-        kvs->size--;
+    int hash = kvs->hashfun(k);
+    struct list *bucket = list_get(kvs->buckets, hash % kvs->bucket_size);
+    for (int i = 0; i < bucket->length; i++) {
+        struct pair *kv = list_get(bucket, i);
+        if (strcmp((char*)kv->k, (char*)k) == 0) {
+            list_set(bucket, i, list_get(bucket, bucket->length - 1));
+            bucket->length--;
+            xfree(kv);
+            kvs->size--;
+            return;
+        }
     }
 }
 
@@ -90,3 +103,70 @@ void *hashmap_lookup(struct hashmap *kvs, void *k) {
         return NULL;
     }
 }
+
+// Remove every pair, handing its key and value to free_entry first (if given).
+// The buckets are kept, so refilling the map does not grow it again.
+void hashmap_clear(struct hashmap *kvs, void (*free_entry)(void *k, void *v)) {
+    for (int i = 0; i < kvs->bucket_size; i++) {
+        struct list *bucket = list_get(kvs->buckets, i);
+        for (int j = 0; j < bucket->length; j++) {
+            struct pair *kv = list_get(bucket, j);
+            if (free_entry != NULL) {
+                free_entry(kv->k, kv->v);
+            }
+            xfree(kv);
+        }
+        bucket->length = 0;
+    }
+    kvs->size = 0;
+}
+
+// Hand every pair to fn, in no particular order. fn must not change the map.
+void hashmap_each(struct hashmap *kvs, void (*fn)(void *k, void *v, void *context), void *context) {
+    for (int i = 0; i < kvs->bucket_size; i++) {
+        struct list *bucket = list_get(kvs->buckets, i);
+        for (int j = 0; j < bucket->length; j++) {
+            struct pair *kv = list_get(bucket, j);
+            fn(kv->k, kv->v, context);
+        }
+    }
+}
+
+// Free every pair, handing its key and value to free_entry first (if given)
+void free_hashmap(struct hashmap *kvs, void (*free_entry)(void *k, void *v)) {
+    if (kvs == NULL) return;
+
+    for (int i = 0; i < kvs->bucket_size; i++) {
+        struct list *bucket = list_get(kvs->buckets, i);
+
+        if (bucket != NULL) {
+            for (int j = 0; j < bucket->length; j++) {
+                struct pair *kv = list_get(bucket, j);
+                if (kv != NULL) {
+                    if (free_entry != NULL) {
+                        free_entry(kv->k, kv->v);
+                    }
+                    xfree(kv);
+                }
+            }
+            free_list(bucket);
+        }
+    }
+
+    free_list(kvs->buckets);
+    xfree(kvs);
+}
+
+// DJB2 Hash Function for Strings
+int hash_string(const void *key) {
+    unsigned long hash = 5381;
+    int c;
+    const char *str = (const char *)key;
+
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+    
+    // Bitwise AND ensures the hash is a positive integer
+    return (int)(hash & 0x7FFFFFFF); 
+}
@@ -28,5 +28,10 @@ struct hashmap *hashmap_new(int initial_buckets, int bucket_capacity,
 void hashmap_insert(struct hashmap *kvs, void *k, void *v);
 void hashmap_delete(struct hashmap *kvs, void *k);
 void *hashmap_lookup(struct hashmap *kvs, void *k);
+void hashmap_clear(struct hashmap *kvs, void (*free_entry)(void *k, void *v));
+void hashmap_each(struct hashmap *kvs, void (*fn)(void *k, void *v, void *context), void *context);
+void free_hashmap(struct hashmap *kvs, void (*free_entry)(void *k, void *v));
+
+int hash_string(const void *key);
 
 #endif
@@ -2,42 +2,102 @@
 
 #include "interpreter.h"
 #include "functions.h"
+#include "memo.h"
+#include "metrics.h"
+#include "trace.h"
+#include "sampler.h"
+#include "runstats.h"
+#include "perfcounters.h"
+#include "parallel.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-Value* evaluate_factor(Factor *factor, MachineState *state);
 Value* evaluate_function(Pinch_Func *func, MachineState *state);
 
+// State whose generator RAND draws from on this thread, see bind_machine_state
+static _Thread_local MachineState *bound_state = NULL;
+static _Thread_local uint64_t unbound_random_state = RANDOM_SEED;
+
+MachineState *bind_machine_state(MachineState *state) {
+    MachineState *previous = bound_state;
+    bound_state = state;
+    return previous;
+}
+
+// splitmix64, so every state carries its whole generator in one word
+double random_number() {
+    uint64_t *seed = bound_state != NULL ? &bound_state->random_state : &unbound_random_state;
+    uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (double)(z >> 11) / (double)(1ULL << 53);
+}
+
+// Text of Values is shared, not copied: copying a Value, or every variable of
+// a state, only takes another reference. Text is never changed in place, so
+// writing it always means building new text, and a copy never has to be made
+// to keep other holders unaffected.
+typedef struct {
+    int refs;
+    char text[];
+} SharedText;
+
+static SharedText *shared_text(char *text) {
+    return (SharedText*)(text - offsetof(SharedText, text));
+}
+
+static char *new_text(size_t length, char *msg) {
+    SharedText *shared = xalloc(sizeof(SharedText) + length + 1, msg);
+    shared->refs = 1;
+    return shared->text;
+}
+
+// Values are copied by other threads too (parallel engine, argument tasks)
+static char *retain_text(char *text) {
+    __atomic_add_fetch(&shared_text(text)->refs, 1, __ATOMIC_RELAXED);
+    return text;
+}
+
+static void release_text(char *text) {
+    SharedText *shared = shared_text(text);
+    if (__atomic_sub_fetch(&shared->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        xfree(shared);
+    }
+}
+
 Value* value_from_none() {
-    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory.\n");
+    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for a none value.\n");
     v->type = VALUE_NONE;
     return v;
 }
 
 Value* value_from_error() {
-    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory.\n");
+    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for an error value.\n");
     v->type = VALUE_ERROR;
     return v;
 }
 
 Value* value_from_num(double num) {
-    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory.\n");
+    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for a Number.\n");
     v->type = VALUE_NUM;
     v->data.num = num;
     return v;
 }
 
 Value* value_from_str(char *s) {
-    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory.\n");
+    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for a Text value.\n");
     v->type = VALUE_STR;
     // Duplicate the string so the Value owns its own memory
-    v->data.str = xalloc(strlen(s) + 1, "Interpreter Error: Fail to allocate memory.\n");
-    strcpy(v->data.str, s);
+    size_t length = strlen(s);
+    v->data.str = new_text(length, "Interpreter Error: Fail to allocate memory for Text.\n");
+    memcpy(v->data.str, s, length + 1);
     return v;
 }
 
 Value* value_from_jump(int lines, jump_type type) {
-    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory.\n");
+    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for a Jump.\n");
     v->type = VALUE_JUMP;
     v->data.jump.lines = lines;
     v->data.jump.type = type;
@@ -50,8 +110,12 @@ Value* copy_value(Value *v) {
     switch (v->type) {
         case VALUE_NUM:
             return value_from_num(v->data.num);  
-        case VALUE_STR:
-            return value_from_str(v->data.str);
+        case VALUE_STR: {
+            Value *copy = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for a Text value.\n");
+            copy->type = VALUE_STR;
+            copy->data.str = retain_text(v->data.str);
+            return copy;
+        }
         case VALUE_JUMP:
             return value_from_jump(v->data.jump.lines, v->data.jump.type);
         case VALUE_NONE: 
@@ -68,7 +132,7 @@ void free_value(Value *v) {
 
     switch (v->type) {
         case VALUE_STR:
-            xfree(v->data.str);
+            release_text(v->data.str);
             break;     
         case VALUE_NUM:
         case VALUE_JUMP:
@@ -80,7 +144,7 @@ void free_value(Value *v) {
     xfree(v);
 }
 
-void print_value(Value *value) {
+void write_value(FILE *out, Value *value) {
     switch (value->type) {
         case VALUE_NUM: {
             // For Number, round to 5 s.f. and trim trailing 0s
@@ -101,17 +165,17 @@ void print_value(Value *value) {
                 }
             }
             
-            printf("%s\n", buf);
+            fprintf(out, "%s\n", buf);
             break;
         }
         case VALUE_STR:
-            printf("%s\n", value->data.str);
+            fprintf(out, "%s\n", value->data.str);
             break;
         case VALUE_JUMP:
             if (value->data.jump.type == JUMP_BACKWARD) {
-                printf("%d <=\n", value->data.jump.lines);
+                fprintf(out, "%d <=\n", value->data.jump.lines);
             } else {
-                printf("=> %d\n", value->data.jump.lines);
+                fprintf(out, "=> %d\n", value->data.jump.lines);
             }
             break;
         default:
@@ -119,117 +183,252 @@ void print_value(Value *value) {
     }
 }
 
+void print_value(Value *value) {
+    write_value(stdout, value);
+}
+
+void output_value(MachineState *state, Value *value) {
+    write_value(state->output != NULL ? state->output : stdout, value);
+}
+
+// Move the program counter by a jump, offsetting the upcoming increment in the main loop
+static void perform_jump(MachineState *state, int lines, jump_type type) {
+    int from = state->program_counter;
+    if (type == JUMP_FORWARD) {
+        state->program_counter += lines;
+    } else {
+        state->program_counter -= lines;
+    }
+    state->program_counter--;
+    if (state->counters != NULL) __atomic_add_fetch(&state->counters->jumps, 1, __ATOMIC_RELAXED);
+    if (tracing()) trace_jump(from + 1, state->program_counter + 2);
+}
+
+// JUMP:: Jump -> []
+static Value* jump(Value **args, int count, MachineState *state) {
+    if (count != 1 || args[0]->type != VALUE_JUMP) {
+        report_error("Runtime Error: JUMP expects 1 argument Jump.\n");
+        return value_from_error();
+    }
+    perform_jump(state, args[0]->data.jump.lines, args[0]->data.jump.type);
+    return value_from_none();
+}
+
+// JUMP_IF:: [Number, Jump, Jump] -> []
+static Value* jump_if(Value **args, int count, MachineState *state) {
+    if (count != 3 || args[0]->type != VALUE_NUM || args[1]->type != VALUE_JUMP) {
+        report_error("Runtime Error: JUMP_IF expects 3 arguments [Number, Jump, Jump].\n");
+        return value_from_error();
+    }
+
+    // Determine which jump to perform
+    Value *taken = args[0]->data.num >= 0.5 ? args[1] : args[2];
+    perform_jump(state, taken->data.jump.lines, taken->data.jump.type);
+    return value_from_none();
+}
+
+// ---------------------------------------------------------
+// QUICKENING
+// ---------------------------------------------------------
+
+// Resolve the function name once, so later executions skip name dispatch
+static void resolve_function(Pinch_Func *func) {
+    func->builtin = find_builtin(func->name);
+    if (func->builtin != NULL) {
+        func->quick = QUICK_GENERIC;
+    } else if (strcmp(func->name, "JUMP") == 0) {
+        func->quick = QUICK_JUMP;
+    } else if (strcmp(func->name, "JUMP_IF") == 0) {
+        func->quick = QUICK_JUMP_IF;
+    } else {
+        func->quick = QUICK_UNKNOWN;
+    }
+}
+
+static bool is_operand(Factor *f, factor_type literal) {
+    return f->type == FACTOR_VAR || f->type == literal;
+}
+
+// Choose a specialised variant from the argument types seen on the first execution
+static void quicken(Pinch_Func *func, Value **args) {
+    if (func->factors->count != 2) return;
+    Factor **factors = func->factors->items;
+
+    if (func->builtin->op != NUM_OP_NONE &&
+        is_operand(factors[0], FACTOR_NUM) && is_operand(factors[1], FACTOR_NUM) &&
+        args[0]->type == VALUE_NUM && args[1]->type == VALUE_NUM) {
+        func->quick = QUICK_NUM_BINARY;
+    } else if (func->builtin->fn == CONCAT &&
+               is_operand(factors[0], FACTOR_STR) && is_operand(factors[1], FACTOR_STR) &&
+               args[0]->type == VALUE_STR && args[1]->type == VALUE_STR) {
+        func->quick = QUICK_CONCAT;
+    }
+}
+
+// Read a Number operand without copying it. Returns false if the guard fails.
+static bool peek_num(Factor *f, MachineState *state, double *num) {
+    if (f->type == FACTOR_NUM) {
+        *num = f->data.num;
+        return true;
+    }
+    Value *val = (Value*)hashmap_lookup(state->variables, f->data.var);
+    if (val == NULL || val->type != VALUE_NUM) return false;
+    *num = val->data.num;
+    return true;
+}
+
+// Read a Text operand without copying it. Returns NULL if the guard fails.
+static char *peek_str(Factor *f, MachineState *state) {
+    if (f->type == FACTOR_STR) return f->data.str;
+    Value *val = (Value*)hashmap_lookup(state->variables, f->data.var);
+    if (val == NULL || val->type != VALUE_STR) return NULL;
+    return val->data.str;
+}
+
+// Specialised variants return NULL when a guard fails. Operands are only
+// variables and literals, so retrying on the generic path is side-effect free.
+static Value* quick_num_binary(Pinch_Func *func, MachineState *state) {
+    double a, b;
+    if (!peek_num(func->factors->items[0], state, &a) ||
+        !peek_num(func->factors->items[1], state, &b)) {
+        return NULL;
+    }
+
+    // Leave the division by zero error to the generic path
+    num_op op = func->builtin->op;
+    if ((op == NUM_OP_DIV || op == NUM_OP_MOD) && b == 0) return NULL;
+
+    return value_from_num(apply_num_op(op, a, b));
+}
+
+static Value* quick_concat(Pinch_Func *func, MachineState *state) {
+    char *s1 = peek_str(func->factors->items[0], state);
+    char *s2 = peek_str(func->factors->items[1], state);
+    if (s1 == NULL || s2 == NULL) return NULL;
+
+    size_t len1 = strlen(s1);
+    size_t len2 = strlen(s2);
+
+    // Build the result in place instead of copying it through value_from_str
+    Value *v = xalloc(sizeof(Value), "Interpreter Error: Fail to allocate memory for a Text value.\n");
+    v->type = VALUE_STR;
+    v->data.str = new_text(len1 + len2, "Runtime Error: Memory allocation failed for CONCAT.");
+    memcpy(v->data.str, s1, len1);
+    memcpy(v->data.str + len1, s2, len2 + 1);
+    return v;
+}
+
+// Name of the function a call resolved to, which outlives the program for
+// the trace
+static const char *traced_name(Pinch_Func *func) {
+    switch (func->quick) {
+        case QUICK_JUMP:
+            return "JUMP";
+        case QUICK_JUMP_IF:
+            return "JUMP_IF";
+        default:
+            return func->builtin != NULL ? func->builtin->name : "unknown";
+    }
+}
+
 Value* evaluate_function(Pinch_Func *func, MachineState *state) {
+    if (state->counters != NULL) __atomic_add_fetch(&state->counters->calls, 1, __ATOMIC_RELAXED);
+    bool sampled = sampling();
+    if (func->quick == QUICK_NUM_BINARY || func->quick == QUICK_CONCAT) {
+        uint64_t quick_start = state->metrics != NULL ? metrics_now(state->metrics) : 0;
+        int64_t quick_trace = tracing() ? trace_begin() : -1;
+        PerfValues quick_perf;
+        if (perf_per_builtin()) quick_perf = perf_read();
+        if (sampled) sample_push(func);
+        Value *quick_result = func->quick == QUICK_NUM_BINARY
+                                  ? quick_num_binary(func, state)
+                                  : quick_concat(func, state);
+        if (sampled) sample_pop();
+        if (quick_result != NULL) {
+            if (state->metrics != NULL) metrics_record(state->metrics, func, quick_start, false);
+            if (quick_trace >= 0) trace_call_end(traced_name(func), quick_trace, false);
+            if (perf_per_builtin()) perf_record_call(func, quick_perf);
+            return quick_result;
+        }
+
+        // The types seen at this call site changed, stay generic from now on
+        func->quick = QUICK_GENERIC;
+    }
+
+    bool first_execution = func->quick == QUICK_UNRESOLVED;
+    if (first_execution) {
+        resolve_function(func);
+    }
+    // The call is on the sampled stack while its arguments are evaluated
+    if (sampled) sample_push(func);
+
     int count = func->factors->count;
     
     // Allocate a temporary array for evaluated arguments
-    Value **args = xalloc(sizeof(Value*) * count, "Interpreter Error: Fail to allocate memory.\n");
+    Value **args = xalloc(sizeof(Value*) * count, "Interpreter Error: Fail to allocate memory for call arguments.\n");
+
+    // Costly independent arguments may be evaluated on other threads
+    int evaluated = state->arg_pool != NULL ? parallel_evaluate_args(func, state, args) : -1;
+    if (evaluated >= 0 && evaluated < count) {
+        xfree(args);
+        if (sampled) sample_pop();
+        return value_from_error();
+    }
 
     // Evaluate all arguments
-    for (int i = 0; i < count; i++) {
+    for (int i = 0; i < count && evaluated < 0; i++) {
         args[i] = evaluate_factor(func->factors->items[i], state);
         
         // If an argument fails, stop immediately.
         if (args[i]->type == VALUE_ERROR) {
-            // Clean up the arguments evaluated so far
-            for (int j = 0; j < i; j++) free_value(args[j]);
+            // Clean up the arguments evaluated so far, the failing one included
+            for (int j = 0; j <= i; j++) free_value(args[j]);
             xfree(args);
+            if (sampled) sample_pop();
             return value_from_error();
         }
     }
 
     Value *result = NULL;
-    char *name = func->name;
-
-    // Call library function
-    if (strcmp(name, "ADD") == 0) result = ADD(args, count);
-    else if (strcmp(name, "SUB") == 0) result = SUB(args, count);
-    else if (strcmp(name, "MUL") == 0) result = MUL(args, count);
-    else if (strcmp(name, "DIV") == 0) result = DIV(args, count);
-    else if (strcmp(name, "MOD") == 0) result = MOD(args, count);
-    else if (strcmp(name, "POW") == 0) result = POW(args, count);
-    else if (strcmp(name, "ABS") == 0) result = ABS(args, count);
-    else if (strcmp(name, "SQRT") == 0) result = SQRT(args, count);
-    else if (strcmp(name, "EQ") == 0) result = EQ(args, count);
-    else if (strcmp(name, "NEQ") == 0) result = NEQ(args, count);
-    else if (strcmp(name, "GT") == 0) result = GT(args, count);
-    else if (strcmp(name, "LT") == 0) result = LT(args, count);
-    else if (strcmp(name, "GTE") == 0) result = GTE(args, count);
-    else if (strcmp(name, "LTE") == 0) result = LTE(args, count);
-    else if (strcmp(name, "FLOOR") == 0) result = FLOOR(args, count);
-    else if (strcmp(name, "CEIL") == 0) result = CEIL(args, count);
-    else if (strcmp(name, "ROUND") == 0) result = ROUND(args, count);
-    else if (strcmp(name, "RAND") == 0) result = RAND(args, count);
-
-    else if (strcmp(name, "UPPER") == 0) result = UPPER(args, count);
-    else if (strcmp(name, "LOWER") == 0) result = LOWER(args, count);
-    else if (strcmp(name, "CONCAT") == 0) result = CONCAT(args, count);
-    else if (strcmp(name, "LEN") == 0) result = LEN(args, count);
-    else if (strcmp(name, "SUBSTR") == 0) result = SUBSTR(args, count);
-    else if (strcmp(name, "CONTAINS") == 0) result = CONTAINS(args, count);
-    else if (strcmp(name, "FIND") == 0) result = FIND(args, count);
-    else if (strcmp(name, "STR_EQ") == 0) result = STR_EQ(args, count);
-    
-    // Special functions
-    else if (strcmp(name, "IF") == 0) result = IF(args, count);
-    else if (strcmp(name, "SLEEP") == 0) result = SLEEP(args, count);
-
-    // JUMP:: Jump -> []
-    else if (strcmp(name, "JUMP") == 0) {
-        if (count != 1 || args[0]->type != VALUE_JUMP) {
-            fprintf(stderr, "Runtime Error: JUMP expects 1 argument Jump.\n");
+
+    // Only the call itself is timed, its arguments count for their own functions
+    uint64_t start = state->metrics != NULL ? metrics_now(state->metrics) : 0;
+    int64_t trace_start = tracing() ? trace_begin() : -1;
+    PerfValues perf_start;
+    if (perf_per_builtin()) perf_start = perf_read();
+    switch (func->quick) {
+        case QUICK_JUMP:
+            result = jump(args, count, state);
+            break;
+        case QUICK_JUMP_IF:
+            result = jump_if(args, count, state);
+            break;
+        case QUICK_UNKNOWN:
+            report_error("Runtime Error: Unknown function '%s'.\n", func->name);
             result = value_from_error();
-        } else {
-            int lines = args[0]->data.jump.lines;
-            if (args[0]->data.jump.type == JUMP_FORWARD) {
-                state->program_counter += lines;
-            } else {
-                state->program_counter -= lines;
+            break;
+        default:
+            // Call library function
+            result = memo_call(state->memo, func->builtin, args, count);
+            if (first_execution && result->type != VALUE_ERROR) {
+                quicken(func, args);
             }
-            // Offset upcoming program_counter increment in the main loop
-            state->program_counter--; 
-            result = value_from_none();
-        }
+            break;
     }
-    // JUMP_IF:: [Number, Jump, Jump] -> []
-    else if (strcmp(name, "JUMP_IF") == 0) {
-        if (count != 3 || args[0]->type != VALUE_NUM || args[1]->type != VALUE_JUMP) {
-            fprintf(stderr, "Runtime Error: JUMP_IF expects 3 arguments [Number, Jump, Jump].\n");
-            result = value_from_error();
-        } else {
-            int lines;
-            jump_type type;
-
-            // Determine which jump to perform
-            if (args[0]->data.num >= 0.5) {
-                lines = args[1]->data.jump.lines;
-                type = args[1]->data.jump.type;
-            } else {
-                lines = args[2]->data.jump.lines;
-                type = args[2]->data.jump.type;
-            }
-
-            // Modify program_counter
-            if (type == JUMP_FORWARD) {
-                state->program_counter += lines;
-            } else {
-                state->program_counter -= lines;
-            }
-            // Offset upcoming program_counter increment in the main loop
-            state->program_counter--;
-            result = value_from_none();
-        }
+    if (state->metrics != NULL) {
+        metrics_record(state->metrics, func, start, result->type == VALUE_ERROR);
     }
-    else {
-        fprintf(stderr, "Runtime Error: Unknown function '%s'.\n", name);
-        result = value_from_error();
+    if (trace_start >= 0) {
+        trace_call_end(traced_name(func), trace_start, result->type == VALUE_ERROR);
     }
+    if (perf_per_builtin()) perf_record_call(func, perf_start);
 
     // Clean up temporary argument Values
     for (int i = 0; i < count; i++) {
         free_value(args[i]);
     }
     xfree(args);
+    if (sampled) sample_pop();
     return result;
 }
 
@@ -248,7 +447,7 @@ Value* evaluate_factor(Factor *factor, MachineState *state) {
             // Hashmap lookup
             Value *val = (Value*)hashmap_lookup(state->variables, factor->data.var);
             if (val == NULL) {
-                fprintf(stderr, "Runtime Error: Undefined variable '%s'.\n", factor->data.var);
+                report_error("Runtime Error: Undefined variable '%s'.\n", factor->data.var);
                 return value_from_error();
             }
             return copy_value(val); 
@@ -269,7 +468,7 @@ bool interpret_factor(Factor *factor, MachineState *state) {
         free_value(result);
         return false;
     }
-    print_value(result);
+    output_value(state, result);
     free_value(result);
     return true;
 }
@@ -287,28 +486,32 @@ bool interpret_variable(Pinch_Var *var_assign, MachineState *state) {
     // If evaluation return none value
     if (result->type == VALUE_NONE) {
         free_value(result);
-        fprintf(stderr, "Runtime Error: Assigning none value to variable '%s'.\n", var_assign->name);
+        report_error("Runtime Error: Assigning none value to variable '%s'.\n", var_assign->name);
         return false;
     } 
 
+    assign_variable(state, var_assign->name, result);
+    return true;
+}
+
+void assign_variable(MachineState *state, const char *name, Value *value) {
     // If variable exists, delete old value first
-    Value *old_value = (Value*)hashmap_lookup(state->variables, var_assign->name);
+    Value *old_value = (Value*)hashmap_lookup(state->variables, (void*)name);
 
-    if (old_value) {        
+    if (old_value) {
         // Free any dynamically allocated inner data from the old value
         if (old_value->type == VALUE_STR) {
-            xfree(old_value->data.str);
+            release_text(old_value->data.str);
         }
-        *old_value = *result;
-        xfree(result);
-    } 
+        *old_value = *value;
+        xfree(value);
+    }
     else {
         // Insert new entry if not exist
-        char *key = xalloc(strlen(var_assign->name) + 1, "Interpreter Error: Fail to allocate memory.\n");
-        strcpy(key, var_assign->name);
-        hashmap_insert(state->variables, key, result);
+        char *key = xalloc(strlen(name) + 1, "Interpreter Error: Fail to allocate memory for a variable name.\n");
+        strcpy(key, name);
+        hashmap_insert(state->variables, key, value);
     }
-    return true;
 }
 
 bool interpret_function(Pinch_Func *function, MachineState *state) {
@@ -319,15 +522,20 @@ bool interpret_function(Pinch_Func *function, MachineState *state) {
         return false;
     }
 
-    print_value(result);
+    output_value(state, result);
     free_value(result);
     return true;
 }
 
-bool interpret_line(Statement *line, MachineState *state, bool interactive) {
+static bool interpret_statement(Statement *line, MachineState *state, bool interactive) {
 
     bool interpret_success;
 
+    if (__atomic_load_n(&state->interrupted, __ATOMIC_RELAXED)) {
+        report_error("Runtime Error: Execution interrupted.\n");
+        return false;
+    }
+
     switch (line->type) {
         case FACTOR:
             interpret_success = interpret_factor(line->content.factor, state);
@@ -340,10 +548,10 @@ bool interpret_line(Statement *line, MachineState *state, bool interactive) {
             // JUMP and JUMP_IF are disabled in interactive mode
             if (interactive) {
                 if (strcmp(func_name, "JUMP") == 0) {
-                    fprintf(stderr, "Interpreter Constraint: JUMP cannot be used in interactive mode.\n");
+                    report_error("Interpreter Constraint: JUMP cannot be used in interactive mode.\n");
                     return false;
                 } else if (strcmp(func_name, "JUMP_IF") == 0) {
-                    fprintf(stderr, "Interpreter Constraint: JUMP_IF cannot be used in interactive mode.\n");
+                    report_error("Interpreter Constraint: JUMP_IF cannot be used in interactive mode.\n");
                     return false;
                 }
             }
@@ -353,3 +561,39 @@ bool interpret_line(Statement *line, MachineState *state, bool interactive) {
     }
     return interpret_success;
 }
+
+bool interpret_line(Statement *line, MachineState *state, bool interactive) {
+    if (state->counters == NULL && !tracing() && !sampling()) return interpret_statement(line, state, interactive);
+    if (state->counters != NULL) __atomic_add_fetch(&state->counters->statements, 1, __ATOMIC_RELAXED);
+    if (sampling()) sample_statement(line->line);
+    int64_t start = tracing() ? trace_statement_begin() : -1;
+    bool success = interpret_statement(line, state, interactive);
+    trace_statement_end(line, start);
+    if (sampling()) sample_statement(0);
+    return success;
+}
+
+static Value* execute_body(Statement *line, MachineState *state) {
+    switch (line->type) {
+        case FACTOR:
+            return evaluate_factor(line->content.factor, state);
+        case PINCH_VAR:
+            return interpret_variable(line->content.pinch_var, state) ? value_from_none() : value_from_error();
+        case PINCH_FUNC_S:
+            return evaluate_function(line->content.pinch_func, state);
+    }
+    return value_from_error();
+}
+
+// Run a statement that cannot jump without printing anything. Returns the
+// Value the statement prints (VALUE_NONE for assignments) or VALUE_ERROR.
+Value* execute_statement(Statement *line, MachineState *state) {
+    if (state->counters == NULL && !tracing() && !sampling()) return execute_body(line, state);
+    if (state->counters != NULL) __atomic_add_fetch(&state->counters->statements, 1, __ATOMIC_RELAXED);
+    if (sampling()) sample_statement(line->line);
+    int64_t start = tracing() ? trace_statement_begin() : -1;
+    Value *result = execute_body(line, state);
+    trace_statement_end(line, start);
+    if (sampling()) sample_statement(0);
+    return result;
+}
@@ -5,6 +5,9 @@
 
 #include "parser.h"
 #include "hashmap.h"
+#include "util.h"
+#include <stdint.h>
+#include <stdio.h>
 
 typedef enum {
     VALUE_NUM,
@@ -27,13 +30,30 @@ typedef struct {
     } data;
 } Value;
 
+struct MemoCache;
+struct ThreadPool;
+struct BuiltinMetrics;
+struct RunCounters;
+
 typedef struct {
     int program_counter;
     Statement **statements;
     int stmt_count;
     struct hashmap *variables;
+    struct MemoCache *memo;     // Cache of pure builtin results, NULL when disabled
+    struct ThreadPool *arg_pool;    // Evaluates costly arguments concurrently, NULL when disabled
+    int arg_min_cost;           // Estimated cost an argument needs to be evaluated as a task
+    struct BuiltinMetrics *metrics; // Counts and times builtin calls, NULL when disabled
+    struct RunCounters *counters;   // Counts statements, jumps and calls, NULL when disabled; not owned
+    FILE *output;               // Printed values, NULL meaning stdout
+    FILE *errors;               // Runtime errors, NULL meaning stderr
+    uint64_t random_state;      // Generator behind RAND
+    bool interrupted;           // Set by interrupt_run, possibly from another thread
 } MachineState;
 
+// Every new state draws the same RAND sequence unless it is reseeded
+#define RANDOM_SEED 0x2545F4914F6CDD1DULL
+
 
 Value* value_from_none();
 Value* value_from_error();
@@ -42,7 +62,22 @@ Value* value_from_str(char *s);
 Value* value_from_jump(int lines, jump_type type);
 Value* copy_value(Value *v);
 void free_value(Value *v);
+void write_value(FILE *out, Value *value);
+void print_value(Value *value);
+void output_value(MachineState *state, Value *value);
 
+Value* evaluate_factor(Factor *factor, MachineState *state);
 bool interpret_line(Statement *line, MachineState *state, bool interactive);
+Value* execute_statement(Statement *line, MachineState *state);
+
+// Store a value in a variable, taking ownership of it. The old value's Value
+// struct is reused, so pointers to it held by the variable table stay valid.
+void assign_variable(MachineState *state, const char *name, Value *value);
+
+// Make RAND on the calling thread draw from the state's generator. Returns
+// the state bound before, so calls can nest. Threads without a bound state
+// draw from a generator of their own.
+MachineState *bind_machine_state(MachineState *state);
+double random_number();
 
 #endif
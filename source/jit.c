@@ -0,0 +1,792 @@
+// Baseline JIT compiler for hot numeric loops (Linux x86-64 only)
+//
+// A loop is the range of statements between the target of a backward jump
+// and the statement that took it. Once such a jump has been taken
+// JIT_HOT_THRESHOLD times, the loop is compiled if every statement in it is
+// a Number assignment or a JUMP/JUMP_IF with literal jumps. Loop variables
+// live in xmm8-xmm15 and expressions are evaluated on a stack of xmm0-xmm7.
+//
+// Native code is only entered when every loop variable currently holds a
+// Number, and all operations it contains produce Numbers, so the variables
+// stay Numbers for as long as the loop runs. Statements that would fail
+// (division by zero, square root of a negative number) deoptimise: their
+// variables are written back and the interpreter resumes at that statement.
+//
+// While a run counts statements, jumps and calls, loops run a second version
+// of their code that adds up what each completed statement did in the frame.
+// Statements handed back to the interpreter are counted there instead.
+
+#include "jit.h"
+#include "functions.h"
+#include "runstats.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_MAX_VARS 8
+#define JIT_MAX_TEMPS 8
+
+// Memory shared between native code and the interpreter, addressed through rbx
+typedef struct {
+    double vars[JIT_MAX_VARS];
+    double temps[JIT_MAX_TEMPS];
+    int deopt;
+    int budget;     // Statements left before returning to the interpreter
+    long statements;    // Only updated by code compiled for counting
+    long jumps;
+    long calls;
+} JitFrame;
+
+// Returns the statement the interpreter resumes at
+typedef int (*jit_fn)(JitFrame *frame);
+
+typedef struct {
+    int head;                       // First statement of the loop
+    int tail;                       // Statement that jumps back to head
+    int var_count;
+    char *var_names[JIT_MAX_VARS];  // Borrowed from the statements
+    jit_fn code;                    // Each compiled the first time it is needed
+    size_t code_size;
+    jit_fn counting_code;
+    size_t counting_code_size;
+} JitLoop;
+
+struct JitState {
+    Statement **statements;
+    int stmt_count;
+    int *back_jumps;    // Backward jumps taken by each statement
+    bool *rejected;     // Loops ending at each statement that cannot be compiled
+    JitLoop **loops;    // Compiled loop ending at each statement
+    JitStats stats;
+};
+
+// ---------------------------------------------------------
+// CODE BUFFER
+// ---------------------------------------------------------
+
+// Exit stubs write the loop variables back and return a resume statement
+typedef struct {
+    int resume;
+    bool deopt;
+} ExitStub;
+
+// A rel32 operand to patch once the target position is known
+typedef struct {
+    int pos;
+    bool to_stub;   // Target is an exit stub rather than a statement label
+    int index;
+} Fixup;
+
+typedef struct {
+    uint8_t *bytes;
+    int length;
+    int capacity;
+
+    Fixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+
+    ExitStub *stubs;
+    int stub_count;
+    int stub_capacity;
+
+    int *labels;        // Code position of each statement in the loop
+
+    // Loop being compiled
+    Statement **statements;
+    int head;
+    int tail;
+    int current;        // Statement being compiled, where deopt stubs resume
+    JitLoop *loop;
+    bool counting;      // Add up statements, jumps and calls in the frame
+} Compiler;
+
+static void *grow(void *items, int *capacity, int count, size_t item_size) {
+    if (count < *capacity) return items;
+
+    int new_capacity = *capacity * 2;
+    void *bigger = xalloc(new_capacity * item_size, "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+    memcpy(bigger, items, count * item_size);
+    xfree(items);
+    *capacity = new_capacity;
+    return bigger;
+}
+
+static void emit8(Compiler *c, uint8_t byte) {
+    c->bytes = grow(c->bytes, &c->capacity, c->length, 1);
+    c->bytes[c->length++] = byte;
+}
+
+static void emit32(Compiler *c, uint32_t word) {
+    for (int i = 0; i < 4; i++) emit8(c, (word >> (8 * i)) & 0xFF);
+}
+
+static void emit64(Compiler *c, uint64_t word) {
+    for (int i = 0; i < 8; i++) emit8(c, (word >> (8 * i)) & 0xFF);
+}
+
+// <prefix> [REX] 0F <op> with both operands in xmm registers
+static void emit_sse(Compiler *c, uint8_t prefix, uint8_t op, int reg, int rm) {
+    emit8(c, prefix);
+    if (reg >= 8 || rm >= 8) emit8(c, 0x40 | ((reg >= 8) << 2) | (rm >= 8));
+    emit8(c, 0x0F);
+    emit8(c, op);
+    emit8(c, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// <prefix> [REX] 0F <op> with a memory operand at [rbx + disp]
+static void emit_sse_mem(Compiler *c, uint8_t prefix, uint8_t op, int reg, int disp) {
+    emit8(c, prefix);
+    if (reg >= 8) emit8(c, 0x44);
+    emit8(c, 0x0F);
+    emit8(c, op);
+    emit8(c, 0x80 | ((reg & 7) << 3) | 3);
+    emit32(c, (uint32_t)disp);
+}
+
+static void emit_movsd(Compiler *c, int dst, int src) {
+    if (dst != src) emit_sse(c, 0xF2, 0x10, dst, src);
+}
+
+static void emit_load(Compiler *c, int xmm, int disp) {
+    emit_sse_mem(c, 0xF2, 0x10, xmm, disp);
+}
+
+static void emit_store(Compiler *c, int xmm, int disp) {
+    emit_sse_mem(c, 0xF2, 0x11, xmm, disp);
+}
+
+// mov rax, imm64; movq xmm, rax
+static void emit_const_bits(Compiler *c, int xmm, uint64_t bits) {
+    emit8(c, 0x48);
+    emit8(c, 0xB8);
+    emit64(c, bits);
+    emit8(c, 0x66);
+    emit8(c, 0x48 | ((xmm >= 8) << 2));
+    emit8(c, 0x0F);
+    emit8(c, 0x6E);
+    emit8(c, 0xC0 | ((xmm & 7) << 3));
+}
+
+static void emit_const(Compiler *c, int xmm, double num) {
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+    emit_const_bits(c, xmm, bits);
+}
+
+static void add_fixup(Compiler *c, bool to_stub, int index) {
+    c->fixups = grow(c->fixups, &c->fixup_capacity, c->fixup_count, sizeof(Fixup));
+    c->fixups[c->fixup_count++] = (Fixup){c->length, to_stub, index};
+    emit32(c, 0);
+}
+
+static int find_stub(Compiler *c, int resume, bool deopt) {
+    for (int i = 0; i < c->stub_count; i++) {
+        if (c->stubs[i].resume == resume && c->stubs[i].deopt == deopt) return i;
+    }
+    c->stubs = grow(c->stubs, &c->stub_capacity, c->stub_count, sizeof(ExitStub));
+    c->stubs[c->stub_count] = (ExitStub){resume, deopt};
+    return c->stub_count++;
+}
+
+#define JMP 0xE9
+#define JB 0x82
+#define JAE 0x83
+#define JE 0x84
+#define JNE 0x85
+#define JA 0x87
+#define JP 0x8A
+
+// Jump (conditionally) to a statement inside the loop, or out of it
+static void emit_jump_to(Compiler *c, uint8_t cond, int target) {
+    if (cond == JMP) {
+        emit8(c, JMP);
+    } else {
+        emit8(c, 0x0F);
+        emit8(c, cond);
+    }
+
+    if (target >= c->head && target <= c->tail) {
+        add_fixup(c, false, target - c->head);
+    } else {
+        add_fixup(c, true, find_stub(c, target, false));
+    }
+}
+
+// Hand the current statement back to the interpreter
+static void emit_deopt(Compiler *c, uint8_t cond) {
+    if (cond == JMP) {
+        emit8(c, JMP);
+    } else {
+        emit8(c, 0x0F);
+        emit8(c, cond);
+    }
+    add_fixup(c, true, find_stub(c, c->current, true));
+}
+
+// Return to the interpreter at the current statement once the budget is spent
+static void emit_budget_check(Compiler *c) {
+    emit8(c, 0x83);     // sub dword [rbx + budget], 1
+    emit8(c, 0xAB);
+    emit32(c, (uint32_t)offsetof(JitFrame, budget));
+    emit8(c, 0x01);
+    emit8(c, 0x0F);
+    emit8(c, JE);
+    add_fixup(c, true, find_stub(c, c->current, false));
+}
+
+// add qword [rbx + disp], imm32
+static void emit_frame_add(Compiler *c, int disp, int32_t amount) {
+    emit8(c, 0x48);
+    emit8(c, 0x81);
+    emit8(c, 0x83);
+    emit32(c, (uint32_t)disp);
+    emit32(c, (uint32_t)amount);
+}
+
+// ---------------------------------------------------------
+// COMPILER
+// ---------------------------------------------------------
+
+#define VAR_REG(slot) (8 + (slot))
+#define VAR_DISP(slot) ((int)(offsetof(JitFrame, vars) + 8 * (slot)))
+#define TEMP_DISP(depth) ((int)(offsetof(JitFrame, temps) + 8 * (depth)))
+
+static const uint64_t ONE_BITS = 0x3FF0000000000000ULL;
+static const uint64_t SIGN_MASK_BITS = 0x7FFFFFFFFFFFFFFFULL;
+
+static int var_slot(JitLoop *loop, char *name) {
+    for (int i = 0; i < loop->var_count; i++) {
+        if (strcmp(loop->var_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static bool add_var(JitLoop *loop, char *name) {
+    if (var_slot(loop, name) >= 0) return true;
+    if (loop->var_count >= JIT_MAX_VARS) return false;
+    loop->var_names[loop->var_count++] = name;
+    return true;
+}
+
+static bool collect_vars(JitLoop *loop, Factors *factors) {
+    for (int i = 0; i < factors->count; i++) {
+        Factor *f = factors->items[i];
+        if (f->type == FACTOR_VAR && !add_var(loop, f->data.var)) return false;
+        if (f->type == FACTOR_FUNC && !collect_vars(loop, f->data.func->factors)) return false;
+    }
+    return true;
+}
+
+// Call a libm function on the operands in xmm(depth)... and leave the result
+// in xmm(depth). Every xmm register is caller-saved, so spill them around it.
+static void emit_call(Compiler *c, void *fn, int argc, int depth) {
+    for (int i = 0; i < depth + argc; i++) emit_store(c, i, TEMP_DISP(i));
+    for (int i = 0; i < c->loop->var_count; i++) emit_store(c, VAR_REG(i), VAR_DISP(i));
+    for (int i = 0; i < argc; i++) emit_load(c, i, TEMP_DISP(depth + i));
+
+    emit8(c, 0x48);
+    emit8(c, 0xB8);
+    emit64(c, (uint64_t)(uintptr_t)fn);
+    emit8(c, 0xFF);     // call rax
+    emit8(c, 0xD0);
+
+    emit_movsd(c, depth, 0);
+    for (int i = 0; i < c->loop->var_count; i++) emit_load(c, VAR_REG(i), VAR_DISP(i));
+    for (int i = 0; i < depth; i++) emit_load(c, i, TEMP_DISP(i));
+}
+
+// Deoptimise if xmm(reg) == 0, matching the divisor check of DIV and MOD
+static void emit_zero_check(Compiler *c, int reg, int scratch) {
+    emit_sse(c, 0x66, 0x57, scratch, scratch);  // xorpd
+    emit_sse(c, 0x66, 0x2E, reg, scratch);      // ucomisd
+
+    // Skip the deopt when not equal or unordered (NaN divides normally)
+    int skip = c->length;
+    emit8(c, 0x75);     // jne rel8
+    emit8(c, 0);
+    emit8(c, 0x7A);     // jp rel8
+    emit8(c, 0);
+    emit_deopt(c, JMP);
+    c->bytes[skip + 1] = (uint8_t)(c->length - (skip + 2));
+    c->bytes[skip + 3] = (uint8_t)(c->length - (skip + 4));
+}
+
+static bool compile_expr(Compiler *c, Factor *f, int depth);
+
+static bool compile_args(Compiler *c, Pinch_Func *func, int depth, int scratch_needed) {
+    if (depth + func->factors->count + scratch_needed > JIT_MAX_TEMPS) return false;
+    for (int i = 0; i < func->factors->count; i++) {
+        if (!compile_expr(c, func->factors->items[i], depth + i)) return false;
+    }
+    return true;
+}
+
+// Compare xmm(a) with xmm(b) and leave 1.0 or 0.0 in xmm(depth)
+static void emit_compare(Compiler *c, int depth, num_op op) {
+    int a = depth;
+    int b = depth + 1;
+    switch (op) {
+        case NUM_OP_EQ:  emit_sse(c, 0xF2, 0xC2, a, b); emit8(c, 0); break;
+        case NUM_OP_NEQ: emit_sse(c, 0xF2, 0xC2, a, b); emit8(c, 4); break;
+        case NUM_OP_LT:  emit_sse(c, 0xF2, 0xC2, a, b); emit8(c, 1); break;
+        case NUM_OP_LTE: emit_sse(c, 0xF2, 0xC2, a, b); emit8(c, 2); break;
+        // a > b is b < a, with the mask computed in b
+        case NUM_OP_GT:  emit_sse(c, 0xF2, 0xC2, b, a); emit8(c, 1); emit_movsd(c, a, b); break;
+        case NUM_OP_GTE: emit_sse(c, 0xF2, 0xC2, b, a); emit8(c, 2); emit_movsd(c, a, b); break;
+        default: break;
+    }
+    emit_const_bits(c, b, ONE_BITS);
+    emit_sse(c, 0x66, 0x54, a, b);  // andpd
+}
+
+static bool compile_func(Compiler *c, Pinch_Func *func, int depth) {
+    const Builtin *builtin = find_builtin(func->name);
+    if (builtin == NULL || func->factors->count != builtin->arity) return false;
+
+    switch (builtin->op) {
+        case NUM_OP_ADD:
+        case NUM_OP_SUB:
+        case NUM_OP_MUL:
+        case NUM_OP_DIV: {
+            if (!compile_args(c, func, depth, 1)) return false;
+            static const uint8_t opcodes[] = {
+                [NUM_OP_ADD] = 0x58, [NUM_OP_SUB] = 0x5C, [NUM_OP_MUL] = 0x59, [NUM_OP_DIV] = 0x5E,
+            };
+            if (builtin->op == NUM_OP_DIV) emit_zero_check(c, depth + 1, depth + 2);
+            emit_sse(c, 0xF2, opcodes[builtin->op], depth, depth + 1);
+            return true;
+        }
+        case NUM_OP_MOD:
+            if (!compile_args(c, func, depth, 1)) return false;
+            emit_zero_check(c, depth + 1, depth + 2);
+            emit_call(c, (void *)fmod, 2, depth);
+            return true;
+        case NUM_OP_POW:
+            if (!compile_args(c, func, depth, 0)) return false;
+            emit_call(c, (void *)pow, 2, depth);
+            return true;
+        case NUM_OP_EQ:
+        case NUM_OP_NEQ:
+        case NUM_OP_GT:
+        case NUM_OP_LT:
+        case NUM_OP_GTE:
+        case NUM_OP_LTE:
+            if (!compile_args(c, func, depth, 0)) return false;
+            emit_compare(c, depth, builtin->op);
+            return true;
+        case NUM_OP_NONE:
+            break;
+    }
+
+    if (builtin->fn == ABS) {
+        if (!compile_args(c, func, depth, 1)) return false;
+        emit_const_bits(c, depth + 1, SIGN_MASK_BITS);
+        emit_sse(c, 0x66, 0x54, depth, depth + 1);  // andpd
+        return true;
+    }
+    if (builtin->fn == SQRT) {
+        if (!compile_args(c, func, depth, 1)) return false;
+        // Deoptimise on a negative operand, which SQRT reports as an error
+        emit_sse(c, 0x66, 0x57, depth + 1, depth + 1);  // xorpd
+        emit_sse(c, 0x66, 0x2E, depth + 1, depth);      // ucomisd
+        emit_deopt(c, JA);
+        emit_sse(c, 0xF2, 0x51, depth, depth);          // sqrtsd
+        return true;
+    }
+    if (builtin->fn == FLOOR || builtin->fn == CEIL || builtin->fn == ROUND) {
+        if (!compile_args(c, func, depth, 0)) return false;
+        void *fn = builtin->fn == FLOOR ? (void *)floor : builtin->fn == CEIL ? (void *)ceil : (void *)round;
+        emit_call(c, fn, 1, depth);
+        return true;
+    }
+    if (builtin->fn == IF) {
+        // Both branches are evaluated, as the interpreter does
+        if (!compile_args(c, func, depth, 1)) return false;
+        emit_const(c, depth + 3, 0.5);
+        emit_sse(c, 0x66, 0x2E, depth, depth + 3);  // ucomisd cond, 0.5
+        emit_movsd(c, depth, depth + 1);
+        int skip = c->length;
+        emit8(c, 0x73);     // jae rel8
+        emit8(c, 0);
+        emit_movsd(c, depth, depth + 2);
+        c->bytes[skip + 1] = (uint8_t)(c->length - (skip + 2));
+        return true;
+    }
+    return false;
+}
+
+// Evaluate a Number expression into xmm(depth)
+static bool compile_expr(Compiler *c, Factor *f, int depth) {
+    if (depth >= JIT_MAX_TEMPS) return false;
+
+    switch (f->type) {
+        case FACTOR_NUM:
+            emit_const(c, depth, f->data.num);
+            return true;
+        case FACTOR_VAR:
+            emit_movsd(c, depth, VAR_REG(var_slot(c->loop, f->data.var)));
+            return true;
+        case FACTOR_FUNC:
+            return compile_func(c, f->data.func, depth);
+        case FACTOR_STR:
+        case FACTOR_JUMP:
+            break;
+    }
+    return false;
+}
+
+static int literal_target(int from, Factor *jump) {
+    return jump->data.jump.type == JUMP_FORWARD ? from + jump->data.jump.lines
+                                                : from - jump->data.jump.lines;
+}
+
+// Every cycle in the loop passes a statement some later statement jumps back
+// to, so checking the budget there is enough
+static bool jumped_back_to(Compiler *c, int target) {
+    for (int s = target; s <= c->tail; s++) {
+        Statement *stmt = c->statements[s];
+        if (stmt->type != PINCH_FUNC_S) continue;
+        Factors *args = stmt->content.pinch_func->factors;
+        for (int i = 0; args != NULL && i < args->count; i++) {
+            if (args->items[i]->type == FACTOR_JUMP && literal_target(s, args->items[i]) == target) return true;
+        }
+    }
+    return false;
+}
+
+static int count_calls(Factors *factors) {
+    int calls = 0;
+    for (int i = 0; factors != NULL && i < factors->count; i++) {
+        Factor *f = factors->items[i];
+        if (f->type == FACTOR_FUNC) calls += 1 + count_calls(f->data.func->factors);
+    }
+    return calls;
+}
+
+// Count the current statement as the interpreter would, once nothing in it
+// can deoptimise any more. Leaves the flags clobbered.
+static void emit_count(Compiler *c, Statement *stmt) {
+    if (!c->counting) return;
+    emit_frame_add(c, (int)offsetof(JitFrame, statements), 1);
+    int calls;
+    if (stmt->type == PINCH_VAR) {
+        calls = count_calls(stmt->content.pinch_var->factors);
+    } else {
+        // Only JUMP and JUMP_IF are compiled, and either always jumps
+        calls = 1 + count_calls(stmt->content.pinch_func->factors);
+        emit_frame_add(c, (int)offsetof(JitFrame, jumps), 1);
+    }
+    if (calls > 0) emit_frame_add(c, (int)offsetof(JitFrame, calls), calls);
+}
+
+static bool compile_statement(Compiler *c, Statement *stmt) {
+    if (stmt->type == PINCH_VAR) {
+        if (!compile_expr(c, stmt->content.pinch_var->factors->items[0], 0)) return false;
+        emit_movsd(c, VAR_REG(var_slot(c->loop, stmt->content.pinch_var->name)), 0);
+        emit_count(c, stmt);
+        return true;
+    }
+    if (stmt->type != PINCH_FUNC_S) return false;
+
+    Pinch_Func *func = stmt->content.pinch_func;
+    Factor **args = func->factors->items;
+    int count = func->factors->count;
+
+    if (strcmp(func->name, "JUMP") == 0 && count == 1 && args[0]->type == FACTOR_JUMP) {
+        emit_count(c, stmt);
+        emit_jump_to(c, JMP, literal_target(c->current, args[0]));
+        return true;
+    }
+    if (strcmp(func->name, "JUMP_IF") == 0 && count == 3 &&
+        args[1]->type == FACTOR_JUMP && args[2]->type == FACTOR_JUMP) {
+        if (!compile_expr(c, args[0], 0)) return false;
+        emit_count(c, stmt);
+        emit_const(c, 1, 0.5);
+        emit_sse(c, 0x66, 0x2E, 0, 1);  // ucomisd cond, 0.5
+        emit_jump_to(c, JAE, literal_target(c->current, args[1]));
+        emit_jump_to(c, JMP, literal_target(c->current, args[2]));
+        return true;
+    }
+    return false;
+}
+
+static void emit_stub(Compiler *c, ExitStub *stub) {
+    for (int i = 0; i < c->loop->var_count; i++) emit_store(c, VAR_REG(i), VAR_DISP(i));
+    emit8(c, 0xC7);     // mov dword [rbx + deopt], imm32
+    emit8(c, 0x83);
+    emit32(c, (uint32_t)offsetof(JitFrame, deopt));
+    emit32(c, stub->deopt ? 1 : 0);
+    emit8(c, 0xB8);     // mov eax, resume
+    emit32(c, (uint32_t)stub->resume);
+    emit8(c, 0x5B);     // pop rbx
+    emit8(c, 0xC3);     // ret
+}
+
+// Copy finished code into its own page, writable only until it is executable
+static jit_fn install_code(Compiler *c, size_t *code_size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = ((size_t)c->length + page - 1) / page * page;
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+
+    memcpy(mem, c->bytes, c->length);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return NULL;
+    }
+    *code_size = size;
+    return (jit_fn)mem;
+}
+
+// Returns NULL if a statement is not supported or the code cannot be installed
+static jit_fn compile_code(JitLoop *loop, Statement **statements, bool counting, size_t *code_size) {
+    int head = loop->head;
+    int tail = loop->tail;
+    Compiler c = {0};
+    c.capacity = 256;
+    c.bytes = xalloc(c.capacity, "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+    c.fixup_capacity = 16;
+    c.fixups = xalloc(c.fixup_capacity * sizeof(Fixup), "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+    c.stub_capacity = 8;
+    c.stubs = xalloc(c.stub_capacity * sizeof(ExitStub), "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+    c.labels = xalloc((tail - head + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+    c.statements = statements;
+    c.head = head;
+    c.tail = tail;
+    c.loop = loop;
+    c.counting = counting;
+
+    // Prologue: push rbx; mov rbx, rdi; load the variables
+    emit8(&c, 0x53);
+    emit8(&c, 0x48);
+    emit8(&c, 0x89);
+    emit8(&c, 0xFB);
+    for (int i = 0; i < loop->var_count; i++) emit_load(&c, VAR_REG(i), VAR_DISP(i));
+
+    bool supported = true;
+    for (int s = head; s <= tail && supported; s++) {
+        c.current = s;
+        c.labels[s - head] = c.length;
+        if (jumped_back_to(&c, s)) emit_budget_check(&c);
+        supported = compile_statement(&c, statements[s]);
+    }
+
+    jit_fn code = NULL;
+    if (supported) {
+        // Falling off the end of the loop continues after it
+        emit_jump_to(&c, JMP, tail + 1);
+
+        int *stub_positions = xalloc((c.stub_count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+        for (int i = 0; i < c.stub_count; i++) {
+            stub_positions[i] = c.length;
+            emit_stub(&c, &c.stubs[i]);
+        }
+        for (int i = 0; i < c.fixup_count; i++) {
+            Fixup *fixup = &c.fixups[i];
+            int target = fixup->to_stub ? stub_positions[fixup->index] : c.labels[fixup->index];
+            int32_t rel = target - (fixup->pos + 4);
+            memcpy(&c.bytes[fixup->pos], &rel, sizeof(rel));
+        }
+        xfree(stub_positions);
+
+        code = install_code(&c, code_size);
+    }
+
+    xfree(c.labels);
+    xfree(c.stubs);
+    xfree(c.fixups);
+    xfree(c.bytes);
+    return code;
+}
+
+static JitLoop *compile_loop(Statement **statements, int head, int tail, bool counting) {
+    JitLoop *loop = xalloc(sizeof(JitLoop), "Interpreter Error: Fail to allocate memory while compiling loop.\n");
+    loop->head = head;
+    loop->tail = tail;
+    loop->var_count = 0;
+    loop->code = NULL;
+    loop->counting_code = NULL;
+
+    // Every variable of the loop gets a register, or the loop is not compiled
+    bool supported = true;
+    for (int s = head; s <= tail && supported; s++) {
+        Statement *stmt = statements[s];
+        if (stmt->type == PINCH_VAR) {
+            supported = add_var(loop, stmt->content.pinch_var->name) &&
+                        collect_vars(loop, stmt->content.pinch_var->factors);
+        } else if (stmt->type == PINCH_FUNC_S) {
+            supported = collect_vars(loop, stmt->content.pinch_func->factors);
+        } else {
+            supported = false;
+        }
+    }
+
+    if (supported && counting) {
+        loop->counting_code = compile_code(loop, statements, true, &loop->counting_code_size);
+    } else if (supported) {
+        loop->code = compile_code(loop, statements, false, &loop->code_size);
+    }
+    if (loop->code == NULL && loop->counting_code == NULL) {
+        xfree(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+// ---------------------------------------------------------
+// RUNTIME
+// ---------------------------------------------------------
+
+JitState *jit_new(Statement **statements, int stmt_count) {
+    JitState *jit = xalloc(sizeof(JitState), "Interpreter Error: Fail to allocate memory for JIT.\n");
+    jit->statements = statements;
+    jit->stmt_count = stmt_count;
+    jit->back_jumps = xalloc((stmt_count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for JIT.\n");
+    jit->rejected = xalloc((stmt_count + 1) * sizeof(bool), "Interpreter Error: Fail to allocate memory for JIT.\n");
+    jit->loops = xalloc((stmt_count + 1) * sizeof(JitLoop*), "Interpreter Error: Fail to allocate memory for JIT.\n");
+    for (int i = 0; i < stmt_count; i++) {
+        jit->back_jumps[i] = 0;
+        jit->rejected[i] = false;
+        jit->loops[i] = NULL;
+    }
+    memset(&jit->stats, 0, sizeof(JitStats));
+    return jit;
+}
+
+void free_jit(JitState *jit) {
+    if (jit == NULL) return;
+    for (int i = 0; i < jit->stmt_count; i++) {
+        JitLoop *loop = jit->loops[i];
+        if (loop != NULL) {
+            if (loop->code != NULL) munmap((void *)loop->code, loop->code_size);
+            if (loop->counting_code != NULL) munmap((void *)loop->counting_code, loop->counting_code_size);
+            xfree(loop);
+        }
+    }
+    xfree(jit->loops);
+    xfree(jit->rejected);
+    xfree(jit->back_jumps);
+    xfree(jit);
+}
+
+static void run_loop(JitState *jit, JitLoop *loop, jit_fn code, MachineState *state) {
+    JitFrame frame;
+    Value *values[JIT_MAX_VARS];
+
+    // Type guard: only enter while every loop variable holds a Number
+    for (int i = 0; i < loop->var_count; i++) {
+        values[i] = (Value*)hashmap_lookup(state->variables, loop->var_names[i]);
+        if (values[i] == NULL || values[i]->type != VALUE_NUM) {
+            jit->stats.deoptimized++;
+            return;
+        }
+        frame.vars[i] = values[i]->data.num;
+    }
+
+    jit->stats.entered++;
+    frame.deopt = 0;
+    frame.budget = JIT_ENTRY_BUDGET;
+    frame.statements = 0;
+    frame.jumps = 0;
+    frame.calls = 0;
+    int resume = code(&frame);
+
+    for (int i = 0; i < loop->var_count; i++) {
+        values[i]->data.num = frame.vars[i];
+    }
+    if (state->counters != NULL) {
+        __atomic_add_fetch(&state->counters->statements, frame.statements, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&state->counters->jumps, frame.jumps, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&state->counters->calls, frame.calls, __ATOMIC_RELAXED);
+    }
+    if (frame.deopt) {
+        jit->stats.deoptimized++;
+    }
+    state->program_counter = resume;
+}
+
+void jit_backward_jump(JitState *jit, MachineState *state, int from) {
+    int head = state->program_counter;
+    if (head < 0 || from >= jit->stmt_count) return;
+
+    bool counting = state->counters != NULL;
+    JitLoop *loop = jit->loops[from];
+    if (loop == NULL) {
+        if (jit->rejected[from] || ++jit->back_jumps[from] < JIT_HOT_THRESHOLD) return;
+
+        loop = compile_loop(jit->statements, head, from, counting);
+        if (loop == NULL) {
+            jit->rejected[from] = true;
+            jit->stats.rejected++;
+            return;
+        }
+        jit->loops[from] = loop;
+        jit->stats.compiled++;
+    }
+
+    // A JUMP_IF can jump back to two different heads; only one is compiled
+    if (loop->head != head) return;
+
+    // The loop compiled, so the other version only fails to install
+    if (counting && loop->counting_code == NULL) {
+        loop->counting_code = compile_code(loop, jit->statements, true, &loop->counting_code_size);
+    } else if (!counting && loop->code == NULL) {
+        loop->code = compile_code(loop, jit->statements, false, &loop->code_size);
+    }
+    jit_fn code = counting ? loop->counting_code : loop->code;
+    if (code != NULL) {
+        run_loop(jit, loop, code, state);
+    }
+}
+
+JitStats jit_stats(JitState *jit) {
+    return jit->stats;
+}
+
+#else
+
+// No native code generation on this platform: the interpreter runs everything
+
+JitState *jit_new(Statement **statements, int stmt_count) {
+    (void)statements;
+    (void)stmt_count;
+    return NULL;
+}
+
+void free_jit(JitState *jit) {
+    (void)jit;
+}
+
+void jit_backward_jump(JitState *jit, MachineState *state, int from) {
+    (void)jit;
+    (void)state;
+    (void)from;
+}
+
+JitStats jit_stats(JitState *jit) {
+    (void)jit;
+    return (JitStats){0, 0, 0, 0};
+}
+
+#endif
+
+void print_jit_stats(JitState *jit) {
+    if (jit == NULL) {
+        fprintf(stderr, "JIT: not available.\n");
+        return;
+    }
+    JitStats stats = jit_stats(jit);
+    fprintf(stderr, "JIT: %d loop(s) compiled, %d rejected, %d native run(s), %d deoptimisation(s).\n",
+            stats.compiled, stats.rejected, stats.entered, stats.deoptimized);
+}
@@ -0,0 +1,37 @@
+// jit.h
+
+#ifndef JIT_H
+#define JIT_H
+
+#include "interpreter.h"
+
+// Backward jumps taken by a statement before its loop is compiled
+#define JIT_HOT_THRESHOLD 64
+
+// Loop iterations native code runs per entry before handing control back to the
+// interpreter, which re-enters it at the next backward jump. Keeps runs
+// interruptible (see interrupt_run) at the cost of one decrement per iteration.
+#define JIT_ENTRY_BUDGET (1 << 20)
+
+typedef struct JitState JitState;
+
+typedef struct {
+    int compiled;       // Loops compiled to native code
+    int rejected;       // Hot loops that use something the compiler does not support
+    int entered;        // Times native code was entered
+    int deoptimized;    // Times native code handed a statement back to the interpreter
+} JitStats;
+
+// Returns NULL when native code generation is unavailable on this platform
+JitState *jit_new(Statement **statements, int stmt_count);
+void free_jit(JitState *jit);
+
+// Called by the main loop after statement from jumped backwards. Counts the
+// jump, compiles the loop once it is hot and runs it natively when possible,
+// leaving program_counter at the next statement for the interpreter.
+void jit_backward_jump(JitState *jit, MachineState *state, int from);
+
+JitStats jit_stats(JitState *jit);
+void print_jit_stats(JitState *jit);
+
+#endif
@@ -171,14 +171,13 @@ consume_name_result consume_var_name(char *input) {
         result = consume_token(TOKEN_SMALL_LETTER_OR_UNDERSCORE, current_input);
 
         if (result.success) {
-            // If var_name exceeds buffer size, exit program
+            // If var_name exceeds buffer size, reject it
             if (var_name_length >= NAME_BUFFER_LENGTH) {
-                fprintf(stderr,
-                        "Interpreter Constraint: Variable name exceeds maximum "
-                        "length of %d characters.\n",
-                        NAME_BUFFER_LENGTH);
+                report_error("Interpreter Constraint: Variable name exceeds maximum "
+                             "length of %d characters.\n",
+                             NAME_BUFFER_LENGTH);
                 xfree(var_name);
-                exit(EXIT_FAILURE);
+                return (consume_name_result){false, NULL, input};
             }
 
             // If successful, add to buffer
@@ -224,14 +223,13 @@ consume_name_result consume_func_name(char *input) {
     while (!reached_end) {
         result = consume_token(TOKEN_BIG_LETTER_OR_UNDERSCORE, current_input);
         if (result.success) {
-            // If func_name exceeds buffer size, exit program
+            // If func_name exceeds buffer size, reject it
             if (func_name_length >= NAME_BUFFER_LENGTH) {
-                fprintf(stderr,
-                        "Interpreter Constraint: Function name exceeds maximum "
-                        "length of %d characters.\n",
-                        NAME_BUFFER_LENGTH);
+                report_error("Interpreter Constraint: Function name exceeds maximum "
+                             "length of %d characters.\n",
+                             NAME_BUFFER_LENGTH);
                 xfree(func_name);
-                exit(EXIT_FAILURE);
+                return (consume_name_result){false, NULL, input};
             }
 
             // If successful, add to buffer
@@ -282,12 +280,11 @@ consume_name_result consume_str_literal(char *input) {
     while (!reached_end) {
         result = consume_token(TOKEN_ASCII_CHAR, current_input);
         if (result.success) {
-            // If str_literal exceeds buffer size, exit program
+            // If str_literal exceeds buffer size, reject it
             if (str_length >= STRING_BUFFER_LENGTH) {
-                fprintf(stderr,
-                        "Interpreter Constraint: String literal exceeds maximum "
-                        "length of %d characters.\n",
-                        STRING_BUFFER_LENGTH);
+                report_error("Interpreter Constraint: String literal exceeds maximum "
+                             "length of %d characters.\n",
+                             STRING_BUFFER_LENGTH);
                 xfree(str_buffer);
                 return (consume_name_result) {false, NULL, input};
             }
@@ -307,10 +304,9 @@ consume_name_result consume_str_literal(char *input) {
         // If successful, advance input (no need to add quoatation to buffer)
         current_input = result.next_input;
     } else {
-        // If unsuccessful, exit program and produce error
-        fprintf(stderr,
-                "Syntax Error: Unclosed quotation for string literal %s.\n",
-                str_buffer);
+        // If unsuccessful, produce error
+        report_error("Syntax Error: Unclosed quotation for string literal %s.\n",
+                     str_buffer);
         xfree(str_buffer);
         return (consume_name_result) {false, NULL, input};
     }
@@ -370,14 +366,13 @@ consume_num_result consume_num_literal(char *input) {
         }
 
         if (result.success) {
-            // If num_buffer length exceeds buffer size, exit program
+            // If num_buffer length exceeds buffer size, reject it
             if (num_length >= NAME_BUFFER_LENGTH) {
-                fprintf(stderr,
-                        "Interpreter Constraint: Number literal exceeds maximum "
-                        "length of %d characters.\n",
-                        NAME_BUFFER_LENGTH);
+                report_error("Interpreter Constraint: Number literal exceeds maximum "
+                             "length of %d characters.\n",
+                             NAME_BUFFER_LENGTH);
                 xfree(num_buffer);
-                exit(EXIT_FAILURE);
+                return (consume_num_result){false, 0, input};
             }
 
             // If successful, add to buffer
@@ -516,12 +511,11 @@ consume_int_result consume_integer(char *input) {
 
         if (result.success) {
             if (num_length >= NAME_BUFFER_LENGTH) {
-                fprintf(stderr,
-                        "Interpreter Constraint: Number literal exceeds maximum "
-                        "length of %d characters.\n",
-                        NAME_BUFFER_LENGTH);
+                report_error("Interpreter Constraint: Number literal exceeds maximum "
+                             "length of %d characters.\n",
+                             NAME_BUFFER_LENGTH);
                 xfree(num_buffer);
-                exit(EXIT_FAILURE);
+                return (consume_int_result){false, 0, input};
             }
 
             // If successful, add to buffer
@@ -595,3 +589,13 @@ consume_jump_result consume_jump_literal(char *input) {
         return (consume_jump_result){false, JUMP_NOT_FOUND, 0, input}; 
     }
 }
+
+// <var_name> ::= <small_letter> (<small_letter> | '_')*
+bool is_var_name(const char *name) {
+    if (name[0] < 'a' || name[0] > 'z') return false;
+    int length = 1;
+    for (const char *c = name + 1; *c != '\0'; c++, length++) {
+        if ((*c < 'a' || *c > 'z') && *c != '_') return false;
+    }
+    return length <= NAME_BUFFER_LENGTH;
+}
@@ -82,4 +82,7 @@ consume_arrow_result consume_right_arrow(char *input);
 consume_int_result consume_integer(char *input);
 consume_jump_result consume_jump_literal(char *input);
 
+// Whether a whole string is a variable name the lexer would accept
+bool is_var_name(const char *name);
+
 #endif
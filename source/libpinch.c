@@ -0,0 +1,254 @@
+// Logic for the embedding API
+
+#define _GNU_SOURCE // fopencookie
+
+#include "libpinch.h"
+#include "engine.h"
+#include "metrics.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct PinchProgram {
+    Program *program;
+};
+
+typedef struct {
+    pinch_write_fn write;
+    void *context;
+} Sink;
+
+struct PinchSnapshot {
+    Snapshot *snapshot;
+};
+
+struct PinchInstance {
+    const PinchProgram *source;
+    Program *program;           // Private copy, rewritten by the interpreter as it runs
+    PreparedProgram *prepared;
+    MachineState *state;
+    Sink output;
+    Sink errors;
+};
+
+// ---------------------------------------------------------
+// COMPILE
+// ---------------------------------------------------------
+
+// Messages of the last failed compile, per thread like every other error stream
+static _Thread_local char *compile_errors = NULL;
+
+PinchProgram *pinch_compile(const char *source) {
+    free(compile_errors);   // Allocated by open_memstream
+    compile_errors = NULL;
+    size_t length = 0;
+    FILE *errors = open_memstream(&compile_errors, &length);
+    FILE *previous = redirect_errors(errors);
+    Program *program = load_program(source);
+    redirect_errors(previous);
+    fclose(errors);
+
+    if (program == NULL) return NULL;
+    PinchProgram *compiled = xalloc(sizeof(PinchProgram), "Interpreter Error: Fail to allocate memory for program.\n");
+    compiled->program = program;
+    return compiled;
+}
+
+void pinch_program_free(PinchProgram *program) {
+    if (program == NULL) return;
+    free_program(program->program);
+    xfree(program);
+}
+
+const char *pinch_error(void) {
+    return compile_errors != NULL ? compile_errors : "";
+}
+
+// ---------------------------------------------------------
+// INSTANCES
+// ---------------------------------------------------------
+
+static ssize_t write_to_sink(void *cookie, const char *text, size_t length) {
+    Sink *sink = (Sink*)cookie;
+    sink->write(sink->context, text, length);
+    return (ssize_t)length;
+}
+
+// A line-buffered stream that hands every line to the sink
+static FILE *open_sink(Sink *sink) {
+    cookie_io_functions_t functions = {NULL, write_to_sink, NULL, NULL};
+    FILE *stream = fopencookie(sink, "w", functions);
+    if (stream == NULL) {
+        alloc_failed("Interpreter Error: Fail to allocate memory for output stream.\n");
+    }
+    setvbuf(stream, NULL, _IOLBF, 0);
+    return stream;
+}
+
+PinchInstance *pinch_instance_new(const PinchProgram *program) {
+    PinchInstance *instance = xalloc(sizeof(PinchInstance), "Interpreter Error: Fail to allocate memory for instance.\n");
+    EngineOptions options = {0};
+    instance->source = program;
+    instance->program = copy_program(program->program);
+    instance->prepared = prepare_program(default_engine(), instance->program, &options);
+    instance->state = new_machine_state();
+    instance->output = (Sink){NULL, NULL};
+    instance->errors = (Sink){NULL, NULL};
+    return instance;
+}
+
+static void close_sink(FILE **stream) {
+    if (*stream != NULL) {
+        fclose(*stream);
+        *stream = NULL;
+    }
+}
+
+void pinch_instance_free(PinchInstance *instance) {
+    if (instance == NULL) return;
+    close_sink(&instance->state->output);
+    close_sink(&instance->state->errors);
+    free_state(instance->state);
+    free_prepared(instance->prepared);
+    free_program(instance->program);
+    xfree(instance);
+}
+
+void pinch_set_output(PinchInstance *instance, pinch_write_fn write, void *context) {
+    close_sink(&instance->state->output);
+    instance->output = (Sink){write, context};
+    if (write != NULL) instance->state->output = open_sink(&instance->output);
+}
+
+void pinch_set_errors(PinchInstance *instance, pinch_write_fn write, void *context) {
+    close_sink(&instance->state->errors);
+    instance->errors = (Sink){write, context};
+    if (write != NULL) instance->state->errors = open_sink(&instance->errors);
+}
+
+void pinch_instance_reset(PinchInstance *instance) {
+    reset_machine_state(instance->state);
+}
+
+// ---------------------------------------------------------
+// VARIABLES AND RUNS
+// ---------------------------------------------------------
+
+bool pinch_set_number(PinchInstance *instance, const char *name, double value) {
+    if (!is_var_name(name)) return false;
+    assign_variable(instance->state, name, value_from_num(value));
+    return true;
+}
+
+bool pinch_set_text(PinchInstance *instance, const char *name, const char *value) {
+    if (!is_var_name(name)) return false;
+    assign_variable(instance->state, name, value_from_str((char*)value));
+    return true;
+}
+
+bool pinch_run(PinchInstance *instance) {
+    MachineState *state = instance->state;
+    state->program_counter = 0;
+    bool success = run_program(instance->prepared, state);
+    if (!success && state->program_counter >= 0 && state->program_counter < instance->program->stmt_count) {
+        FILE *previous = redirect_errors(state->errors);
+        report_error("Execution halted at statement %d.\n", instance->program->statements[state->program_counter]->number);
+        redirect_errors(previous);
+    }
+    if (state->output != NULL) fflush(state->output);
+    if (state->errors != NULL) fflush(state->errors);
+    return success;
+}
+
+static Value *lookup(PinchInstance *instance, const char *name) {
+    return (Value*)hashmap_lookup(instance->state->variables, (void*)name);
+}
+
+PinchType pinch_get_type(PinchInstance *instance, const char *name) {
+    Value *value = lookup(instance, name);
+    if (value == NULL) return PINCH_UNDEFINED;
+    switch (value->type) {
+        case VALUE_NUM:
+            return PINCH_NUMBER;
+        case VALUE_STR:
+            return PINCH_TEXT;
+        case VALUE_JUMP:
+            return PINCH_JUMP;
+        default:
+            return PINCH_UNDEFINED;
+    }
+}
+
+bool pinch_get_number(PinchInstance *instance, const char *name, double *value) {
+    Value *found = lookup(instance, name);
+    if (found == NULL || found->type != VALUE_NUM) return false;
+    *value = found->data.num;
+    return true;
+}
+
+const char *pinch_get_text(PinchInstance *instance, const char *name) {
+    Value *found = lookup(instance, name);
+    if (found == NULL || found->type != VALUE_STR) return NULL;
+    return found->data.str;
+}
+
+// ---------------------------------------------------------
+// METRICS
+// ---------------------------------------------------------
+
+_Static_assert(PINCH_METRICS_BUCKETS == METRICS_BUCKETS, "Metric histograms differ in size.");
+
+void pinch_enable_metrics(PinchInstance *instance, bool cycle_counter) {
+    if (instance->state->metrics != NULL) return;
+    instance->state->metrics = metrics_new(cycle_counter ? METRICS_CLOCK_CYCLES : METRICS_CLOCK_MONOTONIC);
+}
+
+int pinch_metrics(PinchInstance *instance, PinchMetric *metrics, int capacity) {
+    if (instance->state->metrics == NULL) return 0;
+    int called = 0;
+    for (int i = 0; i < metrics_count(); i++) {
+        BuiltinMetric metric = metrics_at(instance->state->metrics, i);
+        if (metric.calls == 0) continue;
+        if (called < capacity) {
+            PinchMetric *to = &metrics[called];
+            to->name = metric.name;
+            to->calls = metric.calls;
+            to->failures = metric.failures;
+            to->total_ns = metric.total_ns;
+            memcpy(to->histogram, metric.buckets, sizeof(to->histogram));
+        }
+        called++;
+    }
+    return called;
+}
+
+// ---------------------------------------------------------
+// SNAPSHOTS
+// ---------------------------------------------------------
+
+PinchSnapshot *pinch_snapshot(PinchInstance *instance) {
+    PinchSnapshot *snapshot = xalloc(sizeof(PinchSnapshot), "Interpreter Error: Fail to allocate memory for snapshot.\n");
+    snapshot->snapshot = snapshot_state(instance->state);
+    return snapshot;
+}
+
+void pinch_restore(PinchInstance *instance, const PinchSnapshot *snapshot) {
+    restore_state(instance->state, snapshot->snapshot);
+}
+
+void pinch_snapshot_free(PinchSnapshot *snapshot) {
+    if (snapshot == NULL) return;
+    free_snapshot(snapshot->snapshot);
+    xfree(snapshot);
+}
+
+PinchInstance *pinch_instance_fork(PinchInstance *instance) {
+    PinchInstance *fork = pinch_instance_new(instance->source);
+    free_state(fork->state);
+    fork->state = fork_state(instance->state);
+    // The streams belong to the original instance
+    fork->state->output = NULL;
+    fork->state->errors = NULL;
+    return fork;
+}
@@ -0,0 +1,94 @@
+// libpinch.h
+//
+// Embedding API, built as output/libpinch.a and output/libpinch.so by
+// "make lib". A program is compiled once and can then be run any number of
+// times without touching the parser. A compiled program never changes, so it
+// may be shared by any number of threads. An instance holds the variables of
+// one evaluation and must only be used by one thread at a time. Compiling and
+// running fail cleanly when memory runs out; the other calls abort.
+
+#ifndef LIBPINCH_H
+#define LIBPINCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct PinchProgram PinchProgram;
+typedef struct PinchInstance PinchInstance;
+
+typedef enum {
+    PINCH_UNDEFINED,
+    PINCH_NUMBER,
+    PINCH_TEXT,
+    PINCH_JUMP
+} PinchType;
+
+// Receives printed values and error messages, one line at a time
+typedef void (*pinch_write_fn)(void *context, const char *text, size_t length);
+
+// Parse a program. Returns NULL if it has a syntax error, in which case
+// pinch_error() holds the messages.
+PinchProgram *pinch_compile(const char *source);
+void pinch_program_free(PinchProgram *program);
+
+// Messages of the last failed pinch_compile on the calling thread
+const char *pinch_error(void);
+
+// An instance starts with no variables. Output goes to stdout and errors to
+// stderr until callbacks are set; a NULL callback restores the default.
+PinchInstance *pinch_instance_new(const PinchProgram *program);
+void pinch_instance_free(PinchInstance *instance);
+void pinch_set_output(PinchInstance *instance, pinch_write_fn write, void *context);
+void pinch_set_errors(PinchInstance *instance, pinch_write_fn write, void *context);
+
+// Forget every variable and restart RAND, keeping the compiled code and the
+// memory of the variable table for the next evaluation
+void pinch_instance_reset(PinchInstance *instance);
+
+// Give a variable a value before a run. Returns false if the name is not a
+// valid variable name.
+bool pinch_set_number(PinchInstance *instance, const char *name, double value);
+bool pinch_set_text(PinchInstance *instance, const char *name, const char *value);
+
+// Run the program from its first statement on the current variables.
+// Returns false if a statement failed; its error went to the error callback.
+bool pinch_run(PinchInstance *instance);
+
+// Read a variable after a run. Text stays valid until the variable changes.
+PinchType pinch_get_type(PinchInstance *instance, const char *name);
+bool pinch_get_number(PinchInstance *instance, const char *name, double *value);
+const char *pinch_get_text(PinchInstance *instance, const char *name);
+
+// Latency buckets of a builtin: histogram[i] counts calls that took from 2^i
+// to 2^(i+1) nanoseconds
+#define PINCH_METRICS_BUCKETS 32
+
+typedef struct {
+    const char *name;
+    long calls;
+    long failures;          // Calls that reported an error, bad arguments included
+    unsigned long long total_ns;
+    long histogram[PINCH_METRICS_BUCKETS];
+} PinchMetric;
+
+// Count and time the builtin calls of every later run, with the processor's
+// cycle counter if asked and available. Counts add up across runs and resets.
+void pinch_enable_metrics(PinchInstance *instance, bool cycle_counter);
+
+// Copy the metrics of up to capacity builtins that have been called. Returns
+// the number of builtins called, which may be more than capacity.
+int pinch_metrics(PinchInstance *instance, PinchMetric *metrics, int capacity);
+
+// A snapshot holds the variables and RAND state of an instance and can be
+// restored into any instance of any program, any number of times. Text is
+// shared rather than copied, so both cost one step per variable.
+typedef struct PinchSnapshot PinchSnapshot;
+PinchSnapshot *pinch_snapshot(PinchInstance *instance);
+void pinch_restore(PinchInstance *instance, const PinchSnapshot *snapshot);
+void pinch_snapshot_free(PinchSnapshot *snapshot);
+
+// A new instance of the same program starting from the variables and RAND
+// state of another. Output and error callbacks are not carried over.
+PinchInstance *pinch_instance_fork(PinchInstance *instance);
+
+#endif
@@ -0,0 +1,199 @@
+// Logic for memoising calls to pure builtins
+
+#include "memo.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const Builtin *builtin;     // NULL while the slot is empty
+    uint64_t hash;
+    int count;
+    Value **args;               // Owned copies of the arguments
+    Value *result;
+    size_t bytes;
+} MemoEntry;
+
+struct MemoCache {
+    int capacity;               // Power of two
+    MemoEntry *slots;
+    MemoStats stats;
+};
+
+MemoCache *memo_new(int entries) {
+    int capacity = 1;
+    while (capacity < entries) capacity *= 2;
+
+    MemoCache *memo = xalloc(sizeof(MemoCache), "Interpreter Error: Fail to allocate memory for memo cache.\n");
+    memo->capacity = capacity;
+    memo->slots = xalloc(capacity * sizeof(MemoEntry), "Interpreter Error: Fail to allocate memory for memo cache.\n");
+    memset(memo->slots, 0, capacity * sizeof(MemoEntry));
+    memset(&memo->stats, 0, sizeof(MemoStats));
+    return memo;
+}
+
+static void clear_entry(MemoEntry *entry) {
+    if (entry->builtin == NULL) return;
+    for (int i = 0; i < entry->count; i++) {
+        free_value(entry->args[i]);
+    }
+    if (entry->args != NULL) xfree(entry->args);
+    free_value(entry->result);
+    memset(entry, 0, sizeof(MemoEntry));
+}
+
+void free_memo(MemoCache *memo) {
+    if (memo == NULL) return;
+    for (int i = 0; i < memo->capacity; i++) {
+        clear_entry(&memo->slots[i]);
+    }
+    xfree(memo->slots);
+    xfree(memo);
+}
+
+// ---------------------------------------------------------
+// HASHING
+// ---------------------------------------------------------
+
+#define HASH_SEED 0x9E3779B97F4A7C15ULL
+#define HASH_MULTIPLIER 0xFF51AFD7ED558CCDULL
+
+static uint64_t mix(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * HASH_MULTIPLIER;
+    return hash ^ (hash >> 32);
+}
+
+// Consume eight bytes per step so hashing long Text stays cheap
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = mix(hash, word);
+        bytes += 8;
+        length -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, length);
+    return mix(hash, tail ^ ((uint64_t)length << 56));
+}
+
+// Hash the argument contents, so equal Text in different Values collides
+static uint64_t hash_call(const Builtin *builtin, Value **args, int count, size_t *bytes) {
+    uint64_t hash = hash_bytes(HASH_SEED, &builtin, sizeof(builtin));
+    *bytes = 0;
+    for (int i = 0; i < count; i++) {
+        Value *arg = args[i];
+        hash = hash_bytes(hash, &arg->type, sizeof(arg->type));
+        switch (arg->type) {
+            case VALUE_NUM:
+                hash = hash_bytes(hash, &arg->data.num, sizeof(double));
+                break;
+            case VALUE_STR: {
+                size_t length = strlen(arg->data.str);
+                hash = hash_bytes(hash, arg->data.str, length);
+                *bytes += length + 1;
+                break;
+            }
+            case VALUE_JUMP:
+                hash = hash_bytes(hash, &arg->data.jump.lines, sizeof(int));
+                hash = hash_bytes(hash, &arg->data.jump.type, sizeof(jump_type));
+                break;
+            default:
+                break;
+        }
+        *bytes += sizeof(Value);
+    }
+    return hash;
+}
+
+static bool same_value(Value *a, Value *b) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case VALUE_NUM:
+            // Compare bits: -0 and 0 differ for some builtins, NaN equals itself
+            return memcmp(&a->data.num, &b->data.num, sizeof(double)) == 0;
+        case VALUE_STR:
+            return strcmp(a->data.str, b->data.str) == 0;
+        case VALUE_JUMP:
+            return a->data.jump.lines == b->data.jump.lines && a->data.jump.type == b->data.jump.type;
+        default:
+            return true;
+    }
+}
+
+static bool entry_matches(MemoEntry *entry, const Builtin *builtin, uint64_t hash, Value **args, int count) {
+    if (entry->builtin != builtin || entry->hash != hash || entry->count != count) return false;
+    for (int i = 0; i < count; i++) {
+        if (!same_value(entry->args[i], args[i])) return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------
+// LOOKUP
+// ---------------------------------------------------------
+
+Value *memo_call(MemoCache *memo, const Builtin *builtin, Value **args, int count) {
+    if (memo == NULL || !builtin->pure) {
+        return builtin->fn(args, count);
+    }
+
+    size_t bytes;
+    uint64_t hash = hash_call(builtin, args, count, &bytes);
+    MemoEntry *entry = &memo->slots[hash & (uint64_t)(memo->capacity - 1)];
+
+    if (entry_matches(entry, builtin, hash, args, count)) {
+        memo->stats.hits++;
+        return copy_value(entry->result);
+    }
+
+    memo->stats.misses++;
+    Value *result = builtin->fn(args, count);
+    if (result->type == VALUE_ERROR) return result;
+
+    if (result->type == VALUE_STR) bytes += strlen(result->data.str) + 1;
+    if (bytes > MEMO_MAX_ENTRY_BYTES) {
+        memo->stats.skipped++;
+        return result;
+    }
+
+    if (entry->builtin != NULL) {
+        memo->stats.evictions++;
+        clear_entry(entry);
+    }
+    entry->builtin = builtin;
+    entry->hash = hash;
+    entry->count = count;
+    entry->args = NULL;
+    if (count > 0) {
+        entry->args = xalloc(count * sizeof(Value*), "Interpreter Error: Fail to allocate memory for memo cache.\n");
+        for (int i = 0; i < count; i++) {
+            entry->args[i] = copy_value(args[i]);
+        }
+    }
+    entry->result = copy_value(result);
+    entry->bytes = bytes;
+    return result;
+}
+
+MemoStats memo_stats(MemoCache *memo) {
+    return memo->stats;
+}
+
+void print_memo_stats(MemoCache *memo) {
+    if (memo == NULL) return;
+
+    long entries = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < memo->capacity; i++) {
+        if (memo->slots[i].builtin != NULL) {
+            entries++;
+            bytes += memo->slots[i].bytes;
+        }
+    }
+    MemoStats stats = memo->stats;
+    fprintf(stderr, "Memo: %ld hit(s), %ld miss(es), %ld eviction(s), %ld too large to cache.\n",
+            stats.hits, stats.misses, stats.evictions, stats.skipped);
+    fprintf(stderr, "Memo: %ld of %d entries in use, %zu bytes.\n", entries, memo->capacity, bytes);
+}
@@ -0,0 +1,38 @@
+// memo.h
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "functions.h"
+
+// Default number of cached calls for --memo without a size
+#define MEMO_DEFAULT_ENTRIES 1024
+
+// Calls whose arguments and result take more bytes than this are not cached
+#define MEMO_MAX_ENTRY_BYTES (64 * 1024)
+
+typedef struct {
+    long hits;
+    long misses;
+    long evictions;     // Entries replaced by a call that hashed to the same slot
+    long skipped;       // Calls too large to cache
+} MemoStats;
+
+typedef struct MemoCache MemoCache;
+
+// A direct-mapped cache of builtin results keyed on (builtin, argument values).
+// The number of entries is rounded up to a power of two.
+MemoCache *memo_new(int entries);
+void free_memo(MemoCache *memo);
+
+// Call a builtin, answering from the cache when it is pure and the same
+// arguments have been seen before. Only successful results are cached, so
+// errors are still reported by the builtin on every call.
+Value *memo_call(MemoCache *memo, const Builtin *builtin, Value **args, int count);
+
+MemoStats memo_stats(MemoCache *memo);
+void print_memo_stats(MemoCache *memo);
+
+#endif
@@ -0,0 +1,220 @@
+// Logic for counting and timing builtin calls
+
+#include "metrics.h"
+#include "functions.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// How long the time stamp counter is measured against the monotonic clock
+#define METRICS_CALIBRATION_NS 5000000
+
+// Counters are updated with relaxed atomics, so the per-call cost is a clock
+// read and two or three uncontended additions
+typedef struct {
+    long failures;
+    uint64_t total_ns;
+    long buckets[METRICS_BUCKETS];
+} Counters;
+
+struct BuiltinMetrics {
+    MetricsClock clock;
+    double ns_per_tick;     // Scale of the cycle clock, 1 for the monotonic one
+    Counters *counters;     // builtin_count() + 2 entries: every builtin, JUMP, JUMP_IF
+};
+
+static uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Time stamp counter ticks per nanosecond, 0 if there is no counter
+static double calibrate_cycles() {
+#if defined(__x86_64__)
+    uint64_t start_ns = monotonic_ns();
+    uint64_t start_ticks = __rdtsc();
+    uint64_t end_ns;
+    do {
+        end_ns = monotonic_ns();
+    } while (end_ns - start_ns < METRICS_CALIBRATION_NS);
+    uint64_t ticks = __rdtsc() - start_ticks;
+    return ticks > 0 ? (double)(end_ns - start_ns) / ticks : 0;
+#else
+    return 0;
+#endif
+}
+
+BuiltinMetrics *metrics_new(MetricsClock clock) {
+    BuiltinMetrics *metrics = xalloc(sizeof(BuiltinMetrics), "Interpreter Error: Fail to allocate memory for metrics.\n");
+    metrics->clock = METRICS_CLOCK_MONOTONIC;
+    metrics->ns_per_tick = 1;
+    if (clock == METRICS_CLOCK_CYCLES) {
+        double ns_per_tick = calibrate_cycles();
+        if (ns_per_tick > 0) {
+            metrics->clock = METRICS_CLOCK_CYCLES;
+            metrics->ns_per_tick = ns_per_tick;
+        }
+    }
+    size_t size = metrics_count() * sizeof(Counters);
+    metrics->counters = xalloc(size, "Interpreter Error: Fail to allocate memory for metrics.\n");
+    memset(metrics->counters, 0, size);
+    return metrics;
+}
+
+void free_metrics(BuiltinMetrics *metrics) {
+    if (metrics == NULL) return;
+    xfree(metrics->counters);
+    xfree(metrics);
+}
+
+MetricsClock metrics_clock(BuiltinMetrics *metrics) {
+    return metrics->clock;
+}
+
+// ---------------------------------------------------------
+// RECORDING
+// ---------------------------------------------------------
+
+uint64_t metrics_now(BuiltinMetrics *metrics) {
+#if defined(__x86_64__)
+    if (metrics->clock == METRICS_CLOCK_CYCLES) return __rdtsc();
+#else
+    (void)metrics;
+#endif
+    return monotonic_ns();
+}
+
+static int bucket_of(uint64_t ns) {
+    if (ns == 0) return 0;
+    int bucket = 63 - __builtin_clzll(ns);
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+int metrics_index(Pinch_Func *func) {
+    switch (func->quick) {
+        case QUICK_JUMP:
+            return builtin_count();
+        case QUICK_JUMP_IF:
+            return builtin_count() + 1;
+        default:
+            return func->builtin != NULL ? (int)(func->builtin - builtin_at(0)) : -1;
+    }
+}
+
+void metrics_record(BuiltinMetrics *metrics, Pinch_Func *func, uint64_t start, bool failed) {
+    uint64_t end = metrics_now(metrics);
+    int index = metrics_index(func);
+    if (index < 0) return;
+
+    uint64_t ns = metrics->clock == METRICS_CLOCK_CYCLES
+                      ? (uint64_t)((end - start) * metrics->ns_per_tick)
+                      : end - start;
+    Counters *counters = &metrics->counters[index];
+    __atomic_add_fetch(&counters->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters->buckets[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+    if (failed) {
+        __atomic_add_fetch(&counters->failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// ---------------------------------------------------------
+// READING
+// ---------------------------------------------------------
+
+int metrics_count() {
+    return builtin_count() + 2;
+}
+
+const char *metrics_name(int index) {
+    int builtins = builtin_count();
+    return index < builtins ? builtin_at(index)->name : index == builtins ? "JUMP" : "JUMP_IF";
+}
+
+BuiltinMetric metrics_at(BuiltinMetrics *metrics, int index) {
+    BuiltinMetric metric;
+    metric.name = metrics_name(index);
+    Counters *counters = &metrics->counters[index];
+    metric.calls = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        metric.buckets[i] = __atomic_load_n(&counters->buckets[i], __ATOMIC_RELAXED);
+        metric.calls += metric.buckets[i];
+    }
+    metric.failures = __atomic_load_n(&counters->failures, __ATOMIC_RELAXED);
+    metric.total_ns = __atomic_load_n(&counters->total_ns, __ATOMIC_RELAXED);
+    return metric;
+}
+
+// Upper bound of the bucket holding the given fraction of the calls
+static uint64_t percentile_ns(BuiltinMetric *metric, double fraction) {
+    long wanted = (long)(fraction * metric->calls);
+    long seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += metric->buckets[i];
+        if (seen > wanted) return 2ULL << i;
+    }
+    return 2ULL << (METRICS_BUCKETS - 1);
+}
+
+static int compare_total(const void *a, const void *b) {
+    const BuiltinMetric *x = (const BuiltinMetric*)a;
+    const BuiltinMetric *y = (const BuiltinMetric*)b;
+    if (x->total_ns != y->total_ns) return x->total_ns < y->total_ns ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+static void print_table(FILE *out, const char *clock, BuiltinMetric *called, int count) {
+    fprintf(out, "Metrics: %d builtin(s) called, timed with the %s clock.\n", count, clock);
+    fprintf(out, "%-10s %10s %8s %12s %10s %10s %10s\n",
+            "builtin", "calls", "failed", "total (ms)", "mean (ns)", "p50 (ns)", "p99 (ns)");
+    for (int i = 0; i < count; i++) {
+        BuiltinMetric *metric = &called[i];
+        fprintf(out, "%-10s %10ld %8ld %12.3f %10.0f %10llu %10llu\n", metric->name, metric->calls,
+                metric->failures, metric->total_ns / 1e6, (double)metric->total_ns / metric->calls,
+                (unsigned long long)percentile_ns(metric, 0.50), (unsigned long long)percentile_ns(metric, 0.99));
+    }
+}
+
+// Histograms list the buckets that were hit by their upper bound
+static void print_json(FILE *out, const char *clock, BuiltinMetric *called, int count) {
+    fprintf(out, "{\"clock\": \"%s\", \"builtins\": [", clock);
+    for (int i = 0; i < count; i++) {
+        BuiltinMetric *metric = &called[i];
+        fprintf(out, "%s\n  {\"name\": \"%s\", \"calls\": %ld, \"failures\": %ld, \"total_ns\": %llu, \"histogram\": [",
+                i > 0 ? "," : "", metric->name, metric->calls, metric->failures, (unsigned long long)metric->total_ns);
+        bool first = true;
+        for (int j = 0; j < METRICS_BUCKETS; j++) {
+            if (metric->buckets[j] == 0) continue;
+            fprintf(out, "%s{\"below_ns\": %llu, \"calls\": %ld}", first ? "" : ", ",
+                    (unsigned long long)(2ULL << j), metric->buckets[j]);
+            first = false;
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "%s]}\n", count > 0 ? "\n" : "");
+}
+
+void print_metrics(FILE *out, BuiltinMetrics *metrics, bool json) {
+    if (metrics == NULL) return;
+
+    BuiltinMetric *called = xalloc(metrics_count() * sizeof(BuiltinMetric), "Interpreter Error: Fail to allocate memory for metrics.\n");
+    int count = 0;
+    for (int i = 0; i < metrics_count(); i++) {
+        BuiltinMetric metric = metrics_at(metrics, i);
+        if (metric.calls > 0) called[count++] = metric;
+    }
+    qsort(called, count, sizeof(BuiltinMetric), compare_total);
+
+    const char *clock = metrics->clock == METRICS_CLOCK_CYCLES ? "cycle" : "monotonic";
+    if (json) {
+        print_json(out, clock, called, count);
+    } else {
+        print_table(out, clock, called, count);
+    }
+    xfree(called);
+}
@@ -0,0 +1,55 @@
+// metrics.h
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "parser.h"
+
+// Latency buckets of a builtin: bucket i counts calls that took from 2^i to
+// 2^(i+1) nanoseconds, the first bucket also those under a nanosecond and
+// the last one everything slower
+#define METRICS_BUCKETS 32
+
+typedef enum {
+    METRICS_CLOCK_MONOTONIC,    // clock_gettime, exact but a few dozen nanoseconds per read
+    METRICS_CLOCK_CYCLES        // Time stamp counter scaled to nanoseconds, x86-64 only
+} MetricsClock;
+
+typedef struct {
+    const char *name;
+    long calls;
+    long failures;          // Calls that reported an error, bad arguments included
+    uint64_t total_ns;
+    long buckets[METRICS_BUCKETS];
+} BuiltinMetric;
+
+typedef struct BuiltinMetrics BuiltinMetrics;
+
+// Counters for every builtin plus JUMP and JUMP_IF. The cycle clock falls
+// back to the monotonic one where there is no usable time stamp counter.
+BuiltinMetrics *metrics_new(MetricsClock clock);
+void free_metrics(BuiltinMetrics *metrics);
+MetricsClock metrics_clock(BuiltinMetrics *metrics);
+
+// Time one call: take metrics_now() before dispatching it and hand it to
+// metrics_record afterwards. Calls may be recorded from several threads at
+// once, as the parallel engine does for one state.
+uint64_t metrics_now(BuiltinMetrics *metrics);
+void metrics_record(BuiltinMetrics *metrics, Pinch_Func *func, uint64_t start, bool failed);
+
+// Counters by position, one per builtin, JUMP and JUMP_IF last
+int metrics_count();
+BuiltinMetric metrics_at(BuiltinMetrics *metrics, int index);
+
+// Position of the function a call resolved to, -1 for unknown names, and the
+// name at a position
+int metrics_index(Pinch_Func *func);
+const char *metrics_name(int index);
+
+// Builtins that were called, by total time, as a table or as a JSON object
+void print_metrics(FILE *out, BuiltinMetrics *metrics, bool json);
+
+#endif
@@ -0,0 +1,505 @@
+// Program optimisation passes run between parsing and execution
+
+#include "optimizer.h"
+#include "analysis.h"
+#include "util.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *rewrite_names[REWRITE_KIND_COUNT] = {
+    [REWRITE_POW_SQUARE] = "POW x 2 -> MUL x x",
+    [REWRITE_POW_ONE] = "POW x 1 -> x",
+    [REWRITE_DIV_RECIPROCAL] = "DIV x c -> MUL x 1/c",
+    [REWRITE_MUL_ONE] = "MUL x 1 -> x",
+    [REWRITE_SUB_ZERO] = "SUB x 0 -> x",
+    [REWRITE_SQRT_SQUARE] = "SQRT (MUL x x) -> ABS x",
+};
+
+// ---------------------------------------------------------
+// ALGEBRAIC SIMPLIFICATION
+// ---------------------------------------------------------
+
+// Every rewrite below drops or renames a call, so it also drops that call's
+// type check. Rewrites therefore only fire when the operands are proven to
+// be Numbers, which leaves division by zero as the only remaining runtime
+// error and that is never rewritten away.
+typedef struct {
+    VarTable *vars;
+    ValueType *var_types;
+    OptimizerReport *report;
+} SimplifyContext;
+
+static bool is_num_literal(Factor *f, double num) {
+    return f->type == FACTOR_NUM && f->data.num == num;
+}
+
+// Calls that return nothing and variables that are never assigned are
+// VALUE_NONE; reading them is an error, so they are not Numbers either
+static bool is_numeric(Factor *f, SimplifyContext *ctx) {
+    return infer_factor_type(f, ctx->vars, ctx->var_types) == VALUE_NUM;
+}
+
+// Variables and literals can be evaluated twice without changing the result
+static bool is_duplicable(Factor *f) {
+    return f->type == FACTOR_VAR || f->type == FACTOR_NUM;
+}
+
+static bool same_duplicable(Factor *a, Factor *b) {
+    if (a->type != b->type) return false;
+    if (a->type == FACTOR_VAR) return strcmp(a->data.var, b->data.var) == 0;
+    if (a->type == FACTOR_NUM) return a->data.num == b->data.num;
+    return false;
+}
+
+static Factor *copy_duplicable(Factor *f) {
+    Factor *copy = xalloc(sizeof(Factor), "Interpreter Error: Fail to allocate memory while optimising factor\n");
+    copy->type = f->type;
+    if (f->type == FACTOR_VAR) {
+        copy->data.var = xalloc(strlen(f->data.var) + 1, "Interpreter Error: Fail to allocate memory while optimising factor\n");
+        strcpy(copy->data.var, f->data.var);
+    } else {
+        copy->data.num = f->data.num;
+    }
+    return copy;
+}
+
+static void rename_func(Pinch_Func *func, char *name) {
+    xfree(func->name);
+    func->name = xalloc(strlen(name) + 1, "Interpreter Error: Fail to allocate memory while optimising function\n");
+    strcpy(func->name, name);
+    func->quick = QUICK_UNRESOLVED;
+    func->builtin = NULL;
+    func->cost = 0;
+}
+
+// x * (1/c) is bit-identical to x / c exactly when c is a power of two whose
+// reciprocal is a normal double
+static bool has_exact_reciprocal(double c) {
+    int exponent;
+    if (!isfinite(c) || c == 0 || fabs(frexp(c, &exponent)) != 0.5) return false;
+    return fpclassify(1.0 / c) == FP_NORMAL;
+}
+
+// Take the argument at idx out of the call so the call can be freed without it
+static Factor *detach_arg(Pinch_Func *func, int idx) {
+    Factor *arg = func->factors->items[idx];
+    func->factors->items[idx] = NULL;
+    return arg;
+}
+
+static void simplify_factor_slot(Factor **slot, SimplifyContext *ctx);
+
+// Rewrite a call in place. Returns the argument the whole call collapses to
+// (already detached from the call), or NULL if the call remains.
+static Factor *simplify_func(Pinch_Func *func, SimplifyContext *ctx) {
+    Factors *args = func->factors;
+
+    // Simplify arguments first so nested rewrites can feed outer ones
+    for (int i = 0; i < args->count; i++) {
+        simplify_factor_slot(&args->items[i], ctx);
+    }
+
+    if (args->count == 2 && is_numeric(args->items[0], ctx) && is_numeric(args->items[1], ctx)) {
+        Factor *x = args->items[0];
+        Factor *y = args->items[1];
+
+        if (strcmp(func->name, "POW") == 0) {
+            // pow(x, 1) == x for every x, including NaN and infinities
+            if (is_num_literal(y, 1)) {
+                ctx->report->rewrites[REWRITE_POW_ONE]++;
+                return detach_arg(func, 0);
+            }
+            // pow(x, 2) is correctly rounded, as is x * x
+            if (is_num_literal(y, 2) && is_duplicable(x)) {
+                free_factor(y);
+                args->items[1] = copy_duplicable(x);
+                rename_func(func, "MUL");
+                ctx->report->rewrites[REWRITE_POW_SQUARE]++;
+                return NULL;
+            }
+        }
+
+        if (strcmp(func->name, "DIV") == 0 && y->type == FACTOR_NUM && has_exact_reciprocal(y->data.num)) {
+            y->data.num = 1.0 / y->data.num;
+            rename_func(func, "MUL");
+            ctx->report->rewrites[REWRITE_DIV_RECIPROCAL]++;
+            // Fall through so that DIV x 1 continues to MUL x 1
+        }
+
+        if (strcmp(func->name, "MUL") == 0) {
+            if (is_num_literal(y, 1)) {
+                ctx->report->rewrites[REWRITE_MUL_ONE]++;
+                return detach_arg(func, 0);
+            }
+            if (is_num_literal(x, 1)) {
+                ctx->report->rewrites[REWRITE_MUL_ONE]++;
+                return detach_arg(func, 1);
+            }
+        }
+
+        // x - 0 == x even for -0, unlike x + 0
+        if (strcmp(func->name, "SUB") == 0 && is_num_literal(y, 0)) {
+            ctx->report->rewrites[REWRITE_SUB_ZERO]++;
+            return detach_arg(func, 0);
+        }
+    }
+
+    // sqrt(x * x) == |x| exactly when x * x is a normal double; once it
+    // overflows or underflows SQRT gives inf or a rounded value and ABS would
+    // not. Only a literal x can be checked, and its square is never negative,
+    // so SQRT could not have failed either.
+    if (strcmp(func->name, "SQRT") == 0 && args->count == 1 && args->items[0]->type == FACTOR_FUNC) {
+        Pinch_Func *inner = args->items[0]->data.func;
+
+        if (strcmp(inner->name, "MUL") == 0 && inner->factors->count == 2 &&
+            same_duplicable(inner->factors->items[0], inner->factors->items[1]) &&
+            inner->factors->items[0]->type == FACTOR_NUM &&
+            fpclassify(inner->factors->items[0]->data.num * inner->factors->items[0]->data.num) == FP_NORMAL) {
+            Factor *x = detach_arg(inner, 0);
+            free_factor(args->items[0]);
+            args->items[0] = x;
+            rename_func(func, "ABS");
+            ctx->report->rewrites[REWRITE_SQRT_SQUARE]++;
+        }
+    }
+    return NULL;
+}
+
+static void simplify_factor_slot(Factor **slot, SimplifyContext *ctx) {
+    if ((*slot)->type != FACTOR_FUNC) return;
+
+    Factor *collapsed = simplify_func((*slot)->data.func, ctx);
+    if (collapsed != NULL) {
+        free_factor(*slot);
+        *slot = collapsed;
+    }
+}
+
+// Apply algebraic simplification and strength reduction to every statement
+void simplify_program(Statement **statements, int stmt_count, OptimizerReport *report) {
+    VarTable *vars = var_table_build(statements, stmt_count);
+    ValueType *var_types = infer_var_types(statements, stmt_count, vars);
+    SimplifyContext ctx = {vars, var_types, report};
+
+    for (int i = 0; i < stmt_count; i++) {
+        Statement *stmt = statements[i];
+        switch (stmt->type) {
+            case PINCH_VAR:
+                simplify_factor_slot(&stmt->content.pinch_var->factors->items[0], &ctx);
+                break;
+            case FACTOR:
+                simplify_factor_slot(&stmt->content.factor, &ctx);
+                break;
+            case PINCH_FUNC_S: {
+                Pinch_Func *func = stmt->content.pinch_func;
+                Factor *collapsed = simplify_func(func, &ctx);
+                // A top-level call that collapses becomes a plain output statement
+                if (collapsed != NULL) {
+                    free_pinch_func(func);
+                    stmt->type = FACTOR;
+                    stmt->content.factor = collapsed;
+                }
+                break;
+            }
+        }
+    }
+
+    xfree(var_types);
+    free_var_table(vars);
+}
+
+// ---------------------------------------------------------
+// DEAD STORE AND DEAD CODE ELIMINATION
+// ---------------------------------------------------------
+
+// Sets of variables are bitsets of `words` 64-bit words, one set per statement
+typedef struct {
+    int words;
+    uint64_t *bits;
+} VarSets;
+
+static VarSets var_sets_new(int stmt_count, int var_count) {
+    VarSets sets;
+    sets.words = (var_count + 63) / 64;
+    sets.bits = xalloc((stmt_count * sets.words + 1) * sizeof(uint64_t), "Interpreter Error: Fail to allocate memory for liveness analysis.\n");
+    memset(sets.bits, 0, (stmt_count * sets.words + 1) * sizeof(uint64_t));
+    return sets;
+}
+
+static uint64_t *var_set(VarSets *sets, int stmt) {
+    return &sets->bits[stmt * sets->words];
+}
+
+static bool var_set_has(uint64_t *set, int var) {
+    return (set[var / 64] >> (var % 64)) & 1;
+}
+
+static void var_set_add(uint64_t *set, int var) {
+    set[var / 64] |= (uint64_t)1 << (var % 64);
+}
+
+static void add_reads(uint64_t *set, Factor *f, VarTable *vars) {
+    if (f->type == FACTOR_VAR) {
+        var_set_add(set, var_table_index(vars, f->data.var));
+    } else if (f->type == FACTOR_FUNC) {
+        Factors *args = f->data.func->factors;
+        for (int i = 0; i < args->count; i++) {
+            add_reads(set, args->items[i], vars);
+        }
+    }
+}
+
+static void statement_reads(uint64_t *set, Statement *stmt, VarTable *vars) {
+    Factors *args = NULL;
+    switch (stmt->type) {
+        case PINCH_VAR: args = stmt->content.pinch_var->factors; break;
+        case PINCH_FUNC_S: args = stmt->content.pinch_func->factors; break;
+        case FACTOR: add_reads(set, stmt->content.factor, vars); return;
+    }
+    for (int i = 0; i < args->count; i++) {
+        add_reads(set, args->items[i], vars);
+    }
+}
+
+static int statement_write(Statement *stmt, VarTable *vars) {
+    return stmt->type == PINCH_VAR ? var_table_index(vars, stmt->content.pinch_var->name) : -1;
+}
+
+// Statements reachable from the first statement
+static bool *find_reachable(ControlFlow *cfg) {
+    int n = cfg->stmt_count;
+    bool *reachable = xalloc((n + 1) * sizeof(bool), "Interpreter Error: Fail to allocate memory for reachability analysis.\n");
+    int *worklist = xalloc((n + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for reachability analysis.\n");
+    memset(reachable, 0, (n + 1) * sizeof(bool));
+
+    int top = 0;
+    if (n > 0) {
+        reachable[0] = true;
+        worklist[top++] = 0;
+    }
+    while (top > 0) {
+        int s = worklist[--top];
+        for (int k = 0; k < 2; k++) {
+            int t = cfg->succ[2 * s + k];
+            if (t >= 0 && t < n && !reachable[t]) {
+                reachable[t] = true;
+                worklist[top++] = t;
+            }
+        }
+    }
+    xfree(worklist);
+    return reachable;
+}
+
+// Variables certainly assigned on every path reaching each statement
+static VarSets find_defined(Statement **statements, ControlFlow *cfg, VarTable *vars, bool *reachable) {
+    int n = cfg->stmt_count;
+    VarSets defined = var_sets_new(n, vars->count);
+    uint64_t *out = xalloc((defined.words + 1) * sizeof(uint64_t), "Interpreter Error: Fail to allocate memory for liveness analysis.\n");
+
+    // Start from the full set everywhere but the entry and shrink to a fixpoint
+    for (int s = 1; s < n; s++) {
+        memset(var_set(&defined, s), 0xFF, defined.words * sizeof(uint64_t));
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int s = 0; s < n; s++) {
+            if (!reachable[s]) continue;
+
+            memcpy(out, var_set(&defined, s), defined.words * sizeof(uint64_t));
+            int write = statement_write(statements[s], vars);
+            if (write >= 0) var_set_add(out, write);
+
+            for (int k = 0; k < 2; k++) {
+                int t = cfg->succ[2 * s + k];
+                if (t <= 0 || t >= n) continue;
+
+                uint64_t *in = var_set(&defined, t);
+                for (int w = 0; w < defined.words; w++) {
+                    uint64_t met = in[w] & out[w];
+                    if (met != in[w]) {
+                        in[w] = met;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    xfree(out);
+    return defined;
+}
+
+// Variables that may be read after each statement before being reassigned
+static VarSets find_live_out(Statement **statements, ControlFlow *cfg, VarTable *vars) {
+    int n = cfg->stmt_count;
+    VarSets live_out = var_sets_new(n, vars->count);
+    VarSets live_in = var_sets_new(n, vars->count);
+    uint64_t *previous = xalloc((live_in.words + 1) * sizeof(uint64_t), "Interpreter Error: Fail to allocate memory for liveness analysis.\n");
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int s = n - 1; s >= 0; s--) {
+            uint64_t *out = var_set(&live_out, s);
+            for (int k = 0; k < 2; k++) {
+                int t = cfg->succ[2 * s + k];
+                if (t < 0 || t >= n) continue;
+
+                uint64_t *succ_in = var_set(&live_in, t);
+                for (int w = 0; w < live_out.words; w++) {
+                    out[w] |= succ_in[w];
+                }
+            }
+
+            uint64_t *in = var_set(&live_in, s);
+            memcpy(previous, in, live_in.words * sizeof(uint64_t));
+
+            memcpy(in, out, live_in.words * sizeof(uint64_t));
+            int write = statement_write(statements[s], vars);
+            if (write >= 0) in[write / 64] &= ~((uint64_t)1 << (write % 64));
+            statement_reads(in, statements[s], vars);
+
+            if (memcmp(previous, in, live_in.words * sizeof(uint64_t)) != 0) changed = true;
+        }
+    }
+    xfree(previous);
+    xfree(live_in.bits);
+    return live_out;
+}
+
+// Whether a factor can be evaluated without failing or any side effect
+static bool is_removable_factor(Factor *f, uint64_t *defined, VarTable *vars, ValueType *var_types) {
+    switch (f->type) {
+        case FACTOR_NUM:
+        case FACTOR_STR:
+        case FACTOR_JUMP:
+            return true;
+        case FACTOR_VAR:
+            return var_set_has(defined, var_table_index(vars, f->data.var));
+        case FACTOR_FUNC: {
+            Factors *args = f->data.func->factors;
+            for (int i = 0; i < args->count; i++) {
+                if (!is_removable_factor(args->items[i], defined, vars, var_types)) return false;
+            }
+            return is_total_builtin_call(f->data.func, vars, var_types);
+        }
+    }
+    return false;
+}
+
+// Point jump literals at the same statements after the removed ones are gone.
+// new_index[i] is the position of the first kept statement at or after i.
+static void renumber_jumps(Statement **statements, int stmt_count, bool *removed, int *new_index) {
+    for (int s = 0; s < stmt_count; s++) {
+        if (removed[s] || statements[s]->type != PINCH_FUNC_S) continue;
+
+        Pinch_Func *func = statements[s]->content.pinch_func;
+        if (!is_jump_func(func)) continue;
+
+        for (int i = 0; i < func->factors->count; i++) {
+            Factor *jump = func->factors->items[i];
+            if (jump->type != FACTOR_JUMP) continue;
+
+            int target = new_index[jump_target(s, jump, stmt_count)];
+            int offset = target - new_index[s];
+            jump->data.jump.type = offset >= 0 ? JUMP_FORWARD : JUMP_BACKWARD;
+            jump->data.jump.lines = offset >= 0 ? offset : -offset;
+        }
+    }
+}
+
+// One round of analysis and removal. Returns whether anything was removed.
+static bool eliminate_dead_code_round(Statement **statements, int *stmt_count, OptimizerReport *report) {
+    int n = *stmt_count;
+    ControlFlow *cfg = control_flow_build(statements, n);
+
+    // Without a complete control flow graph nothing can be proven dead
+    if (!cfg->resolved) {
+        free_control_flow(cfg);
+        return false;
+    }
+
+    VarTable *vars = var_table_build(statements, n);
+    ValueType *var_types = infer_var_types(statements, n, vars);
+    bool *reachable = find_reachable(cfg);
+    VarSets defined = find_defined(statements, cfg, vars, reachable);
+    VarSets live_out = find_live_out(statements, cfg, vars);
+
+    bool *removed = xalloc((n + 1) * sizeof(bool), "Interpreter Error: Fail to allocate memory for dead code elimination.\n");
+    int removed_count = 0;
+
+    for (int s = 0; s < n; s++) {
+        removed[s] = false;
+        if (!reachable[s]) {
+            removed[s] = true;
+            report->unreachable++;
+        } else if (statements[s]->type == PINCH_VAR) {
+            int write = statement_write(statements[s], vars);
+            Factor *value = statements[s]->content.pinch_var->factors->items[0];
+
+            if (!var_set_has(var_set(&live_out, s), write) &&
+                is_removable_factor(value, var_set(&defined, s), vars, var_types)) {
+                removed[s] = true;
+                report->dead_stores++;
+            }
+        }
+        if (removed[s]) removed_count++;
+    }
+
+    if (removed_count > 0) {
+        int *new_index = xalloc((n + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for dead code elimination.\n");
+        new_index[n] = n - removed_count;
+        for (int s = n - 1; s >= 0; s--) {
+            new_index[s] = removed[s] ? new_index[s + 1] : new_index[s + 1] - 1;
+        }
+        renumber_jumps(statements, n, removed, new_index);
+        xfree(new_index);
+
+        // Compact the statement array in place
+        int kept = 0;
+        for (int s = 0; s < n; s++) {
+            if (removed[s]) {
+                free_statement(statements[s]);
+            } else {
+                statements[kept++] = statements[s];
+            }
+        }
+        *stmt_count = kept;
+    }
+
+    xfree(removed);
+    xfree(live_out.bits);
+    xfree(defined.bits);
+    xfree(reachable);
+    xfree(var_types);
+    free_var_table(vars);
+    free_control_flow(cfg);
+    return removed_count > 0;
+}
+
+// Remove unreachable statements and assignments whose value is never read.
+// Removing a store can make the stores feeding it dead, so repeat until stable.
+void eliminate_dead_code(Statement **statements, int *stmt_count, OptimizerReport *report) {
+    while (eliminate_dead_code_round(statements, stmt_count, report))
+        ;
+}
+
+void print_optimizer_report(OptimizerReport *report) {
+    int total = 0;
+    for (int i = 0; i < REWRITE_KIND_COUNT; i++) {
+        total += report->rewrites[i];
+    }
+
+    fprintf(stderr, "Optimiser: %d rewrite(s) applied.\n", total);
+    for (int i = 0; i < REWRITE_KIND_COUNT; i++) {
+        if (report->rewrites[i] > 0) {
+            fprintf(stderr, "  %-26s %d\n", rewrite_names[i], report->rewrites[i]);
+        }
+    }
+    fprintf(stderr, "Optimiser: %d dead store(s) and %d unreachable statement(s) removed.\n",
+            report->dead_stores, report->unreachable);
+}
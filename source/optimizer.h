@@ -0,0 +1,28 @@
+// optimizer.h
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "parser.h"
+
+typedef enum {
+    REWRITE_POW_SQUARE,      // (x -> POW <- 2)           => (x -> MUL <- x)
+    REWRITE_POW_ONE,         // (x -> POW <- 1)           => x
+    REWRITE_DIV_RECIPROCAL,  // (x -> DIV <- c)           => (x -> MUL <- 1/c)
+    REWRITE_MUL_ONE,         // (x -> MUL <- 1)           => x
+    REWRITE_SUB_ZERO,        // (x -> SUB <- 0)           => x
+    REWRITE_SQRT_SQUARE,     // ((x -> MUL <- x) -> SQRT) => (x -> ABS)
+    REWRITE_KIND_COUNT
+} rewrite_kind;
+
+typedef struct {
+    int rewrites[REWRITE_KIND_COUNT];
+    int dead_stores;    // Assignments to variables that are never read again
+    int unreachable;    // Statements no path from the first statement reaches
+} OptimizerReport;
+
+void simplify_program(Statement **statements, int stmt_count, OptimizerReport *report);
+void eliminate_dead_code(Statement **statements, int *stmt_count, OptimizerReport *report);
+void print_optimizer_report(OptimizerReport *report);
+
+#endif
@@ -0,0 +1,743 @@
+// Logic for running independent statements of jump-free blocks concurrently
+
+#include "parallel.h"
+#include "analysis.h"
+#include "functions.h"
+#include "threadpool.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Variables a statement reads and assigns, as VarTable indices
+typedef struct {
+    int *reads;
+    int read_count;
+    int write;          // -1 if the statement prints instead
+    bool impure;        // Calls RAND or SLEEP, so its order with other such calls matters
+} StatementUse;
+
+// A run of statements none of which jumps. Statements only depend on earlier
+// statements of the block, so program order is a topological order.
+typedef struct {
+    int start;
+    int count;
+    int *pred_count;    // Statements each statement waits for
+    int *succ_start;    // succ[succ_start[i] .. succ_start[i + 1]) depend on statement i
+    int *succ;
+    bool parallel;      // Slow enough sequentially to be worth the threads
+    long runs;          // Sequential runs, only some of which are timed
+} Block;
+
+struct ParallelState {
+    Statement **statements;
+    int stmt_count;
+    VarTable *vars;
+    StatementUse *uses;
+    Block **block_at;   // Block starting at each statement, NULL if none
+    Block **blocks;
+    int block_count;
+    int *stamp;         // Scratch space with one entry per variable
+    int threads;
+    long min_ns;
+    ThreadPool *pool;   // Started on the first parallel block run
+    bool pool_failed;
+    ParallelStats stats;
+};
+
+// ---------------------------------------------------------
+// READ AND WRITE SETS
+// ---------------------------------------------------------
+
+static void add_use_factors(StatementUse *use, Factors *factors, VarTable *vars, int *capacity);
+
+static void add_use_read(StatementUse *use, int var, int *capacity) {
+    for (int i = 0; i < use->read_count; i++) {
+        if (use->reads[i] == var) return;
+    }
+    if (use->read_count >= *capacity) {
+        *capacity *= 2;
+        int *reads = xalloc(*capacity * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+        for (int i = 0; i < use->read_count; i++) {
+            reads[i] = use->reads[i];
+        }
+        xfree(use->reads);
+        use->reads = reads;
+    }
+    use->reads[use->read_count++] = var;
+}
+
+static void add_use_factor(StatementUse *use, Factor *factor, VarTable *vars, int *capacity) {
+    if (factor->type == FACTOR_VAR) {
+        add_use_read(use, var_table_index(vars, factor->data.var), capacity);
+    } else if (factor->type == FACTOR_FUNC) {
+        const Builtin *builtin = find_builtin(factor->data.func->name);
+        if (builtin == NULL || !builtin->pure) use->impure = true;
+        add_use_factors(use, factor->data.func->factors, vars, capacity);
+    }
+}
+
+static void add_use_factors(StatementUse *use, Factors *factors, VarTable *vars, int *capacity) {
+    for (int i = 0; i < factors->count; i++) {
+        add_use_factor(use, factors->items[i], vars, capacity);
+    }
+}
+
+static void collect_use(StatementUse *use, Statement *stmt, VarTable *vars) {
+    int capacity = 4;
+    use->reads = xalloc(capacity * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    use->read_count = 0;
+    use->write = -1;
+    use->impure = false;
+
+    switch (stmt->type) {
+        case PINCH_VAR:
+            use->write = var_table_index(vars, stmt->content.pinch_var->name);
+            add_use_factors(use, stmt->content.pinch_var->factors, vars, &capacity);
+            break;
+        case PINCH_FUNC_S: {
+            const Builtin *builtin = find_builtin(stmt->content.pinch_func->name);
+            if (builtin == NULL || !builtin->pure) use->impure = true;
+            add_use_factors(use, stmt->content.pinch_func->factors, vars, &capacity);
+            break;
+        }
+        case FACTOR:
+            add_use_factor(use, stmt->content.factor, vars, &capacity);
+            break;
+    }
+}
+
+// ---------------------------------------------------------
+// BLOCKS
+// ---------------------------------------------------------
+
+// Dependencies between the statements of a block: read after write, write
+// after write, write after read, and the order of impure calls. Returns
+// NULL if the statements form a chain, leaving nothing to run concurrently.
+static Block *build_block(ParallelState *parallel, int start, int count) {
+    int var_count = parallel->vars->count;
+    int *last_writer = xalloc((var_count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    struct list **readers = xalloc((var_count + 1) * sizeof(struct list*), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    for (int v = 0; v < var_count; v++) {
+        last_writer[v] = -1;
+        readers[v] = NULL;
+    }
+
+    // Edges as (from, to) pairs, from < to
+    int edge_capacity = 16;
+    int edge_count = 0;
+    int *edges = xalloc(2 * edge_capacity * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    int *depth = xalloc(count * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    int *added = xalloc(count * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    int last_impure = -1;
+    int max_depth = 0;
+
+    for (int j = 0; j < count; j++) {
+        StatementUse *use = &parallel->uses[start + j];
+        depth[j] = 1;
+        added[j] = -1;
+
+        // Collect the predecessors of j, each once
+        int preds[3 + use->read_count];
+        int pred_total = 0;
+        for (int r = 0; r < use->read_count; r++) {
+            preds[pred_total++] = last_writer[use->reads[r]];
+        }
+        if (use->write >= 0) {
+            preds[pred_total++] = last_writer[use->write];
+        }
+        if (use->impure) {
+            preds[pred_total++] = last_impure;
+            last_impure = j;
+        }
+
+        struct list *war = use->write >= 0 ? readers[use->write] : NULL;
+        int war_count = war != NULL ? war->length : 0;
+        for (int p = 0; p < pred_total + war_count; p++) {
+            int i = p < pred_total ? preds[p] : (int)(long)list_get(war, p - pred_total);
+            if (i < 0 || i == j || added[i] == j) continue;
+            added[i] = j;
+
+            if (edge_count >= edge_capacity) {
+                edge_capacity *= 2;
+                int *grown = xalloc(2 * edge_capacity * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+                memcpy(grown, edges, 2 * edge_count * sizeof(int));
+                xfree(edges);
+                edges = grown;
+            }
+            edges[2 * edge_count] = i;
+            edges[2 * edge_count + 1] = j;
+            edge_count++;
+            if (depth[i] + 1 > depth[j]) depth[j] = depth[i] + 1;
+        }
+        if (depth[j] > max_depth) max_depth = depth[j];
+
+        // Reads are recorded after the write check so a statement never waits on itself
+        for (int r = 0; r < use->read_count; r++) {
+            int v = use->reads[r];
+            if (readers[v] == NULL) readers[v] = list_new(4);
+            list_append(readers[v], (void*)(long)j);
+        }
+        if (use->write >= 0) {
+            last_writer[use->write] = j;
+            if (readers[use->write] != NULL) readers[use->write]->length = 0;
+        }
+    }
+
+    for (int v = 0; v < var_count; v++) {
+        free_list(readers[v]);
+    }
+    xfree(readers);
+    xfree(last_writer);
+    xfree(depth);
+    xfree(added);
+
+    if (max_depth >= count) {
+        xfree(edges);
+        return NULL;
+    }
+
+    Block *block = xalloc(sizeof(Block), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    block->start = start;
+    block->count = count;
+    block->parallel = parallel->min_ns <= 0;
+    block->runs = 0;
+    block->pred_count = xalloc(count * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    block->succ_start = xalloc((count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    block->succ = xalloc((edge_count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+
+    for (int i = 0; i <= count; i++) block->succ_start[i] = 0;
+    for (int i = 0; i < count; i++) block->pred_count[i] = 0;
+    for (int e = 0; e < edge_count; e++) {
+        block->succ_start[edges[2 * e] + 1]++;
+        block->pred_count[edges[2 * e + 1]]++;
+    }
+    for (int i = 0; i < count; i++) block->succ_start[i + 1] += block->succ_start[i];
+
+    // Edges were added in order of their target, so every successor list stays sorted
+    int *fill = xalloc((count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    memcpy(fill, block->succ_start, (count + 1) * sizeof(int));
+    for (int e = 0; e < edge_count; e++) {
+        block->succ[fill[edges[2 * e]]++] = edges[2 * e + 1];
+    }
+    xfree(fill);
+    xfree(edges);
+    return block;
+}
+
+static void free_block(Block *block) {
+    xfree(block->pred_count);
+    xfree(block->succ_start);
+    xfree(block->succ);
+    xfree(block);
+}
+
+ParallelState *parallel_new(Statement **statements, int stmt_count, int threads, long min_ns) {
+    ParallelState *parallel = xalloc(sizeof(ParallelState), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    parallel->statements = statements;
+    parallel->stmt_count = stmt_count;
+    parallel->vars = var_table_build(statements, stmt_count);
+    parallel->uses = xalloc((stmt_count + 1) * sizeof(StatementUse), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    parallel->block_at = xalloc((stmt_count + 1) * sizeof(Block*), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    parallel->blocks = xalloc((stmt_count + 1) * sizeof(Block*), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    parallel->block_count = 0;
+    parallel->stamp = xalloc((parallel->vars->count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    parallel->threads = threads > 0 ? threads : pool_default_threads();
+    parallel->min_ns = min_ns;
+    parallel->pool = NULL;
+    parallel->pool_failed = false;
+    memset(&parallel->stats, 0, sizeof(ParallelStats));
+
+    for (int i = 0; i < stmt_count; i++) {
+        collect_use(&parallel->uses[i], statements[i], parallel->vars);
+        parallel->block_at[i] = NULL;
+    }
+
+    // Blocks also end where a literal jump can land, so loops enter at a block start
+    bool *leader = xalloc((stmt_count + 1) * sizeof(bool), "Interpreter Error: Fail to allocate memory for parallel analysis.\n");
+    for (int i = 0; i <= stmt_count; i++) leader[i] = false;
+    ControlFlow *cfg = control_flow_build(statements, stmt_count);
+    for (int i = 0; i < 2 * stmt_count; i++) {
+        int target = cfg->succ[i];
+        if (target >= 0 && target != i / 2 + 1) leader[target] = true;
+    }
+    free_control_flow(cfg);
+
+    int start = 0;
+    for (int i = 0; i <= stmt_count; i++) {
+        bool jumps = i < stmt_count && statement_has_jump(statements[i]);
+        if (i == stmt_count || jumps || (leader[i] && i > start)) {
+            if (i - start >= 2) {
+                Block *block = build_block(parallel, start, i - start);
+                if (block != NULL) {
+                    parallel->blocks[parallel->block_count++] = block;
+                    parallel->block_at[start] = block;
+                }
+            }
+            start = jumps ? i + 1 : i;
+        }
+    }
+    xfree(leader);
+    parallel->stats.blocks = parallel->block_count;
+    return parallel;
+}
+
+void free_parallel(ParallelState *parallel) {
+    if (parallel == NULL) return;
+    free_pool(parallel->pool);
+    for (int i = 0; i < parallel->block_count; i++) {
+        free_block(parallel->blocks[i]);
+    }
+    for (int i = 0; i < parallel->stmt_count; i++) {
+        xfree(parallel->uses[i].reads);
+    }
+    xfree(parallel->uses);
+    xfree(parallel->block_at);
+    xfree(parallel->blocks);
+    xfree(parallel->stamp);
+    free_var_table(parallel->vars);
+    xfree(parallel);
+}
+
+// ---------------------------------------------------------
+// CONCURRENT BLOCK RUNS
+// ---------------------------------------------------------
+
+typedef struct BlockRun BlockRun;
+
+typedef struct {
+    BlockRun *run;
+    Statement *stmt;
+    int index;
+    int pending;        // Predecessors that have not finished
+    bool skipped;       // A predecessor failed, so the statement is not run
+    bool done;
+    bool failed;
+    Value *result;      // What the statement prints, NULL if memory ran out
+    char *errors;       // Runtime errors, reported when the statement is committed
+    size_t errors_length;
+} StatementTask;
+
+struct BlockRun {
+    ParallelState *parallel;
+    Block *block;
+    MachineState *state;
+    StatementTask *tasks;
+    int finished;
+    pthread_mutex_t lock;
+    pthread_cond_t progress;
+};
+
+static void run_statement_task(void *arg);
+
+static void finish_task(StatementTask *task) {
+    BlockRun *run = task->run;
+    Block *block = run->block;
+    int ready[block->succ_start[task->index + 1] - block->succ_start[task->index] + 1];
+    int ready_count = 0;
+
+    pthread_mutex_lock(&run->lock);
+    task->done = true;
+    run->finished++;
+    for (int e = block->succ_start[task->index]; e < block->succ_start[task->index + 1]; e++) {
+        StatementTask *next = &run->tasks[block->succ[e]];
+        if (task->failed) next->skipped = true;
+        if (--next->pending == 0) ready[ready_count++] = block->succ[e];
+    }
+    pthread_cond_broadcast(&run->progress);
+    pthread_mutex_unlock(&run->lock);
+
+    for (int i = 0; i < ready_count; i++) {
+        pool_submit(run->parallel->pool, run_statement_task, &run->tasks[ready[i]]);
+    }
+}
+
+static void run_statement_task(void *arg) {
+    StatementTask *task = (StatementTask*)arg;
+    if (task->skipped) {
+        task->failed = true;
+    } else {
+        // Hold errors back until the statements before this one are committed
+        FILE *errors = open_memstream(&task->errors, &task->errors_length);
+        FILE *previous = redirect_errors(errors);
+        MachineState *previous_state = bind_machine_state(task->run->state);
+        AllocRecovery recovery;
+        if (setjmp(recovery.env) == 0) {
+            push_alloc_recovery(&recovery);
+            task->result = execute_statement(task->stmt, task->run->state);
+            pop_alloc_recovery(&recovery);
+        } else {
+            report_error("%s", recovery.message);
+            task->result = NULL;
+        }
+        bind_machine_state(previous_state);
+        redirect_errors(previous);
+        fclose(errors);
+        task->failed = task->result == NULL || task->result->type == VALUE_ERROR;
+    }
+    finish_task(task);
+}
+
+static void wait_for(BlockRun *run, StatementTask *task) {
+    pthread_mutex_lock(&run->lock);
+    while (!task->done) {
+        pthread_cond_wait(&run->progress, &run->lock);
+    }
+    pthread_mutex_unlock(&run->lock);
+}
+
+// Whether every variable the block reads is assigned before it is read.
+// Blocks that would read an undefined variable run sequentially, so the
+// error is reported exactly as the interpreter reports it.
+static bool reads_are_defined(ParallelState *parallel, Block *block, MachineState *state) {
+    VarTable *vars = parallel->vars;
+    for (int v = 0; v < vars->count; v++) {
+        parallel->stamp[v] = hashmap_lookup(state->variables, vars->names[v]) != NULL;
+    }
+    for (int i = block->start; i < block->start + block->count; i++) {
+        StatementUse *use = &parallel->uses[i];
+        for (int r = 0; r < use->read_count; r++) {
+            if (!parallel->stamp[use->reads[r]]) return false;
+        }
+        if (use->write >= 0) parallel->stamp[use->write] = 1;
+    }
+    return true;
+}
+
+// Give every variable the block assigns an entry up front, so workers only
+// ever replace values in place and never change the table itself
+static void reserve_variables(ParallelState *parallel, Block *block, MachineState *state) {
+    for (int i = block->start; i < block->start + block->count; i++) {
+        int write = parallel->uses[i].write;
+        if (write < 0) continue;
+        char *name = parallel->vars->names[write];
+        if (hashmap_lookup(state->variables, name) == NULL) {
+            char *key = xalloc(strlen(name) + 1, "Interpreter Error: Fail to allocate memory for a variable name.\n");
+            strcpy(key, name);
+            hashmap_insert(state->variables, key, value_from_none());
+        }
+    }
+}
+
+static bool run_block_concurrently(ParallelState *parallel, Block *block, MachineState *state) {
+    reserve_variables(parallel, block, state);
+
+    BlockRun run;
+    run.parallel = parallel;
+    run.block = block;
+    run.state = state;
+    run.finished = 0;
+    run.tasks = xalloc(block->count * sizeof(StatementTask), "Interpreter Error: Fail to allocate memory for parallel run.\n");
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.progress, NULL);
+
+    for (int i = 0; i < block->count; i++) {
+        StatementTask *task = &run.tasks[i];
+        task->run = &run;
+        task->stmt = parallel->statements[block->start + i];
+        task->index = i;
+        task->pending = block->pred_count[i];
+        task->skipped = false;
+        task->done = false;
+        task->failed = false;
+        task->result = NULL;
+        task->errors = NULL;
+        task->errors_length = 0;
+    }
+    // Roots are chosen before any is queued, since finishing tasks lower the
+    // pending counts of the others
+    for (int i = 0; i < block->count; i++) {
+        if (block->pred_count[i] == 0) {
+            pool_submit(parallel->pool, run_statement_task, &run.tasks[i]);
+        }
+    }
+
+    // Commit in program order: print results and report the first failure.
+    // The tasks point into this frame, so running out of memory here must
+    // not unwind past it until they are all done.
+    bool success = true;
+    const char *failure = NULL;
+    AllocRecovery recovery;
+    if (setjmp(recovery.env) == 0) {
+        push_alloc_recovery(&recovery);
+        for (int i = 0; i < block->count && success; i++) {
+            StatementTask *task = &run.tasks[i];
+            wait_for(&run, task);
+            if (task->errors_length > 0) {
+                report_error("%s", task->errors);
+            }
+            if (task->failed) {
+                state->program_counter = block->start + i;
+                success = false;
+            } else {
+                output_value(state, task->result);
+            }
+        }
+        pop_alloc_recovery(&recovery);
+    } else {
+        failure = recovery.message;
+    }
+
+    // Statements after a failure may still be running
+    pthread_mutex_lock(&run.lock);
+    while (run.finished < block->count) {
+        pthread_cond_wait(&run.progress, &run.lock);
+    }
+    pthread_mutex_unlock(&run.lock);
+
+    for (int i = 0; i < block->count; i++) {
+        free_value(run.tasks[i].result);
+        free(run.tasks[i].errors);  // Allocated by open_memstream
+    }
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.progress);
+    xfree(run.tasks);
+    if (failure != NULL) alloc_failed(failure);
+
+    parallel->stats.block_runs++;
+    parallel->stats.tasks += block->count;
+    return success;
+}
+
+// ---------------------------------------------------------
+// CONCURRENT ARGUMENTS
+// ---------------------------------------------------------
+
+// Text builtins walk their arguments, so they count for more than arithmetic
+#define TEXT_CALL_COST 4
+#define MAX_COST (1 << 24)
+
+static int factor_cost(Factor *factor);
+
+// Cached on the call node. -1 if the call jumps, or calls RAND, SLEEP or an
+// unknown function, whose order relative to other calls matters.
+static int func_cost(Pinch_Func *func) {
+    if (func->cost != 0) return func->cost;
+
+    const Builtin *builtin = find_builtin(func->name);
+    int cost = -1;
+    if (builtin != NULL && builtin->pure) {
+        cost = builtin->result == VALUE_STR || builtin->params[0] == VALUE_STR ? TEXT_CALL_COST : 1;
+        for (int i = 0; i < func->factors->count && cost > 0; i++) {
+            int arg_cost = factor_cost(func->factors->items[i]);
+            cost = arg_cost < 0 ? -1 : cost + arg_cost;
+            if (cost > MAX_COST) cost = MAX_COST;
+        }
+    }
+    func->cost = cost;
+    return cost;
+}
+
+static int factor_cost(Factor *factor) {
+    switch (factor->type) {
+        case FACTOR_FUNC:
+            return func_cost(factor->data.func);
+        case FACTOR_STR:
+            return 1 + (int)(strlen(factor->data.str) / 64);
+        default:
+            return 1;
+    }
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int remaining;
+} ArgJoin;
+
+typedef struct {
+    Factor *factor;
+    MachineState *state;
+    ArgJoin *join;
+    Value *result;
+    char *errors;
+    size_t errors_length;
+} ArgTask;
+
+// Errors are held back so they can be reported in argument order. Running
+// out of memory leaves a NULL result, which counts as a failed argument.
+static void evaluate_arg(ArgTask *task) {
+    FILE *errors = open_memstream(&task->errors, &task->errors_length);
+    FILE *previous = redirect_errors(errors);
+    AllocRecovery recovery;
+    if (setjmp(recovery.env) == 0) {
+        push_alloc_recovery(&recovery);
+        task->result = evaluate_factor(task->factor, task->state);
+        pop_alloc_recovery(&recovery);
+    } else {
+        report_error("%s", recovery.message);
+        task->result = NULL;
+    }
+    redirect_errors(previous);
+    fclose(errors);
+}
+
+static void run_arg_task(void *arg) {
+    ArgTask *task = (ArgTask*)arg;
+    evaluate_arg(task);
+
+    pthread_mutex_lock(&task->join->lock);
+    task->join->remaining--;
+    pthread_cond_broadcast(&task->join->done);
+    pthread_mutex_unlock(&task->join->lock);
+}
+
+// Wait for the queued arguments, running queued tasks meanwhile so a worker
+// waiting here never holds up the tasks it is waiting for
+static void join_args(ThreadPool *pool, ArgJoin *join) {
+    while (true) {
+        pthread_mutex_lock(&join->lock);
+        bool done = join->remaining == 0;
+        pthread_mutex_unlock(&join->lock);
+        if (done) return;
+        if (pool_run_one(pool)) continue;
+
+        pthread_mutex_lock(&join->lock);
+        if (join->remaining > 0) {
+            pthread_cond_wait(&join->done, &join->lock);
+        }
+        pthread_mutex_unlock(&join->lock);
+    }
+}
+
+int parallel_evaluate_args(Pinch_Func *func, MachineState *state, Value **args) {
+    int count = func->factors->count;
+    if (count < 2 || state->memo != NULL) return -1;
+
+    // Only pure calls qualify, and at least two arguments must be costly
+    int costly = 0;
+    int last_costly = -1;
+    for (int i = 0; i < count; i++) {
+        int cost = factor_cost(func->factors->items[i]);
+        if (cost < 0) return -1;
+        if (cost >= state->arg_min_cost) {
+            costly++;
+            last_costly = i;
+        }
+    }
+    if (costly < 2) return -1;
+
+    ArgJoin join;
+    pthread_mutex_init(&join.lock, NULL);
+    pthread_cond_init(&join.done, NULL);
+    join.remaining = costly - 1;
+
+    ArgTask tasks[count];
+    for (int i = 0; i < count; i++) {
+        tasks[i].factor = func->factors->items[i];
+        tasks[i].state = state;
+        tasks[i].join = &join;
+        tasks[i].result = NULL;
+        tasks[i].errors = NULL;
+        tasks[i].errors_length = 0;
+    }
+
+    bool queued[count];
+    for (int i = 0; i < count; i++) {
+        queued[i] = i != last_costly && factor_cost(tasks[i].factor) >= state->arg_min_cost;
+        if (queued[i]) pool_submit(state->arg_pool, run_arg_task, &tasks[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        if (!queued[i]) evaluate_arg(&tasks[i]);
+    }
+    join_args(state->arg_pool, &join);
+    pthread_mutex_destroy(&join.lock);
+    pthread_cond_destroy(&join.done);
+
+    // Sequential evaluation would have stopped at the first failing argument
+    int failed = count;
+    for (int i = 0; i < count; i++) {
+        if (failed == count && (tasks[i].result == NULL || tasks[i].result->type == VALUE_ERROR)) {
+            failed = i;
+            if (tasks[i].errors_length > 0) report_error("%s", tasks[i].errors);
+        }
+        args[i] = tasks[i].result;
+        free(tasks[i].errors);  // Allocated by open_memstream
+    }
+    if (failed < count) {
+        for (int i = 0; i < count; i++) {
+            free_value(args[i]);
+        }
+    }
+    return failed;
+}
+
+// ---------------------------------------------------------
+// RUN
+// ---------------------------------------------------------
+
+#define BLOCK_TIMING_INTERVAL 64
+
+static long elapsed_ns(struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000000L + (now.tv_nsec - since->tv_nsec);
+}
+
+static bool pool_ready(ParallelState *parallel) {
+    if (parallel->pool == NULL && !parallel->pool_failed) {
+        parallel->pool = pool_new(parallel->threads);
+        parallel->pool_failed = parallel->pool == NULL;
+    }
+    return parallel->pool != NULL;
+}
+
+static bool run_block(ParallelState *parallel, Block *block, MachineState *state, bool interactive) {
+    // The memo cache is not shared between threads
+    if (block->parallel && state->memo == NULL && pool_ready(parallel) &&
+        reads_are_defined(parallel, block, state)) {
+        return run_block_concurrently(parallel, block, state);
+    }
+
+    // Time one sequential run in every BLOCK_TIMING_INTERVAL, so cheap blocks
+    // in hot loops do not pay for the clock
+    bool timed = block->runs++ % BLOCK_TIMING_INTERVAL == 0;
+    struct timespec start;
+    if (timed) clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = block->start; i < block->start + block->count; i++) {
+        state->program_counter = i;
+        if (!interpret_line(parallel->statements[i], state, interactive)) {
+            return false;
+        }
+    }
+    if (timed && elapsed_ns(&start) >= parallel->min_ns) {
+        block->parallel = true;
+    }
+    return true;
+}
+
+bool parallel_run(ParallelState *parallel, MachineState *state, bool interactive) {
+    while (state->program_counter >= 0 && state->program_counter < parallel->stmt_count) {
+        Block *block = parallel->block_at[state->program_counter];
+        if (block != NULL) {
+            if (!run_block(parallel, block, state, interactive)) {
+                return false;
+            }
+            state->program_counter = block->start + block->count;
+            continue;
+        }
+
+        if (!interpret_line(parallel->statements[state->program_counter], state, interactive)) {
+            return false;
+        }
+        state->program_counter++;
+    }
+    return true;
+}
+
+ParallelStats parallel_stats(ParallelState *parallel) {
+    ParallelStats stats = parallel->stats;
+    if (parallel->pool != NULL) {
+        stats.steals = pool_stats(parallel->pool).stolen;
+        stats.threads = pool_threads(parallel->pool);
+    }
+    return stats;
+}
+
+void print_parallel_stats(ParallelState *parallel) {
+    ParallelStats stats = parallel_stats(parallel);
+    fprintf(stderr, "Parallel: %d block(s) with independent statements, %ld run(s) on %d thread(s).\n",
+            stats.blocks, stats.block_runs, stats.threads);
+    fprintf(stderr, "Parallel: %ld statement(s) run as tasks, %ld stolen.\n", stats.tasks, stats.steals);
+}
@@ -0,0 +1,48 @@
+// parallel.h
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "interpreter.h"
+
+// Blocks whose sequential run took less than this many nanoseconds are not
+// worth handing to the thread pool
+#define PARALLEL_MIN_BLOCK_NS 50000
+
+// Estimated cost, in builtin calls, an argument needs before it is evaluated
+// as a task of its own
+#define PARALLEL_ARG_MIN_COST 64
+
+typedef struct ParallelState ParallelState;
+
+typedef struct {
+    int blocks;             // Jump-free blocks with statements that may run at the same time
+    long block_runs;        // Times such a block ran on the thread pool
+    long tasks;             // Statements run on the thread pool
+    long steals;            // Statements a worker took from another worker's deque
+    int threads;            // Worker threads, 0 if the pool was never started
+} ParallelStats;
+
+// Split the program into jump-free blocks and find the statements of each
+// block that do not depend on each other. threads == 0 means one worker per
+// processor; blocks that ran faster than min_ns stay sequential.
+ParallelState *parallel_new(Statement **statements, int stmt_count, int threads, long min_ns);
+void free_parallel(ParallelState *parallel);
+
+// Run from the program counter like the tree-walking interpreter. Output and
+// errors match sequential execution. When a statement fails, statements after
+// it in the same block may already have assigned their variables.
+bool parallel_run(ParallelState *parallel, MachineState *state, bool interactive);
+
+// Evaluate the arguments of a call on state->arg_pool when at least two of
+// them are estimated to cost state->arg_min_cost or more. Cheap arguments and
+// the last costly one are evaluated on the calling thread. Returns -1, having
+// evaluated nothing, if the call does not qualify. Otherwise returns the
+// index of the first failing argument, after reporting its error and freeing
+// every argument, or the argument count when all of them succeeded.
+int parallel_evaluate_args(Pinch_Func *func, MachineState *state, Value **args);
+
+ParallelStats parallel_stats(ParallelState *parallel);
+void print_parallel_stats(ParallelState *parallel);
+
+#endif
@@ -5,6 +5,7 @@
 #include "util.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 // Helper to allocate memory for a factor
 Factor* create_factor(factor_type type) {
@@ -85,6 +86,68 @@ void free_statement(Statement *stmt) {
     }
 }
 
+// Helper to duplicate a string owned by a copied node
+static char *copy_text(const char *s) {
+    char *copy = xalloc(strlen(s) + 1, "Interpreter Error: Fail to allocate memory while copying statement.\n");
+    strcpy(copy, s);
+    return copy;
+}
+
+static Pinch_Func *copy_pinch_func(Pinch_Func *func);
+
+static Factor *copy_factor(Factor *f) {
+    Factor *copy = create_factor(f->type);
+    copy->data = f->data;
+    if (f->type == FACTOR_STR) {
+        copy->data.str = copy_text(f->data.str);
+    } else if (f->type == FACTOR_VAR) {
+        copy->data.var = copy_text(f->data.var);
+    } else if (f->type == FACTOR_FUNC) {
+        copy->data.func = copy_pinch_func(f->data.func);
+    }
+    return copy;
+}
+
+static Factors *copy_factors(Factors *factors) {
+    Factors *copy = xalloc(sizeof(Factors), "Interpreter Error: Fail to allocate memory while copying statement.\n");
+    copy->count = factors->count;
+    copy->capacity = factors->count > 0 ? factors->count : 1;
+    copy->items = xalloc(copy->capacity * sizeof(Factor*), "Interpreter Error: Fail to allocate memory while copying statement.\n");
+    for (int i = 0; i < factors->count; i++) {
+        copy->items[i] = copy_factor(factors->items[i]);
+    }
+    return copy;
+}
+
+// The copy starts unresolved, so it is quickened on its own first execution
+static Pinch_Func *copy_pinch_func(Pinch_Func *func) {
+    Pinch_Func *copy = xalloc(sizeof(Pinch_Func), "Interpreter Error: Fail to allocate memory while copying statement.\n");
+    copy->name = copy_text(func->name);
+    copy->factors = copy_factors(func->factors);
+    copy->quick = QUICK_UNRESOLVED;
+    copy->builtin = NULL;
+    copy->cost = 0;
+    return copy;
+}
+
+Statement *copy_statement(Statement *stmt) {
+    Statement *copy = xalloc(sizeof(Statement), "Interpreter Error: Fail to allocate memory while copying statement.\n");
+    copy->type = stmt->type;
+    copy->number = stmt->number;
+    copy->line = stmt->line;
+    if (stmt->type == PINCH_VAR) {
+        Pinch_Var *var = xalloc(sizeof(Pinch_Var), "Interpreter Error: Fail to allocate memory while copying statement.\n");
+        var->name = copy_text(stmt->content.pinch_var->name);
+        var->factors = copy_factors(stmt->content.pinch_var->factors);
+        copy->content.pinch_var = var;
+    } else if (stmt->type == PINCH_FUNC_S) {
+        copy->content.pinch_func = copy_pinch_func(stmt->content.pinch_func);
+    } else {
+        copy->content.factor = copy_factor(stmt->content.factor);
+    }
+    return copy;
+}
+
 // <factor> ::= <num_literal> | '"' <str_literal> '"' | <jump_literal> | <var-name> | '('<pinch_func>')'
 parse_factor_result parse_factor(char *input) {
     char *current_input = skip_whitespace(input);
@@ -180,11 +243,7 @@ parse_factors_result parse_factors(char *input) {
 
                 // If factors' list is full, resize list
                 if (factors->count >= factors->capacity) {
-                    factors -> items = realloc(factors->items, 2 * factors->capacity * sizeof(Factor*));
-                    if (factors->items == NULL) {
-                        fprintf(stderr, "Interpreter Error: Fail to allocate memory while parsing factors.\n");
-                        exit(EXIT_FAILURE);
-                    }
+                    factors -> items = xrealloc(factors->items, 2 * factors->capacity * sizeof(Factor*), "Interpreter Error: Fail to allocate memory while parsing factors.\n");
                     factors -> capacity *= 2;
                 }
 
@@ -305,12 +364,7 @@ parse_pinch_func_result parse_pinch_func(char *input) {
 
             // expand left pinch capacity to fit right pinch
             final_factors->capacity += r_factors->count; 
-            final_factors->items = realloc(final_factors->items, final_factors->capacity * sizeof(Factor*));
-            
-            if (final_factors->items == NULL) {
-                fprintf(stderr, "Interpreter Error: Fail to allocate memory while parsing function.\n");
-                exit(EXIT_FAILURE);
-            }
+            final_factors->items = xrealloc(final_factors->items, final_factors->capacity * sizeof(Factor*), "Interpreter Error: Fail to allocate memory while parsing function.\n");
 
             // copy pointers from right pinch to left pinch
             for (int i = 0; i < r_factors->count; i++) {
@@ -341,6 +395,9 @@ parse_pinch_func_result parse_pinch_func(char *input) {
         Pinch_Func *pinch_func = xalloc(sizeof(Pinch_Func), "Interpreter Error: Fail to allocate memory while parsing function.\n");
         pinch_func->name = func_name_result.name;
         pinch_func->factors = final_factors;
+        pinch_func->quick = QUICK_UNRESOLVED;
+        pinch_func->builtin = NULL;
+        pinch_func->cost = 0;
 
         char *final_input = right_pinch_result.success ? right_pinch_result.next_input : func_name_result.next_input;
         return (parse_pinch_func_result){true, pinch_func, final_input};
@@ -410,6 +467,8 @@ parse_pinch_var_result parse_pinch_var(char *input) {
 parse_statement_result parse_statement(char *input) {
     char *current_input = skip_whitespace(input);
     Statement *stmt = xalloc(sizeof(Statement), "Interpreter Error: Fail to allocate memory while parsing statement.\n");
+    stmt->number = 0;
+    stmt->line = 0;
     
     // We need a temporary pointer to track where the logic ends
     // so we can check for the newline character afterwards.
@@ -49,9 +49,27 @@ struct Factors {
     int capacity;
 };
 
+// Variants a call node is rewritten into by the interpreter after its first
+// execution. Specialised variants fall back to QUICK_GENERIC when a guard fails.
+typedef enum {
+    QUICK_UNRESOLVED,   // Not executed yet
+    QUICK_GENERIC,      // Cached in-built function, arguments boxed as Values
+    QUICK_UNKNOWN,      // Name does not refer to any function
+    QUICK_JUMP,
+    QUICK_JUMP_IF,
+    QUICK_NUM_BINARY,   // Number operation on two Number variables or literals
+    QUICK_CONCAT        // CONCAT on two Text variables or literals
+} quick_kind;
+
+struct Builtin;
+
 struct Pinch_Func {
     char *name;
     Factors *factors;
+    quick_kind quick;
+    const struct Builtin *builtin;  // Resolved on first execution
+    int cost;                       // Estimated evaluation cost, 0 until first needed and
+                                    // -1 if the call must not run alongside others
 };
 
 struct Pinch_Var {
@@ -61,6 +79,8 @@ struct Pinch_Var {
 
 struct Statement {
     enum statement_type type;
+    int number;  // 1-based position in the program, 0 outside of a program
+    int line;    // Physical line in the source file, 0 outside of a program
     union {
         Pinch_Var *pinch_var;
         Pinch_Func *pinch_func;
@@ -98,7 +118,13 @@ typedef struct {
     char *next_input;
 } parse_statement_result;
 
+void free_factor(Factor *f);
+void free_pinch_func(Pinch_Func *pinch_func);
 void free_statement(Statement *stmt);
+
+// Deep copy. The interpreter rewrites call nodes as it runs them, so threads
+// that run the same program each need a copy of their own.
+Statement *copy_statement(Statement *stmt);
 parse_statement_result parse_statement(char *input);
 
 #endif
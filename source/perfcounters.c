@@ -0,0 +1,161 @@
+// Logic for reading hardware performance counters with perf_event_open
+
+#include "perfcounters.h"
+#include "metrics.h"
+#include "util.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+typedef struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} EventSpec;
+
+typedef struct {
+    long calls;
+    PerfValues totals;
+} BuiltinCounts;
+
+bool perf_enabled = false;
+bool perf_builtins_enabled = false;
+
+static int fds[PERF_EVENTS] = {-1, -1, -1, -1, -1};
+static BuiltinCounts *builtins = NULL;  // One per metrics_index, written by the counted thread
+static _Thread_local bool counted_thread = false;
+
+#if defined(__linux__)
+static const EventSpec specs[PERF_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"dTLB-misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+static int open_event(const EventSpec *spec) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec->type;
+    attr.config = spec->config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#else
+static const EventSpec specs[PERF_EVENTS] = {
+    {"cycles", 0, 0}, {"instructions", 0, 0}, {"branch-misses", 0, 0}, {"cache-misses", 0, 0}, {"dTLB-misses", 0, 0},
+};
+
+static int open_event(const EventSpec *spec) {
+    (void)spec;
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+bool open_perf_counters(bool per_builtin) {
+    if (perf_counting()) return true;
+    int opened = 0;
+    int first_error = 0;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        fds[e] = open_event(&specs[e]);
+        if (fds[e] >= 0) {
+            opened++;
+        } else if (first_error == 0) {
+            first_error = errno;
+        }
+    }
+    if (opened == 0) {
+        fprintf(stderr, "Perf counters: unavailable (%s), running without them.\n", strerror(first_error));
+        return false;
+    }
+    if (per_builtin) {
+        size_t size = metrics_count() * sizeof(BuiltinCounts);
+        builtins = xalloc(size, "Interpreter Error: Fail to allocate memory for perf counters.\n");
+        memset(builtins, 0, size);
+    }
+    counted_thread = true;
+    __atomic_store_n(&perf_enabled, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&perf_builtins_enabled, per_builtin, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool perf_available(PerfEvent event) {
+    return fds[event] >= 0;
+}
+
+PerfValues perf_read() {
+    PerfValues values = {{0}};
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        uint64_t raw[3];    // Value, time enabled, time running
+        if (fds[e] < 0 || read(fds[e], raw, sizeof(raw)) != sizeof(raw)) continue;
+        values.values[e] = raw[2] > 0 && raw[2] < raw[1] ? (uint64_t)((double)raw[0] * raw[1] / raw[2]) : raw[0];
+    }
+    return values;
+}
+
+void perf_record_call(Pinch_Func *func, PerfValues start) {
+    if (!counted_thread) return;
+    int index = metrics_index(func);
+    if (index < 0) return;
+    PerfValues end = perf_read();
+    BuiltinCounts *counts = &builtins[index];
+    counts->calls++;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        counts->totals.values[e] += end.values[e] - start.values[e];
+    }
+}
+
+// ---------------------------------------------------------
+// REPORT
+// ---------------------------------------------------------
+
+static void print_header(FILE *out, const char *first) {
+    fprintf(out, "%-10s", first);
+    for (int e = 0; e < PERF_EVENTS; e++) fprintf(out, " %14s", specs[e].name);
+    fprintf(out, " %6s\n", "IPC");
+}
+
+static void print_row(FILE *out, const char *name, const PerfValues *values, double per) {
+    fprintf(out, "%-10s", name);
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (perf_available(e)) {
+            fprintf(out, " %14.0f", values->values[e] / per);
+        } else {
+            fprintf(out, " %14s", "n/a");
+        }
+    }
+    uint64_t cycles = values->values[PERF_CYCLES];
+    if (perf_available(PERF_CYCLES) && perf_available(PERF_INSTRUCTIONS) && cycles > 0) {
+        fprintf(out, " %6.2f\n", (double)values->values[PERF_INSTRUCTIONS] / cycles);
+    } else {
+        fprintf(out, " %6s\n", "n/a");
+    }
+}
+
+void print_perf_counters(FILE *out, const char **phase_names, const PerfValues *phases, int phase_count) {
+    if (!perf_counting()) return;
+    fprintf(out, "Perf counters: user space of the interpreter thread, n/a where not available.\n");
+    print_header(out, "phase");
+    for (int p = 0; p < phase_count; p++) {
+        print_row(out, phase_names[p], &phases[p], 1);
+    }
+    if (!perf_per_builtin()) return;
+
+    fprintf(out, "Perf counters: per call of each builtin, measurement included.\n");
+    print_header(out, "builtin");
+    for (int i = 0; i < metrics_count(); i++) {
+        if (builtins[i].calls == 0) continue;
+        print_row(out, metrics_name(i), &builtins[i].totals, (double)builtins[i].calls);
+    }
+}
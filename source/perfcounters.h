@@ -0,0 +1,54 @@
+// perfcounters.h
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "parser.h"
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    PERF_DTLB_MISSES,       // Data TLB load misses
+    PERF_EVENTS
+} PerfEvent;
+
+typedef struct {
+    uint64_t values[PERF_EVENTS];
+} PerfValues;
+
+// Open hardware counters for the calling thread with perf_event_open, user
+// space only. Counters the processor, kernel or container does not allow are
+// left out and reported as unavailable; returns false, with the reason on
+// stderr, if none could be opened. With per_builtin, builtin calls made on
+// that thread are counted as well, which costs a few system calls per call.
+bool open_perf_counters(bool per_builtin);
+
+extern bool perf_enabled;           // Only written by open_perf_counters
+extern bool perf_builtins_enabled;
+
+static inline bool perf_counting() {
+    return __atomic_load_n(&perf_enabled, __ATOMIC_RELAXED);
+}
+
+static inline bool perf_per_builtin() {
+    return __atomic_load_n(&perf_builtins_enabled, __ATOMIC_RELAXED);
+}
+
+// Current values, scaled up for the time a counter was multiplexed out.
+// Values of unavailable counters stay 0.
+PerfValues perf_read();
+bool perf_available(PerfEvent event);
+
+// Count one builtin call: take perf_read() before dispatching it and hand it
+// to perf_record_call afterwards. Calls on other threads are ignored.
+void perf_record_call(Pinch_Func *func, PerfValues start);
+
+// Counters for each phase, by name, then per builtin if counted
+void print_perf_counters(FILE *out, const char **phase_names, const PerfValues *phases, int phase_count);
+
+#endif
@@ -10,6 +10,21 @@
 #include "interpreter.h"
 #include "util.h"
 #include "list.h"
+#include "engine.h"
+#include "transpiler.h"
+#include "memo.h"
+#include "metrics.h"
+#include "reactive.h"
+#include "parallel.h"
+#include "threadpool.h"
+#include "batch.h"
+#include "allocstats.h"
+#include "trace.h"
+#include "sampler.h"
+#include "runstats.h"
+#include "perfcounters.h"
+#include "server.h"
+#include <signal.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -17,214 +32,372 @@
 
 #define MAX_LINE_LENGTH 1024
 
-// DJB2 Hash Function for Strings
-int hash_string(const void *key) {
-    unsigned long hash = 5381;
-    int c;
-    const char *str = (const char *)key;
-
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+// Command line options
+typedef struct {
+    const char *filepath;
+    const Engine *engine;
+    EngineOptions engine_options;
+    bool emit_c;        // Print the program translated to C instead of running it
+    int memo_entries;   // Size of the pure builtin memo cache, 0 when disabled
+    bool memo_stats;    // Print memo cache hits and misses
+    bool metrics;       // Count and time builtin calls, printed at exit
+    bool metrics_json;
+    MetricsClock metrics_clock;
+    bool reactive;      // Keep the program as a dataflow graph and read updates from stdin
+    int arg_min_cost;   // Cost at which arguments are evaluated concurrently, 0 when disabled
+    bool each;          // Run the program once per line of stdin
+    int workers;        // Threads running records in --each mode, or serving connections
+    const char *socket_path;    // Serve requests on this Unix socket
+    int cache_entries;  // Compiled programs the server keeps
+    long time_limit_ms; // Per server request, 0 for none
+    long memory_limit_mb;   // Per server request, 0 for none
+    const char *trace_path; // Write a Chrome trace of the run here
+    int trace_sample;   // Trace one statement in this many
+    int sample_hz;      // Sample the running line this often, 0 when not sampling
+    const char *folded_path;    // Write the sampled stacks here
+    bool stats;         // Summarize the run in one line at exit
+    bool stats_json;
+    const char *stats_path;     // Where the summary goes, NULL meaning stderr
+    bool perf_counters; // Read hardware counters around each phase
+    bool perf_builtins; // and around builtin calls
+} RunOptions;
+
+// Filled in by every mode when options.stats is set, printed at exit
+static RunStats run_stats;
+
+static MachineState *create_state(RunOptions *options) {
+    MachineState *state = new_machine_state();
+    if (options->memo_entries > 0) {
+        state->memo = memo_new(options->memo_entries);
     }
-    
-    // Bitwise AND ensures the hash is a positive integer
-    return (int)(hash & 0x7FFFFFFF); 
+    if (options->metrics) {
+        state->metrics = metrics_new(options->metrics_clock);
+    }
+    if (options->stats) {
+        state->counters = &run_stats.counters;
+    }
+    if (options->arg_min_cost > 0) {
+        int threads = options->engine_options.threads;
+        state->arg_pool = pool_new(threads > 0 ? threads : pool_default_threads());
+        state->arg_min_cost = options->arg_min_cost;
+    }
+    return state;
 }
 
-struct hashmap *create_var_hashmap() {
-    // 16 initial buckets, 5 elements per bucket initial capacity
-    return hashmap_new(16, 5, hash_string);
+// Batch mode creates a state for every worker
+static MachineState *create_worker_state(void *options) {
+    return create_state((RunOptions*)options);
 }
 
-void free_state(MachineState *state) {
-    if (state == NULL) return;
+// Read an entire source file into memory, exiting if it cannot be opened
+static char *read_source(const char *filepath) {
+    PhaseTime start = phase_now();
+    FILE *file = fopen(filepath, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open file '%s'\n", filepath);
+        exit(EXIT_FAILURE);
+    }
 
-    // Free Statements
-    if (state->statements != NULL) {
-        for (int i = 0; i < state->stmt_count; i++) {
-            free_statement(state->statements[i]);
-        }
-        xfree(state->statements);
+    // Find file size
+    fseek(file, 0, SEEK_END);
+    long fsize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // Read entire file into memory
+    char *source_code = xalloc(fsize + 1, "Interpreter Error: Fail to allocate memory for source code.\n");
+    fread(source_code, 1, fsize, file);
+    fclose(file);
+    source_code[fsize] = 0; // Null-terminate
+    phase_add(&run_stats, RUN_PHASE_READ, start);
+    return source_code;
+}
+
+// Parse a source file's contents, exiting on a syntax error
+static Program *load_source(const char *source_code) {
+    PhaseTime start = phase_now();
+    Program *program = load_program(source_code);
+    phase_add(&run_stats, RUN_PHASE_PARSE, start);
+
+    if (program == NULL) {
+        fprintf(stderr, "Compilation failed due to syntax error.\n");
+        exit(EXIT_FAILURE);
     }
+    run_stats.program_statements += program->stmt_count;
+    return program;
+}
 
-    // Free the Variables Hashmap
-    if (state->variables != NULL) {
-        struct hashmap *map = state->variables;
-        
-        // Iterate over the master list of buckets
-        for (int i = 0; i < map->bucket_size; i++) {
-            struct list *bucket = list_get(map->buckets, i);
-            
-            if (bucket != NULL) {
-                // Iterate over every key-value pair inside this bucket
-                for (int j = 0; j < bucket->length; j++) {
-                    struct pair *kv = list_get(bucket, j);
-                    if (kv != NULL) {
-                        xfree(kv->k);
-                        free_value((Value*)kv->v);
-                        xfree(kv);
-                    }
-                }
-                free_list(bucket);
-            }
+// Prompt for the next REPL line. Returns false on EOF or exit/quit.
+static bool read_repl_line(char *line, int size) {
+    while (true) {
+        printf(">> ");
+        if (fgets(line, size, stdin) == NULL) {
+            printf("\n");
+            return false; // Handle EOF (Ctrl+D)
         }
-        
-        free_list(map->buckets); 
-        xfree(map);
+
+        // Remove trailing newline
+        line[strcspn(line, "\n")] = 0;
+
+        if (strcmp(line, "exit") == 0 || strcmp(line, "quit") == 0) {
+            return false;
+        }
+
+        // Skip empty lines
+        if (strlen(line) > 0) return true;
     }
-    xfree(state);
 }
 
 // ---------------------------------------------------------
 // Interactive REPL Mode
 // ---------------------------------------------------------
-void run_repl() {
+
+// A state saved with ":snapshot NAME"
+typedef struct {
+    char *name;
+    Snapshot *snapshot;
+} NamedSnapshot;
+
+static NamedSnapshot *find_snapshot(struct list *snapshots, const char *name) {
+    for (int i = 0; i < snapshots->length; i++) {
+        NamedSnapshot *named = list_get(snapshots, i);
+        if (strcmp(named->name, name) == 0) return named;
+    }
+    return NULL;
+}
+
+// Handle a line starting with ':'. Variable statements never do, so the
+// commands cannot hide a statement.
+static void run_repl_command(const char *line, MachineState *state, struct list *snapshots) {
+    char command[16];
+    char name[MAX_LINE_LENGTH];
+    int fields = sscanf(line, ":%15s %1023s", command, name);
+
+    if (fields == 1 && strcmp(command, "snapshots") == 0) {
+        for (int i = 0; i < snapshots->length; i++) {
+            printf("%s\n", ((NamedSnapshot*)list_get(snapshots, i))->name);
+        }
+    } else if (fields == 2 && strcmp(command, "snapshot") == 0) {
+        NamedSnapshot *named = find_snapshot(snapshots, name);
+        if (named == NULL) {
+            named = xalloc(sizeof(NamedSnapshot), "Interpreter Error: Fail to allocate memory for snapshot.\n");
+            named->name = xalloc(strlen(name) + 1, "Interpreter Error: Fail to allocate memory for snapshot.\n");
+            strcpy(named->name, name);
+            list_append(snapshots, named);
+        } else {
+            free_snapshot(named->snapshot);
+        }
+        named->snapshot = snapshot_state(state);
+    } else if (fields == 2 && strcmp(command, "restore") == 0) {
+        NamedSnapshot *named = find_snapshot(snapshots, name);
+        if (named == NULL) {
+            fprintf(stderr, "No snapshot named '%s'.\n", name);
+        } else {
+            restore_state(state, named->snapshot);
+        }
+    } else {
+        fprintf(stderr, "Unknown command '%s'.\n", line);
+    }
+}
+
+void run_repl(RunOptions *options) {
     printf("PINCH INTERACTIVE MODE\n");
     printf("Type 'exit' or 'quit' to close.\n");
+    printf("':snapshot NAME' saves the variables, ':restore NAME' brings them back, ':snapshots' lists them.\n");
 
     char line[MAX_LINE_LENGTH];
     
     // Create MachineState
-    MachineState *state = xalloc(sizeof(MachineState), "Alloc MachineState");
-    state->program_counter = 0;
-    state->statements = NULL;
-    state->stmt_count = 0;
-    state->variables = create_var_hashmap();
+    MachineState *state = create_state(options);
+    struct list *snapshots = list_new(4);
     
-    while (true) {
-        printf(">> ");
-        if (fgets(line, sizeof(line), stdin) == NULL) {
-            printf("\n");
-            break; // Handle EOF (Ctrl+D)
+    while (read_repl_line(line, sizeof(line))) {
+        if (line[0] == ':') {
+            run_repl_command(line, state, snapshots);
+            continue;
         }
 
-        // Remove trailing newline
-        line[strcspn(line, "\n")] = 0;
-
-        if (strcmp(line, "exit") == 0 || strcmp(line, "quit") == 0) {
-            break;
-        }
-
-        // Skip empty lines
-        if (strlen(line) == 0) continue; 
-
         // Parse a single line
+        set_alloc_phase(ALLOC_PHASE_LOAD);
+        PhaseTime start = phase_now();
         parse_statement_result res = parse_statement(line);
+        phase_add(&run_stats, RUN_PHASE_PARSE, start);
         
         if (res.success) {
-            interpret_line(res.stmt, state, true);
-            free_statement(res.stmt);
+            // Each line is a one-statement program run on the shared state
+            run_stats.program_statements++;
+            Program *program = program_from_statement(res.stmt);
+            start = phase_now();
+            PreparedProgram *prepared = prepare_program(options->engine, program, &options->engine_options);
+            phase_add(&run_stats, RUN_PHASE_PREPARE, start);
+            state->program_counter = 0;
+            set_alloc_phase(ALLOC_PHASE_EXECUTE);
+            start = phase_now();
+            run_program(prepared, state);
+            phase_add(&run_stats, RUN_PHASE_EXECUTE, start);
+            free_prepared(prepared);
+            free_program(program);
         } else {
             fprintf(stderr, "Syntax Error.\n");
         }
+        set_alloc_phase(ALLOC_PHASE_OTHER);
+    }
+    if (options->memo_stats) {
+        print_memo_stats(state->memo);
+    }
+    print_metrics(stderr, state->metrics, options->metrics_json);
+    for (int i = 0; i < snapshots->length; i++) {
+        NamedSnapshot *named = list_get(snapshots, i);
+        free_snapshot(named->snapshot);
+        xfree(named->name);
+        xfree(named);
     }
+    free_list(snapshots);
     free_state(state);
 }
 
 // ---------------------------------------------------------
 // File Execution Mode
 // ---------------------------------------------------------
-void run_file(const char *filepath) {
-    FILE *file = fopen(filepath, "r");
-    if (!file) {
-        fprintf(stderr, "Error: Could not open file '%s'\n", filepath);
-        exit(EXIT_FAILURE);
+void run_file(RunOptions *options) {
+    const char *filepath = options->filepath;
+    set_alloc_phase(ALLOC_PHASE_LOAD);
+    char *source_code = read_source(filepath);
+    Program *program = load_source(source_code);
+    xfree(source_code);
+
+    PhaseTime start = phase_now();
+    PreparedProgram *prepared = prepare_program(options->engine, program, &options->engine_options);
+    phase_add(&run_stats, RUN_PHASE_PREPARE, start);
+
+    if (options->emit_c) {
+        emit_c_program(stdout, program->statements, program->stmt_count, filepath);
+    } else {
+        set_alloc_phase(ALLOC_PHASE_EXECUTE);
+        MachineState *state = create_state(options);
+        start = phase_now();
+        bool success = run_program(prepared, state);
+        phase_add(&run_stats, RUN_PHASE_EXECUTE, start);
+        if (!success) {
+            Statement *current_stmt = program->statements[state->program_counter];
+            fprintf(stderr, "Execution halted at statement %d.\n", current_stmt->number);
+        }
+        set_alloc_phase(ALLOC_PHASE_OTHER);
+        if (options->memo_stats) {
+            print_memo_stats(state->memo);
+        }
+        print_metrics(stderr, state->metrics, options->metrics_json);
+        free_state(state);
     }
 
-    // Find file size
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    free_prepared(prepared);
+    free_program(program);
+}
 
-    // Read entire file into memory
-    char *source_code = xalloc(fsize + 1, "Interpreter Error: Fail to allocate memory for source code.\n");
-    fread(source_code, 1, fsize, file);
-    fclose(file);
-    source_code[fsize] = 0; // Null-terminate
-    
-    // Create and initialize MachineState
-    MachineState *state = xalloc(sizeof(MachineState), "Interpreter Error: Fail to allocate memory for MachineState.\n");
-    state->program_counter = 0;
-    state->stmt_count = 0;
-    state->variables = create_var_hashmap();
-    
-    int capacity = 64; // Initial array capacity
-    state->statements = xalloc(capacity * sizeof(Statement*), "Interpreter Error: Fail to allocate memory for statements.\n");
+// ---------------------------------------------------------
+// Batch Mode
+// ---------------------------------------------------------
+bool run_each(RunOptions *options) {
+    set_alloc_phase(ALLOC_PHASE_LOAD);
+    char *source_code = read_source(options->filepath);
+    Program *program = load_source(source_code);
+    xfree(source_code);
 
-    bool syntax_error = false;
-    int physical_line = 1;
-    char *current_pos = source_code;
+    // Records are small, so flush output in blocks instead of per line
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+
+    BatchOptions batch = {0};
+    batch.engine = options->engine;
+    batch.engine_options = options->engine_options;
+    batch.workers = options->workers > 0 ? options->workers : 1;
+    batch.new_state = create_worker_state;
+    batch.state_context = options;
+    BatchStats stats;
+    set_alloc_phase(ALLOC_PHASE_EXECUTE);
+    PhaseTime start = phase_now();
+    bool success = batch_run(program, &batch, stdin, stdout, stderr, &stats);
+    phase_add(&run_stats, RUN_PHASE_EXECUTE, start);
+    set_alloc_phase(ALLOC_PHASE_OTHER);
+    fflush(stdout);
+
+    free_program(program);
+    return success;
+}
 
-    // Traverse the file string line by line
-    while (*current_pos != '\0') {
-        char *newline = strchr(current_pos, '\n');
-        int len = newline ? (newline - current_pos) : (int)strlen(current_pos);
-        
-        char *line_buf = xalloc(len + 2, "Interpreter Error: Fail to allocate memory for a line of code.\n");
-        strncpy(line_buf, current_pos, len);
-        line_buf[len] = '\n';
-        line_buf[len + 1] = '\0';
-
-        // Check if the line is just empty whitespace
-        bool is_empty = true;
-        for (int i = 0; i < len; i++) {
-            if (line_buf[i] != ' ' && line_buf[i] != '\t' && line_buf[i] != '\r') {
-                is_empty = false;
-                break;
-            }
-        }
+// ---------------------------------------------------------
+// Server Mode
+// ---------------------------------------------------------
+bool run_server(RunOptions *options) {
+    ServerOptions server_options = {0};
+    server_options.engine = options->engine;
+    server_options.engine_options = options->engine_options;
+    server_options.workers = options->workers;
+    server_options.cache_entries = options->cache_entries;
+    server_options.time_limit_ms = options->time_limit_ms;
+    server_options.memory_limit = (size_t)options->memory_limit_mb << 20;
+
+    // Only this thread takes the stop signals, the server threads inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    Server *server = server_start(options->socket_path, &server_options);
+    if (server == NULL) {
+        return false;
+    }
+    fprintf(stderr, "Serving on '%s'.\n", options->socket_path);
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    server_stop(server);
+    return true;
+}
 
-        if (!is_empty) {
-            parse_statement_result res = parse_statement(line_buf);
-            
-            if (res.success) {
-                // Resize the dynamic array if hit capacity
-                if (state->stmt_count >= capacity) {
-                    capacity *= 2;
-                    Statement **new_stmts = xalloc(capacity * sizeof(Statement*), "Resize stmts");
-                    for (int i = 0; i < state->stmt_count; i++) {
-                        new_stmts[i] = state->statements[i];
-                    }
-                    xfree(state->statements);
-                    state->statements = new_stmts;
-                }
-                state->statements[state->stmt_count++] = res.stmt;
-            } else {
-                fprintf(stderr, "Syntax Error on line %d.\n", physical_line);
-                syntax_error = true;
-                xfree(line_buf);
-                break; // Stop parsing on first error
-            }
+// ---------------------------------------------------------
+// Reactive Mode
+// ---------------------------------------------------------
+void run_reactive(RunOptions *options) {
+    MachineState *state = create_state(options);
+    ReactiveGraph *graph = reactive_new(state);
+
+    // A program given on the command line seeds the graph
+    if (options->filepath != NULL) {
+        char *source_code = read_source(options->filepath);
+        Program *program = load_program(source_code);
+        xfree(source_code);
+
+        if (program == NULL) {
+            fprintf(stderr, "Compilation failed due to syntax error.\n");
+            exit(EXIT_FAILURE);
         }
-        
-        xfree(line_buf);
-        
-        if (!newline) break; 
-        current_pos = newline + 1;
-        physical_line++;
+        // reactive_load explains why a program does not fit the graph
+        if (!reactive_load(graph, program)) {
+            free_program(program);
+            free_reactive(graph);
+            free_state(state);
+            exit(EXIT_FAILURE);
+        }
+        free_program(program);
     }
-    
-    xfree(source_code);
 
-    if (syntax_error) {
-        free_state(state);
-        fprintf(stderr, "Compilation failed due to syntax error.\n");
-        exit(EXIT_FAILURE);
-    }
+    printf("PINCH REACTIVE MODE\n");
+    printf("Assigning a variable again re-evaluates the statements that use it.\n");
+    printf("Type 'exit' or 'quit' to close.\n");
 
-    // Execution
-    while (state->program_counter >= 0 && state->program_counter < state->stmt_count) {
-        Statement *current_stmt = state->statements[state->program_counter];
-        
-        // Interpret a single line (Interactive = false)
-        bool success = interpret_line(current_stmt, state, false);
-        
-        if (!success) {
-            fprintf(stderr, "Execution halted at statement %d.\n", state->program_counter + 1);
-            break; 
+    char line[MAX_LINE_LENGTH];
+    while (read_repl_line(line, sizeof(line))) {
+        parse_statement_result res = parse_statement(line);
+        if (res.success) {
+            reactive_update(graph, res.stmt);
+        } else {
+            fprintf(stderr, "Syntax Error.\n");
         }
-        state->program_counter++;
     }
+    if (options->memo_stats) {
+        print_memo_stats(state->memo);
+    }
+    print_metrics(stderr, state->metrics, options->metrics_json);
+    free_reactive(graph);
     free_state(state);
 }
 
@@ -233,99 +406,297 @@ void run_file(const char *filepath) {
 // ---------------------------------------------------------
 #ifdef __EMSCRIPTEN__
 EMSCRIPTEN_KEEPALIVE
-void run_web(const char *source_code) {
-    MachineState *state = xalloc(sizeof(MachineState), "Alloc MachineState");
-    state->program_counter = 0;
-    state->variables = create_var_hashmap();
-    state->stmt_count = 0;
-    
-    int capacity = 64; 
-    state->statements = xalloc(capacity * sizeof(Statement*), "Alloc Statements");
-
-    bool syntax_error = false;
-    int physical_line = 1;
-    const char *current_pos = source_code;
-
-    while (*current_pos != '\0') {
-        const char *newline = strchr(current_pos, '\n');
-        int len = newline ? (newline - current_pos) : (int)strlen(current_pos);
-        
-        char *line_buf = xalloc(len + 2, "Alloc line buffer");
-        strncpy(line_buf, current_pos, len);
-        line_buf[len] = '\n';
-        line_buf[len + 1] = '\0';
-
-        bool is_empty = true;
-        for (int i = 0; i < len; i++) {
-            if (line_buf[i] != ' ' && line_buf[i] != '\t' && line_buf[i] != '\r' && line_buf[i] != '\n') {
-                is_empty = false;
-                break;
-            }
-        }
-
-        if (!is_empty) {
-            parse_statement_result res = parse_statement(line_buf);
-            
-            if (res.success) {
-                if (state->stmt_count >= capacity) {
-                    capacity *= 2;
-                    Statement **new_stmts = xalloc(capacity * sizeof(Statement*), "Resize stmts");
-                    for (int i = 0; i < state->stmt_count; i++) new_stmts[i] = state->statements[i];
-                    xfree(state->statements);
-                    state->statements = new_stmts;
-                }
-                state->statements[state->stmt_count++] = res.stmt;
-            } else {
-                fprintf(stderr, "Syntax Error on line %d.\n", physical_line);
-                syntax_error = true;
-                xfree(line_buf);
-                break; 
-            }
-        }
-        
-        xfree(line_buf);
-        if (!newline) break; 
-        current_pos = newline + 1;
-        physical_line++;
+void run_web(const char *source_code, const char *engine_name) {
+    // Pages that only pass the source get the default engine
+    const Engine *engine = engine_name != NULL ? find_engine(engine_name) : default_engine();
+    if (engine == NULL) {
+        fprintf(stderr, "Unknown engine '%s'.\n", engine_name);
+        return;
     }
 
-    if (syntax_error) {
-        free_state(state);
+    Program *program = load_program(source_code);
+    if (program == NULL) {
         return; // Return instead of exit() so the web tab stays alive
     }
 
-    // Execution Loop
-    while (state->program_counter >= 0 && state->program_counter < state->stmt_count) {
-        Statement *current_stmt = state->statements[state->program_counter];
-        bool success = interpret_line(current_stmt, state, false);
-        
-        if (!success) {
-            fprintf(stderr, "Execution halted at statement %d.\n", state->program_counter + 1);
-            break; 
-        }
-        state->program_counter++;
+    EngineOptions engine_options = {0};
+    engine_options.parallel_min_ns = PARALLEL_MIN_BLOCK_NS;
+    PreparedProgram *prepared = prepare_program(engine, program, &engine_options);
+    MachineState *state = new_machine_state();
+
+    if (!run_program(prepared, state)) {
+        Statement *current_stmt = program->statements[state->program_counter];
+        fprintf(stderr, "Execution halted at statement %d.\n", current_stmt->number);
     }
 
     free_state(state);
+    free_prepared(prepared);
+    free_program(program);
 }
 #endif
 
 // ---------------------------------------------------------
 // Main Entry
 // ---------------------------------------------------------
+// Printed last, so blocks still live are the ones the process never freed
+static void print_alloc_stats_at_exit() {
+    print_alloc_stats(stderr, ALLOC_STATS_REPORT_SITES);
+}
+
+static bool stats_json = false;
+static const char *stats_path = NULL;
+
+static void print_run_stats_at_exit() {
+    FILE *out = stats_path != NULL ? fopen(stats_path, "w") : stderr;
+    if (out == NULL) {
+        fprintf(stderr, "Error: Could not open '%s'\n", stats_path);
+        return;
+    }
+    print_run_stats(out, &run_stats, stats_json);
+    if (out != stderr) fclose(out);
+}
+
+static void print_phase_counters_at_exit() {
+    print_phase_counters(stderr, &run_stats);
+}
+
+static const char *folded_stacks_path = NULL;
+
+static void print_sample_profile_at_exit() {
+    stop_sampling();
+    print_sample_profile(stderr, SAMPLE_REPORT_LINES);
+    if (folded_stacks_path == NULL) return;
+    FILE *out = fopen(folded_stacks_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: Could not open '%s'\n", folded_stacks_path);
+        return;
+    }
+    write_folded_stacks(out);
+    fclose(out);
+}
+
 int main(int argc, char **argv) {
 
 #ifdef __EMSCRIPTEN__
     return EXIT_SUCCESS;
 #else
-    if (argc == 1) {
-        run_repl();
-    } else if (argc == 2) {
-        run_file(argv[1]);
-    } else {
-        fprintf(stderr, "Too many arguments provided.\n");
+    // Loading and running recover from running out of memory themselves,
+    // anything else the command line allocates ends the process here
+    AllocRecovery recovery;
+    if (setjmp(recovery.env) != 0) {
+        fputs(recovery.message, stderr);
         return EXIT_FAILURE;
     }
+    push_alloc_recovery(&recovery);
+
+    RunOptions options = {0};
+    options.engine = default_engine();
+    options.engine_options.parallel_min_ns = PARALLEL_MIN_BLOCK_NS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            options.engine = find_engine(argv[i] + 9);
+            if (options.engine == NULL) {
+                fprintf(stderr, "Unknown engine '%s'.\n", argv[i] + 9);
+                print_engines(stderr);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--engines") == 0) {
+            print_engines(stdout);
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "--optimize") == 0) {
+            options.engine_options.optimize = true;
+        } else if (strcmp(argv[i], "--opt-report") == 0) {
+            options.engine_options.optimize = true;
+            options.engine_options.opt_report = true;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            options.engine = find_engine("tree");
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options.engine = find_engine("profile");
+            options.engine_options.stats = true;
+        } else if (strcmp(argv[i], "--engine-stats") == 0 || strcmp(argv[i], "--jit-stats") == 0) {
+            options.engine_options.stats = true;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            char *end;
+            long threads = strtol(argv[i] + 10, &end, 10);
+            if (*end != '\0' || threads <= 0 || threads > 1024) {
+                fprintf(stderr, "Invalid thread count '%s'.\n", argv[i] + 10);
+                return EXIT_FAILURE;
+            }
+            options.engine_options.threads = (int)threads;
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            options.memo_entries = MEMO_DEFAULT_ENTRIES;
+        } else if (strncmp(argv[i], "--memo=", 7) == 0) {
+            char *end;
+            long entries = strtol(argv[i] + 7, &end, 10);
+            if (*end != '\0' || entries <= 0 || entries > (1 << 24)) {
+                fprintf(stderr, "Invalid memo cache size '%s'.\n", argv[i] + 7);
+                return EXIT_FAILURE;
+            }
+            options.memo_entries = (int)entries;
+        } else if (strcmp(argv[i], "--memo-stats") == 0) {
+            options.memo_stats = true;
+            if (options.memo_entries == 0) options.memo_entries = MEMO_DEFAULT_ENTRIES;
+        } else if (strcmp(argv[i], "--metrics") == 0 || strcmp(argv[i], "--metrics=table") == 0) {
+            options.metrics = true;
+            options.metrics_json = false;
+        } else if (strcmp(argv[i], "--metrics=json") == 0) {
+            options.metrics = true;
+            options.metrics_json = true;
+        } else if (strcmp(argv[i], "--metrics-cycles") == 0) {
+            options.metrics = true;
+            options.metrics_clock = METRICS_CLOCK_CYCLES;
+        } else if (strcmp(argv[i], "--alloc-stats") == 0) {
+            if (!tracking_allocations()) {
+                track_allocations();
+                atexit(print_alloc_stats_at_exit);
+            }
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            options.emit_c = true;
+        } else if (strcmp(argv[i], "--parallel-args") == 0) {
+            options.arg_min_cost = PARALLEL_ARG_MIN_COST;
+        } else if (strncmp(argv[i], "--parallel-args=", 16) == 0) {
+            char *end;
+            long cost = strtol(argv[i] + 16, &end, 10);
+            if (*end != '\0' || cost <= 0 || cost > (1 << 24)) {
+                fprintf(stderr, "Invalid argument cost '%s'.\n", argv[i] + 16);
+                return EXIT_FAILURE;
+            }
+            options.arg_min_cost = (int)cost;
+        } else if (strcmp(argv[i], "--reactive") == 0) {
+            options.reactive = true;
+        } else if (strcmp(argv[i], "--each") == 0) {
+            options.each = true;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "--serve needs a socket path.\n");
+                return EXIT_FAILURE;
+            }
+            options.socket_path = argv[++i];
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            char *end;
+            long entries = strtol(argv[i] + 8, &end, 10);
+            if (*end != '\0' || entries <= 0 || entries > (1 << 20)) {
+                fprintf(stderr, "Invalid cache size '%s'.\n", argv[i] + 8);
+                return EXIT_FAILURE;
+            }
+            options.cache_entries = (int)entries;
+        } else if (strncmp(argv[i], "--time-limit=", 13) == 0) {
+            char *end;
+            long ms = strtol(argv[i] + 13, &end, 10);
+            if (*end != '\0' || ms <= 0) {
+                fprintf(stderr, "Invalid time limit '%s'.\n", argv[i] + 13);
+                return EXIT_FAILURE;
+            }
+            options.time_limit_ms = ms;
+        } else if (strncmp(argv[i], "--memory-limit=", 15) == 0) {
+            char *end;
+            long mb = strtol(argv[i] + 15, &end, 10);
+            if (*end != '\0' || mb <= 0 || mb > (1L << 20)) {
+                fprintf(stderr, "Invalid memory limit '%s'.\n", argv[i] + 15);
+                return EXIT_FAILURE;
+            }
+            options.memory_limit_mb = mb;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            char *end;
+            long workers = strtol(argv[i] + 10, &end, 10);
+            if (*end != '\0' || workers <= 0 || workers > 1024) {
+                fprintf(stderr, "Invalid worker count '%s'.\n", argv[i] + 10);
+                return EXIT_FAILURE;
+            }
+            options.workers = (int)workers;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            options.trace_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--trace-sample=", 15) == 0) {
+            char *end;
+            long every = strtol(argv[i] + 15, &end, 10);
+            if (*end != '\0' || every <= 0 || every > (1L << 30)) {
+                fprintf(stderr, "Invalid sample rate '%s'.\n", argv[i] + 15);
+                return EXIT_FAILURE;
+            }
+            options.trace_sample = (int)every;
+        } else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=line") == 0) {
+            options.stats = true;
+            options.stats_json = false;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            options.stats = true;
+            options.stats_json = true;
+        } else if (strncmp(argv[i], "--stats-file=", 13) == 0) {
+            options.stats = true;
+            options.stats_path = argv[i] + 13;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            options.perf_counters = true;
+        } else if (strcmp(argv[i], "--perf-counters=builtins") == 0) {
+            options.perf_counters = true;
+            options.perf_builtins = true;
+        } else if (strcmp(argv[i], "--sample-profile") == 0) {
+            options.sample_hz = SAMPLE_DEFAULT_HZ;
+        } else if (strncmp(argv[i], "--sample-profile=", 17) == 0) {
+            char *end;
+            long hz = strtol(argv[i] + 17, &end, 10);
+            if (*end != '\0' || hz <= 0 || hz > SAMPLE_MAX_HZ) {
+                fprintf(stderr, "Invalid sampling frequency '%s'.\n", argv[i] + 17);
+                return EXIT_FAILURE;
+            }
+            options.sample_hz = (int)hz;
+        } else if (strncmp(argv[i], "--sample-folded=", 16) == 0) {
+            options.folded_path = argv[i] + 16;
+            if (options.sample_hz == 0) options.sample_hz = SAMPLE_DEFAULT_HZ;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown option '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        } else if (options.filepath == NULL) {
+            options.filepath = argv[i];
+        } else {
+            fprintf(stderr, "Too many arguments provided.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.each && options.filepath == NULL) {
+        fprintf(stderr, "--each needs a program file.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Written out at exit, however the run ends
+    if (options.trace_path != NULL) {
+        if (!start_trace(options.trace_path, options.trace_sample)) return EXIT_FAILURE;
+        atexit(stop_trace);
+    }
+    if (options.stats) {
+        count_allocations();
+        stats_json = options.stats_json;
+        stats_path = options.stats_path;
+        atexit(print_run_stats_at_exit);
+    }
+    // Without counters the run goes ahead, only the report is missing
+    if (options.perf_counters && open_perf_counters(options.perf_builtins)) {
+        atexit(print_phase_counters_at_exit);
+    }
+    if (options.sample_hz > 0) {
+        if (!start_sampling(options.sample_hz)) return EXIT_FAILURE;
+        folded_stacks_path = options.folded_path;
+        atexit(print_sample_profile_at_exit);
+    }
+
+    if (options.socket_path != NULL) {
+        if (!run_server(&options)) {
+            pop_alloc_recovery(&recovery);
+            return EXIT_FAILURE;
+        }
+    } else if (options.reactive) {
+        run_reactive(&options);
+    } else if (options.each) {
+        if (!run_each(&options)) {
+            pop_alloc_recovery(&recovery);
+            return EXIT_FAILURE;
+        }
+    } else if (options.filepath == NULL) {
+        run_repl(&options);
+    } else {
+        run_file(&options);
+    }
+    pop_alloc_recovery(&recovery);
     return EXIT_SUCCESS;
 #endif
 
@@ -0,0 +1,154 @@
+// Logic for counting and timing the statements of a program as it runs
+
+#include "profile.h"
+#include "analysis.h"
+#include "util.h"
+#include <stdlib.h>
+#include <time.h>
+
+// Loops listed for one line before the rest are elided
+#define PROFILE_LOOPS_SHOWN 3
+
+// A loop closed by a backward jump from statement end to statement start
+typedef struct {
+    int start;
+    int end;
+} Loop;
+
+struct Profile {
+    Statement **statements;
+    int stmt_count;
+    StatementProfile *counts;
+};
+
+Profile *profile_new(Statement **statements, int stmt_count) {
+    Profile *profile = xalloc(sizeof(Profile), "Interpreter Error: Fail to allocate memory for profile.\n");
+    profile->statements = statements;
+    profile->stmt_count = stmt_count;
+    profile->counts = xalloc((stmt_count + 1) * sizeof(StatementProfile), "Interpreter Error: Fail to allocate memory for profile.\n");
+    for (int i = 0; i < stmt_count; i++) {
+        profile->counts[i] = (StatementProfile){statements[i]->line, 0, 0};
+    }
+    return profile;
+}
+
+void free_profile(Profile *profile) {
+    if (profile == NULL) return;
+    xfree(profile->counts);
+    xfree(profile);
+}
+
+StatementProfile profile_statement(Profile *profile, int index) {
+    return profile->counts[index];
+}
+
+// ---------------------------------------------------------
+// RUN
+// ---------------------------------------------------------
+
+static int64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+bool profile_run(Profile *profile, MachineState *state, bool interactive) {
+    // The end of one statement is the start of the next, so each costs one clock read
+    int64_t start = now_ns();
+    while (state->program_counter >= 0 && state->program_counter < profile->stmt_count) {
+        int current = state->program_counter;
+        bool success = interpret_line(profile->statements[current], state, interactive);
+        int64_t end = now_ns();
+        profile->counts[current].runs++;
+        profile->counts[current].ns += end - start;
+        start = end;
+        if (!success) {
+            return false;
+        }
+        state->program_counter++;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------
+// REPORT
+// ---------------------------------------------------------
+
+static int compare_hottest(const void *a, const void *b) {
+    const StatementProfile *x = *(const StatementProfile**)a;
+    const StatementProfile *y = *(const StatementProfile**)b;
+    if (x->ns != y->ns) return x->ns < y->ns ? 1 : -1;
+    if (x->runs != y->runs) return x->runs < y->runs ? 1 : -1;
+    return x->line - y->line;
+}
+
+static int compare_size(const void *a, const void *b) {
+    const Loop *x = (const Loop*)a;
+    const Loop *y = (const Loop*)b;
+    return (x->end - x->start) - (y->end - y->start);
+}
+
+// Every loop closed by a literal backward jump, innermost first
+static Loop *find_loops(Profile *profile, int *count) {
+    ControlFlow *cfg = control_flow_build(profile->statements, profile->stmt_count);
+    Loop *loops = xalloc((2 * profile->stmt_count + 1) * sizeof(Loop), "Interpreter Error: Fail to allocate memory for profile.\n");
+    *count = 0;
+    for (int i = 0; i < profile->stmt_count; i++) {
+        for (int j = 0; j < 2; j++) {
+            int target = cfg->succ[2 * i + j];
+            if (target >= 0 && target <= i) {
+                loops[(*count)++] = (Loop){target, i};
+            }
+        }
+    }
+    free_control_flow(cfg);
+    qsort(loops, *count, sizeof(Loop), compare_size);
+    return loops;
+}
+
+// The loops around statement index as line ranges
+static void print_loops(FILE *out, Profile *profile, Loop *loops, int loop_count, int index) {
+    int shown = 0;
+    for (int i = 0; i < loop_count; i++) {
+        if (loops[i].start > index || loops[i].end < index) continue;
+        if (shown == PROFILE_LOOPS_SHOWN) {
+            fprintf(out, ", ...");
+            break;
+        }
+        fprintf(out, "%s%d-%d", shown > 0 ? ", " : "   ",
+                profile->counts[loops[i].start].line, profile->counts[loops[i].end].line);
+        shown++;
+    }
+    fprintf(out, "\n");
+}
+
+void print_profile(FILE *out, Profile *profile, int lines) {
+    StatementProfile **ran = xalloc((profile->stmt_count + 1) * sizeof(StatementProfile*), "Interpreter Error: Fail to allocate memory for profile.\n");
+    int ran_count = 0;
+    long total_runs = 0;
+    int64_t total_ns = 0;
+    for (int i = 0; i < profile->stmt_count; i++) {
+        if (profile->counts[i].runs == 0) continue;
+        ran[ran_count++] = &profile->counts[i];
+        total_runs += profile->counts[i].runs;
+        total_ns += profile->counts[i].ns;
+    }
+    qsort(ran, ran_count, sizeof(StatementProfile*), compare_hottest);
+
+    int loop_count;
+    Loop *loops = find_loops(profile, &loop_count);
+
+    fprintf(out, "Profile: %ld statement(s) run in %.3f ms, hottest lines first.\n", total_runs, total_ns / 1e6);
+    fprintf(out, "%8s %12s %12s %7s   %s\n", "line", "runs", "time (ms)", "time", "loops");
+    for (int i = 0; i < ran_count && i < lines; i++) {
+        StatementProfile *line = ran[i];
+        fprintf(out, "%8d %12ld %12.3f %6.1f%%", line->line, line->runs, line->ns / 1e6,
+                total_ns > 0 ? 100.0 * line->ns / total_ns : 0.0);
+        print_loops(out, profile, loops, loop_count, (int)(line - profile->counts));
+    }
+    if (ran_count > lines) {
+        fprintf(out, "Profile: %d more line(s) ran.\n", ran_count - lines);
+    }
+    xfree(loops);
+    xfree(ran);
+}
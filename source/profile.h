@@ -0,0 +1,36 @@
+// profile.h
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "interpreter.h"
+
+// Hottest lines listed in a report
+#define PROFILE_REPORT_LINES 20
+
+typedef struct Profile Profile;
+
+typedef struct {
+    int line;               // Physical source line of the statement
+    long runs;              // Times it ran, the failing run included
+    int64_t ns;             // Time spent in it, the builtins it called included
+} StatementProfile;
+
+// Counters for every statement of a program, all zero to begin with
+Profile *profile_new(Statement **statements, int stmt_count);
+void free_profile(Profile *profile);
+
+// Run from the program counter like the tree-walking interpreter, counting
+// and timing every statement. The clock is read once per statement.
+bool profile_run(Profile *profile, MachineState *state, bool interactive);
+
+StatementProfile profile_statement(Profile *profile, int index);
+
+// The lines that took the most time, hottest first, with the loops that
+// contain them. Loops are found through literal backward jumps and shown as
+// the range of lines from the jump target to the jump.
+void print_profile(FILE *out, Profile *profile, int lines);
+
+#endif
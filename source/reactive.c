@@ -0,0 +1,448 @@
+// Logic for the reactive dataflow mode
+
+#include "reactive.h"
+#include "analysis.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    Statement *stmt;
+    char *writes;       // Variable the statement assigns, NULL if it prints
+    char **reads;       // Distinct variables the statement reads
+    int read_count;
+    int index;          // Arrival order, which breaks ties between independent statements
+    long rank;          // Position in a topological order of the graph
+    unsigned epoch;     // Last load or update that reached the node
+    bool failed;        // Evaluation failed during that load or update
+} ReactiveNode;
+
+struct ReactiveGraph {
+    MachineState *state;
+    struct list *nodes;         // ReactiveNode*, in arrival order
+    struct hashmap *writers;    // name -> ReactiveNode assigning it
+    struct hashmap *readers;    // name -> list of ReactiveNode reading it
+    long next_rank;
+    unsigned epoch;
+    ReactiveStats stats;
+};
+
+static struct hashmap *create_name_hashmap() {
+    return hashmap_new(16, 5, hash_string);
+}
+
+ReactiveGraph *reactive_new(MachineState *state) {
+    ReactiveGraph *graph = xalloc(sizeof(ReactiveGraph), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    graph->state = state;
+    graph->nodes = list_new(16);
+    graph->writers = create_name_hashmap();
+    graph->readers = create_name_hashmap();
+    graph->next_rank = 0;
+    graph->epoch = 0;
+    memset(&graph->stats, 0, sizeof(ReactiveStats));
+    return graph;
+}
+
+static void free_writer_entry(void *name, void *node) {
+    (void)node;
+    xfree(name);
+}
+
+static void free_readers_entry(void *name, void *readers) {
+    xfree(name);
+    free_list((struct list*)readers);
+}
+
+// Forget every node. Statements are freed only when the graph owns them.
+static void clear_graph(ReactiveGraph *graph, bool free_statements) {
+    for (int i = 0; i < graph->nodes->length; i++) {
+        ReactiveNode *node = list_get(graph->nodes, i);
+        if (free_statements) free_statement(node->stmt);
+        xfree(node->reads);
+        xfree(node);
+    }
+    graph->nodes->length = 0;
+    free_hashmap(graph->writers, free_writer_entry);
+    free_hashmap(graph->readers, free_readers_entry);
+    graph->writers = create_name_hashmap();
+    graph->readers = create_name_hashmap();
+}
+
+void free_reactive(ReactiveGraph *graph) {
+    if (graph == NULL) return;
+    clear_graph(graph, true);
+    free_hashmap(graph->writers, free_writer_entry);
+    free_hashmap(graph->readers, free_readers_entry);
+    free_list(graph->nodes);
+    xfree(graph);
+}
+
+ReactiveStats reactive_stats(ReactiveGraph *graph) {
+    ReactiveStats stats = graph->stats;
+    stats.nodes = graph->nodes->length;
+    return stats;
+}
+
+// ---------------------------------------------------------
+// DEPENDENCIES
+// ---------------------------------------------------------
+
+static char *copy_name(const char *name) {
+    char *copy = xalloc(strlen(name) + 1, "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    strcpy(copy, name);
+    return copy;
+}
+
+static void add_read(ReactiveNode *node, char *name, int *capacity) {
+    for (int i = 0; i < node->read_count; i++) {
+        if (strcmp(node->reads[i], name) == 0) return;
+    }
+    if (node->read_count >= *capacity) {
+        *capacity *= 2;
+        char **reads = xalloc(*capacity * sizeof(char*), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+        for (int i = 0; i < node->read_count; i++) {
+            reads[i] = node->reads[i];
+        }
+        xfree(node->reads);
+        node->reads = reads;
+    }
+    node->reads[node->read_count++] = name;
+}
+
+static void add_reads_factors(ReactiveNode *node, Factors *factors, int *capacity);
+
+static void add_reads_factor(ReactiveNode *node, Factor *factor, int *capacity) {
+    if (factor->type == FACTOR_VAR) {
+        add_read(node, factor->data.var, capacity);
+    } else if (factor->type == FACTOR_FUNC) {
+        add_reads_factors(node, factor->data.func->factors, capacity);
+    }
+}
+
+static void add_reads_factors(ReactiveNode *node, Factors *factors, int *capacity) {
+    for (int i = 0; i < factors->count; i++) {
+        add_reads_factor(node, factors->items[i], capacity);
+    }
+}
+
+// Point the node at a statement and collect what it reads and writes. The
+// names point into the statement.
+static void set_statement(ReactiveNode *node, Statement *stmt) {
+    int capacity = 4;
+    node->stmt = stmt;
+    node->writes = NULL;
+    node->reads = xalloc(capacity * sizeof(char*), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    node->read_count = 0;
+
+    switch (stmt->type) {
+        case PINCH_VAR:
+            node->writes = stmt->content.pinch_var->name;
+            add_reads_factors(node, stmt->content.pinch_var->factors, &capacity);
+            break;
+        case PINCH_FUNC_S:
+            add_reads_factors(node, stmt->content.pinch_func->factors, &capacity);
+            break;
+        case FACTOR:
+            add_reads_factor(node, stmt->content.factor, &capacity);
+            break;
+    }
+}
+
+static struct list *readers_of(ReactiveGraph *graph, const char *name) {
+    return (struct list*)hashmap_lookup(graph->readers, (void*)name);
+}
+
+static void link_node(ReactiveGraph *graph, ReactiveNode *node) {
+    for (int i = 0; i < node->read_count; i++) {
+        struct list *readers = readers_of(graph, node->reads[i]);
+        if (readers == NULL) {
+            readers = list_new(4);
+            hashmap_insert(graph->readers, copy_name(node->reads[i]), readers);
+        }
+        list_append(readers, node);
+    }
+}
+
+static void unlink_node(ReactiveGraph *graph, ReactiveNode *node) {
+    for (int i = 0; i < node->read_count; i++) {
+        struct list *readers = readers_of(graph, node->reads[i]);
+        for (int j = 0; j < readers->length; j++) {
+            if (list_get(readers, j) == node) {
+                readers->elems[j] = readers->elems[readers->length - 1];
+                readers->length--;
+                break;
+            }
+        }
+    }
+}
+
+static ReactiveNode *writer_of(ReactiveGraph *graph, const char *name) {
+    return (ReactiveNode*)hashmap_lookup(graph->writers, (void*)name);
+}
+
+static ReactiveNode *add_node(ReactiveGraph *graph, Statement *stmt) {
+    ReactiveNode *node = xalloc(sizeof(ReactiveNode), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    set_statement(node, stmt);
+    node->index = graph->nodes->length;
+    node->rank = graph->next_rank++;
+    node->epoch = 0;
+    node->failed = false;
+    list_append(graph->nodes, node);
+    if (node->writes != NULL) {
+        hashmap_insert(graph->writers, copy_name(node->writes), node);
+    }
+    link_node(graph, node);
+    return node;
+}
+
+// Collect every statement that reads name, directly or through other
+// variables, marking each with the current epoch
+static void collect_downstream(ReactiveGraph *graph, const char *name, struct list *affected) {
+    int start = affected->length;
+    struct list *readers = readers_of(graph, name);
+    for (int i = 0; readers != NULL && i < readers->length; i++) {
+        ReactiveNode *reader = list_get(readers, i);
+        if (reader->epoch != graph->epoch) {
+            reader->epoch = graph->epoch;
+            list_append(affected, reader);
+        }
+    }
+
+    // The list doubles as the work queue
+    for (int i = start; i < affected->length; i++) {
+        ReactiveNode *node = list_get(affected, i);
+        if (node->writes == NULL) continue;
+        readers = readers_of(graph, node->writes);
+        for (int j = 0; readers != NULL && j < readers->length; j++) {
+            ReactiveNode *reader = list_get(readers, j);
+            if (reader->epoch != graph->epoch) {
+                reader->epoch = graph->epoch;
+                list_append(affected, reader);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------
+// EVALUATION
+// ---------------------------------------------------------
+
+// Evaluate nodes already in topological order. A statement whose inputs
+// failed in this pass is skipped rather than run on stale values.
+static void evaluate_nodes(ReactiveGraph *graph, ReactiveNode **order, int count) {
+    MachineState *previous_state = bind_machine_state(graph->state);
+    FILE *previous_errors = redirect_errors(graph->state->errors);
+    int evaluated = 0;
+    for (int i = 0; i < count; i++) {
+        ReactiveNode *node = order[i];
+        node->epoch = graph->epoch;
+        node->failed = false;
+
+        for (int j = 0; j < node->read_count; j++) {
+            ReactiveNode *writer = writer_of(graph, node->reads[j]);
+            if (writer != NULL && writer->epoch == graph->epoch && writer->failed) {
+                node->failed = true;
+                break;
+            }
+        }
+        if (node->failed) continue;
+
+        node->failed = !interpret_line(node->stmt, graph->state, true);
+        evaluated++;
+    }
+    redirect_errors(previous_errors);
+    bind_machine_state(previous_state);
+    graph->stats.last_evaluated = evaluated;
+    graph->stats.evaluated += evaluated;
+}
+
+static int compare_rank(const void *a, const void *b) {
+    long ra = (*(ReactiveNode* const*)a)->rank;
+    long rb = (*(ReactiveNode* const*)b)->rank;
+    return (ra > rb) - (ra < rb);
+}
+
+// ---------------------------------------------------------
+// LOAD
+// ---------------------------------------------------------
+
+// Min-heap of node indices, so independent statements keep program order
+typedef struct {
+    int *items;
+    int count;
+} IndexHeap;
+
+static void heap_push(IndexHeap *heap, int index) {
+    int i = heap->count++;
+    while (i > 0 && heap->items[(i - 1) / 2] > index) {
+        heap->items[i] = heap->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->items[i] = index;
+}
+
+static int heap_pop(IndexHeap *heap) {
+    int top = heap->items[0];
+    int last = heap->items[--heap->count];
+    int i = 0;
+    while (2 * i + 1 < heap->count) {
+        int child = 2 * i + 1;
+        if (child + 1 < heap->count && heap->items[child + 1] < heap->items[child]) child++;
+        if (heap->items[child] >= last) break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    heap->items[i] = last;
+    return top;
+}
+
+// Rank every node with Kahn's algorithm. Returns false on a cycle.
+static bool rank_nodes(ReactiveGraph *graph, ReactiveNode **order) {
+    int count = graph->nodes->length;
+    int *pending = xalloc((count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    IndexHeap heap;
+    heap.items = xalloc((count + 1) * sizeof(int), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    heap.count = 0;
+
+    for (int i = 0; i < count; i++) {
+        ReactiveNode *node = list_get(graph->nodes, i);
+        pending[i] = 0;
+        for (int j = 0; j < node->read_count; j++) {
+            if (writer_of(graph, node->reads[j]) != NULL) pending[i]++;
+        }
+        if (pending[i] == 0) heap_push(&heap, i);
+    }
+
+    int ranked = 0;
+    while (heap.count > 0) {
+        ReactiveNode *node = list_get(graph->nodes, heap_pop(&heap));
+        node->rank = graph->next_rank++;
+        order[ranked++] = node;
+        if (node->writes == NULL) continue;
+
+        struct list *readers = readers_of(graph, node->writes);
+        for (int i = 0; readers != NULL && i < readers->length; i++) {
+            ReactiveNode *reader = list_get(readers, i);
+            if (--pending[reader->index] == 0) heap_push(&heap, reader->index);
+        }
+    }
+
+    if (ranked < count) {
+        for (int i = 0; i < count; i++) {
+            if (pending[i] > 0) {
+                ReactiveNode *node = list_get(graph->nodes, i);
+                report_error("Reactive Error: Statement %d is part of a dependency cycle.\n", node->stmt->number);
+                break;
+            }
+        }
+    }
+    xfree(pending);
+    xfree(heap.items);
+    return ranked == count;
+}
+
+bool reactive_load(ReactiveGraph *graph, Program *program) {
+    if (graph->nodes->length > 0) {
+        report_error("Reactive Error: A program is already loaded.\n");
+        return false;
+    }
+
+    for (int i = 0; i < program->stmt_count; i++) {
+        Statement *stmt = program->statements[i];
+        if (statement_has_jump(stmt)) {
+            report_error("Reactive Error: Statement %d uses JUMP or JUMP_IF, which reactive mode does not support.\n", stmt->number);
+            clear_graph(graph, false);
+            return false;
+        }
+        if (stmt->type == PINCH_VAR && writer_of(graph, stmt->content.pinch_var->name) != NULL) {
+            report_error("Reactive Error: Statement %d assigns '%s' a second time.\n",
+                    stmt->number, stmt->content.pinch_var->name);
+            clear_graph(graph, false);
+            return false;
+        }
+        add_node(graph, stmt);
+    }
+
+    int count = program->stmt_count;
+    ReactiveNode **order = xalloc((count + 1) * sizeof(ReactiveNode*), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    if (!rank_nodes(graph, order)) {
+        xfree(order);
+        clear_graph(graph, false);
+        return false;
+    }
+
+    // The graph owns the statements from here on
+    program->stmt_count = 0;
+
+    graph->epoch++;
+    evaluate_nodes(graph, order, count);
+    xfree(order);
+    return true;
+}
+
+// ---------------------------------------------------------
+// UPDATE
+// ---------------------------------------------------------
+
+bool reactive_update(ReactiveGraph *graph, Statement *stmt) {
+    if (statement_has_jump(stmt)) {
+        report_error("Reactive Error: JUMP and JUMP_IF cannot be used in reactive mode.\n");
+        free_statement(stmt);
+        return false;
+    }
+
+    char *name = stmt->type == PINCH_VAR ? stmt->content.pinch_var->name : NULL;
+    ReactiveNode *node = name != NULL ? writer_of(graph, name) : NULL;
+
+    // Everything downstream of the assigned variable has to be re-evaluated
+    graph->epoch++;
+    struct list *affected = list_new(8);
+    if (name != NULL) {
+        collect_downstream(graph, name, affected);
+    }
+
+    // Reading a variable computed from this one would close a cycle
+    ReactiveNode probe;
+    set_statement(&probe, stmt);
+    for (int i = 0; i < probe.read_count && name != NULL; i++) {
+        ReactiveNode *writer = writer_of(graph, probe.reads[i]);
+        if (strcmp(probe.reads[i], name) == 0 || (writer != NULL && writer->epoch == graph->epoch)) {
+            report_error("Reactive Error: '%s' cannot depend on itself.\n", name);
+            xfree(probe.reads);
+            free_list(affected);
+            free_statement(stmt);
+            return false;
+        }
+    }
+    xfree(probe.reads);
+
+    if (node != NULL) {
+        unlink_node(graph, node);
+        free_statement(node->stmt);
+        xfree(node->reads);
+        set_statement(node, stmt);
+        link_node(graph, node);
+    } else {
+        node = add_node(graph, stmt);
+    }
+
+    // The affected nodes are downstream-closed and none of them feeds the
+    // updated node, so ranking it first and the rest in their old relative
+    // order above every existing rank keeps the whole order topological
+    int count = affected->length + 1;
+    ReactiveNode **order = xalloc(count * sizeof(ReactiveNode*), "Interpreter Error: Fail to allocate memory for reactive graph.\n");
+    order[0] = node;
+    for (int i = 1; i < count; i++) {
+        order[i] = list_get(affected, i - 1);
+    }
+    qsort(order + 1, count - 1, sizeof(ReactiveNode*), compare_rank);
+    for (int i = 0; i < count; i++) {
+        order[i]->rank = graph->next_rank++;
+    }
+
+    graph->stats.updates++;
+    evaluate_nodes(graph, order, count);
+    xfree(order);
+    free_list(affected);
+    return true;
+}
@@ -0,0 +1,44 @@
+// reactive.h
+
+#ifndef REACTIVE_H
+#define REACTIVE_H
+
+#include "engine.h"
+
+// Reactive dataflow mode. Statements form a graph in which each statement
+// depends on the statements assigning the variables it reads, like cells in
+// a spreadsheet. Redefining a variable re-evaluates only the statements
+// downstream of it, in dependency order, so the work per update grows with
+// the affected part of the graph rather than with the whole program.
+//
+// Only programs without JUMP or JUMP_IF fit this model, and every variable is
+// assigned by at most one statement: assigning it again redefines it.
+
+typedef struct {
+    int nodes;              // Statements in the graph
+    long updates;           // Statements accepted by reactive_update
+    int last_evaluated;     // Statements evaluated by the last load or update
+    long evaluated;         // Statements evaluated in total
+} ReactiveStats;
+
+typedef struct ReactiveGraph ReactiveGraph;
+
+// The graph evaluates statements on state, which stays with the caller
+ReactiveGraph *reactive_new(MachineState *state);
+void free_reactive(ReactiveGraph *graph);
+
+// Load a whole program into an empty graph and evaluate it in dependency
+// order, so statements may read variables assigned further down. On success
+// the statements move from the program into the graph. Returns false, and
+// leaves the program untouched, if it jumps, assigns a variable twice or has
+// a dependency cycle.
+bool reactive_load(ReactiveGraph *graph, Program *program);
+
+// Add a statement, or redefine the variable it assigns, then evaluate it and
+// everything downstream of it. The graph takes the statement either way; it
+// is freed if the update is rejected for jumping or creating a cycle.
+bool reactive_update(ReactiveGraph *graph, Statement *stmt);
+
+ReactiveStats reactive_stats(ReactiveGraph *graph);
+
+#endif
@@ -0,0 +1,63 @@
+// Logic for timing the phases of a run and summarizing it
+
+#include "runstats.h"
+#include "util.h"
+#include <sys/resource.h>
+#include <time.h>
+
+static const char *phase_names[RUN_PHASES] = {"read", "parse", "prepare", "execute"};
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+PhaseTime phase_now() {
+    PhaseTime now = {clock_ns(CLOCK_MONOTONIC), clock_ns(CLOCK_PROCESS_CPUTIME_ID), {{0}}};
+    if (perf_counting()) now.perf = perf_read();
+    return now;
+}
+
+void phase_add(RunStats *stats, RunPhase phase, PhaseTime start) {
+    PhaseTime end = phase_now();
+    PhaseTime *total = &stats->phases[phase];
+    total->wall_ns += end.wall_ns - start.wall_ns;
+    total->cpu_ns += end.cpu_ns - start.cpu_ns;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        total->perf.values[e] += end.perf.values[e] - start.perf.values[e];
+    }
+}
+
+void print_run_stats(FILE *out, RunStats *stats, bool json) {
+    struct rusage usage;
+    long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    long statements = __atomic_load_n(&stats->counters.statements, __ATOMIC_RELAXED);
+    long jumps = __atomic_load_n(&stats->counters.jumps, __ATOMIC_RELAXED);
+    long calls = __atomic_load_n(&stats->counters.calls, __ATOMIC_RELAXED);
+
+    if (json) {
+        fprintf(out, "{\"phases\": {");
+        for (int p = 0; p < RUN_PHASES; p++) {
+            fprintf(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", p > 0 ? ", " : "", phase_names[p],
+                    stats->phases[p].wall_ns / 1e6, stats->phases[p].cpu_ns / 1e6);
+        }
+        fprintf(out, "}, \"statements\": %ld, \"executed\": %ld, \"jumps\": %ld, \"calls\": %ld, "
+                "\"peak_rss_kb\": %ld, \"allocations\": %ld}\n",
+                stats->program_statements, statements, jumps, calls, peak_rss_kb, allocation_count());
+        return;
+    }
+    fprintf(out, "Stats:");
+    for (int p = 0; p < RUN_PHASES; p++) {
+        fprintf(out, " %s_wall_ms=%.3f %s_cpu_ms=%.3f", phase_names[p], stats->phases[p].wall_ns / 1e6,
+                phase_names[p], stats->phases[p].cpu_ns / 1e6);
+    }
+    fprintf(out, " statements=%ld executed=%ld jumps=%ld calls=%ld peak_rss_kb=%ld allocations=%ld\n",
+            stats->program_statements, statements, jumps, calls, peak_rss_kb, allocation_count());
+}
+
+void print_phase_counters(FILE *out, RunStats *stats) {
+    PerfValues phases[RUN_PHASES];
+    for (int p = 0; p < RUN_PHASES; p++) phases[p] = stats->phases[p].perf;
+    print_perf_counters(out, phase_names, phases, RUN_PHASES);
+}
@@ -0,0 +1,53 @@
+// runstats.h
+
+#ifndef RUNSTATS_H
+#define RUNSTATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "perfcounters.h"
+
+// What a state executed, shared by every state of a run and updated with
+// relaxed atomics
+typedef struct RunCounters {
+    long statements;
+    long jumps;             // Taken by JUMP and JUMP_IF
+    long calls;             // Builtin calls, JUMP and JUMP_IF included
+} RunCounters;
+
+typedef enum {
+    RUN_PHASE_READ,         // Reading the source file
+    RUN_PHASE_PARSE,        // Lexing and parsing it
+    RUN_PHASE_PREPARE,      // Optimizing and handing it to the engine
+    RUN_PHASE_EXECUTE,
+    RUN_PHASES
+} RunPhase;
+
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;        // Of the whole process, every thread included
+    PerfValues perf;        // Hardware counters, while they are open
+} PhaseTime;
+
+typedef struct {
+    PhaseTime phases[RUN_PHASES];
+    long program_statements;    // In the programs loaded
+    RunCounters counters;
+} RunStats;
+
+// Time a phase: take phase_now() when it starts and hand it to phase_add
+// when it ends. A phase entered several times, as in the REPL, adds up.
+// Hardware counters opened with open_perf_counters are read along.
+PhaseTime phase_now();
+void phase_add(RunStats *stats, RunPhase phase, PhaseTime start);
+
+// One line with the phase times, the counters, the peak resident set size
+// and the allocations counted by count_allocations, as key=value pairs or
+// as a JSON object
+void print_run_stats(FILE *out, RunStats *stats, bool json);
+
+// The hardware counters of every phase, if they were opened
+void print_phase_counters(FILE *out, RunStats *stats);
+
+#endif
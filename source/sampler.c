@@ -0,0 +1,258 @@
+// Logic for sampling the running statement and builtin calls on SIGPROF
+
+#include "sampler.h"
+#include "functions.h"
+#include "util.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Frames are builtin positions, then JUMP, JUMP_IF and calls to unknown names
+#define FRAME_JUMP (builtin_count())
+#define FRAME_JUMP_IF (builtin_count() + 1)
+#define FRAME_UNKNOWN (builtin_count() + 2)
+
+// What a thread is executing. Written only by the thread itself, read by the
+// signal handler when it interrupts that thread.
+typedef struct {
+    volatile int line;
+    volatile int depth;     // May exceed SAMPLE_MAX_DEPTH, frames past it are not kept
+    volatile short frames[SAMPLE_MAX_DEPTH];
+} Activity;
+
+// Claimed by compare-and-swap, filled, then published as ready. A handler
+// finding a slot still being filled moves on, so the same stack may take
+// two slots; the line report and flame graph tools add them up.
+typedef enum { SLOT_EMPTY, SLOT_FILLING, SLOT_READY } SlotState;
+
+typedef struct {
+    int state;
+    long count;
+    int line;
+    int depth;
+    short frames[SAMPLE_MAX_DEPTH];
+} StackSlot;
+
+bool sampler_enabled = false;
+
+static _Thread_local Activity activity;
+
+static StackSlot stacks[SAMPLE_STACKS];
+static long samples = 0;
+static long dropped = 0;        // Stacks that found the table full
+static int sample_hz = 0;
+static struct sigaction previous_action;
+
+// ---------------------------------------------------------
+// SIGNAL HANDLER
+// ---------------------------------------------------------
+
+static unsigned hash_stack(int line, int depth, const short *frames) {
+    unsigned hash = 2166136261u ^ (unsigned)line;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash * 16777619u) ^ (unsigned short)frames[i];
+    }
+    return hash * 16777619u;
+}
+
+static bool same_stack(StackSlot *slot, int line, int depth, const short *frames) {
+    if (slot->line != line || slot->depth != depth) return false;
+    for (int i = 0; i < depth; i++) {
+        if (slot->frames[i] != frames[i]) return false;
+    }
+    return true;
+}
+
+static void on_sample(int signal) {
+    (void)signal;
+    int saved_errno = errno;
+
+    // Copy the stack first, the thread cannot change it while the handler runs
+    int line = activity.line;
+    int depth = activity.depth;
+    if (depth > SAMPLE_MAX_DEPTH) depth = SAMPLE_MAX_DEPTH;
+    if (depth < 0) depth = 0;
+    short frames[SAMPLE_MAX_DEPTH];
+    for (int i = 0; i < depth; i++) frames[i] = activity.frames[i];
+
+    __atomic_add_fetch(&samples, 1, __ATOMIC_RELAXED);
+    unsigned start = hash_stack(line, depth, frames) % SAMPLE_STACKS;
+    for (int probe = 0; probe < SAMPLE_STACKS; probe++) {
+        StackSlot *slot = &stacks[(start + probe) % SAMPLE_STACKS];
+        int state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_EMPTY) {
+            int expected = SLOT_EMPTY;
+            if (__atomic_compare_exchange_n(&slot->state, &expected, SLOT_FILLING, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                slot->line = line;
+                slot->depth = depth;
+                for (int i = 0; i < depth; i++) slot->frames[i] = frames[i];
+                slot->count = 1;
+                __atomic_store_n(&slot->state, SLOT_READY, __ATOMIC_RELEASE);
+                errno = saved_errno;
+                return;
+            }
+            state = expected;
+        }
+        if (state == SLOT_READY && same_stack(slot, line, depth, frames)) {
+            __atomic_add_fetch(&slot->count, 1, __ATOMIC_RELAXED);
+            errno = saved_errno;
+            return;
+        }
+    }
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+    errno = saved_errno;
+}
+
+// ---------------------------------------------------------
+// CONTROL
+// ---------------------------------------------------------
+
+bool start_sampling(int hz) {
+    if (sampling()) stop_sampling();
+    memset(stacks, 0, sizeof(stacks));
+    samples = 0;
+    dropped = 0;
+    sample_hz = hz > 0 ? hz : SAMPLE_DEFAULT_HZ;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previous_action) != 0) {
+        fprintf(stderr, "Error: Could not install the sampling signal handler.\n");
+        return false;
+    }
+
+    __atomic_store_n(&sampler_enabled, true, __ATOMIC_RELAXED);
+    long interval_us = 1000000 / sample_hz;
+    struct timeval interval = {interval_us / 1000000, interval_us % 1000000};
+    struct itimerval timer = {interval, interval};
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        __atomic_store_n(&sampler_enabled, false, __ATOMIC_RELAXED);
+        sigaction(SIGPROF, &previous_action, NULL);
+        fprintf(stderr, "Error: Could not start the sampling timer.\n");
+        return false;
+    }
+    return true;
+}
+
+void stop_sampling() {
+    if (!sampling()) return;
+    struct itimerval off = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &off, NULL);
+    // A signal already pending is still handled by on_sample
+    __atomic_store_n(&sampler_enabled, false, __ATOMIC_RELAXED);
+}
+
+// ---------------------------------------------------------
+// PUBLISHING
+// ---------------------------------------------------------
+
+// Activity is volatile, so the handler sees these stores in program order
+void sample_statement(int line) {
+    activity.depth = 0;
+    activity.line = line;
+}
+
+void sample_push(Pinch_Func *func) {
+    short frame;
+    switch (func->quick) {
+        case QUICK_JUMP:
+            frame = FRAME_JUMP;
+            break;
+        case QUICK_JUMP_IF:
+            frame = FRAME_JUMP_IF;
+            break;
+        default:
+            frame = func->builtin != NULL ? (short)(func->builtin - builtin_at(0)) : FRAME_UNKNOWN;
+            break;
+    }
+    int depth = activity.depth;
+    if (depth < SAMPLE_MAX_DEPTH) activity.frames[depth] = frame;
+    activity.depth = depth + 1;
+}
+
+void sample_pop() {
+    if (activity.depth > 0) activity.depth = activity.depth - 1;
+}
+
+// ---------------------------------------------------------
+// REPORT
+// ---------------------------------------------------------
+
+long sample_count() {
+    return __atomic_load_n(&samples, __ATOMIC_RELAXED);
+}
+
+static const char *frame_name(short frame) {
+    if (frame == FRAME_JUMP) return "JUMP";
+    if (frame == FRAME_JUMP_IF) return "JUMP_IF";
+    if (frame == FRAME_UNKNOWN) return "unknown";
+    return builtin_at(frame)->name;
+}
+
+typedef struct {
+    int line;
+    long samples;
+} LineSamples;
+
+static int compare_samples(const void *a, const void *b) {
+    const LineSamples *x = (const LineSamples*)a;
+    const LineSamples *y = (const LineSamples*)b;
+    if (x->samples != y->samples) return x->samples < y->samples ? 1 : -1;
+    return x->line - y->line;
+}
+
+void print_sample_profile(FILE *out, int shown) {
+    long total = sample_count();
+    long lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    fprintf(out, "Sample profile: %ld sample(s) at %d Hz of CPU time", total, sample_hz);
+    if (lost > 0) fprintf(out, ", %ld not counted by stack", lost);
+    fprintf(out, ".\n");
+
+    LineSamples *lines = xalloc(SAMPLE_STACKS * sizeof(LineSamples), "Interpreter Error: Fail to allocate memory for the sample profile.\n");
+    int count = 0;
+    for (int i = 0; i < SAMPLE_STACKS; i++) {
+        StackSlot *slot = &stacks[i];
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SLOT_READY) continue;
+        int at = 0;
+        while (at < count && lines[at].line != slot->line) at++;
+        if (at == count) lines[count++] = (LineSamples){slot->line, 0};
+        lines[at].samples += __atomic_load_n(&slot->count, __ATOMIC_RELAXED);
+    }
+    qsort(lines, count, sizeof(LineSamples), compare_samples);
+
+    fprintf(out, "%10s %8s   %s\n", "samples", "share", "line");
+    for (int i = 0; i < count && i < shown; i++) {
+        double share = total > 0 ? 100.0 * lines[i].samples / total : 0;
+        if (lines[i].line > 0) {
+            fprintf(out, "%10ld %7.1f%%   %d\n", lines[i].samples, share, lines[i].line);
+        } else {
+            fprintf(out, "%10ld %7.1f%%   (outside statements)\n", lines[i].samples, share);
+        }
+    }
+    if (count > shown) {
+        fprintf(out, "Sample profile: %d more line(s).\n", count - shown);
+    }
+    xfree(lines);
+}
+
+void write_folded_stacks(FILE *out) {
+    for (int i = 0; i < SAMPLE_STACKS; i++) {
+        StackSlot *slot = &stacks[i];
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SLOT_READY) continue;
+        if (slot->line > 0) {
+            fprintf(out, "line %d", slot->line);
+        } else {
+            fprintf(out, "(outside statements)");
+        }
+        for (int j = 0; j < slot->depth; j++) {
+            fprintf(out, ";%s", frame_name(slot->frames[j]));
+        }
+        fprintf(out, " %ld\n", __atomic_load_n(&slot->count, __ATOMIC_RELAXED));
+    }
+}
@@ -0,0 +1,46 @@
+// sampler.h
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "parser.h"
+
+#define SAMPLE_DEFAULT_HZ 1000
+#define SAMPLE_MAX_HZ 100000
+#define SAMPLE_MAX_DEPTH 8      // Nested calls kept per sample, deeper ones are cut off
+#define SAMPLE_STACKS 4096      // Distinct stacks counted, later ones are dropped
+#define SAMPLE_REPORT_LINES 20
+
+// Sample what every thread is executing hz times per second of CPU time,
+// with SIGPROF from setitimer(ITIMER_PROF). A sample is the source line of
+// the statement running and the builtin calls it is inside, outermost first.
+// The signal handler only reads what the interpreter publishes for its
+// thread and counts the stack in a preallocated table with atomics, so it
+// is async-signal-safe. Returns false, with a message on stderr, if the
+// timer cannot be set.
+bool start_sampling(int hz);
+void stop_sampling();
+
+extern bool sampler_enabled;    // Only written by start_sampling and stop_sampling
+
+static inline bool sampling() {
+    return __atomic_load_n(&sampler_enabled, __ATOMIC_RELAXED);
+}
+
+// Published by the interpreter while sampling. Line 0 is outside of any
+// statement, which also clears the calls.
+void sample_statement(int line);
+void sample_push(Pinch_Func *func);
+void sample_pop();
+
+long sample_count();
+
+// Samples by source line, most sampled first
+void print_sample_profile(FILE *out, int lines);
+
+// One line per stack, "line 12;ADD;MUL 37", as flame graph tools read them
+void write_folded_stacks(FILE *out);
+
+#endif
@@ -0,0 +1,744 @@
+// Logic for serving compiled programs over a Unix socket
+
+#define _GNU_SOURCE // fopencookie
+
+#include "server.h"
+#include "sha256.h"
+#include "threadpool.h"
+#include "util.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HASH_LENGTH SHA256_HEX_LENGTH
+#define WATCHDOG_INTERVAL_MS 5
+
+// A private copy of a cached program, prepared for the server's engine. The
+// interpreter rewrites the statements it runs, so every running request
+// needs a copy of its own; finished copies are kept for the next request.
+typedef struct Copy {
+    Program *program;
+    PreparedProgram *prepared;
+    struct Copy *next;
+} Copy;
+
+typedef struct Entry {
+    char hash[HASH_LENGTH + 1];
+    char *source;           // Compiled from, hits are checked against it
+    size_t length;
+    Program *program;       // As compiled, only ever copied
+    Copy *idle;             // Copies no request is running
+    int users;              // Requests holding the entry
+    bool evicted;           // Out of the cache, freed by its last user
+    struct Entry *newer;
+    struct Entry *older;
+} Entry;
+
+typedef struct {
+    struct Server *server;
+    pthread_t thread;
+    MachineState *state;
+    int connection;             // -1 while waiting for one
+    bool running;               // A request is executing
+    struct timespec deadline;
+} Worker;
+
+// Connections accepted but not yet taken by a worker
+typedef struct Pending {
+    int fd;
+    struct Pending *next;
+} Pending;
+
+struct Server {
+    ServerOptions options;
+    char *path;
+    int listener;
+    pthread_t acceptor;
+    pthread_t watchdog;
+    bool has_acceptor;
+    bool has_watchdog;
+
+    pthread_mutex_t lock;       // Guards everything below
+    pthread_cond_t changed;     // Uses CLOCK_MONOTONIC
+    bool stopping;
+    Pending *pending_head;
+    Pending *pending_tail;
+    Worker *workers;
+    int worker_count;
+
+    struct hashmap *entries;    // Content hash to Entry
+    Entry *newest;
+    Entry *oldest;
+    int cached;
+    ServerStats stats;
+};
+
+// SHA-256 in hex. HASH requests are trusted to name the program they mean,
+// so finding another source with the same hash must be out of reach.
+static void hash_source(const char *source, size_t length, char *hash) {
+    sha256_hex(source, length, hash);
+}
+
+static bool valid_hash(const char *hash) {
+    if (strlen(hash) != HASH_LENGTH) return false;
+    for (const char *c = hash; *c != '\0'; c++) {
+        if (!((*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'f'))) return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------
+// PROGRAM CACHE
+// ---------------------------------------------------------
+
+static void free_copy(Copy *copy) {
+    free_prepared(copy->prepared);
+    free_program(copy->program);
+    xfree(copy);
+}
+
+static void free_entry(Entry *entry) {
+    while (entry->idle != NULL) {
+        Copy *next = entry->idle->next;
+        free_copy(entry->idle);
+        entry->idle = next;
+    }
+    free_program(entry->program);
+    xfree(entry->source);
+    xfree(entry);
+}
+
+// The functions below expect the server lock to be held
+
+static void unlink_entry(Server *server, Entry *entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else server->newest = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else server->oldest = entry->newer;
+}
+
+static void push_newest(Server *server, Entry *entry) {
+    entry->newer = NULL;
+    entry->older = server->newest;
+    if (server->newest != NULL) server->newest->newer = entry;
+    server->newest = entry;
+    if (server->oldest == NULL) server->oldest = entry;
+}
+
+static bool same_source(Entry *entry, const char *source, size_t length) {
+    return entry->length == length && memcmp(entry->source, source, length) == 0;
+}
+
+// Find a cached program and hold it for a request. With a source, only a
+// program compiled from that very source is a hit; without one (a HASH
+// request) the hash alone names the program.
+static Entry *use_program(Server *server, const char *hash, const char *source, size_t length) {
+    Entry *entry = (Entry*)hashmap_lookup(server->entries, (void*)hash);
+    if (entry == NULL) return NULL;
+    if (source != NULL && !same_source(entry, source, length)) return NULL;
+    unlink_entry(server, entry);
+    push_newest(server, entry);
+    entry->users++;
+    server->stats.cache_hits++;
+    return entry;
+}
+
+// Cache a compiled program and hold it for a request, dropping the least
+// recently used programs over the limit. Programs in use stay alive until
+// their last request ends. Takes the source, which the entry keeps.
+static Entry *add_program(Server *server, const char *hash, char *source, size_t length, Program *program) {
+    // Another connection may have compiled the same source meanwhile
+    Entry *cached = (Entry*)hashmap_lookup(server->entries, (void*)hash);
+    if (cached != NULL && same_source(cached, source, length)) {
+        xfree(source);
+        free_program(program);
+        return use_program(server, hash, NULL, 0);
+    }
+
+    Entry *entry = xalloc(sizeof(Entry), "Interpreter Error: Fail to allocate memory for program cache.\n");
+    strcpy(entry->hash, hash);
+    entry->source = source;
+    entry->length = length;
+    entry->program = program;
+    entry->idle = NULL;
+    entry->users = 1;
+    entry->evicted = false;
+    server->stats.compiled++;
+
+    // A different source with the same hash keeps its place; this one runs
+    // uncached, as if already evicted, and is freed by its only user
+    if (cached != NULL) {
+        entry->evicted = true;
+        entry->newer = NULL;
+        entry->older = NULL;
+        return entry;
+    }
+
+    push_newest(server, entry);
+    hashmap_insert(server->entries, entry->hash, entry);
+    server->cached++;
+
+    while (server->cached > server->options.cache_entries) {
+        Entry *victim = server->oldest;
+        unlink_entry(server, victim);
+        hashmap_delete(server->entries, victim->hash);
+        server->cached--;
+        server->stats.evicted++;
+        victim->evicted = true;
+        if (victim->users == 0) free_entry(victim);
+    }
+    return entry;
+}
+
+// A copy is only kept if the run left it intact
+static void release_program(Entry *entry, Copy *copy, bool reusable) {
+    if (copy != NULL && reusable) {
+        copy->next = entry->idle;
+        entry->idle = copy;
+    } else if (copy != NULL) {
+        free_copy(copy);
+    }
+    entry->users--;
+    if (entry->evicted && entry->users == 0) free_entry(entry);
+}
+
+// Called without the lock: preparing a new copy can take a while
+static Copy *take_copy(Server *server, Entry *entry) {
+    pthread_mutex_lock(&server->lock);
+    Copy *copy = entry->idle;
+    if (copy != NULL) entry->idle = copy->next;
+    pthread_mutex_unlock(&server->lock);
+    if (copy != NULL) return copy;
+
+    // Holding the entry keeps its program alive, and it is only ever read
+    copy = xalloc(sizeof(Copy), "Interpreter Error: Fail to allocate memory for program cache.\n");
+    copy->program = copy_program(entry->program);
+    copy->prepared = prepare_program(server->options.engine, copy->program, &server->options.engine_options);
+    copy->next = NULL;
+    return copy;
+}
+
+// ---------------------------------------------------------
+// CONNECTIONS
+// ---------------------------------------------------------
+
+typedef struct {
+    int fd;
+    FILE *in;
+    bool broken;            // The client stopped reading
+    FILE *output;           // OUT frames
+    FILE *errors;           // ERR frames
+} Connection;
+
+typedef struct {
+    Connection *connection;
+    const char *kind;
+} Channel;
+
+// Write a whole buffer, false once the client has gone
+static bool send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+static void send_frame(Connection *connection, const char *kind, const char *data, size_t length) {
+    char header[32];
+    int header_length = snprintf(header, sizeof(header), "%s %zu\n", kind, length);
+    if (connection->broken) return;
+    if (!send_all(connection->fd, header, header_length) || !send_all(connection->fd, data, length)) {
+        connection->broken = true;
+    }
+}
+
+static ssize_t write_channel(void *cookie, const char *text, size_t length) {
+    Channel *channel = (Channel*)cookie;
+    send_frame(channel->connection, channel->kind, text, length);
+    return (ssize_t)length;
+}
+
+// A buffered stream sending what it holds as a frame whenever it fills up or
+// is flushed, so long outputs reach the client while the program runs
+static FILE *open_channel(Channel *channel) {
+    cookie_io_functions_t functions = {NULL, write_channel, NULL, NULL};
+    FILE *stream = fopencookie(channel, "w", functions);
+    if (stream == NULL) {
+        alloc_failed("Interpreter Error: Fail to allocate memory for output stream.\n");
+    }
+    setvbuf(stream, NULL, _IOFBF, BUFSIZ);
+    return stream;
+}
+
+// A request being read: the first problem found is its status
+typedef struct {
+    bool started;
+    Entry *entry;
+    char hash[HASH_LENGTH + 1];
+    const char *status;
+} Request;
+
+static void fail_request(Request *request, const char *status) {
+    if (request->status == NULL) request->status = status;
+}
+
+// Let go of the program a request named, if any
+static void drop_program(Server *server, Request *request) {
+    if (request->entry != NULL) {
+        pthread_mutex_lock(&server->lock);
+        release_program(request->entry, NULL, false);
+        pthread_mutex_unlock(&server->lock);
+        request->entry = NULL;
+    }
+}
+
+static void end_request(Server *server, Request *request) {
+    drop_program(server, request);
+    *request = (Request){0};
+}
+
+// SOURCE <bytes>: false if the rest of the connection cannot be read
+static bool read_source(Worker *worker, Connection *connection, Request *request, const char *argument) {
+    Server *server = worker->server;
+    char *end;
+    long length = strtol(argument, &end, 10);
+    if (*end != '\0' || end == argument || length < 0 || length > SERVER_MAX_SOURCE) {
+        fail_request(request, "invalid");
+        return false;
+    }
+    char *source = xalloc((size_t)length + 1, "Interpreter Error: Fail to allocate memory for program.\n");
+    if (fread(source, 1, (size_t)length, connection->in) != (size_t)length) {
+        xfree(source);
+        return false;
+    }
+    source[length] = '\0';
+
+    drop_program(server, request);
+    hash_source(source, (size_t)length, request->hash);
+
+    pthread_mutex_lock(&server->lock);
+    request->entry = use_program(server, request->hash, source, (size_t)length);
+    pthread_mutex_unlock(&server->lock);
+
+    if (request->entry == NULL) {
+        FILE *previous = redirect_errors(connection->errors);
+        Program *program = load_program(source);
+        redirect_errors(previous);
+        if (program == NULL) {
+            fail_request(request, "syntax");
+        } else {
+            pthread_mutex_lock(&server->lock);
+            request->entry = add_program(server, request->hash, source, (size_t)length, program);
+            // The hash names another program, so it is not handed out
+            if (request->entry->evicted) request->hash[0] = '\0';
+            pthread_mutex_unlock(&server->lock);
+            return true;
+        }
+    }
+    xfree(source);
+    return true;
+}
+
+static void read_hash(Server *server, Request *request, const char *hash) {
+    if (!valid_hash(hash)) {
+        fail_request(request, "invalid");
+        return;
+    }
+    drop_program(server, request);
+    strcpy(request->hash, hash);
+    pthread_mutex_lock(&server->lock);
+    request->entry = use_program(server, hash, NULL, 0);
+    pthread_mutex_unlock(&server->lock);
+    if (request->entry == NULL) fail_request(request, "unknown");
+}
+
+// NUMBER <name> <value> or TEXT <name> <text>
+static void read_variable(MachineState *state, Request *request, char *argument, bool number) {
+    char *space = strchr(argument, ' ');
+    if (space == NULL) {
+        fail_request(request, "invalid");
+        return;
+    }
+    *space = '\0';
+    char *value = space + 1;
+    if (!is_var_name(argument)) {
+        fail_request(request, "invalid");
+        return;
+    }
+    if (number) {
+        char *end;
+        double num = strtod(value, &end);
+        if (*end != '\0' || end == value) {
+            fail_request(request, "invalid");
+            return;
+        }
+        assign_variable(state, argument, value_from_num(num));
+    } else {
+        assign_variable(state, argument, value_from_str(value));
+    }
+}
+
+static const char *run_request(Worker *worker, Connection *connection, Entry *entry) {
+    Server *server = worker->server;
+    MachineState *state = worker->state;
+    Copy *copy = take_copy(server, entry);
+    state->output = connection->output;
+    state->errors = connection->errors;
+    state->program_counter = 0;
+
+    pthread_mutex_lock(&server->lock);
+    if (server->options.time_limit_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &worker->deadline);
+        long ns = worker->deadline.tv_nsec + (server->options.time_limit_ms % 1000) * 1000000L;
+        worker->deadline.tv_sec += server->options.time_limit_ms / 1000 + ns / 1000000000L;
+        worker->deadline.tv_nsec = ns % 1000000000L;
+    }
+    worker->running = true;
+    if (server->stopping) interrupt_run(state);
+    pthread_mutex_unlock(&server->lock);
+
+    limit_allocations(server->options.memory_limit);
+    bool success = run_program(copy->prepared, state);
+    bool out_of_memory = allocation_limit_exceeded();
+    limit_allocations(0);
+
+    pthread_mutex_lock(&server->lock);
+    worker->running = false;
+    pthread_mutex_unlock(&server->lock);
+
+    const char *status = "ok";
+    if (!success && out_of_memory) {
+        status = "memory";
+    } else if (!success && __atomic_load_n(&state->interrupted, __ATOMIC_RELAXED)) {
+        status = "timeout";
+    } else if (!success) {
+        status = "failed";
+        if (state->program_counter >= 0 && state->program_counter < copy->program->stmt_count) {
+            FILE *previous = redirect_errors(state->errors);
+            report_error("Execution halted at statement %d.\n", copy->program->statements[state->program_counter]->number);
+            redirect_errors(previous);
+        }
+    }
+    state->output = NULL;
+    state->errors = NULL;
+
+    // Running out of memory may leave a statement half rewritten
+    pthread_mutex_lock(&server->lock);
+    if (out_of_memory) server->stats.memory_exceeded++;
+    if (strcmp(status, "timeout") == 0) server->stats.timeouts++;
+    release_program(entry, copy, !out_of_memory);
+    pthread_mutex_unlock(&server->lock);
+    return status;
+}
+
+static void serve_connection(Worker *worker, int fd) {
+    Server *server = worker->server;
+    MachineState *state = worker->state;
+    Connection connection = {fd, fdopen(fd, "r"), false, NULL, NULL};
+    if (connection.in == NULL) {
+        close(fd);
+        return;
+    }
+    Channel out_channel = {&connection, "OUT"};
+    Channel err_channel = {&connection, "ERR"};
+    connection.output = open_channel(&out_channel);
+    connection.errors = open_channel(&err_channel);
+
+    Request request = {0};
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    bool open = true;
+    while (open && !connection.broken && (length = getline(&line, &capacity, connection.in)) >= 0) {
+        if (length > 0 && line[length - 1] == '\n') line[--length] = '\0';
+
+        // Every request starts from empty variables
+        if (!request.started) {
+            reset_machine_state(state);
+            request.started = true;
+        }
+
+        if (strncmp(line, "SOURCE ", 7) == 0) {
+            open = read_source(worker, &connection, &request, line + 7);
+        } else if (strncmp(line, "HASH ", 5) == 0) {
+            read_hash(server, &request, line + 5);
+        } else if (strncmp(line, "NUMBER ", 7) == 0) {
+            read_variable(state, &request, line + 7, true);
+        } else if (strncmp(line, "TEXT ", 5) == 0) {
+            read_variable(state, &request, line + 5, false);
+        } else if (strcmp(line, "RUN") == 0) {
+            if (request.entry == NULL) fail_request(&request, "invalid");
+            const char *status = request.status;
+            if (status == NULL) status = run_request(worker, &connection, request.entry);
+            fflush(connection.output);
+            fflush(connection.errors);
+
+            pthread_mutex_lock(&server->lock);
+            server->stats.requests++;
+            pthread_mutex_unlock(&server->lock);
+
+            char done[HASH_LENGTH + 32];
+            int done_length = snprintf(done, sizeof(done), "DONE %s %s\n", status,
+                                       request.hash[0] != '\0' ? request.hash : "-");
+            if (!send_all(fd, done, done_length)) connection.broken = true;
+            // run_request already let go of the program
+            if (request.status == NULL) request.entry = NULL;
+            end_request(server, &request);
+        } else {
+            open = false;
+        }
+
+        // Without a valid length the next request cannot be found
+        if (!open) {
+            fflush(connection.errors);
+            send_all(fd, "DONE invalid -\n", 15);
+        }
+    }
+    free(line); // Allocated by getline
+    end_request(server, &request);
+
+    pthread_mutex_lock(&server->lock);
+    worker->connection = -1;
+    pthread_mutex_unlock(&server->lock);
+    fclose(connection.output);
+    fclose(connection.errors);
+    fclose(connection.in);
+}
+
+// ---------------------------------------------------------
+// THREADS
+// ---------------------------------------------------------
+
+static void *run_worker(void *arg) {
+    Worker *worker = (Worker*)arg;
+    Server *server = worker->server;
+    pthread_mutex_lock(&server->lock);
+    while (true) {
+        while (server->pending_head == NULL && !server->stopping) {
+            pthread_cond_wait(&server->changed, &server->lock);
+        }
+        if (server->stopping) break;
+        Pending *pending = server->pending_head;
+        server->pending_head = pending->next;
+        if (server->pending_head == NULL) server->pending_tail = NULL;
+        worker->connection = pending->fd;
+        pthread_mutex_unlock(&server->lock);
+
+        int fd = pending->fd;
+        xfree(pending);
+        serve_connection(worker, fd);
+
+        pthread_mutex_lock(&server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+static void *run_acceptor(void *arg) {
+    Server *server = (Server*)arg;
+    while (true) {
+        int fd = accept(server->listener, NULL, NULL);
+        pthread_mutex_lock(&server->lock);
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            if (fd >= 0) close(fd);
+            break;
+        }
+        if (fd < 0) {
+            // Out of descriptors or an aborted connection: try again shortly
+            pthread_mutex_unlock(&server->lock);
+            usleep(1000);
+            continue;
+        }
+        Pending *pending = xalloc(sizeof(Pending), "Interpreter Error: Fail to allocate memory for connection.\n");
+        pending->fd = fd;
+        pending->next = NULL;
+        if (server->pending_tail != NULL) server->pending_tail->next = pending;
+        else server->pending_head = pending;
+        server->pending_tail = pending;
+        server->stats.connections++;
+        pthread_cond_broadcast(&server->changed);
+        pthread_mutex_unlock(&server->lock);
+    }
+    return NULL;
+}
+
+static bool before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// Interrupts requests that run past their deadline
+static void *run_watchdog(void *arg) {
+    Server *server = (Server*)arg;
+    pthread_mutex_lock(&server->lock);
+    while (!server->stopping) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < server->worker_count; i++) {
+            Worker *worker = &server->workers[i];
+            if (worker->running && !before(&now, &worker->deadline)) {
+                interrupt_run(worker->state);
+            }
+        }
+        struct timespec wake = now;
+        wake.tv_nsec += WATCHDOG_INTERVAL_MS * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&server->changed, &server->lock, &wake);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+// ---------------------------------------------------------
+// START AND STOP
+// ---------------------------------------------------------
+
+static bool socket_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) return false;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+// A socket file nobody accepts on is left over from a server that did not stop
+static void remove_stale_socket(const char *path, struct sockaddr_un *address) {
+    struct stat info;
+    if (stat(path, &info) != 0 || !S_ISSOCK(info.st_mode)) return;
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) return;
+    if (connect(probe, (struct sockaddr*)address, sizeof(*address)) != 0 && errno == ECONNREFUSED) {
+        unlink(path);
+    }
+    close(probe);
+}
+
+Server *server_start(const char *path, const ServerOptions *options) {
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        fprintf(stderr, "Socket path '%s' is too long.\n", path);
+        return NULL;
+    }
+    remove_stale_socket(path, &address);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        fprintf(stderr, "Could not listen on '%s': %s.\n", path, strerror(errno));
+        if (listener >= 0) close(listener);
+        return NULL;
+    }
+
+    Server *server = xalloc(sizeof(Server), "Interpreter Error: Fail to allocate memory for server.\n");
+    memset(server, 0, sizeof(Server));
+    server->options = *options;
+    if (server->options.workers <= 0) server->options.workers = pool_default_threads();
+    if (server->options.cache_entries <= 0) server->options.cache_entries = SERVER_CACHE_ENTRIES;
+    server->path = xalloc(strlen(path) + 1, "Interpreter Error: Fail to allocate memory for server.\n");
+    strcpy(server->path, path);
+    server->listener = listener;
+    server->entries = hashmap_new(64, 4, hash_string);
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&server->changed, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    server->workers = xalloc(server->options.workers * sizeof(Worker), "Interpreter Error: Fail to allocate memory for server.\n");
+    for (int i = 0; i < server->options.workers; i++) {
+        Worker *worker = &server->workers[server->worker_count];
+        worker->server = server;
+        worker->state = new_machine_state();
+        worker->connection = -1;
+        worker->running = false;
+        if (pthread_create(&worker->thread, NULL, run_worker, worker) == 0) {
+            server->worker_count++;
+        } else {
+            free_state(worker->state);
+        }
+    }
+    server->has_acceptor = server->worker_count > 0 && pthread_create(&server->acceptor, NULL, run_acceptor, server) == 0;
+    bool started = server->has_acceptor;
+    if (started && server->options.time_limit_ms > 0) {
+        server->has_watchdog = pthread_create(&server->watchdog, NULL, run_watchdog, server) == 0;
+        started = server->has_watchdog;
+    }
+    if (!started) {
+        fprintf(stderr, "Could not start the server threads.\n");
+        server_stop(server);
+        return NULL;
+    }
+    return server;
+}
+
+void server_stop(Server *server) {
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    for (int i = 0; i < server->worker_count; i++) {
+        Worker *worker = &server->workers[i];
+        if (worker->running) interrupt_run(worker->state);
+        if (worker->connection >= 0) shutdown(worker->connection, SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+
+    // Wake the acceptor with a connection of our own
+    struct sockaddr_un address;
+    socket_address(server->path, &address);
+    int wake = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (wake >= 0) {
+        connect(wake, (struct sockaddr*)&address, sizeof(address));
+        close(wake);
+    }
+    if (server->has_acceptor) pthread_join(server->acceptor, NULL);
+    close(server->listener);
+    unlink(server->path);
+
+    for (int i = 0; i < server->worker_count; i++) {
+        pthread_join(server->workers[i].thread, NULL);
+        free_state(server->workers[i].state);
+    }
+    if (server->has_watchdog) pthread_join(server->watchdog, NULL);
+
+    while (server->pending_head != NULL) {
+        Pending *next = server->pending_head->next;
+        close(server->pending_head->fd);
+        xfree(server->pending_head);
+        server->pending_head = next;
+    }
+    while (server->newest != NULL) {
+        Entry *older = server->newest->older;
+        free_entry(server->newest);
+        server->newest = older;
+    }
+    free_hashmap(server->entries, NULL);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->changed);
+    xfree(server->workers);
+    xfree(server->path);
+    xfree(server);
+}
+
+ServerStats server_stats(Server *server) {
+    pthread_mutex_lock(&server->lock);
+    ServerStats stats = server->stats;
+    pthread_mutex_unlock(&server->lock);
+    return stats;
+}
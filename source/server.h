@@ -0,0 +1,68 @@
+// server.h
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "engine.h"
+
+// Compiled programs kept by default, the least recently used is dropped first
+#define SERVER_CACHE_ENTRIES 64
+
+// Largest program a SOURCE request may send
+#define SERVER_MAX_SOURCE (1 << 24)
+
+// Requests on a connection are sequences of lines:
+//
+//     SOURCE <bytes>\n<source>     program text, compiled unless cached
+//     HASH <hash>\n                program sent before, by its SHA-256 in hex
+//     NUMBER <name> <value>\n      input variables, any number of them
+//     TEXT <name> <text>\n
+//     RUN\n                        run the program with those variables
+//
+// and every RUN is answered with the program's output and errors as they
+// are produced, then a status line:
+//
+//     OUT <bytes>\n<output>
+//     ERR <bytes>\n<errors>
+//     DONE <status> <hash>\n
+//
+// where status is ok, failed (runtime error), timeout, memory, syntax,
+// unknown (HASH not in the cache) or invalid (malformed request; the server
+// closes the connection when it can no longer tell where the next request
+// starts). Each request starts from empty variables. The hash is "-" if the
+// request named no program, or if a different cached source already has the
+// same hash, so HASH would not find this one.
+typedef struct {
+    const Engine *engine;
+    EngineOptions engine_options;
+    int workers;            // Threads serving connections, 0 for one per processor
+    int cache_entries;      // Compiled programs kept, 0 for SERVER_CACHE_ENTRIES
+    long time_limit_ms;     // Run time of a request, 0 for no limit
+    size_t memory_limit;    // Bytes a request may allocate on top of its program, 0 for no limit
+} ServerOptions;
+
+typedef struct {
+    long connections;
+    long requests;
+    long compiled;          // Programs compiled for the cache
+    long cache_hits;        // Requests whose program was already cached
+    long evicted;
+    long timeouts;
+    long memory_exceeded;
+} ServerStats;
+
+typedef struct Server Server;
+
+// Listen on a Unix socket at path, replacing a stale socket file, and serve
+// connections on worker threads until stopped. A connection keeps its worker
+// until it closes. Returns NULL, with a message on stderr, if the socket
+// cannot be opened.
+Server *server_start(const char *path, const ServerOptions *options);
+
+// Interrupt the requests still running, close every connection and remove
+// the socket file
+void server_stop(Server *server);
+
+ServerStats server_stats(Server *server);
+
+#endif
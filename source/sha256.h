@@ -0,0 +1,19 @@
+// sha256.h
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LENGTH 32
+#define SHA256_HEX_LENGTH (2 * SHA256_DIGEST_LENGTH)
+
+// SHA-256 (FIPS 180-4) of length bytes, for content hashes that must not
+// collide even when someone tries
+void sha256(const void *data, size_t length, uint8_t digest[SHA256_DIGEST_LENGTH]);
+
+// The same digest as lowercase hex digits, NUL-terminated
+void sha256_hex(const void *data, size_t length, char hex[SHA256_HEX_LENGTH + 1]);
+
+#endif
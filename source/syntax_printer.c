@@ -3,9 +3,9 @@
 #include <string.h>
 #include "syntax_printer.h"
 
-// Static buffer for test strings
-static char snap_buf[4096]; 
-static int snap_pos = 0;
+// Buffer for test strings, one per thread
+static _Thread_local char snap_buf[4096];
+static _Thread_local int snap_pos = 0;
 
 // Helper to append to the buffer like printf
 void buf_printf(const char *format, ...) {
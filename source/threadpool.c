@@ -0,0 +1,280 @@
+// Logic for the work-stealing thread pool
+
+#include "threadpool.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    pool_task_fn fn;
+    void *arg;
+} PoolTask;
+
+// Ring buffer used as a deque, grown when full. Its array comes from malloc
+// directly: xalloc may jump to the caller's recovery point, which would leave
+// the deque locked, and the pool's memory is not the caller's to account for.
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask *tasks;
+    int capacity;
+    int top;            // Oldest task, taken by thieves
+    int count;
+} TaskDeque;
+
+typedef struct {
+    ThreadPool *pool;
+    int index;
+    pthread_t thread;
+    TaskDeque deque;
+} Worker;
+
+struct ThreadPool {
+    Worker *workers;
+    int allocated;          // Workers with an initialised deque
+    int threads;            // Workers whose thread started
+    int next;               // Round-robin target for tasks submitted from outside
+
+    pthread_mutex_t lock;   // Guards pending, stop and the counters
+    pthread_cond_t wake;
+    int pending;            // Tasks queued but not taken yet
+    bool stop;
+    PoolStats stats;
+};
+
+// The worker running on this thread, NULL outside the pool
+static _Thread_local Worker *current_worker = NULL;
+
+int pool_default_threads() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// ---------------------------------------------------------
+// DEQUES
+// ---------------------------------------------------------
+
+static bool deque_init(TaskDeque *deque) {
+    deque->capacity = 64;
+    deque->tasks = malloc(deque->capacity * sizeof(PoolTask));
+    if (deque->tasks == NULL) return false;
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->top = 0;
+    deque->count = 0;
+    return true;
+}
+
+// Returns false, leaving the deque as it was, if it is full and cannot grow
+static bool deque_push(TaskDeque *deque, PoolTask task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        PoolTask *tasks = malloc(deque->capacity * 2 * sizeof(PoolTask));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&deque->lock);
+            return false;
+        }
+        for (int i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->top = 0;
+        deque->capacity *= 2;
+    }
+    deque->tasks[(deque->top + deque->count) % deque->capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+// The owner takes the newest task, whose data is most likely still in cache
+static bool deque_pop(TaskDeque *deque, PoolTask *task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        deque->count--;
+        *task = deque->tasks[(deque->top + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Thieves take the oldest task
+static bool deque_steal(TaskDeque *deque, PoolTask *task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        *task = deque->tasks[deque->top];
+        deque->top = (deque->top + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// ---------------------------------------------------------
+// WORKERS
+// ---------------------------------------------------------
+
+static bool find_task(Worker *worker, PoolTask *task, bool *stolen) {
+    *stolen = false;
+    if (deque_pop(&worker->deque, task)) return true;
+
+    ThreadPool *pool = worker->pool;
+    for (int i = 1; i < pool->allocated; i++) {
+        Worker *victim = &pool->workers[(worker->index + i) % pool->allocated];
+        if (deque_steal(&victim->deque, task)) {
+            *stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_task(ThreadPool *pool, PoolTask task, bool stolen) {
+    pthread_mutex_lock(&pool->lock);
+    pool->pending--;
+    pool->stats.executed++;
+    if (stolen) pool->stats.stolen++;
+    pthread_mutex_unlock(&pool->lock);
+
+    task.fn(task.arg);
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = (Worker*)arg;
+    ThreadPool *pool = worker->pool;
+    current_worker = worker;
+
+    while (true) {
+        PoolTask task;
+        bool stolen;
+        if (find_task(worker, &task, &stolen)) {
+            run_task(pool, task, stolen);
+            continue;
+        }
+
+        // Sleep until a task is queued somewhere
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending == 0 && !pool->stop) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        bool stop = pool->stop && pool->pending == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+ThreadPool *pool_new(int threads) {
+    ThreadPool *pool = xalloc(sizeof(ThreadPool), "Interpreter Error: Fail to allocate memory for thread pool.\n");
+    pool->workers = xalloc(threads * sizeof(Worker), "Interpreter Error: Fail to allocate memory for thread pool.\n");
+    pool->allocated = threads;
+    pool->threads = 0;
+    pool->next = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pool->pending = 0;
+    pool->stop = false;
+    memset(&pool->stats, 0, sizeof(PoolStats));
+
+    for (int i = 0; i < threads; i++) {
+        if (!deque_init(&pool->workers[i].deque)) {
+            pool->allocated = i;
+            free_pool(pool);
+            return NULL;
+        }
+    }
+
+    // Workers steal from every deque, so all of them exist before any starts
+    for (int i = 0; i < threads; i++) {
+        Worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        pool->threads = i + 1;
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            pool->threads = i;
+            break;
+        }
+    }
+
+    if (pool->threads == 0) {
+        free_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void free_pool(ThreadPool *pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    // Deques of workers whose thread failed to start were still initialised
+    for (int i = 0; i < pool->allocated; i++) {
+        pthread_mutex_destroy(&pool->workers[i].deque.lock);
+        free(pool->workers[i].deque.tasks);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    xfree(pool->workers);
+    xfree(pool);
+}
+
+void pool_submit(ThreadPool *pool, pool_task_fn fn, void *arg) {
+    PoolTask task = {fn, arg};
+    Worker *worker = current_worker;
+    if (worker == NULL || worker->pool != pool) {
+        pthread_mutex_lock(&pool->lock);
+        worker = &pool->workers[pool->next];
+        pool->next = (pool->next + 1) % pool->threads;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    // Out of memory for the queue, the caller runs the task itself
+    if (!deque_push(&worker->deque, task)) {
+        fn(arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+bool pool_run_one(ThreadPool *pool) {
+    PoolTask task;
+    bool stolen;
+    Worker *worker = current_worker;
+    if (worker != NULL && worker->pool == pool) {
+        if (!find_task(worker, &task, &stolen)) return false;
+        run_task(pool, task, stolen);
+        return true;
+    }
+
+    for (int i = 0; i < pool->allocated; i++) {
+        if (deque_steal(&pool->workers[i].deque, &task)) {
+            run_task(pool, task, true);
+            return true;
+        }
+    }
+    return false;
+}
+
+int pool_threads(ThreadPool *pool) {
+    return pool->threads;
+}
+
+PoolStats pool_stats(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    PoolStats stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+    return stats;
+}
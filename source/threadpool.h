@@ -0,0 +1,39 @@
+// threadpool.h
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdbool.h>
+
+typedef void (*pool_task_fn)(void *arg);
+
+typedef struct {
+    long executed;      // Tasks run by the workers
+    long stolen;        // Tasks a worker took from another worker's deque
+} PoolStats;
+
+typedef struct ThreadPool ThreadPool;
+
+// A work-stealing pool. Every worker owns a deque: it pushes and pops its own
+// tasks at the bottom, and idle workers steal from the top of the others.
+// Returns NULL if no worker thread could be started.
+ThreadPool *pool_new(int threads);
+void free_pool(ThreadPool *pool);
+
+// Queue a task. A worker queues on its own deque, any other thread spreads
+// its tasks over the workers round-robin. Never jumps to an allocation
+// recovery point: if the deque cannot grow, the task runs before returning.
+void pool_submit(ThreadPool *pool, pool_task_fn fn, void *arg);
+
+// Run one queued task on the calling thread, if there is any. Threads that
+// wait for tasks they queued help with the work this way instead of blocking
+// a worker the tasks may need.
+bool pool_run_one(ThreadPool *pool);
+
+int pool_threads(ThreadPool *pool);
+PoolStats pool_stats(ThreadPool *pool);
+
+// Number of online processors, at least 1
+int pool_default_threads();
+
+#endif
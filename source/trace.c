@@ -0,0 +1,211 @@
+// Logic for recording a timeline of execution as Chrome trace events
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum {
+    EVENT_STATEMENT,
+    EVENT_CALL,
+    EVENT_FAILED_CALL,
+    EVENT_WAIT,
+    EVENT_JUMP
+} EventKind;
+
+typedef struct {
+    int64_t start;
+    int64_t duration;
+    const char *name;       // Builtin of a call
+    EventKind kind;
+    int a;                  // Statement: number and line. Jump: from and to.
+    int b;
+} TraceEvent;
+
+// Written only by its own thread while tracing, read by stop_trace after.
+// Buffers are kept for the life of the process, to be reused by the next trace.
+typedef struct TraceBuffer {
+    int tid;
+    int count;
+    long statements;        // Seen by this thread, for sampling
+    bool active;            // The current statement is sampled
+    bool named;             // Its thread name has been written
+    struct TraceBuffer *next;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+bool trace_enabled = false;
+
+static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file = NULL;
+static bool first_event = true;
+static int sample_every = 1;
+static int64_t epoch;
+static int pid;
+static TraceBuffer *buffers = NULL;    // Every thread's buffer, under file_lock
+static int thread_count = 0;
+
+static _Thread_local TraceBuffer *buffer = NULL;
+
+static int64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+bool start_trace(const char *path, int every) {
+    if (tracing()) stop_trace();
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open trace file '%s'\n", path);
+        return false;
+    }
+    pthread_mutex_lock(&file_lock);
+    trace_file = file;
+    first_event = true;
+    for (TraceBuffer *own = buffers; own != NULL; own = own->next) {
+        own->count = 0;
+        own->statements = 0;
+        own->active = false;
+        own->named = false;
+    }
+    pthread_mutex_unlock(&file_lock);
+    sample_every = every > 0 ? every : 1;
+    epoch = now_ns();
+    pid = (int)getpid();
+    fprintf(trace_file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    __atomic_store_n(&trace_enabled, true, __ATOMIC_RELAXED);
+    return true;
+}
+
+// ---------------------------------------------------------
+// WRITING
+// ---------------------------------------------------------
+
+static void begin_event() {
+    fputs(first_event ? "\n" : ",\n", trace_file);
+    first_event = false;
+}
+
+static void write_event(TraceBuffer *owner, TraceEvent *event) {
+    begin_event();
+    double ts = (event->start - epoch) / 1e3;
+    switch (event->kind) {
+        case EVENT_STATEMENT:
+            fprintf(trace_file, "{\"name\": \"line %d\", \"cat\": \"statement\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                    "\"pid\": %d, \"tid\": %d, \"args\": {\"statement\": %d}}",
+                    event->b, ts, event->duration / 1e3, pid, owner->tid, event->a);
+            break;
+        case EVENT_CALL:
+        case EVENT_FAILED_CALL:
+            fprintf(trace_file, "{\"name\": \"%s\", \"cat\": \"builtin\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                    "\"pid\": %d, \"tid\": %d%s}",
+                    event->name, ts, event->duration / 1e3, pid, owner->tid,
+                    event->kind == EVENT_FAILED_CALL ? ", \"args\": {\"failed\": true}" : "");
+            break;
+        case EVENT_WAIT:
+            fprintf(trace_file, "{\"name\": \"SLEEP wait\", \"cat\": \"wait\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                    "\"pid\": %d, \"tid\": %d}",
+                    ts, event->duration / 1e3, pid, owner->tid);
+            break;
+        case EVENT_JUMP:
+            fprintf(trace_file, "{\"name\": \"jump\", \"cat\": \"jump\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, "
+                    "\"pid\": %d, \"tid\": %d, \"args\": {\"from\": %d, \"to\": %d}}",
+                    ts, pid, owner->tid, event->a, event->b);
+            break;
+    }
+}
+
+// Called with file_lock held
+static void write_buffer(TraceBuffer *owner) {
+    if (!owner->named) {
+        begin_event();
+        fprintf(trace_file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+                pid, owner->tid, owner->tid);
+        owner->named = true;
+    }
+    for (int i = 0; i < owner->count; i++) {
+        write_event(owner, &owner->events[i]);
+    }
+    owner->count = 0;
+}
+
+void stop_trace() {
+    if (!tracing()) return;
+    __atomic_store_n(&trace_enabled, false, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&file_lock);
+    for (TraceBuffer *own = buffers; own != NULL; own = own->next) {
+        write_buffer(own);
+    }
+    fprintf(trace_file, "\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+    pthread_mutex_unlock(&file_lock);
+}
+
+// ---------------------------------------------------------
+// RECORDING
+// ---------------------------------------------------------
+
+// The calling thread's buffer, made on its first statement. NULL if there
+// is no memory for it, which leaves the thread out of the trace.
+static TraceBuffer *thread_buffer() {
+    if (buffer == NULL) {
+        TraceBuffer *made = malloc(sizeof(TraceBuffer));
+        if (made == NULL) return NULL;
+        made->count = 0;
+        made->statements = 0;
+        made->active = false;
+        made->named = false;
+        pthread_mutex_lock(&file_lock);
+        made->tid = ++thread_count;
+        made->next = buffers;
+        buffers = made;
+        pthread_mutex_unlock(&file_lock);
+        buffer = made;
+    }
+    return buffer;
+}
+
+static void record(TraceEvent event) {
+    if (buffer->count == TRACE_BUFFER_EVENTS) {
+        pthread_mutex_lock(&file_lock);
+        write_buffer(buffer);
+        pthread_mutex_unlock(&file_lock);
+    }
+    buffer->events[buffer->count++] = event;
+}
+
+int64_t trace_statement_begin() {
+    TraceBuffer *own = thread_buffer();
+    if (own == NULL) return -1;
+    own->active = own->statements++ % sample_every == 0;
+    return own->active ? now_ns() : -1;
+}
+
+void trace_statement_end(Statement *stmt, int64_t start) {
+    if (start < 0) return;
+    buffer->active = false;
+    record((TraceEvent){start, now_ns() - start, NULL, EVENT_STATEMENT, stmt->number, stmt->line});
+}
+
+int64_t trace_begin() {
+    return buffer != NULL && buffer->active ? now_ns() : -1;
+}
+
+void trace_call_end(const char *name, int64_t start, bool failed) {
+    if (start < 0) return;
+    record((TraceEvent){start, now_ns() - start, name, failed ? EVENT_FAILED_CALL : EVENT_CALL, 0, 0});
+}
+
+void trace_wait_end(int64_t start) {
+    if (start < 0) return;
+    record((TraceEvent){start, now_ns() - start, NULL, EVENT_WAIT, 0, 0});
+}
+
+void trace_jump(int from, int to) {
+    if (buffer == NULL || !buffer->active) return;
+    record((TraceEvent){now_ns(), 0, NULL, EVENT_JUMP, from, to});
+}
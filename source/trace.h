@@ -0,0 +1,41 @@
+// trace.h
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "parser.h"
+
+// Events a thread buffers before it writes them out
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+// Write a timeline of statements, builtin calls, jumps taken and SLEEP waits
+// to path as Chrome trace-event JSON, readable by chrome://tracing and
+// Perfetto. Only one statement in every sample_every is recorded, with the
+// calls, jumps and waits it makes. Every thread records into a buffer of its
+// own without locking; a full buffer is written out by its thread, the rest
+// by stop_trace. Returns false, with a message on stderr, if path cannot be
+// written. A trace already running is stopped first.
+bool start_trace(const char *path, int sample_every);
+
+// Write out the rest of the trace. Called once nothing is running.
+void stop_trace();
+
+extern bool trace_enabled;      // Only written by start_trace and stop_trace
+
+static inline bool tracing() {
+    return __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED);
+}
+
+// Recording, called while tracing. The begin functions return the start
+// time of the event, or -1 if the statement it belongs to is not sampled, in
+// which case the matching end function does nothing.
+int64_t trace_statement_begin();
+void trace_statement_end(Statement *stmt, int64_t start);
+int64_t trace_begin();
+void trace_call_end(const char *name, int64_t start, bool failed);
+void trace_wait_end(int64_t start);
+void trace_jump(int from, int to);
+
+#endif
@@ -0,0 +1,565 @@
+// Logic for translating Pinch programs into C
+//
+// Every statement becomes a labelled block and literal jumps become gotos.
+// Variables that only ever hold Numbers are plain doubles, everything else
+// stays a boxed Value. Expressions are flattened into temporaries so that
+// arguments are evaluated left to right, as the interpreter does, and
+// builtins without an unboxed equivalent are called through functions.c.
+
+#include "transpiler.h"
+#include "analysis.h"
+#include "functions.h"
+#include "util.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    FILE *out;
+    Statement **statements;
+    int stmt_count;
+    VarTable *vars;
+    ValueType *var_types;
+    int temps;          // Temporaries declared so far
+    int number;         // Statement number reported by runtime errors
+    bool dynamic;       // Current statement jumps by a computed amount
+    bool *labelled;     // Statements some jump can land on
+    bool end_used;
+} Emitter;
+
+// A value computed into temporary t<temp>
+typedef struct {
+    bool boxed;         // Value* owned by the block if true, double otherwise
+    int temp;
+} Operand;
+
+// Support code placed at the top of every generated file. Errors are
+// reported with the interpreter's messages, mostly by the builtins themselves.
+static const char *PRELUDE =
+    "#include <math.h>\n"
+    "#include <stdbool.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include \"interpreter.h\"\n"
+    "#include \"functions.h\"\n"
+    "\n"
+    "static inline void halt(int number) {\n"
+    "    fprintf(stderr, \"Execution halted at statement %d.\\n\", number);\n"
+    "    exit(EXIT_SUCCESS);\n"
+    "}\n"
+    "\n"
+    "static inline void undefined(const char *name, int number) {\n"
+    "    fprintf(stderr, \"Runtime Error: Undefined variable '%s'.\\n\", name);\n"
+    "    halt(number);\n"
+    "}\n"
+    "\n"
+    "static inline double num_var(double value, bool defined, const char *name, int number) {\n"
+    "    if (!defined) undefined(name, number);\n"
+    "    return value;\n"
+    "}\n"
+    "\n"
+    "static inline Value *box_var(Value *value, const char *name, int number) {\n"
+    "    if (value == NULL) undefined(name, number);\n"
+    "    return copy_value(value);\n"
+    "}\n"
+    "\n"
+    "// Call a builtin on owned arguments, halting if it reports an error\n"
+    "static inline Value *call(builtin_fn fn, Value **args, int count, int number) {\n"
+    "    Value *result = fn(args, count);\n"
+    "    for (int i = 0; i < count; i++) free_value(args[i]);\n"
+    "    if (result->type == VALUE_ERROR) halt(number);\n"
+    "    return result;\n"
+    "}\n"
+    "\n"
+    "// Let a builtin report why it rejects unboxed Number arguments\n"
+    "static inline void reject(builtin_fn fn, double a, double b, int count, int number) {\n"
+    "    Value *args[2] = {value_from_num(a), value_from_num(b)};\n"
+    "    call(fn, args, count, number);\n"
+    "    halt(number);\n"
+    "}\n"
+    "\n"
+    "static inline double unbox_num(Value *value) {\n"
+    "    double num = value->data.num;\n"
+    "    free_value(value);\n"
+    "    return num;\n"
+    "}\n"
+    "\n"
+    "static inline void check_none(Value *value, const char *name, int number) {\n"
+    "    if (value->type == VALUE_NONE) {\n"
+    "        fprintf(stderr, \"Runtime Error: Assigning none value to variable '%s'.\\n\", name);\n"
+    "        halt(number);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static inline void assign(Value **var, Value *value, const char *name, int number) {\n"
+    "    check_none(value, name, number);\n"
+    "    free_value(*var);\n"
+    "    *var = value;\n"
+    "}\n"
+    "\n"
+    "static inline void print_num(double num) {\n"
+    "    Value value = {.type = VALUE_NUM, .data.num = num};\n"
+    "    print_value(&value);\n"
+    "}\n"
+    "\n"
+    "static inline void print_boxed(Value *value) {\n"
+    "    print_value(value);\n"
+    "    free_value(value);\n"
+    "}\n"
+    "\n"
+    "static inline Value *unknown(const char *name, Value **args, int count, int number) {\n"
+    "    for (int i = 0; i < count; i++) free_value(args[i]);\n"
+    "    fprintf(stderr, \"Runtime Error: Unknown function '%s'.\\n\", name);\n"
+    "    halt(number);\n"
+    "    return NULL;\n"
+    "}\n"
+    "\n"
+    "static inline double jump_if_cond(Value *cond, int number) {\n"
+    "    if (cond->type != VALUE_NUM) {\n"
+    "        fprintf(stderr, \"Runtime Error: JUMP_IF expects 3 arguments [Number, Jump, Jump].\\n\");\n"
+    "        halt(number);\n"
+    "    }\n"
+    "    return unbox_num(cond);\n"
+    "}\n"
+    "\n"
+    "// Jumps by computed amounts move pc like the interpreter's program counter\n"
+    "static inline Value *jump(Value **args, int count, int *pc, int number) {\n"
+    "    if (count != 1 || args[0]->type != VALUE_JUMP) {\n"
+    "        fprintf(stderr, \"Runtime Error: JUMP expects 1 argument Jump.\\n\");\n"
+    "        halt(number);\n"
+    "    }\n"
+    "    *pc += args[0]->data.jump.type == JUMP_FORWARD ? args[0]->data.jump.lines : -args[0]->data.jump.lines;\n"
+    "    (*pc)--;\n"
+    "    for (int i = 0; i < count; i++) free_value(args[i]);\n"
+    "    return value_from_none();\n"
+    "}\n"
+    "\n"
+    "static inline Value *jump_if(Value **args, int count, int *pc, int number) {\n"
+    "    if (count != 3 || args[0]->type != VALUE_NUM || args[1]->type != VALUE_JUMP) {\n"
+    "        fprintf(stderr, \"Runtime Error: JUMP_IF expects 3 arguments [Number, Jump, Jump].\\n\");\n"
+    "        halt(number);\n"
+    "    }\n"
+    "    Value *taken = args[0]->data.num >= 0.5 ? args[1] : args[2];\n"
+    "    *pc += taken->data.jump.type == JUMP_FORWARD ? taken->data.jump.lines : -taken->data.jump.lines;\n"
+    "    (*pc)--;\n"
+    "    for (int i = 0; i < count; i++) free_value(args[i]);\n"
+    "    return value_from_none();\n"
+    "}\n";
+
+// ---------------------------------------------------------
+// HELPERS
+// ---------------------------------------------------------
+
+static void emit_string_literal(FILE *out, const char *s) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)s; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20 || *c >= 0x7F) {
+            fprintf(out, "\\%03o", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Print a double so the C compiler reads back exactly the same value
+static void emit_double(FILE *out, double num) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", num);
+    fputs(buf, out);
+    if (strpbrk(buf, ".e") == NULL) fputs(".0", out);
+}
+
+static bool is_typed_num(Emitter *e, int var) {
+    return e->var_types[var] == VALUE_NUM;
+}
+
+static bool is_literal_jump(Pinch_Func *func) {
+    Factor **args = func->factors->items;
+    if (strcmp(func->name, "JUMP") == 0) {
+        return func->factors->count == 1 && args[0]->type == FACTOR_JUMP;
+    }
+    if (strcmp(func->name, "JUMP_IF") == 0) {
+        return func->factors->count == 3 && args[1]->type == FACTOR_JUMP && args[2]->type == FACTOR_JUMP;
+    }
+    return false;
+}
+
+// Whether a JUMP or JUMP_IF call appears anywhere in the factors
+static bool contains_jump(Factors *factors) {
+    for (int i = 0; i < factors->count; i++) {
+        Factor *f = factors->items[i];
+        if (f->type != FACTOR_FUNC) continue;
+        if (is_jump_func(f->data.func) || contains_jump(f->data.func->factors)) return true;
+    }
+    return false;
+}
+
+// Statements that move the program counter by amounts only known at run time
+static bool has_dynamic_jump(Statement *stmt) {
+    switch (stmt->type) {
+        case PINCH_VAR:
+            return contains_jump(stmt->content.pinch_var->factors);
+        case FACTOR: {
+            Factor *f = stmt->content.factor;
+            if (f->type != FACTOR_FUNC) return false;
+            return is_jump_func(f->data.func) || contains_jump(f->data.func->factors);
+        }
+        case PINCH_FUNC_S: {
+            Pinch_Func *func = stmt->content.pinch_func;
+            if (contains_jump(func->factors)) return true;
+            return is_jump_func(func) && !is_literal_jump(func);
+        }
+    }
+    return false;
+}
+
+static void emit_goto(Emitter *e, int target) {
+    if (target >= e->stmt_count) {
+        fprintf(e->out, "goto end;");
+        e->end_used = true;
+    } else {
+        fprintf(e->out, "goto s%d;", target);
+    }
+}
+
+// Emit an owned Value* expression for an operand
+static void emit_boxed(Emitter *e, Operand op) {
+    if (op.boxed) {
+        fprintf(e->out, "t%d", op.temp);
+    } else {
+        fprintf(e->out, "value_from_num(t%d)", op.temp);
+    }
+}
+
+// ---------------------------------------------------------
+// EXPRESSIONS
+// ---------------------------------------------------------
+
+static Operand emit_factor(Emitter *e, Factor *f);
+
+// Collect already evaluated arguments into an array a<temp>
+static int emit_arg_array(Emitter *e, Operand *ops, int count) {
+    int array = e->temps++;
+    if (count == 0) {
+        fprintf(e->out, "        Value **a%d = NULL;\n", array);
+        return array;
+    }
+    fprintf(e->out, "        Value *a%d[] = {", array);
+    for (int i = 0; i < count; i++) {
+        if (i > 0) fprintf(e->out, ", ");
+        emit_boxed(e, ops[i]);
+    }
+    fprintf(e->out, "};\n");
+    return array;
+}
+
+static bool all_unboxed(Operand *ops, int count) {
+    for (int i = 0; i < count; i++) {
+        if (ops[i].boxed) return false;
+    }
+    return true;
+}
+
+// Unboxed code for Number builtins. Returns false if there is none.
+static bool emit_unboxed_call(Emitter *e, const Builtin *builtin, Operand *ops, int count, int result) {
+    if (count != builtin->arity || !all_unboxed(ops, count)) return false;
+
+    FILE *out = e->out;
+    int a = count > 0 ? ops[0].temp : 0;
+    int b = count > 1 ? ops[1].temp : 0;
+
+    switch (builtin->op) {
+        case NUM_OP_ADD: fprintf(out, "        double t%d = t%d + t%d;\n", result, a, b); return true;
+        case NUM_OP_SUB: fprintf(out, "        double t%d = t%d - t%d;\n", result, a, b); return true;
+        case NUM_OP_MUL: fprintf(out, "        double t%d = t%d * t%d;\n", result, a, b); return true;
+        case NUM_OP_DIV:
+            fprintf(out, "        if (t%d == 0) reject(%s, t%d, t%d, 2, %d);\n", b, builtin->name, a, b, e->number);
+            fprintf(out, "        double t%d = t%d / t%d;\n", result, a, b);
+            return true;
+        case NUM_OP_MOD:
+            fprintf(out, "        if (t%d == 0) reject(%s, t%d, t%d, 2, %d);\n", b, builtin->name, a, b, e->number);
+            fprintf(out, "        double t%d = fmod(t%d, t%d);\n", result, a, b);
+            return true;
+        case NUM_OP_POW: fprintf(out, "        double t%d = pow(t%d, t%d);\n", result, a, b); return true;
+        case NUM_OP_EQ:  fprintf(out, "        double t%d = t%d == t%d ? 1.0 : 0.0;\n", result, a, b); return true;
+        case NUM_OP_NEQ: fprintf(out, "        double t%d = t%d != t%d ? 1.0 : 0.0;\n", result, a, b); return true;
+        case NUM_OP_GT:  fprintf(out, "        double t%d = t%d > t%d ? 1.0 : 0.0;\n", result, a, b); return true;
+        case NUM_OP_LT:  fprintf(out, "        double t%d = t%d < t%d ? 1.0 : 0.0;\n", result, a, b); return true;
+        case NUM_OP_GTE: fprintf(out, "        double t%d = t%d >= t%d ? 1.0 : 0.0;\n", result, a, b); return true;
+        case NUM_OP_LTE: fprintf(out, "        double t%d = t%d <= t%d ? 1.0 : 0.0;\n", result, a, b); return true;
+        case NUM_OP_NONE:
+            break;
+    }
+
+    if (builtin->fn == ABS) {
+        fprintf(out, "        double t%d = fabs(t%d);\n", result, a);
+    } else if (builtin->fn == SQRT) {
+        fprintf(out, "        if (t%d < 0) reject(SQRT, t%d, 0, 1, %d);\n", a, a, e->number);
+        fprintf(out, "        double t%d = sqrt(t%d);\n", result, a);
+    } else if (builtin->fn == FLOOR) {
+        fprintf(out, "        double t%d = floor(t%d);\n", result, a);
+    } else if (builtin->fn == CEIL) {
+        fprintf(out, "        double t%d = ceil(t%d);\n", result, a);
+    } else if (builtin->fn == ROUND) {
+        fprintf(out, "        double t%d = round(t%d);\n", result, a);
+    } else if (builtin->fn == IF) {
+        // Both branches have already been evaluated, as in the interpreter
+        fprintf(out, "        double t%d = t%d >= 0.5 ? t%d : t%d;\n", result, a, b, ops[2].temp);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static Operand emit_func(Emitter *e, Pinch_Func *func) {
+    int count = func->factors->count;
+    Operand *ops = xalloc((count + 1) * sizeof(Operand), "Interpreter Error: Fail to allocate memory while emitting C.\n");
+    for (int i = 0; i < count; i++) {
+        ops[i] = emit_factor(e, func->factors->items[i]);
+    }
+
+    Operand result = {true, 0};
+    const Builtin *builtin = find_builtin(func->name);
+
+    if (is_jump_func(func)) {
+        int array = emit_arg_array(e, ops, count);
+        result.temp = e->temps++;
+        fprintf(e->out, "        Value *t%d = %s(a%d, %d, &pc, %d);\n",
+                result.temp, strcmp(func->name, "JUMP") == 0 ? "jump" : "jump_if", array, count, e->number);
+        e->dynamic = true;
+    } else if (builtin == NULL) {
+        int array = emit_arg_array(e, ops, count);
+        result.temp = e->temps++;
+        fprintf(e->out, "        Value *t%d = unknown(", result.temp);
+        emit_string_literal(e->out, func->name);
+        fprintf(e->out, ", a%d, %d, %d);\n", array, count, e->number);
+    } else {
+        result.temp = e->temps++;
+        if (emit_unboxed_call(e, builtin, ops, count, result.temp)) {
+            result.boxed = false;
+        } else {
+            int array = emit_arg_array(e, ops, count);
+            fprintf(e->out, "        Value *t%d = call(%s, a%d, %d, %d);\n",
+                    result.temp, builtin->name, array, count, e->number);
+
+            // Successful calls always return the registered result type
+            if (builtin->result == VALUE_NUM) {
+                int boxed = result.temp;
+                result = (Operand){false, e->temps++};
+                fprintf(e->out, "        double t%d = unbox_num(t%d);\n", result.temp, boxed);
+            }
+        }
+    }
+
+    xfree(ops);
+    return result;
+}
+
+static Operand emit_factor(Emitter *e, Factor *f) {
+    FILE *out = e->out;
+    Operand op = {true, e->temps};
+
+    switch (f->type) {
+        case FACTOR_NUM:
+            op.boxed = false;
+            e->temps++;
+            fprintf(out, "        double t%d = ", op.temp);
+            emit_double(out, f->data.num);
+            fprintf(out, ";\n");
+            break;
+        case FACTOR_STR:
+            e->temps++;
+            fprintf(out, "        Value *t%d = value_from_str(", op.temp);
+            emit_string_literal(out, f->data.str);
+            fprintf(out, ");\n");
+            break;
+        case FACTOR_JUMP:
+            e->temps++;
+            fprintf(out, "        Value *t%d = value_from_jump(%d, %s);\n", op.temp, f->data.jump.lines,
+                    f->data.jump.type == JUMP_FORWARD ? "JUMP_FORWARD" : "JUMP_BACKWARD");
+            break;
+        case FACTOR_VAR: {
+            int var = var_table_index(e->vars, f->data.var);
+            e->temps++;
+            if (is_typed_num(e, var)) {
+                op.boxed = false;
+                fprintf(out, "        double t%d = num_var(v%d, d%d, ", op.temp, var, var);
+            } else {
+                fprintf(out, "        Value *t%d = box_var(v%d, ", op.temp, var);
+            }
+            emit_string_literal(out, f->data.var);
+            fprintf(out, ", %d);\n", e->number);
+            break;
+        }
+        case FACTOR_FUNC:
+            op = emit_func(e, f->data.func);
+            break;
+    }
+    return op;
+}
+
+// ---------------------------------------------------------
+// STATEMENTS
+// ---------------------------------------------------------
+
+static void emit_print(Emitter *e, Operand op) {
+    fprintf(e->out, "        %s(t%d);\n", op.boxed ? "print_boxed" : "print_num", op.temp);
+}
+
+static void emit_assignment(Emitter *e, Pinch_Var *assign) {
+    Operand op = emit_factor(e, assign->factors->items[0]);
+    int var = var_table_index(e->vars, assign->name);
+    FILE *out = e->out;
+
+    if (is_typed_num(e, var)) {
+        if (op.boxed) {
+            fprintf(out, "        check_none(t%d, ", op.temp);
+            emit_string_literal(out, assign->name);
+            fprintf(out, ", %d);\n", e->number);
+            fprintf(out, "        v%d = unbox_num(t%d);\n", var, op.temp);
+        } else {
+            fprintf(out, "        v%d = t%d;\n", var, op.temp);
+        }
+        fprintf(out, "        d%d = true;\n", var);
+    } else {
+        fprintf(out, "        assign(&v%d, ", var);
+        emit_boxed(e, op);
+        fprintf(out, ", ");
+        emit_string_literal(out, assign->name);
+        fprintf(out, ", %d);\n", e->number);
+    }
+}
+
+static void emit_statement(Emitter *e, int index) {
+    Statement *stmt = e->statements[index];
+    FILE *out = e->out;
+
+    e->number = index + 1;
+    e->dynamic = false;
+
+    if (e->labelled[index]) {
+        fprintf(out, "s%d:\n", index);
+    }
+    fprintf(out, "    {\n");
+    if (has_dynamic_jump(stmt)) {
+        fprintf(out, "        pc = %d;\n", index);
+    }
+
+    switch (stmt->type) {
+        case FACTOR:
+            emit_print(e, emit_factor(e, stmt->content.factor));
+            break;
+        case PINCH_VAR:
+            emit_assignment(e, stmt->content.pinch_var);
+            break;
+        case PINCH_FUNC_S: {
+            Pinch_Func *func = stmt->content.pinch_func;
+            Factor **args = func->factors->items;
+
+            if (!has_dynamic_jump(stmt) && strcmp(func->name, "JUMP") == 0) {
+                fprintf(out, "        ");
+                emit_goto(e, jump_target(index, args[0], e->stmt_count));
+                fprintf(out, "\n");
+            } else if (!has_dynamic_jump(stmt) && strcmp(func->name, "JUMP_IF") == 0) {
+                Operand cond = emit_factor(e, args[0]);
+                if (cond.boxed) {
+                    int num = e->temps++;
+                    fprintf(out, "        double t%d = jump_if_cond(t%d, %d);\n", num, cond.temp, e->number);
+                    cond = (Operand){false, num};
+                }
+                fprintf(out, "        if (t%d >= 0.5) ", cond.temp);
+                emit_goto(e, jump_target(index, args[1], e->stmt_count));
+                fprintf(out, "\n        ");
+                emit_goto(e, jump_target(index, args[2], e->stmt_count));
+                fprintf(out, "\n");
+            } else {
+                emit_print(e, emit_func(e, func));
+            }
+            break;
+        }
+    }
+
+    if (e->dynamic) {
+        fprintf(out, "        pc++;\n");
+        fprintf(out, "        goto dispatch;\n");
+    }
+    fprintf(out, "    }\n");
+}
+
+// ---------------------------------------------------------
+// PROGRAM
+// ---------------------------------------------------------
+
+void emit_c_program(FILE *out, Statement **statements, int stmt_count, const char *source_name) {
+    VarTable *vars = var_table_build(statements, stmt_count);
+    ValueType *var_types = infer_var_types(statements, stmt_count, vars);
+
+    bool *labelled = xalloc((stmt_count + 1) * sizeof(bool), "Interpreter Error: Fail to allocate memory while emitting C.\n");
+    Emitter e = {out, statements, stmt_count, vars, var_types, 0, 0, false, labelled, false};
+
+    // Only label jump targets, unless computed jumps can land anywhere
+    bool dynamic = false;
+    for (int i = 0; i < stmt_count; i++) {
+        dynamic = dynamic || has_dynamic_jump(statements[i]);
+        labelled[i] = false;
+    }
+    for (int i = 0; i < stmt_count; i++) {
+        Statement *stmt = statements[i];
+        if (dynamic) {
+            labelled[i] = true;
+        } else if (stmt->type == PINCH_FUNC_S && is_jump_func(stmt->content.pinch_func)) {
+            Factors *args = stmt->content.pinch_func->factors;
+            for (int j = 0; j < args->count; j++) {
+                if (args->items[j]->type != FACTOR_JUMP) continue;
+                int target = jump_target(i, args->items[j], stmt_count);
+                if (target < stmt_count) labelled[target] = true;
+            }
+        }
+    }
+
+    fprintf(out, "// Generated by pinch --emit-c from %s\n", source_name);
+    fprintf(out, "// Build with the interpreter objects, e.g. make native PROG=%s\n\n", source_name);
+    fputs(PRELUDE, out);
+    fprintf(out, "\nint main(void) {\n");
+
+    for (int i = 0; i < vars->count; i++) {
+        if (is_typed_num(&e, i)) {
+            fprintf(out, "    double v%d = 0;     // %s\n", i, vars->names[i]);
+            fprintf(out, "    bool d%d = false;\n", i);
+        } else {
+            fprintf(out, "    Value *v%d = NULL;  // %s\n", i, vars->names[i]);
+        }
+    }
+    if (dynamic) {
+        fprintf(out, "    int pc = 0;\n");
+    }
+    fprintf(out, "\n");
+
+    for (int i = 0; i < stmt_count; i++) {
+        emit_statement(&e, i);
+    }
+
+    if (dynamic) {
+        // Computed jumps land on any statement, or end the program when out of range
+        fprintf(out, "    goto end;\n");
+        fprintf(out, "dispatch:\n");
+        fprintf(out, "    switch (pc) {\n");
+        for (int i = 0; i < stmt_count; i++) {
+            fprintf(out, "        case %d: goto s%d;\n", i, i);
+        }
+        fprintf(out, "        default: goto end;\n");
+        fprintf(out, "    }\n");
+    }
+    if (e.end_used || dynamic) {
+        fprintf(out, "end:\n");
+    }
+    fprintf(out, "    return EXIT_SUCCESS;\n");
+    fprintf(out, "}\n");
+
+    xfree(labelled);
+    xfree(var_types);
+    free_var_table(vars);
+}
@@ -0,0 +1,14 @@
+// transpiler.h
+
+#ifndef TRANSPILER_H
+#define TRANSPILER_H
+
+#include <stdio.h>
+#include "parser.h"
+
+// Translate a program into a standalone C file that links against the
+// interpreter objects for its builtins and prints exactly what the
+// interpreter would.
+void emit_c_program(FILE *out, Statement **statements, int stmt_count, const char *source_name);
+
+#endif
@@ -1,18 +1,143 @@
 #include "util.h"
+#include "allocstats.h"
 #include <assert.h>
-#include <stdio.h>
+#include <malloc.h>
+#include <stdarg.h>
 #include <stdlib.h>
 
+// Per thread, so programs running on different threads never share them
+static _Thread_local AllocRecovery *recovery_point = NULL;
+static _Thread_local FILE *error_stream = NULL;
+static _Thread_local size_t alloc_limit = 0;
+static _Thread_local size_t alloc_held = 0;
+static _Thread_local bool alloc_limit_hit = false;
+
+static bool alloc_counting = false;
+static long alloc_count = 0;
+static long free_count = 0;
+
 void *xalloc(size_t size, char *msg) {
     void *mem = malloc(size);
     if (mem == NULL) {
-        fprintf(stderr, "%s", msg);
-        exit(EXIT_FAILURE);
+        alloc_failed(msg);
+    }
+    if (alloc_limit > 0) {
+        alloc_held += malloc_usable_size(mem);
+        if (alloc_held > alloc_limit) {
+            alloc_held -= malloc_usable_size(mem);
+            free(mem);
+            alloc_limit_hit = true;
+            alloc_failed("Runtime Error: Memory limit exceeded.\n");
+        }
+    }
+    if (tracking_allocations()) {
+        alloc_stats_add(mem, size, msg);
+    }
+    if (__atomic_load_n(&alloc_counting, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
     }
     return mem;
 }
 
+// Counted like freeing the block and allocating the new one. The cap is
+// checked before resizing, so on failure the caller still owns the old block.
+void *xrealloc(void *mem, size_t size, char *msg) {
+    assert(mem != NULL);
+    size_t old_size = malloc_usable_size(mem);
+    size_t held = alloc_held > old_size ? alloc_held - old_size : 0;
+    if (alloc_limit > 0 && held + size > alloc_limit) {
+        alloc_limit_hit = true;
+        alloc_failed("Runtime Error: Memory limit exceeded.\n");
+    }
+    // Dropped first, another thread may be handed the old address at once
+    bool tracking = tracking_allocations();
+    if (tracking) {
+        alloc_stats_remove(mem);
+    }
+    void *resized = realloc(mem, size);
+    if (resized == NULL) {
+        alloc_failed(msg);
+    }
+    if (alloc_limit > 0) {
+        alloc_held = held + malloc_usable_size(resized);
+    }
+    if (tracking) {
+        alloc_stats_add(resized, size, msg);
+    }
+    if (__atomic_load_n(&alloc_counting, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&free_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    }
+    return resized;
+}
+
 void xfree(void *mem) {
     assert(mem != NULL);
+    if (tracking_allocations()) {
+        alloc_stats_remove(mem);
+    }
+    if (__atomic_load_n(&alloc_counting, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&free_count, 1, __ATOMIC_RELAXED);
+    }
+    if (alloc_limit > 0) {
+        size_t size = malloc_usable_size(mem);
+        alloc_held = alloc_held > size ? alloc_held - size : 0;
+    }
     free(mem);
 }
+
+void limit_allocations(size_t bytes) {
+    alloc_limit = bytes;
+    alloc_held = 0;
+    alloc_limit_hit = false;
+}
+
+bool allocation_limit_exceeded() {
+    return alloc_limit_hit;
+}
+
+void count_allocations() {
+    __atomic_store_n(&alloc_counting, true, __ATOMIC_RELAXED);
+}
+
+long allocation_count() {
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+long deallocation_count() {
+    return __atomic_load_n(&free_count, __ATOMIC_RELAXED);
+}
+
+void push_alloc_recovery(AllocRecovery *recovery) {
+    recovery->message = NULL;
+    recovery->previous = recovery_point;
+    recovery_point = recovery;
+}
+
+void pop_alloc_recovery(AllocRecovery *recovery) {
+    recovery_point = recovery->previous;
+}
+
+void alloc_failed(const char *msg) {
+    AllocRecovery *recovery = recovery_point;
+    if (recovery == NULL) {
+        fputs(msg, stderr);
+        abort();
+    }
+    recovery_point = recovery->previous;
+    recovery->message = msg;
+    longjmp(recovery->env, 1);
+}
+
+void report_error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(error_stream != NULL ? error_stream : stderr, format, args);
+    va_end(args);
+}
+
+FILE *redirect_errors(FILE *stream) {
+    FILE *previous = error_stream;
+    error_stream = stream;
+    return previous;
+}
@@ -4,8 +4,51 @@
 #define UTIL_H
 
 #include "stddef.h"
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 void *xalloc(size_t size, char *msg);
+void *xrealloc(void *mem, size_t size, char *msg);
 void xfree(void *mem);
 
+// Cap the bytes the calling thread holds through xalloc, counting from now,
+// 0 lifting the cap. An allocation over the cap fails like running out of
+// memory with "Memory limit exceeded", and allocation_limit_exceeded reports
+// it until the next call.
+void limit_allocations(size_t bytes);
+bool allocation_limit_exceeded();
+
+// Count xalloc and xfree calls on every thread from now on, for run
+// summaries and allocation budgets in tests. Unlike track_allocations this is
+// a single atomic addition per call.
+void count_allocations();
+long allocation_count();
+long deallocation_count();
+
+// xalloc never exits the process. When memory runs out it jumps back to the
+// innermost recovery point of the calling thread, or aborts if the thread has
+// none. Whatever the interrupted work had allocated is leaked.
+//
+//     AllocRecovery recovery;
+//     if (setjmp(recovery.env) != 0) { report recovery.message; }
+//     push_alloc_recovery(&recovery);
+//     ...
+//     pop_alloc_recovery(&recovery);
+typedef struct AllocRecovery {
+    jmp_buf env;
+    const char *message;            // Message of the allocation that failed
+    struct AllocRecovery *previous;
+} AllocRecovery;
+
+void push_alloc_recovery(AllocRecovery *recovery);
+void pop_alloc_recovery(AllocRecovery *recovery);
+void alloc_failed(const char *msg);
+
+// Errors about the program being loaded or run go to stderr, or to the stream
+// the calling thread redirected them to (NULL meaning stderr). Redirecting
+// returns the stream that was in use, so nested redirections can restore it.
+void report_error(const char *format, ...);
+FILE *redirect_errors(FILE *stream);
+
 #endif
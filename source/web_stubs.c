@@ -0,0 +1,141 @@
+// Logic standing in for the modules the WebAssembly build leaves out
+
+// The browser has no Unix sockets, no SIGPROF timer and no perf_event_open,
+// and threads need cross-origin isolation the page does not ask for. "make
+// wasm" builds this file instead of server.c, threadpool.c, sampler.c and
+// perfcounters.c. The flags that would turn them on are only parsed by the
+// command line, which the web build never runs, and callers already fall
+// back to running sequentially when a thread pool cannot start.
+
+#include "perfcounters.h"
+#include "sampler.h"
+#include "server.h"
+#include "threadpool.h"
+
+// ---------------------------------------------------------
+// THREAD POOL
+// ---------------------------------------------------------
+
+int pool_default_threads() {
+    return 1;
+}
+
+ThreadPool *pool_new(int threads) {
+    (void)threads;
+    return NULL;
+}
+
+void free_pool(ThreadPool *pool) {
+    (void)pool;
+}
+
+void pool_submit(ThreadPool *pool, pool_task_fn fn, void *arg) {
+    (void)pool;
+    fn(arg);
+}
+
+bool pool_run_one(ThreadPool *pool) {
+    (void)pool;
+    return false;
+}
+
+int pool_threads(ThreadPool *pool) {
+    (void)pool;
+    return 0;
+}
+
+PoolStats pool_stats(ThreadPool *pool) {
+    (void)pool;
+    return (PoolStats){0};
+}
+
+// ---------------------------------------------------------
+// SERVER
+// ---------------------------------------------------------
+
+Server *server_start(const char *path, const ServerOptions *options) {
+    (void)path;
+    (void)options;
+    fprintf(stderr, "Error: Serving is not available in the web build.\n");
+    return NULL;
+}
+
+void server_stop(Server *server) {
+    (void)server;
+}
+
+ServerStats server_stats(Server *server) {
+    (void)server;
+    return (ServerStats){0};
+}
+
+// ---------------------------------------------------------
+// SAMPLER
+// ---------------------------------------------------------
+
+bool sampler_enabled = false;
+
+bool start_sampling(int hz) {
+    (void)hz;
+    fprintf(stderr, "Error: Sampling is not available in the web build.\n");
+    return false;
+}
+
+void stop_sampling() {}
+
+void sample_statement(int line) {
+    (void)line;
+}
+
+void sample_push(Pinch_Func *func) {
+    (void)func;
+}
+
+void sample_pop() {}
+
+long sample_count() {
+    return 0;
+}
+
+void print_sample_profile(FILE *out, int lines) {
+    (void)out;
+    (void)lines;
+}
+
+void write_folded_stacks(FILE *out) {
+    (void)out;
+}
+
+// ---------------------------------------------------------
+// PERF COUNTERS
+// ---------------------------------------------------------
+
+bool perf_enabled = false;
+bool perf_builtins_enabled = false;
+
+bool open_perf_counters(bool per_builtin) {
+    (void)per_builtin;
+    fprintf(stderr, "Perf counters: unavailable (not in the web build), running without them.\n");
+    return false;
+}
+
+PerfValues perf_read() {
+    return (PerfValues){{0}};
+}
+
+bool perf_available(PerfEvent event) {
+    (void)event;
+    return false;
+}
+
+void perf_record_call(Pinch_Func *func, PerfValues start) {
+    (void)func;
+    (void)start;
+}
+
+void print_perf_counters(FILE *out, const char **phase_names, const PerfValues *phases, int phase_count) {
+    (void)out;
+    (void)phase_names;
+    (void)phases;
+    (void)phase_count;
+}
@@ -0,0 +1,91 @@
+#include "test_harness.h"
+#include "allocstats.h"
+#include "engine.h"
+#include "util.h"
+#include <stdlib.h>
+
+bool test_sites_and_phases_are_counted() {
+    AllocTotals before = alloc_totals();
+    set_alloc_phase(ALLOC_PHASE_LOAD);
+    void *kept = xalloc(100, "Interpreter Error: Fail to allocate memory for test blocks.\n");
+    set_alloc_phase(ALLOC_PHASE_EXECUTE);
+    void *blocks[1000];
+    for (int i = 0; i < 1000; i++) {
+        blocks[i] = xalloc(10, "Interpreter Error: Fail to allocate memory for test blocks.\n");
+    }
+    AllocTotals peak = alloc_totals();
+    for (int i = 0; i < 1000; i++) xfree(blocks[i]);
+    set_alloc_phase(ALLOC_PHASE_OTHER);
+    AllocTotals after = alloc_totals();
+
+    ASSERT_TRUE(after.allocations - before.allocations == 1001);
+    ASSERT_TRUE(after.frees - before.frees == 1000);
+    ASSERT_TRUE(after.bytes - before.bytes == 10100);
+    ASSERT_TRUE(after.live_bytes - before.live_bytes == 100);
+    ASSERT_TRUE(after.peak_bytes >= before.live_bytes + 10100);
+    ASSERT_TRUE(peak.live_bytes - before.live_bytes == 10100);
+    ASSERT_TRUE(after.phase_allocations[ALLOC_PHASE_LOAD] - before.phase_allocations[ALLOC_PHASE_LOAD] == 1);
+    ASSERT_TRUE(after.phase_allocations[ALLOC_PHASE_EXECUTE] - before.phase_allocations[ALLOC_PHASE_EXECUTE] == 1000);
+
+    FILE *out = tmpfile();
+    print_alloc_stats(out, ALLOC_STATS_REPORT_SITES);
+    char *report = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strstr(report, "        1001          10100          1          100            1         1000   for test blocks\n") != NULL);
+    free(report);
+    xfree(kept);
+    return true;
+}
+
+bool test_resizing_moves_the_block() {
+    AllocTotals before = alloc_totals();
+    char *block = xalloc(10, "Interpreter Error: Fail to allocate memory for test blocks.\n");
+    block = xrealloc(block, 1000, "Interpreter Error: Fail to allocate memory for test blocks.\n");
+    AllocTotals resized = alloc_totals();
+    ASSERT_TRUE(resized.live_bytes - before.live_bytes == 1000);
+    ASSERT_TRUE(resized.bytes - before.bytes == 1010);
+    xfree(block);
+    AllocTotals after = alloc_totals();
+    ASSERT_TRUE(after.allocations - before.allocations == 2);
+    ASSERT_TRUE(after.frees - before.frees == 2);
+    ASSERT_TRUE(after.live_bytes == before.live_bytes);
+
+    // Growing past the cap fails and leaves the old block to the caller
+    char *kept = xalloc(10, "Interpreter Error: Fail to allocate memory for test blocks.\n");
+    limit_allocations(4096);
+    AllocRecovery recovery;
+    if (setjmp(recovery.env) == 0) {
+        push_alloc_recovery(&recovery);
+        kept = xrealloc(kept, 8192, "Interpreter Error: Fail to allocate memory for test blocks.\n");
+        pop_alloc_recovery(&recovery);
+    }
+    ASSERT_TRUE(allocation_limit_exceeded());
+    limit_allocations(0);
+    xfree(kept);
+    return true;
+}
+
+bool test_program_runs_free_what_they_allocate() {
+    Program *program = load_program("0 -> i\n(i -> ADD <- 1) -> i\n\"x\" -> s\n(s -> CONCAT <- \"y\") -> t\nJUMP_IF <- [(i -> LT <- 100), 3<=, =>1]\n");
+    PreparedProgram *prepared = prepare_program(find_engine("tree"), program, &(EngineOptions){0});
+    MachineState *state = new_machine_state();
+    AllocTotals before = alloc_totals();
+    ASSERT_TRUE(run_program(prepared, state));
+    AllocTotals after = alloc_totals();
+    // Every Value made by an iteration is gone by the next one
+    ASSERT_TRUE(after.allocations - before.allocations > 1000);
+    ASSERT_TRUE(after.live_bytes - before.live_bytes < 1024);
+    free_state(state);
+    free_prepared(prepared);
+    free_program(program);
+    return true;
+}
+
+int main() {
+    track_allocations();
+    RUN_TEST(test_sites_and_phases_are_counted);
+    RUN_TEST(test_resizing_moves_the_block);
+    RUN_TEST(test_program_runs_free_what_they_allocate);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
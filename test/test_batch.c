@@ -0,0 +1,123 @@
+#include "test_harness.h"
+#include "batch.h"
+#include "util.h"
+#include <stdlib.h>
+
+// Labels every record, failing on records reading "x"
+static const char *source =
+    "(1 -> DIV <- (IF <- [(line -> STR_EQ <- \"x\"), 0, 1])) -> n\n"
+    "(RAND) -> r\n"
+    "(IF <- [(r -> LT <- 1), \"ok\", \"bad\"]) -> tag\n"
+    "(tag -> CONCAT <- (line -> CONCAT <- \"!\"))\n";
+
+typedef struct {
+    char *output;
+    size_t output_length;
+    char *errors;
+    size_t errors_length;
+    bool success;
+    BatchStats stats;
+} BatchResult;
+
+static MachineState *plain_state(void *context) {
+    (void)context;
+    return new_machine_state();
+}
+
+static BatchResult run_batch(const char *program_source, const char *input, int workers) {
+    BatchResult result = {0};
+    FILE *in = fmemopen((void*)input, strlen(input), "r");
+    FILE *out = open_memstream(&result.output, &result.output_length);
+    FILE *err = open_memstream(&result.errors, &result.errors_length);
+
+    Program *program = load_program(program_source);
+    BatchOptions options = {0};
+    options.engine = default_engine();
+    options.workers = workers;
+    options.new_state = plain_state;
+    result.success = batch_run(program, &options, in, out, err, &result.stats);
+    free_program(program);
+
+    fclose(in);
+    fclose(out);
+    fclose(err);
+    return result;
+}
+
+static void free_result(BatchResult *result) {
+    free(result->output);   // Allocated by open_memstream
+    free(result->errors);
+}
+
+bool test_records_are_bound_to_line() {
+    BatchResult result = run_batch(source, "1\n22\n333", 1);
+    ASSERT_TRUE(result.success);
+    ASSERT_TRUE(result.stats.records == 3 && result.stats.failed == 0);
+    ASSERT_TRUE(strcmp(result.output, "ok1!\nok22!\nok333!\n") == 0);
+    free_result(&result);
+    return true;
+}
+
+bool test_variables_do_not_leak_between_records() {
+    // Only the first record assigns seen before reading it
+    BatchResult result = run_batch("JUMP_IF <- [(line -> STR_EQ <- \"a\"), =>2, =>1]\nseen\nline -> seen\n(RAND)\n", "a\nb\n", 1);
+    ASSERT_TRUE(!result.success);
+    ASSERT_TRUE(result.stats.failed == 1);
+    ASSERT_TRUE(strstr(result.errors, "Undefined variable 'seen'") != NULL);
+    ASSERT_TRUE(strstr(result.errors, "Execution halted at statement 2 of record 2.") != NULL);
+    free_result(&result);
+
+    // RAND restarts for every record
+    result = run_batch("(RAND)\n", "a\nb\n", 1);
+    char *second = strchr(result.output, '\n') + 1;
+    ASSERT_TRUE(strncmp(result.output, second, second - result.output) == 0);
+    free_result(&result);
+    return true;
+}
+
+bool test_failing_records_do_not_stop_the_batch() {
+    BatchResult result = run_batch("(1 -> DIV <- (line -> LEN))\n", "ab\nabcd\n\na\n", 1);
+    ASSERT_TRUE(!result.success);
+    ASSERT_TRUE(result.stats.records == 4 && result.stats.failed == 1);
+    ASSERT_TRUE(strcmp(result.output, "0.5\n0.25\n1\n") == 0);
+    ASSERT_TRUE(strstr(result.errors, "Division by zero") != NULL);
+    ASSERT_TRUE(strstr(result.errors, "of record 3.") != NULL);
+    free_result(&result);
+    return true;
+}
+
+bool test_workers_keep_record_order() {
+    // Enough records for several chunks per worker
+    size_t capacity = 8 * BATCH_CHUNK_RECORDS * 8;
+    char *input = xalloc(capacity, "Test Error: Out of memory.\n");
+    size_t length = 0;
+    for (int i = 0; i < 8 * BATCH_CHUNK_RECORDS + 17; i++) {
+        if (i % 500 == 7) {
+            length += snprintf(input + length, capacity - length, "x\n");
+        } else {
+            length += snprintf(input + length, capacity - length, "%d\n", i);
+        }
+    }
+
+    BatchResult sequential = run_batch(source, input, 1);
+    BatchResult parallel = run_batch(source, input, 4);
+    ASSERT_TRUE(sequential.stats.records == 8 * BATCH_CHUNK_RECORDS + 17);
+    ASSERT_TRUE(parallel.stats.records == sequential.stats.records);
+    ASSERT_TRUE(parallel.stats.failed == sequential.stats.failed && sequential.stats.failed == 5);
+    ASSERT_TRUE(strcmp(parallel.output, sequential.output) == 0);
+    ASSERT_TRUE(strcmp(parallel.errors, sequential.errors) == 0);
+
+    free_result(&sequential);
+    free_result(&parallel);
+    xfree(input);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_records_are_bound_to_line);
+    RUN_TEST(test_variables_do_not_leak_between_records);
+    RUN_TEST(test_failing_records_do_not_stop_the_batch);
+    RUN_TEST(test_workers_keep_record_order);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
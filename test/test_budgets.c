@@ -0,0 +1,168 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "hashmap.h"
+#include "util.h"
+#include <stdlib.h>
+
+// Budgets on the hot paths. Allocations are counted exactly, so their limits
+// are a small margin over what the code does today; times are measured as the
+// best of a few runs and only compared with each other, or with a limit far
+// beyond what a debug build needs, so a loaded machine does not fail them.
+
+#define NUMERIC_LOOP "0 -> i\n0 -> acc\n(acc -> ADD <- i) -> acc\n(i -> ADD <- 1) -> i\n" \
+                     "JUMP_IF <- [(i -> LT <- %d), 2<=, =>1]\n"
+#define TEXT_LOOP "\"abcdefghij\" -> base\n0 -> i\n0 -> found\n(base -> CONCAT <- \"needle\") -> hay\n" \
+                  "(hay -> FIND <- \"needle\") -> at\n(found -> ADD <- at) -> found\n(i -> ADD <- 1) -> i\n" \
+                  "JUMP_IF <- [(i -> LT <- %d), 4<=, =>1]\n"
+
+static char *loop_source(const char *format, int iterations) {
+    char *source = malloc(strlen(format) + 16);
+    sprintf(source, format, iterations);
+    return source;
+}
+
+// n lines of arithmetic on a handful of variables, none of them jumps
+static char *straight_source(int lines) {
+    const char *body[] = {"(a -> ADD <- b) -> c\n", "(c -> MUL <- 0.5) -> a\n", "(a -> SUB <- 1.25) -> b\n"};
+    char *source = malloc(32 * (lines + 2));
+    char *end = source + sprintf(source, "0 -> a\n1 -> b\n");
+    for (int i = 0; i < lines; i++) {
+        end += sprintf(end, "%s", body[i % 3]);
+    }
+    return source;
+}
+
+// n distinct variables assigned, then all read back
+static char *variables_source(int count) {
+    char *source = malloc(64 * (count + 1));
+    char *end = source + sprintf(source, "0 -> total\n");
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < count; i++) {
+            char name[8];
+            for (int k = 0, n = i; k < 4; k++, n /= 26) name[3 - k] = 'a' + n % 26;
+            name[4] = '\0';
+            end += pass == 0 ? sprintf(end, "%d -> v_%s\n", i, name) : sprintf(end, "(total -> ADD <- v_%s) -> total\n", name);
+        }
+    }
+    return source;
+}
+
+// Allocations made loading, preparing and running the source
+static long run_allocations(const char *engine, const char *source) {
+    MachineState *state = new_machine_state();
+    long allocations;
+    COUNT_ALLOCATIONS(allocations, run_source(source, engine, state));
+    free_state(state);
+    return allocations;
+}
+
+// Entries a successful lookup compares, averaged over the variables a run
+// leaves behind. Unlike timing it, this does not depend on the machine.
+static double probes_per_lookup(const char *engine, const char *source) {
+    MachineState *state = new_machine_state();
+    run_source(source, engine, state);
+    struct hashmap *variables = state->variables;
+    long probes = 0;
+    for (int i = 0; i < variables->bucket_size; i++) {
+        long length = ((struct list*)list_get(variables->buckets, i))->length;
+        probes += length * (length + 1) / 2;
+    }
+    double per_lookup = (double)probes / variables->size;
+    free_state(state);
+    return per_lookup;
+}
+
+static void load_and_free(const char *source) {
+    free_program(load_program(source));
+}
+
+static void load_run_and_free(const char *engine, const char *source) {
+    MachineState *state = new_machine_state();
+    run_source(source, engine, state);
+    free_state(state);
+}
+
+// Allocations per iteration, from the difference between two loop lengths so
+// that loading, the first iterations and compiling cancel out
+static double allocations_per_iteration(const char *engine, const char *format) {
+    char *small = loop_source(format, 1000);
+    char *large = loop_source(format, 11000);
+    double per_iteration = (run_allocations(engine, large) - run_allocations(engine, small)) / 10000.0;
+    free(small);
+    free(large);
+    return per_iteration;
+}
+
+bool test_numeric_loop_iteration_allocations() {
+    // Seven today in the interpreting engines
+    ASSERT_AT_MOST(allocations_per_iteration("tree", NUMERIC_LOOP), 8);
+    ASSERT_AT_MOST(allocations_per_iteration("profile", NUMERIC_LOOP), 8);
+    // Compiled loops keep their variables in registers
+    ASSERT_AT_MOST(allocations_per_iteration("jit", NUMERIC_LOOP), 0);
+    return true;
+}
+
+bool test_text_loop_iteration_allocations() {
+    ASSERT_AT_MOST(allocations_per_iteration("tree", TEXT_LOOP), 16);
+    ASSERT_AT_MOST(allocations_per_iteration("jit", TEXT_LOOP), 16);
+    return true;
+}
+
+bool test_runs_free_what_they_allocate() {
+    char *source = loop_source(TEXT_LOOP, 100);
+    const char *engines[] = {"tree", "jit", "profile"};
+    for (int i = 0; i < 3; i++) {
+        ASSERT_NO_LEAKS(load_run_and_free(engines[i], source));
+    }
+    free(source);
+    return true;
+}
+
+bool test_parsing_is_linear_in_lines() {
+    char *small = straight_source(2000);
+    char *large = straight_source(20000);
+    long small_allocations, large_allocations, small_ns, large_ns;
+    COUNT_ALLOCATIONS(small_allocations, load_and_free(small));
+    COUNT_ALLOCATIONS(large_allocations, load_and_free(large));
+    ASSERT_AT_MOST(small_allocations / 2000.0, 25);
+    ASSERT_LINEAR(2000, small_allocations, 20000, large_allocations, 1.05);
+    BEST_TIME_NS(small_ns, 5, load_and_free(small));
+    BEST_TIME_NS(large_ns, 5, load_and_free(large));
+    ASSERT_LINEAR(2000, small_ns, 20000, large_ns, 3);
+    free(small);
+    free(large);
+    return true;
+}
+
+bool test_variable_lookups_stay_constant_time() {
+    char *small = variables_source(500);
+    char *large = variables_source(50000);
+    double small_probes = probes_per_lookup("tree", small);
+    double large_probes = probes_per_lookup("tree", large);
+    // The table grows with the variables, so chains stay short at any size
+    ASSERT_AT_MOST(small_probes, 3);
+    ASSERT_AT_MOST(large_probes, 3);
+    ASSERT_AT_MOST(large_probes, small_probes * 1.5);
+    free(small);
+    free(large);
+    return true;
+}
+
+bool test_numeric_loop_time_budget() {
+    // About a microsecond per iteration in a debug build
+    char *source = loop_source(NUMERIC_LOOP, 100000);
+    ASSERT_TIME_AT_MOST(5000, load_run_and_free("tree", source));
+    free(source);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_numeric_loop_iteration_allocations);
+    RUN_TEST(test_text_loop_iteration_allocations);
+    RUN_TEST(test_runs_free_what_they_allocate);
+    RUN_TEST(test_parsing_is_linear_in_lines);
+    RUN_TEST(test_variable_lookups_stay_constant_time);
+    RUN_TEST(test_numeric_loop_time_budget);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
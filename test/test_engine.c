@@ -0,0 +1,170 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "util.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+// Programs every engine must run identically, including how they fail
+static const char *programs[] = {
+    "0 -> i\n"
+    "0 -> acc\n"
+    "(i -> ADD <- 1) -> i\n"
+    "(acc -> ADD <- ((i -> MUL <- i) -> MOD <- 7)) -> acc\n"
+    "JUMP_IF <- [(i -> LT <- 500), 2<=, =>1]\n"
+    "acc\n",
+
+    "\"word\" -> w\n"
+    "0 -> n\n"
+    "(w -> CONCAT <- \"!\") -> w\n"
+    "(n -> ADD <- 1) -> n\n"
+    "JUMP_IF <- [(n -> LT <- 100), 2<=, =>1]\n"
+    "(w -> LEN)\n"
+    "(IF <- [(n -> GTE <- 100), \"done\", 0])\n",
+
+    "0 -> i\n"
+    "100 -> d\n"
+    "(i -> ADD <- 1) -> i\n"
+    "(d -> SUB <- 1) -> d\n"
+    "(i -> DIV <- d) -> q\n"
+    "JUMP_IF <- [(i -> LT <- 500), 3<=, =>1]\n"
+    "q\n",
+
+    "5 -> x\n"
+    "(x -> ADD <- y)\n",
+};
+
+static const char *example_programs[] = {
+    "example_programs/arithmetic.pinch",
+    "example_programs/fibonacci.pinch",
+    "example_programs/hypotenuse.pinch",
+    "example_programs/keyword.pinch",
+    "example_programs/prime_number.pinch",
+};
+
+// Run a program on an engine the way the command line does, returning
+// everything it wrote to stdout and stderr
+static char *run_captured(const Engine *engine, const char *source, bool optimize) {
+    FILE *capture = tmpfile();
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    dup2(fileno(capture), STDERR_FILENO);
+
+    Program *program = load_program(source);
+    if (program != NULL) {
+        EngineOptions options = {0};
+        options.optimize = optimize;
+        PreparedProgram *prepared = prepare_program(engine, program, &options);
+        MachineState *state = new_machine_state();
+        if (!run_program(prepared, state)) {
+            fprintf(stderr, "Execution halted at statement %d.\n",
+                    program->statements[state->program_counter]->number);
+        }
+        free_state(state);
+        free_prepared(prepared);
+        free_program(program);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    char *output = read_stream(capture);
+    fclose(capture);
+    return output;
+}
+
+// Every engine must print exactly what the tree-walker prints
+static bool engines_agree(const char *source, const char *label) {
+    const Engine *reference = find_engine("tree");
+    char *expected = run_captured(reference, source, false);
+    bool agree = true;
+
+    for (int i = 0; i < engine_count() && agree; i++) {
+        for (int optimize = 0; optimize <= 1 && agree; optimize++) {
+            char *actual = run_captured(engine_at(i), source, optimize);
+            if (strcmp(expected, actual) != 0) {
+                printf("\n\033[31m[FAIL]\033[0m Engine '%s'%s differs on %s\n",
+                       engine_at(i)->name, optimize ? " (optimised)" : "", label);
+                printf("   Expected: %s\n", expected);
+                printf("   Actual:   %s\n", actual);
+                agree = false;
+            }
+            free(actual);
+        }
+    }
+    free(expected);
+    return agree;
+}
+
+bool test_engines_agree_on_programs() {
+    int count = sizeof(programs) / sizeof(programs[0]);
+    for (int i = 0; i < count; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "program %d", i + 1);
+        ASSERT_TRUE(engines_agree(programs[i], label));
+    }
+    return true;
+}
+
+bool test_engines_agree_on_examples() {
+    int count = sizeof(example_programs) / sizeof(example_programs[0]);
+    for (int i = 0; i < count; i++) {
+        FILE *file = fopen(example_programs[i], "r");
+        ASSERT_TRUE(file != NULL);
+        char *source = read_stream(file);
+        fclose(file);
+        bool agree = engines_agree(source, example_programs[i]);
+        free(source);
+        ASSERT_TRUE(agree);
+    }
+    return true;
+}
+
+bool test_engine_registry() {
+    ASSERT_TRUE(find_engine("tree") != NULL);
+    ASSERT_TRUE(find_engine("jit") != NULL);
+    ASSERT_TRUE(find_engine("missing") == NULL);
+    ASSERT_TRUE(default_engine() == find_engine("jit"));
+    return true;
+}
+
+bool test_state_persists_across_programs() {
+    // The REPL runs each line as its own program on one state
+    MachineState *state = new_machine_state();
+    EngineOptions options = {0};
+    char *lines[] = {"3 -> a\n", "(a -> MUL <- 2) -> a\n"};
+
+    for (int i = 0; i < 2; i++) {
+        parse_statement_result res = parse_statement(lines[i]);
+        ASSERT_TRUE(res.success);
+        Program *program = program_from_statement(res.stmt);
+        PreparedProgram *prepared = prepare_program(default_engine(), program, &options);
+        state->program_counter = 0;
+        ASSERT_TRUE(run_program(prepared, state));
+        free_prepared(prepared);
+        free_program(program);
+    }
+
+    Value *a = (Value*)hashmap_lookup(state->variables, "a");
+    ASSERT_TRUE(a != NULL && a->type == VALUE_NUM && a->data.num == 6);
+
+    reset_machine_state(state);
+    ASSERT_TRUE(hashmap_lookup(state->variables, "a") == NULL);
+    free_state(state);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_engine_registry);
+    RUN_TEST(test_engines_agree_on_programs);
+    RUN_TEST(test_engines_agree_on_examples);
+    RUN_TEST(test_state_persists_across_programs);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
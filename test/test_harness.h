@@ -5,12 +5,26 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "engine.h"
 
 static int tests_run = 0;
 static int tests_passed = 0;
 static int tests_failed = 0;
 
+// Everything written to a file so far, NUL-terminated; free it with free
+static inline char *read_stream(FILE *file) {
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    size_t read = fread(text, 1, size, file);
+    text[read] = '\0';
+    return text;
+}
+
 #define ASSERT_TRUE(cond) do { \
     if (!(cond)) { \
         printf("\033[31m[FAIL]\033[0m %s:%d: Assertion failed: %s\n", __FILE__, __LINE__, #cond); \
@@ -45,6 +59,94 @@ static int tests_failed = 0;
     } \
 } while(0)
 
+// Budgets, for tests that pin down the cost of hot paths. The allocation
+// macros need util.h and count xalloc and xfree calls on every thread, so
+// nothing else should be running. Pick limits with plenty of headroom: they
+// are there to catch a path that starts allocating or goes quadratic, not a
+// few percent.
+
+// Load the source, prepare it for the named engine and run it on state,
+// freeing the program afterwards. The caller owns the state, so it can give
+// it counters or metrics first and read the variables it is left with.
+static inline bool run_source(const char *source, const char *engine, MachineState *state) {
+    Program *program = load_program(source);
+    if (program == NULL) return false;
+    PreparedProgram *prepared = prepare_program(find_engine(engine), program, &(EngineOptions){0});
+    bool success = run_program(prepared, state);
+    free_prepared(prepared);
+    free_program(program);
+    return success;
+}
+
+static inline long harness_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+#define ASSERT_AT_MOST(actual, limit) do { \
+    double actual_value = (double)(actual); \
+    double limit_value = (double)(limit); \
+    if (actual_value > limit_value) { \
+        printf("\033[31m[FAIL]\033[0m %s:%d: %s is %g, over the budget of %g\n", \
+               __FILE__, __LINE__, #actual, actual_value, limit_value); \
+        return false; \
+    } \
+} while(0)
+
+// Store in result the xalloc calls made by the code
+#define COUNT_ALLOCATIONS(result, ...) do { \
+    count_allocations(); \
+    long allocations_before = allocation_count(); \
+    __VA_ARGS__; \
+    (result) = allocation_count() - allocations_before; \
+} while(0)
+
+// Store in result the fastest of repeats runs of the code, in nanoseconds
+#define BEST_TIME_NS(result, repeats, ...) do { \
+    long best_ns = -1; \
+    for (int repeat = 0; repeat < (repeats); repeat++) { \
+        long started_ns = harness_now_ns(); \
+        __VA_ARGS__; \
+        long taken_ns = harness_now_ns() - started_ns; \
+        if (best_ns < 0 || taken_ns < best_ns) best_ns = taken_ns; \
+    } \
+    (result) = best_ns; \
+} while(0)
+
+#define ASSERT_ALLOCATIONS_AT_MOST(limit, ...) do { \
+    long allocations_made; \
+    COUNT_ALLOCATIONS(allocations_made, __VA_ARGS__); \
+    ASSERT_AT_MOST(allocations_made, limit); \
+} while(0)
+
+// Fail unless the code xfrees as many blocks as it xallocs
+#define ASSERT_NO_LEAKS(...) do { \
+    count_allocations(); \
+    long leaks_before = allocation_count() - deallocation_count(); \
+    __VA_ARGS__; \
+    long leaked_blocks = allocation_count() - deallocation_count() - leaks_before; \
+    ASSERT_AT_MOST(leaked_blocks, 0); \
+} while(0)
+
+#define ASSERT_TIME_AT_MOST(ms, ...) do { \
+    long elapsed_ns; \
+    BEST_TIME_NS(elapsed_ns, 1, __VA_ARGS__); \
+    ASSERT_AT_MOST(elapsed_ns / 1e6, ms); \
+} while(0)
+
+// Fail if the cost per unit of work at large_n is more than slack times the
+// cost per unit at small_n, i.e. the work grows worse than linearly
+#define ASSERT_LINEAR(small_n, small_cost, large_n, large_cost, slack) do { \
+    double small_per_unit = (double)(small_cost) / (small_n); \
+    double large_per_unit = (double)(large_cost) / (large_n); \
+    if (large_per_unit > small_per_unit * (slack)) { \
+        printf("\033[31m[FAIL]\033[0m %s:%d: Cost per unit grew from %g at %ld to %g at %ld, over %gx\n", \
+               __FILE__, __LINE__, small_per_unit, (long)(small_n), large_per_unit, (long)(large_n), (double)(slack)); \
+        return false; \
+    } \
+} while(0)
+
 #define RUN_TEST(test_func) do { \
     tests_run++; \
     printf("Running %s...", #test_func); \
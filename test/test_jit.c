@@ -0,0 +1,180 @@
+#include "test_harness.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "runstats.h"
+#include "util.h"
+
+#define MAX_TEST_STATEMENTS 16
+
+static Statement *statements[MAX_TEST_STATEMENTS];
+static MachineState state;
+static JitStats stats;
+
+static void free_variable(void *name, void *value) {
+    xfree(name);
+    free_value((Value*)value);
+}
+
+// Parse a NULL-terminated list of lines and run them as a program with the JIT
+static bool run_lines(char **lines) {
+    state.program_counter = 0;
+    state.stmt_count = 0;
+    state.statements = statements;
+    state.variables = hashmap_new(16, 5, hash_string);
+    for (int i = 0; lines[i] != NULL; i++) {
+        parse_statement_result res = parse_statement(lines[i]);
+        if (!res.success) return false;
+        statements[state.stmt_count++] = res.stmt;
+    }
+
+    JitState *jit = jit_new(statements, state.stmt_count);
+    bool success = true;
+    while (state.program_counter >= 0 && state.program_counter < state.stmt_count) {
+        int from = state.program_counter;
+        if (!interpret_line(statements[from], &state, false)) {
+            success = false;
+            break;
+        }
+        state.program_counter++;
+        if (jit != NULL && state.program_counter <= from) {
+            jit_backward_jump(jit, &state, from);
+        }
+    }
+    stats = jit != NULL ? jit_stats(jit) : (JitStats){0, 0, 0, 0};
+    free_jit(jit);
+    return success;
+}
+
+static void free_lines() {
+    for (int i = 0; i < state.stmt_count; i++) {
+        free_statement(statements[i]);
+    }
+    free_hashmap(state.variables, free_variable);
+}
+
+static double num_var(char *name) {
+    Value *v = (Value*)hashmap_lookup(state.variables, name);
+    return (v != NULL && v->type == VALUE_NUM) ? v->data.num : -1;
+}
+
+bool test_hot_loop_matches_interpreter() {
+    char *lines[] = {
+        "0 -> i\n",
+        "0 -> acc\n",
+        "0 -> odd\n",
+        "(i -> ADD <- 1) -> i\n",
+        "(acc -> ADD <- ((i -> MUL <- i) -> DIV <- 2)) -> acc\n",
+        "(odd -> ADD <- (IF <- [(i -> MOD <- 2), 1, 0])) -> odd\n",
+        "JUMP_IF <- [(i -> LT <- 1000), 3<=, =>1]\n",
+        NULL
+    };
+    ASSERT_TRUE(run_lines(lines));
+    ASSERT_TRUE(num_var("i") == 1000);
+    ASSERT_TRUE(num_var("acc") == 166916750);
+    ASSERT_TRUE(num_var("odd") == 500);
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_TRUE(stats.compiled == 1);
+    ASSERT_TRUE(stats.entered == 1);
+    ASSERT_TRUE(stats.deoptimized == 0);
+#endif
+    free_lines();
+    return true;
+}
+
+bool test_failing_statement_deoptimizes() {
+    char *lines[] = {
+        "0 -> i\n",
+        "200 -> d\n",
+        "(i -> ADD <- 1) -> i\n",
+        "(d -> SUB <- 1) -> d\n",
+        "(1 -> DIV <- d) -> q\n",
+        "JUMP_IF <- [(i -> LT <- 500), 3<=, =>1]\n",
+        NULL
+    };
+    // The interpreter reports the division by zero on the 200th iteration
+    ASSERT_TRUE(!run_lines(lines));
+    ASSERT_TRUE(state.program_counter == 4);
+    ASSERT_TRUE(num_var("i") == 200);
+    ASSERT_TRUE(num_var("d") == 0);
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_TRUE(stats.deoptimized == 1);
+#endif
+    free_lines();
+    return true;
+}
+
+bool test_unsupported_loop_is_rejected() {
+    char *lines[] = {
+        "0 -> i\n",
+        "\"\" -> s\n",
+        "(i -> ADD <- 1) -> i\n",
+        "(s -> CONCAT <- \"x\") -> s\n",
+        "JUMP_IF <- [(i -> LT <- 100), 2<=, =>1]\n",
+        NULL
+    };
+    ASSERT_TRUE(run_lines(lines));
+    ASSERT_TRUE(num_var("i") == 100);
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_TRUE(stats.compiled == 0);
+    ASSERT_TRUE(stats.rejected == 1);
+#endif
+    free_lines();
+    return true;
+}
+
+bool test_native_loops_are_counted() {
+    char *lines[] = {
+        "0 -> i\n",
+        "0 -> acc\n",
+        "(i -> ADD <- 1) -> i\n",
+        "(acc -> ADD <- (i -> MUL <- 2)) -> acc\n",
+        "JUMP_IF <- [(i -> LT <- 1000), 2<=, =>1]\n",
+        NULL
+    };
+    RunCounters counters = {0};
+    state.counters = &counters;
+    ASSERT_TRUE(run_lines(lines));
+    state.counters = NULL;
+    ASSERT_TRUE(num_var("acc") == 1001000);
+    ASSERT_TRUE(counters.statements == 3002);
+    ASSERT_TRUE(counters.jumps == 1000);
+    ASSERT_TRUE(counters.calls == 5000);
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_TRUE(stats.compiled == 1);
+    ASSERT_TRUE(stats.entered == 1);
+#endif
+    free_lines();
+
+    // The statement handed back is counted once, by the interpreter
+    char *failing[] = {
+        "0 -> i\n",
+        "200 -> d\n",
+        "(i -> ADD <- 1) -> i\n",
+        "(d -> SUB <- 1) -> d\n",
+        "(1 -> DIV <- d) -> q\n",
+        "JUMP_IF <- [(i -> LT <- 500), 3<=, =>1]\n",
+        NULL
+    };
+    counters = (RunCounters){0};
+    state.counters = &counters;
+    ASSERT_TRUE(!run_lines(failing));
+    state.counters = NULL;
+    ASSERT_TRUE(counters.statements == 801);
+    ASSERT_TRUE(counters.jumps == 199);
+    ASSERT_TRUE(counters.calls == 998);
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_TRUE(stats.deoptimized == 1);
+#endif
+    free_lines();
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_hot_loop_matches_interpreter);
+    RUN_TEST(test_failing_statement_deoptimizes);
+    RUN_TEST(test_unsupported_loop_is_rejected);
+    RUN_TEST(test_native_loops_are_counted);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include "test_harness.h"
+#include "libpinch.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Scales a price by a rate in a loop and labels the result
+static const char *source =
+    "0 -> i\n"
+    "(i -> ADD <- 1) -> i\n"
+    "(price -> MUL <- rate) -> price\n"
+    "JUMP_IF <- [(i -> LT <- 3), 2<=, =>1]\n"
+    "(label -> CONCAT <- (IF <- [(price -> GT <- 100), \"large\", \"small\"])) -> out\n"
+    "out\n";
+
+typedef struct {
+    char text[256];
+    size_t length;
+    int calls;
+} Captured;
+
+static void capture(void *context, const char *text, size_t length) {
+    Captured *captured = (Captured*)context;
+    if (captured->length + length < sizeof(captured->text)) {
+        memcpy(captured->text + captured->length, text, length);
+        captured->length += length;
+        captured->text[captured->length] = '\0';
+    }
+    captured->calls++;
+}
+
+bool test_compile_once_run_many() {
+    PinchProgram *program = pinch_compile(source);
+    ASSERT_TRUE(program != NULL);
+    PinchInstance *instance = pinch_instance_new(program);
+    Captured output = {"", 0, 0};
+    pinch_set_output(instance, capture, &output);
+
+    for (int run = 1; run <= 100; run++) {
+        pinch_instance_reset(instance);
+        ASSERT_TRUE(pinch_set_number(instance, "price", run));
+        ASSERT_TRUE(pinch_set_number(instance, "rate", 2));
+        ASSERT_TRUE(pinch_set_text(instance, "label", "total "));
+        ASSERT_TRUE(pinch_run(instance));
+
+        double price = 0;
+        ASSERT_TRUE(pinch_get_number(instance, "price", &price));
+        ASSERT_TRUE(price == run * 8);
+        ASSERT_TRUE(pinch_get_type(instance, "out") == PINCH_TEXT);
+    }
+    ASSERT_TRUE(strcmp(pinch_get_text(instance, "out"), "total large") == 0);
+    ASSERT_TRUE(strstr(output.text, "total small\ntotal small\ntotal large\n") != NULL);
+    ASSERT_TRUE(output.calls == 100);
+
+    // Reset forgets the inputs, so the run fails on the first read
+    pinch_instance_reset(instance);
+    ASSERT_TRUE(pinch_get_type(instance, "price") == PINCH_UNDEFINED);
+    Captured errors = {"", 0, 0};
+    pinch_set_errors(instance, capture, &errors);
+    ASSERT_TRUE(!pinch_run(instance));
+    ASSERT_TRUE(strstr(errors.text, "Undefined variable 'price'") != NULL);
+    ASSERT_TRUE(strstr(errors.text, "Execution halted at statement 3.") != NULL);
+
+    pinch_instance_free(instance);
+    pinch_program_free(program);
+    return true;
+}
+
+bool test_compile_errors_and_names() {
+    ASSERT_TRUE(pinch_compile("1 -> a\n(a -> ADD <- )\n") == NULL);
+    ASSERT_TRUE(strstr(pinch_error(), "Syntax Error on line 2.") != NULL);
+
+    PinchProgram *program = pinch_compile("x\n");
+    ASSERT_TRUE(program != NULL);
+    PinchInstance *instance = pinch_instance_new(program);
+    ASSERT_TRUE(!pinch_set_number(instance, "Price", 1));
+    ASSERT_TRUE(!pinch_set_number(instance, "a1", 1));
+    ASSERT_TRUE(!pinch_set_text(instance, "", "text"));
+    ASSERT_TRUE(pinch_set_text(instance, "long_name", "text"));
+    pinch_instance_free(instance);
+    pinch_program_free(program);
+    return true;
+}
+
+#define THREADS 4
+
+typedef struct {
+    const PinchProgram *program;
+    int id;
+    bool ok;
+} Worker;
+
+static void *run_worker(void *arg) {
+    Worker *worker = (Worker*)arg;
+    PinchInstance *instance = pinch_instance_new(worker->program);
+    Captured output = {"", 0, 0};
+    pinch_set_output(instance, capture, &output);
+    worker->ok = true;
+    for (int run = 0; run < 200; run++) {
+        pinch_instance_reset(instance);
+        pinch_set_number(instance, "price", worker->id + run);
+        pinch_set_number(instance, "rate", 0.5);
+        pinch_set_text(instance, "label", "");
+        double price = -1;
+        if (!pinch_run(instance) || !pinch_get_number(instance, "price", &price) ||
+            price != (worker->id + run) / 8.0) {
+            worker->ok = false;
+        }
+    }
+    pinch_instance_free(instance);
+    return NULL;
+}
+
+bool test_program_is_shared_between_threads() {
+    PinchProgram *program = pinch_compile(source);
+    ASSERT_TRUE(program != NULL);
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        workers[i] = (Worker){program, i, false};
+        ASSERT_TRUE(pthread_create(&threads[i], NULL, run_worker, &workers[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ASSERT_TRUE(workers[i].ok);
+    }
+    pinch_program_free(program);
+    return true;
+}
+
+bool test_snapshots_and_forks() {
+    PinchProgram *program = pinch_compile("(RAND) -> r\n(n -> ADD <- 1) -> n\n");
+    ASSERT_TRUE(program != NULL);
+    PinchInstance *instance = pinch_instance_new(program);
+    ASSERT_TRUE(pinch_set_number(instance, "n", 1));
+    ASSERT_TRUE(pinch_set_text(instance, "label", "shared"));
+    PinchSnapshot *snapshot = pinch_snapshot(instance);
+
+    double first_r, first_n, r, n;
+    ASSERT_TRUE(pinch_run(instance));
+    ASSERT_TRUE(pinch_get_number(instance, "r", &first_r) && pinch_get_number(instance, "n", &first_n));
+    ASSERT_TRUE(pinch_run(instance));
+    ASSERT_TRUE(pinch_get_number(instance, "n", &n) && n == 3);
+
+    // Restoring brings back the variables and the RAND sequence
+    pinch_restore(instance, snapshot);
+    ASSERT_TRUE(pinch_get_type(instance, "r") == PINCH_UNDEFINED);
+    ASSERT_TRUE(pinch_run(instance));
+    ASSERT_TRUE(pinch_get_number(instance, "r", &r) && r == first_r);
+    ASSERT_TRUE(pinch_get_number(instance, "n", &n) && n == first_n);
+
+    // A fork shares Text with its original until one of them assigns it
+    PinchInstance *fork = pinch_instance_fork(instance);
+    ASSERT_TRUE(pinch_get_text(fork, "label") == pinch_get_text(instance, "label"));
+    ASSERT_TRUE(pinch_set_text(fork, "label", "forked"));
+    ASSERT_TRUE(pinch_run(fork));
+    ASSERT_TRUE(strcmp(pinch_get_text(instance, "label"), "shared") == 0);
+    ASSERT_TRUE(pinch_get_number(instance, "n", &n) && n == first_n);
+    ASSERT_TRUE(pinch_get_number(fork, "n", &n) && n == first_n + 1);
+    ASSERT_TRUE(pinch_get_number(fork, "r", &r) && r != first_r);
+
+    pinch_snapshot_free(snapshot);
+    pinch_instance_free(fork);
+    pinch_instance_free(instance);
+    pinch_program_free(program);
+    return true;
+}
+
+bool test_metrics_count_builtin_calls() {
+    PinchProgram *program = pinch_compile("(s -> UPPER) -> s\n(n -> SQRT) -> r\n");
+    PinchInstance *instance = pinch_instance_new(program);
+    pinch_set_errors(instance, capture, &(Captured){"", 0, 0});
+    PinchMetric metrics[4];
+    ASSERT_TRUE(pinch_metrics(instance, metrics, 4) == 0);
+
+    pinch_enable_metrics(instance, false);
+    for (int run = 0; run < 3; run++) {
+        pinch_instance_reset(instance);
+        pinch_set_text(instance, "s", "abc");
+        pinch_set_number(instance, "n", run - 1);
+        pinch_run(instance);
+    }
+    ASSERT_TRUE(pinch_metrics(instance, metrics, 1) == 2);
+    ASSERT_TRUE(pinch_metrics(instance, metrics, 4) == 2);
+    ASSERT_TRUE(strcmp(metrics[0].name, "SQRT") == 0 && metrics[0].calls == 3 && metrics[0].failures == 1);
+    ASSERT_TRUE(strcmp(metrics[1].name, "UPPER") == 0 && metrics[1].calls == 3 && metrics[1].failures == 0);
+    long bucketed = 0;
+    for (int i = 0; i < PINCH_METRICS_BUCKETS; i++) bucketed += metrics[1].histogram[i];
+    ASSERT_TRUE(bucketed == 3);
+
+    pinch_instance_free(instance);
+    pinch_program_free(program);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_compile_once_run_many);
+    RUN_TEST(test_compile_errors_and_names);
+    RUN_TEST(test_program_is_shared_between_threads);
+    RUN_TEST(test_snapshots_and_forks);
+    RUN_TEST(test_metrics_count_builtin_calls);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include "test_harness.h"
+#include "memo.h"
+#include "util.h"
+
+// Call a builtin by name through the cache and return its result
+static Value *call(MemoCache *memo, const char *name, Value *a, Value *b) {
+    Value *args[2] = {a, b};
+    int count = b != NULL ? 2 : (a != NULL ? 1 : 0);
+    Value *result = memo_call(memo, find_builtin(name), args, count);
+    for (int i = 0; i < count; i++) free_value(args[i]);
+    return result;
+}
+
+bool test_repeated_text_calls_hit() {
+    MemoCache *memo = memo_new(64);
+    for (int i = 0; i < 5; i++) {
+        Value *upper = call(memo, "UPPER", value_from_str("pinch"), NULL);
+        ASSERT_TRUE(upper->type == VALUE_STR && strcmp(upper->data.str, "PINCH") == 0);
+        free_value(upper);
+    }
+    // Equal contents in a different Value still hit
+    Value *found = call(memo, "FIND", value_from_str("dataflow"), value_from_str("flow"));
+    free_value(found);
+    found = call(memo, "FIND", value_from_str("dataflow"), value_from_str("flow"));
+    ASSERT_TRUE(found->type == VALUE_NUM && found->data.num == 4);
+    free_value(found);
+
+    MemoStats stats = memo_stats(memo);
+    ASSERT_TRUE(stats.hits == 5);
+    ASSERT_TRUE(stats.misses == 2);
+    free_memo(memo);
+    return true;
+}
+
+bool test_impure_calls_and_errors_are_not_cached() {
+    MemoCache *memo = memo_new(64);
+    free_value(call(memo, "RAND", NULL, NULL));
+    free_value(call(memo, "RAND", NULL, NULL));
+
+    // The builtin reports the error on every call
+    for (int i = 0; i < 2; i++) {
+        Value *err = call(memo, "DIV", value_from_num(1), value_from_num(0));
+        ASSERT_TRUE(err->type == VALUE_ERROR);
+        free_value(err);
+    }
+
+    MemoStats stats = memo_stats(memo);
+    ASSERT_TRUE(stats.hits == 0);
+    ASSERT_TRUE(stats.misses == 2);
+    free_memo(memo);
+    return true;
+}
+
+bool test_cache_is_bounded() {
+    MemoCache *memo = memo_new(4);
+    for (int i = 0; i < 100; i++) {
+        free_value(call(memo, "SQRT", value_from_num(i), NULL));
+    }
+    MemoStats stats = memo_stats(memo);
+    ASSERT_TRUE(stats.misses == 100);
+    ASSERT_TRUE(stats.evictions >= 96);
+    free_memo(memo);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_repeated_text_calls_hit);
+    RUN_TEST(test_impure_calls_and_errors_are_not_cached);
+    RUN_TEST(test_cache_is_bounded);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
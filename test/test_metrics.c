@@ -0,0 +1,88 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "metrics.h"
+#include "util.h"
+#include <stdlib.h>
+
+// A loop of Text and Number calls ending in a call with a Text argument
+// where a Number is expected
+static const char *source =
+    "0 -> i\n"
+    "\"ab\" -> s\n"
+    "(i -> ADD <- 1) -> i\n"
+    "((s -> CONCAT <- s) -> UPPER) -> t\n"
+    "JUMP_IF <- [(i -> LT <- 10), 2<=, =>1]\n"
+    "(i -> ADD <- t)\n";
+
+static BuiltinMetrics *run_counted(const char *engine, MetricsClock clock) {
+    MachineState *state = new_machine_state();
+    state->errors = tmpfile();
+    state->metrics = metrics_new(clock);
+    run_source(source, engine, state);
+
+    BuiltinMetrics *metrics = state->metrics;
+    state->metrics = NULL;
+    fclose(state->errors);
+    free_state(state);
+    return metrics;
+}
+
+static BuiltinMetric find_metric(BuiltinMetrics *metrics, const char *name) {
+    for (int i = 0; i < metrics_count(); i++) {
+        BuiltinMetric metric = metrics_at(metrics, i);
+        if (strcmp(metric.name, name) == 0) return metric;
+    }
+    return (BuiltinMetric){0};
+}
+
+bool test_calls_and_failures_are_counted() {
+    const char *engines[] = {"tree", "jit"};
+    for (int e = 0; e < 2; e++) {
+        BuiltinMetrics *metrics = run_counted(engines[e], METRICS_CLOCK_MONOTONIC);
+        BuiltinMetric add = find_metric(metrics, "ADD");
+        ASSERT_TRUE(add.calls == 11 && add.failures == 1);
+        ASSERT_TRUE(find_metric(metrics, "CONCAT").calls == 10);
+        ASSERT_TRUE(find_metric(metrics, "UPPER").calls == 10);
+        ASSERT_TRUE(find_metric(metrics, "LT").calls == 10);
+        BuiltinMetric jump_if = find_metric(metrics, "JUMP_IF");
+        ASSERT_TRUE(jump_if.calls == 10 && jump_if.failures == 0);
+        ASSERT_TRUE(find_metric(metrics, "SQRT").calls == 0);
+
+        long bucketed = 0;
+        for (int i = 0; i < METRICS_BUCKETS; i++) bucketed += add.buckets[i];
+        ASSERT_TRUE(bucketed == add.calls);
+        free_metrics(metrics);
+    }
+    return true;
+}
+
+bool test_reports_list_called_builtins() {
+    BuiltinMetrics *metrics = run_counted("tree", METRICS_CLOCK_CYCLES);
+    FILE *out = tmpfile();
+    print_metrics(out, metrics, false);
+    char *table = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strstr(table, "Metrics: 5 builtin(s) called") != NULL);
+    ASSERT_TRUE(strstr(table, "\nUPPER ") != NULL);
+    ASSERT_TRUE(strstr(table, "SQRT") == NULL);
+    free(table);
+
+    out = tmpfile();
+    print_metrics(out, metrics, true);
+    char *json = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strncmp(json, "{\"clock\": \"", 11) == 0);
+    ASSERT_TRUE(strstr(json, "{\"name\": \"ADD\", \"calls\": 11, \"failures\": 1, \"total_ns\": ") != NULL);
+    ASSERT_TRUE(strstr(json, "\"histogram\": [{\"below_ns\": ") != NULL);
+    ASSERT_TRUE(strcmp(json + strlen(json) - 3, "]}\n") == 0);
+    free(json);
+    free_metrics(metrics);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_calls_and_failures_are_counted);
+    RUN_TEST(test_reports_list_called_builtins);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
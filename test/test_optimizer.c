@@ -0,0 +1,144 @@
+#include "test_harness.h"
+#include "parser.h"
+#include "optimizer.h"
+#include "syntax_printer.h"
+
+#define MAX_TEST_STATEMENTS 16
+
+static Statement *statements[MAX_TEST_STATEMENTS];
+static int stmt_count;
+static OptimizerReport report;
+
+// Parse a NULL-terminated list of lines and run the optimisation passes
+static bool optimize_lines(char **lines, bool eliminate) {
+    stmt_count = 0;
+    memset(&report, 0, sizeof(report));
+    for (int i = 0; lines[i] != NULL; i++) {
+        parse_statement_result res = parse_statement(lines[i]);
+        if (!res.success) return false;
+        statements[stmt_count++] = res.stmt;
+    }
+    simplify_program(statements, stmt_count, &report);
+    if (eliminate) {
+        eliminate_dead_code(statements, &stmt_count, &report);
+    }
+    return true;
+}
+
+static void free_lines() {
+    for (int i = 0; i < stmt_count; i++) {
+        free_statement(statements[i]);
+    }
+}
+
+#define ASSERT_STATEMENT(idx, expected_str) do { \
+    char *actual_str = statement_to_string(statements[idx]); \
+    if (strcmp(actual_str, expected_str) != 0) { \
+        printf("\n\033[31m[FAIL]\033[0m Rewrite mismatch!\n"); \
+        printf("   Expected: %s\n", expected_str); \
+        printf("   Actual:   %s\n", actual_str); \
+        free_lines(); \
+        return false; \
+    } \
+} while(0)
+
+bool test_numeric_rewrites() {
+    char *lines[] = {
+        "3 -> a\n",
+        "(a -> POW <- 2) -> b\n",
+        "(a -> DIV <- 4) -> c\n",
+        "(a -> DIV <- 3) -> d\n",
+        "((a -> SUB <- 0) -> MUL <- 1) -> e\n",
+        "POW <- [a, 1]\n",
+        "((a -> POW <- 2) -> SQRT) -> f\n",
+        "((3 -> POW <- 2) -> SQRT) -> g\n",
+        NULL
+    };
+    ASSERT_TRUE(optimize_lines(lines, false));
+    ASSERT_STATEMENT(1, "(ASSIGN b [(MUL [a, a])])");
+    ASSERT_STATEMENT(2, "(ASSIGN c [(MUL [a, 0.25])])");
+    ASSERT_STATEMENT(3, "(ASSIGN d [(DIV [a, 3.00])])");
+    ASSERT_STATEMENT(4, "(ASSIGN e [a])");
+    ASSERT_STATEMENT(5, "(FACTOR a)");
+    // a * a may overflow, so only a literal square is rewritten to ABS
+    ASSERT_STATEMENT(6, "(ASSIGN f [(SQRT [(MUL [a, a])])])");
+    ASSERT_STATEMENT(7, "(ASSIGN g [(ABS [3.00])])");
+    ASSERT_TRUE(report.rewrites[REWRITE_POW_SQUARE] == 3);
+    ASSERT_TRUE(report.rewrites[REWRITE_SQRT_SQUARE] == 1);
+    free_lines();
+    return true;
+}
+
+bool test_rewrites_keep_type_errors() {
+    // t may hold Text, so dropping the type check of MUL would hide an error
+    char *lines[] = {
+        "\"text\" -> t\n",
+        "(t -> MUL <- 1) -> u\n",
+        "(t -> DIV <- 2) -> v\n",
+        "((RAND) -> POW <- 2) -> w\n",
+        "(t -> DIV <- 0) -> z\n",
+        "((0 -> SLEEP) -> SUB <- 0)\n",
+        "(missing -> MUL <- 1) -> m\n",
+        NULL
+    };
+    ASSERT_TRUE(optimize_lines(lines, false));
+    ASSERT_STATEMENT(1, "(ASSIGN u [(MUL [t, 1.00])])");
+    ASSERT_STATEMENT(2, "(ASSIGN v [(DIV [t, 2.00])])");
+    ASSERT_STATEMENT(3, "(ASSIGN w [(POW [(RAND []), 2.00])])");
+    ASSERT_STATEMENT(4, "(ASSIGN z [(DIV [t, 0.00])])");
+    // SLEEP returns nothing and missing is never assigned
+    ASSERT_STATEMENT(5, "(FACTOR (SUB [(SLEEP [0.00]), 0.00]))");
+    ASSERT_STATEMENT(6, "(ASSIGN m [(MUL [missing, 1.00])])");
+    free_lines();
+    return true;
+}
+
+bool test_dead_code_elimination() {
+    char *lines[] = {
+        "0 -> i\n",
+        "\"debug\" -> trace\n",
+        "(i -> MUL <- 2) -> unused\n",
+        "(i -> ADD <- 1) -> i\n",
+        "JUMP_IF <- [(i -> LT <- 5), 3<=, =>1]\n",
+        "JUMP <- =>2\n",
+        "\"never printed\"\n",
+        "i\n",
+        NULL
+    };
+    ASSERT_TRUE(optimize_lines(lines, true));
+    ASSERT_TRUE(stmt_count == 5);
+    ASSERT_STATEMENT(0, "(ASSIGN i [0.00])");
+    ASSERT_STATEMENT(1, "(ASSIGN i [(ADD [i, 1.00])])");
+    // Jump offsets are renumbered around the removed statements
+    ASSERT_STATEMENT(2, "(CALL JUMP_IF [(LT [i, 5.00]), (1 <=), (=> 1)])");
+    ASSERT_STATEMENT(3, "(CALL JUMP [(=> 1)])");
+    ASSERT_STATEMENT(4, "(FACTOR i)");
+    ASSERT_TRUE(report.dead_stores == 2);
+    ASSERT_TRUE(report.unreachable == 1);
+    free_lines();
+    return true;
+}
+
+bool test_dead_stores_that_may_fail_are_kept() {
+    char *lines[] = {
+        "(missing -> ADD <- 1) -> a\n",
+        "(2 -> DIV <- 0) -> b\n",
+        "(RAND) -> c\n",
+        "\"kept\"\n",
+        NULL
+    };
+    ASSERT_TRUE(optimize_lines(lines, true));
+    ASSERT_TRUE(stmt_count == 4);
+    ASSERT_TRUE(report.dead_stores == 0);
+    free_lines();
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_numeric_rewrites);
+    RUN_TEST(test_rewrites_keep_type_errors);
+    RUN_TEST(test_dead_code_elimination);
+    RUN_TEST(test_dead_stores_that_may_fail_are_kept);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "parallel.h"
+#include "threadpool.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Straight-line programs with independent statements, including a failure
+// in the middle of a block and impure calls whose order matters
+static const char *programs[] = {
+    "\"pinch\" -> a\n"
+    "\"dataflow\" -> b\n"
+    "(a -> UPPER) -> ua\n"
+    "(b -> UPPER) -> ub\n"
+    "(ua -> CONCAT <- ub)\n"
+    "(a -> LEN) -> la\n"
+    "(b -> LEN) -> lb\n"
+    "(la -> ADD <- lb)\n",
+
+    "3 -> a\n"
+    "4 -> b\n"
+    "(a -> MUL <- a) -> sqa\n"
+    "(b -> MUL <- b) -> sqb\n"
+    "sqa\n"
+    "(a -> DIV <- 0) -> bad\n"
+    "sqb\n"
+    "(b -> SQRT)\n",
+
+    "(RAND) -> x\n"
+    "(RAND) -> y\n"
+    "(x -> ADD <- y)\n"
+    "5 -> z\n"
+    "(z -> MUL <- 2)\n",
+
+    "0 -> i\n"
+    "0 -> s\n"
+    "1 -> t\n"
+    "(i -> ADD <- 1) -> i\n"
+    "(s -> ADD <- i) -> s\n"
+    "(t -> MUL <- 2) -> t\n"
+    "s\n"
+    "JUMP_IF <- [(i -> LT <- 20), 4<=, =>1]\n"
+    "t\n",
+};
+
+// Calls with several nested arguments, failing ones included
+static const char *nested_programs[] = {
+    "\"pinch\" -> a\n"
+    "\"flow\" -> b\n"
+    "(((a -> UPPER) -> CONCAT <- (a -> LOWER)) -> CONCAT <- ((b -> UPPER) -> CONCAT <- (b -> LEN)))\n"
+    "((((a -> LEN) -> MUL <- 3) -> ADD <- ((b -> LEN) -> POW <- 2)) -> SUB <- 1)\n",
+
+    "4 -> x\n"
+    "-1 -> y\n"
+    "(((x -> DIV <- 0) -> ADD <- 1) -> ADD <- ((y -> SQRT) -> ADD <- 1))\n"
+    "(((x -> ADD <- 1) -> MUL <- 2) -> ADD <- ((y -> SQRT) -> ADD <- 1))\n",
+
+    "((RAND) -> ADD <- ((RAND) -> MUL <- 2))\n",
+};
+
+// Run a program the way the command line does and capture stdout and stderr
+static char *run_captured(const char *engine_name, const char *source, int arg_min_cost, ParallelStats *stats) {
+    FILE *capture = tmpfile();
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    dup2(fileno(capture), STDERR_FILENO);
+
+    Program *program = load_program(source);
+    EngineOptions options = {0};
+    options.threads = 4;
+    PreparedProgram *prepared = prepare_program(find_engine(engine_name), program, &options);
+    MachineState *state = new_machine_state();
+    if (arg_min_cost > 0) {
+        state->arg_pool = pool_new(4);
+        state->arg_min_cost = arg_min_cost;
+    }
+    if (!run_program(prepared, state)) {
+        fprintf(stderr, "Execution halted at statement %d.\n",
+                program->statements[state->program_counter]->number);
+    }
+    if (stats != NULL) {
+        *stats = parallel_stats((ParallelState*)prepared->data);
+    }
+    free_state(state);
+    free_prepared(prepared);
+    free_program(program);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    char *output = read_stream(capture);
+    fclose(capture);
+    return output;
+}
+
+bool test_output_matches_sequential_execution() {
+    int count = sizeof(programs) / sizeof(programs[0]);
+    for (int i = 0; i < count; i++) {
+        char *expected = run_captured("tree", programs[i], 0, NULL);
+        // Repeat to give different interleavings a chance to show up
+        for (int run = 0; run < 20; run++) {
+            ParallelStats stats;
+            char *actual = run_captured("parallel", programs[i], 0, &stats);
+            bool same = strcmp(expected, actual) == 0;
+            if (!same) {
+                printf("\n   Program %d expected:\n%s   Actual:\n%s", i + 1, expected, actual);
+            }
+            free(actual);
+            ASSERT_TRUE(same);
+            ASSERT_TRUE(stats.block_runs > 0);
+        }
+        free(expected);
+    }
+    return true;
+}
+
+bool test_chains_are_not_parallelised() {
+    ParallelStats stats;
+    char *output = run_captured("parallel", "1 -> a\n(a -> ADD <- 1) -> b\n(b -> ADD <- 1) -> c\nc\n", 0, &stats);
+    ASSERT_TRUE(strcmp(output, "3\n") == 0);
+    ASSERT_TRUE(stats.blocks == 0);
+    ASSERT_TRUE(stats.block_runs == 0);
+    free(output);
+    return true;
+}
+
+bool test_concurrent_arguments_match_sequential_evaluation() {
+    int count = sizeof(nested_programs) / sizeof(nested_programs[0]);
+    for (int i = 0; i < count; i++) {
+        char *expected = run_captured("tree", nested_programs[i], 0, NULL);
+        for (int run = 0; run < 20; run++) {
+            // A minimum cost of 1 turns every argument of a pure call into a task
+            char *actual = run_captured(run % 2 ? "tree" : "parallel", nested_programs[i], 1, NULL);
+            bool same = strcmp(expected, actual) == 0;
+            if (!same) {
+                printf("\n   Program %d expected:\n%s   Actual:\n%s", i + 1, expected, actual);
+            }
+            free(actual);
+            ASSERT_TRUE(same);
+        }
+        free(expected);
+    }
+    return true;
+}
+
+bool test_only_costly_arguments_become_tasks() {
+    MachineState *state = new_machine_state();
+    state->arg_pool = pool_new(2);
+    state->arg_min_cost = 8;
+
+    parse_statement_result res = parse_statement(
+        "((((\"a\" -> UPPER) -> CONCAT <- \"b\") -> LOWER) -> CONCAT <- (((\"c\" -> UPPER) -> CONCAT <- \"d\") -> LOWER)) -> s\n");
+    ASSERT_TRUE(res.success);
+    ASSERT_TRUE(interpret_line(res.stmt, state, false));
+    ASSERT_TRUE(pool_stats(state->arg_pool).executed == 1);
+    free_statement(res.stmt);
+
+    // Two cheap arguments are evaluated inline
+    res = parse_statement("(s -> CONCAT <- \"!\") -> s\n");
+    ASSERT_TRUE(res.success);
+    ASSERT_TRUE(interpret_line(res.stmt, state, false));
+    ASSERT_TRUE(pool_stats(state->arg_pool).executed == 1);
+    free_statement(res.stmt);
+
+    Value *s = (Value*)hashmap_lookup(state->variables, "s");
+    ASSERT_TRUE(s != NULL && strcmp(s->data.str, "abcd!") == 0);
+    free_state(state);
+    return true;
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    int count;
+} Counter;
+
+static void count_task(void *arg) {
+    Counter *counter = (Counter*)arg;
+    pthread_mutex_lock(&counter->lock);
+    counter->count++;
+    pthread_mutex_unlock(&counter->lock);
+}
+
+bool test_pool_runs_every_task() {
+    Counter counter;
+    pthread_mutex_init(&counter.lock, NULL);
+    counter.count = 0;
+
+    ThreadPool *pool = pool_new(4);
+    ASSERT_TRUE(pool != NULL);
+    for (int i = 0; i < 10000; i++) {
+        pool_submit(pool, count_task, &counter);
+    }
+    // Freeing the pool drains the queued tasks first
+    free_pool(pool);
+    ASSERT_TRUE(counter.count == 10000);
+    pthread_mutex_destroy(&counter.lock);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_output_matches_sequential_execution);
+    RUN_TEST(test_chains_are_not_parallelised);
+    RUN_TEST(test_concurrent_arguments_match_sequential_evaluation);
+    RUN_TEST(test_only_costly_arguments_become_tasks);
+    RUN_TEST(test_pool_runs_every_task);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "perfcounters.h"
+#include "runstats.h"
+#include "util.h"
+#include <stdlib.h>
+
+// Counters are often unavailable in containers and virtual machines, so
+// either outcome of opening them is accepted as long as it is consistent
+bool test_runs_with_or_without_counters() {
+    FILE *errors = tmpfile();
+    FILE *previous = stderr;
+    stderr = errors;
+    bool opened = open_perf_counters(true);
+    stderr = previous;
+    char *message = read_stream(errors);
+    fclose(errors);
+    ASSERT_TRUE(opened == perf_counting());
+    ASSERT_TRUE(opened == perf_per_builtin());
+    ASSERT_TRUE(opened || strncmp(message, "Perf counters: unavailable (", 28) == 0);
+    free(message);
+
+    RunStats stats = {0};
+    MachineState *state = new_machine_state();
+    PhaseTime start = phase_now();
+    ASSERT_TRUE(run_source("0 -> i\n(i -> ADD <- 1) -> i\nJUMP_IF <- [(i -> LT <- 1000), 1<=, =>1]\n", "jit", state));
+    phase_add(&stats, RUN_PHASE_EXECUTE, start);
+    free_state(state);
+
+    FILE *out = tmpfile();
+    print_phase_counters(out, &stats);
+    char *report = read_stream(out);
+    fclose(out);
+    if (!opened) {
+        ASSERT_TRUE(report[0] == '\0');
+    } else {
+        ASSERT_TRUE(strstr(report, "\nexecute ") != NULL);
+        ASSERT_TRUE(strstr(report, "\nADD ") != NULL);
+        if (perf_available(PERF_INSTRUCTIONS)) {
+            ASSERT_TRUE(stats.phases[RUN_PHASE_EXECUTE].perf.values[PERF_INSTRUCTIONS] > 1000);
+        }
+    }
+    free(report);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_runs_with_or_without_counters);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
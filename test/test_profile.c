@@ -0,0 +1,108 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "profile.h"
+#include "util.h"
+#include <stdlib.h>
+
+// Nested loops with blank lines between statements, so statement and line
+// numbers differ
+static const char *source =
+    "0 -> i\n"
+    "\n"
+    "0 -> total\n"
+    "(i -> ADD <- 1) -> i\n"
+    "0 -> j\n"
+    "\n"
+    "(j -> ADD <- 1) -> j\n"
+    "(total -> ADD <- j) -> total\n"
+    "JUMP_IF <- [(j -> LT <- 5), 2<=, =>1]\n"
+    "JUMP_IF <- [(i -> LT <- 3), 5<=, =>1]\n"
+    "(total -> DIV <- 0)\n";
+
+// Profile the program on the calling thread, errors going to a scratch file
+static Profile *profile_source(Program *program, bool *success) {
+    Profile *profile = profile_new(program->statements, program->stmt_count);
+    MachineState *state = new_machine_state();
+    state->errors = tmpfile();
+    MachineState *previous_state = bind_machine_state(state);
+    FILE *previous_errors = redirect_errors(state->errors);
+    *success = profile_run(profile, state, false);
+    redirect_errors(previous_errors);
+    bind_machine_state(previous_state);
+    fclose(state->errors);
+    free_state(state);
+    return profile;
+}
+
+bool test_statements_are_counted_on_their_lines() {
+    Program *program = load_program(source);
+    ASSERT_TRUE(program != NULL);
+    bool success;
+    Profile *profile = profile_source(program, &success);
+    ASSERT_TRUE(!success);
+
+    int lines[] = {1, 3, 4, 5, 7, 8, 9, 10, 11};
+    long runs[] = {1, 1, 3, 3, 15, 15, 15, 3, 1};
+    for (int i = 0; i < program->stmt_count; i++) {
+        StatementProfile counted = profile_statement(profile, i);
+        ASSERT_TRUE(counted.line == lines[i]);
+        ASSERT_TRUE(counted.runs == runs[i]);
+        ASSERT_TRUE(counted.ns >= 0);
+    }
+
+    free_profile(profile);
+    free_program(program);
+    return true;
+}
+
+// The report row of a line, up to its newline
+static char *report_row(char *report, int line, char *row, size_t size) {
+    char start[16];
+    snprintf(start, sizeof(start), "\n%8d ", line);
+    char *found = strstr(report, start);
+    if (found == NULL) return NULL;
+    size_t length = strcspn(found + 1, "\n");
+    snprintf(row, size, "%.*s", (int)length, found + 1);
+    return row;
+}
+
+bool test_report_lists_lines_with_their_loops() {
+    Program *program = load_program(source);
+    bool success;
+    Profile *profile = profile_source(program, &success);
+    FILE *out = tmpfile();
+    print_profile(out, profile, PROFILE_REPORT_LINES);
+    char *report = read_stream(out);
+    fclose(out);
+
+    ASSERT_TRUE(strncmp(report, "Profile: 57 statement(s) run in", 31) == 0);
+    char row[128];
+    ASSERT_TRUE(report_row(report, 8, row, sizeof(row)) != NULL);
+    ASSERT_TRUE(strstr(row, " 15 ") != NULL);
+    ASSERT_TRUE(strstr(row, "%   7-9, 4-10") != NULL);
+    ASSERT_TRUE(report_row(report, 5, row, sizeof(row)) != NULL);
+    ASSERT_TRUE(strstr(row, "%   4-10") != NULL && strstr(row, "7-9") == NULL);
+    ASSERT_TRUE(report_row(report, 1, row, sizeof(row)) != NULL);
+    ASSERT_TRUE(row[strlen(row) - 1] == '%');
+    ASSERT_TRUE(report_row(report, 2, row, sizeof(row)) == NULL);
+    free(report);
+
+    // Lines past the limit are only counted
+    out = tmpfile();
+    print_profile(out, profile, 3);
+    report = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strstr(report, "Profile: 6 more line(s) ran.") != NULL);
+
+    free(report);
+    free_profile(profile);
+    free_program(program);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_statements_are_counted_on_their_lines);
+    RUN_TEST(test_report_lists_lines_with_their_loops);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include "test_harness.h"
+#include "reactive.h"
+#include "util.h"
+
+static bool update(ReactiveGraph *graph, char *line) {
+    parse_statement_result res = parse_statement(line);
+    return res.success && reactive_update(graph, res.stmt);
+}
+
+static bool has_num(MachineState *state, char *name, double num) {
+    Value *value = (Value*)hashmap_lookup(state->variables, name);
+    return value != NULL && value->type == VALUE_NUM && value->data.num == num;
+}
+
+bool test_update_reevaluates_downstream_only() {
+    MachineState *state = new_machine_state();
+    ReactiveGraph *graph = reactive_new(state);
+    Program *program = load_program(
+        "3 -> a\n"
+        "4 -> b\n"
+        "(a -> ADD <- 1) -> c\n"
+        "(b -> ADD <- 1) -> d\n"
+        "(c -> ADD <- d) -> e\n");
+    ASSERT_TRUE(reactive_load(graph, program));
+    free_program(program);
+    ASSERT_TRUE(has_num(state, "e", 9));
+    ASSERT_TRUE(reactive_stats(graph).last_evaluated == 5);
+
+    // a, c and e change; b and d are left alone
+    ASSERT_TRUE(update(graph, "10 -> a\n"));
+    ASSERT_TRUE(has_num(state, "e", 16));
+    ASSERT_TRUE(reactive_stats(graph).last_evaluated == 3);
+
+    // Redefining d in terms of a moves it downstream of a
+    ASSERT_TRUE(update(graph, "(a -> MUL <- 2) -> d\n"));
+    ASSERT_TRUE(has_num(state, "e", 31));
+    ASSERT_TRUE(update(graph, "1 -> a\n"));
+    ASSERT_TRUE(has_num(state, "e", 4));
+    ASSERT_TRUE(reactive_stats(graph).last_evaluated == 4);
+
+    free_reactive(graph);
+    free_state(state);
+    return true;
+}
+
+bool test_statements_run_in_dependency_order() {
+    MachineState *state = new_machine_state();
+    ReactiveGraph *graph = reactive_new(state);
+    Program *program = load_program(
+        "(x -> MUL <- 2) -> y\n"
+        "5 -> x\n");
+    ASSERT_TRUE(reactive_load(graph, program));
+    free_program(program);
+    ASSERT_TRUE(has_num(state, "y", 10));
+
+    // A variable read before it exists is picked up once it is assigned
+    ASSERT_TRUE(update(graph, "(z -> ADD <- y) -> w\n"));
+    ASSERT_TRUE(hashmap_lookup(state->variables, "w") == NULL);
+    ASSERT_TRUE(update(graph, "1 -> z\n"));
+    ASSERT_TRUE(has_num(state, "w", 11));
+
+    free_reactive(graph);
+    free_state(state);
+    return true;
+}
+
+bool test_unsupported_programs_are_rejected() {
+    MachineState *state = new_machine_state();
+    ReactiveGraph *graph = reactive_new(state);
+
+    char *sources[] = {
+        "0 -> i\n(i -> ADD <- 1) -> i\n",
+        "1 -> i\nJUMP <- =>1\n",
+        "(b -> ADD <- 1) -> a\n(a -> ADD <- 1) -> b\n",
+    };
+    for (int i = 0; i < 3; i++) {
+        Program *program = load_program(sources[i]);
+        ASSERT_TRUE(!reactive_load(graph, program));
+        ASSERT_TRUE(program->stmt_count == 2);
+        ASSERT_TRUE(reactive_stats(graph).nodes == 0);
+        free_program(program);
+    }
+
+    // Updates that would close a cycle leave the graph as it was
+    ASSERT_TRUE(update(graph, "2 -> a\n"));
+    ASSERT_TRUE(update(graph, "(a -> ADD <- 1) -> b\n"));
+    ASSERT_TRUE(!update(graph, "(b -> ADD <- 1) -> a\n"));
+    ASSERT_TRUE(!update(graph, "(a -> ADD <- 1) -> a\n"));
+    ASSERT_TRUE(update(graph, "5 -> a\n"));
+    ASSERT_TRUE(has_num(state, "b", 6));
+
+    free_reactive(graph);
+    free_state(state);
+    return true;
+}
+
+bool test_update_work_scales_with_affected_statements() {
+    MachineState *state = new_machine_state();
+    ReactiveGraph *graph = reactive_new(state);
+    char line[64];
+
+    // Many independent inputs feeding one chain of two statements
+    ASSERT_TRUE(update(graph, "1 -> a\n"));
+    ASSERT_TRUE(update(graph, "(a -> ADD <- 1) -> b\n"));
+    for (int i = 0; i < 500; i++) {
+        char name[8] = "v";
+        for (int n = i, j = 1; j < 7; j++, n /= 26) name[j] = 'a' + n % 26;
+        snprintf(line, sizeof(line), "%d -> %s\n", i, name);
+        ASSERT_TRUE(update(graph, line));
+    }
+
+    ASSERT_TRUE(update(graph, "7 -> a\n"));
+    ReactiveStats stats = reactive_stats(graph);
+    ASSERT_TRUE(stats.last_evaluated == 2);
+    ASSERT_TRUE(stats.nodes == 502);
+    ASSERT_TRUE(has_num(state, "b", 8));
+
+    free_reactive(graph);
+    free_state(state);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_update_reevaluates_downstream_only);
+    RUN_TEST(test_statements_run_in_dependency_order);
+    RUN_TEST(test_unsupported_programs_are_rejected);
+    RUN_TEST(test_update_work_scales_with_affected_statements);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
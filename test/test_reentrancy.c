@@ -0,0 +1,196 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define THREADS 8
+#define RUNS_PER_THREAD 40
+
+// Programs with loops, Text, RAND and runtime errors, so every per-run piece
+// of state is exercised while other threads do the same
+static const char *programs[] = {
+    "0 -> i\n"
+    "0 -> acc\n"
+    "(i -> ADD <- 1) -> i\n"
+    "(acc -> ADD <- ((i -> MUL <- i) -> MOD <- 7)) -> acc\n"
+    "JUMP_IF <- [(i -> LT <- 300), 2<=, =>1]\n"
+    "acc\n",
+
+    "\"word\" -> w\n"
+    "0 -> n\n"
+    "(w -> CONCAT <- (SUBSTR <- [\"abcdef\", (n -> MOD <- 5), 1])) -> w\n"
+    "(n -> ADD <- 1) -> n\n"
+    "JUMP_IF <- [(n -> LT <- 40), 2<=, =>1]\n"
+    "(w -> UPPER)\n"
+    "(w -> LEN)\n",
+
+    "(RAND) -> a\n"
+    "(RAND) -> b\n"
+    "((a -> ADD <- b) -> MUL <- 1000)\n"
+    "(RAND)\n",
+
+    "3 -> a\n"
+    "(a -> MUL <- a)\n"
+    "(a -> DIV <- 0)\n"
+    "a\n",
+
+    "\"x\" -> s\n"
+    "(s -> ADD <- 1)\n",
+};
+
+#define PROGRAM_COUNT ((int)(sizeof(programs) / sizeof(programs[0])))
+
+static const char *engine_names[] = {"tree", "jit", "parallel"};
+
+typedef struct {
+    char *output;
+    size_t output_length;
+    char *errors;
+    size_t errors_length;
+    bool success;
+} RunResult;
+
+// Run a program with output and errors written to memory instead of the
+// process streams
+static RunResult run_to_memory(const char *engine_name, const char *source) {
+    RunResult result = {NULL, 0, NULL, 0, false};
+    FILE *output = open_memstream(&result.output, &result.output_length);
+    FILE *errors = open_memstream(&result.errors, &result.errors_length);
+
+    FILE *previous = redirect_errors(errors);
+    Program *program = load_program(source);
+    redirect_errors(previous);
+
+    if (program != NULL) {
+        EngineOptions options = {0};
+        options.threads = 2;
+        PreparedProgram *prepared = prepare_program(find_engine(engine_name), program, &options);
+        MachineState *state = new_machine_state();
+        state->output = output;
+        state->errors = errors;
+        result.success = run_program(prepared, state);
+        free_state(state);
+        free_prepared(prepared);
+        free_program(program);
+    }
+    fclose(output);
+    fclose(errors);
+    return result;
+}
+
+static void free_result(RunResult *result) {
+    free(result->output);   // Allocated by open_memstream
+    free(result->errors);
+}
+
+static RunResult expected[PROGRAM_COUNT];
+
+typedef struct {
+    int id;
+    int mismatches;
+} Worker;
+
+static void *run_worker(void *arg) {
+    Worker *worker = (Worker*)arg;
+    for (int run = 0; run < RUNS_PER_THREAD; run++) {
+        int p = (worker->id + run) % PROGRAM_COUNT;
+        const char *engine = engine_names[(worker->id + run) % 3];
+        RunResult result = run_to_memory(engine, programs[p]);
+        if (result.success != expected[p].success ||
+            strcmp(result.output, expected[p].output) != 0 ||
+            strcmp(result.errors, expected[p].errors) != 0) {
+            worker->mismatches++;
+        }
+        free_result(&result);
+    }
+    return NULL;
+}
+
+bool test_concurrent_runs_match_sequential_runs() {
+    for (int p = 0; p < PROGRAM_COUNT; p++) {
+        expected[p] = run_to_memory("tree", programs[p]);
+    }
+    // Nothing reached the process streams
+    ASSERT_TRUE(expected[0].success && expected[1].success && expected[2].success);
+    ASSERT_TRUE(strstr(expected[3].errors, "Division by zero") != NULL);
+    ASSERT_TRUE(strcmp(expected[3].output, "9\n") == 0);
+    ASSERT_TRUE(!expected[4].success);
+
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        workers[i].id = i;
+        workers[i].mismatches = 0;
+        ASSERT_TRUE(pthread_create(&threads[i], NULL, run_worker, &workers[i]) == 0);
+    }
+    int mismatches = 0;
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        mismatches += workers[i].mismatches;
+    }
+    for (int p = 0; p < PROGRAM_COUNT; p++) {
+        free_result(&expected[p]);
+    }
+    ASSERT_TRUE(mismatches == 0);
+    return true;
+}
+
+bool test_states_have_their_own_random_sequence() {
+    RunResult first = run_to_memory("tree", "(RAND)\n(RAND)\n");
+    RunResult second = run_to_memory("tree", "(RAND)\n(RAND)\n");
+    ASSERT_TRUE(strcmp(first.output, second.output) == 0);
+    free_result(&first);
+    free_result(&second);
+
+    // Reseeding one state leaves the others alone
+    MachineState *a = new_machine_state();
+    MachineState *b = new_machine_state();
+    b->random_state = 42;
+    MachineState *previous = bind_machine_state(a);
+    double from_a = random_number();
+    bind_machine_state(b);
+    double from_b = random_number();
+    bind_machine_state(previous);
+    ASSERT_TRUE(from_a != from_b);
+    ASSERT_TRUE(from_a >= 0 && from_a < 1 && from_b >= 0 && from_b < 1);
+    free_state(a);
+    free_state(b);
+    return true;
+}
+
+bool test_lexer_limits_fail_instead_of_exiting() {
+    char source[200];
+    memset(source, 'a', 150);
+    strcpy(source + 150, " -> x\n");
+    RunResult result = run_to_memory("tree", source);
+    ASSERT_TRUE(!result.success);
+    ASSERT_TRUE(strstr(result.errors, "exceeds maximum length") != NULL);
+    ASSERT_TRUE(strstr(result.errors, "Syntax Error on line 1.") != NULL);
+    free_result(&result);
+    return true;
+}
+
+bool test_allocation_failure_jumps_to_recovery_point() {
+    AllocRecovery recovery;
+    volatile bool recovered = false;
+    if (setjmp(recovery.env) != 0) {
+        recovered = true;
+    } else {
+        push_alloc_recovery(&recovery);
+        alloc_failed("Test Error: Out of memory.\n");
+        pop_alloc_recovery(&recovery);
+    }
+    ASSERT_TRUE(recovered);
+    ASSERT_TRUE(strcmp(recovery.message, "Test Error: Out of memory.\n") == 0);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_concurrent_runs_match_sequential_runs);
+    RUN_TEST(test_states_have_their_own_random_sequence);
+    RUN_TEST(test_lexer_limits_fail_instead_of_exiting);
+    RUN_TEST(test_allocation_failure_jumps_to_recovery_point);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
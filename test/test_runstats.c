@@ -0,0 +1,72 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "runstats.h"
+#include "util.h"
+#include <stdlib.h>
+
+static bool count_run(const char *engine, RunCounters *counters) {
+    MachineState *state = new_machine_state();
+    state->counters = counters;
+    bool success = run_source("0 -> i\n(i -> ADD <- 1) -> i\nJUMP_IF <- [(i -> LT <- 50), 1<=, =>1]\n", engine, state);
+    free_state(state);
+    return success;
+}
+
+bool test_statements_jumps_and_calls_are_counted() {
+    const char *engines[] = {"tree", "jit", "profile"};
+    for (int i = 0; i < 3; i++) {
+        RunCounters counters = {0};
+        ASSERT_TRUE(count_run(engines[i], &counters));
+        ASSERT_TRUE(counters.statements == 101);
+        // Every iteration jumps, back to the loop or past its end
+        ASSERT_TRUE(counters.jumps == 50);
+        ASSERT_TRUE(counters.calls == 150);
+    }
+    return true;
+}
+
+bool test_phases_add_up_and_print_on_one_line() {
+    RunStats stats = {0};
+    stats.program_statements = 3;
+    stats.counters.statements = 101;
+    for (int i = 0; i < 2; i++) {
+        PhaseTime start = phase_now();
+        for (volatile int spin = 0; spin < 100000; spin++) {}
+        phase_add(&stats, RUN_PHASE_EXECUTE, start);
+    }
+    ASSERT_TRUE(stats.phases[RUN_PHASE_EXECUTE].wall_ns > 0);
+    ASSERT_TRUE(stats.phases[RUN_PHASE_EXECUTE].cpu_ns > 0);
+    ASSERT_TRUE(stats.phases[RUN_PHASE_READ].wall_ns == 0);
+
+    FILE *out = tmpfile();
+    print_run_stats(out, &stats, false);
+    print_run_stats(out, &stats, true);
+    char *text = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strncmp(text, "Stats: read_wall_ms=0.000 read_cpu_ms=0.000 parse_wall_ms=", 58) == 0);
+    ASSERT_TRUE(strstr(text, " statements=3 executed=101 jumps=0 calls=0 peak_rss_kb=") != NULL);
+    ASSERT_TRUE(strstr(text, "\n{\"phases\": {\"read\": {\"wall_ms\": 0.000, \"cpu_ms\": 0.000}, ") != NULL);
+    ASSERT_TRUE(strstr(text, "\"statements\": 3, \"executed\": 101, ") != NULL);
+    // One line each
+    int lines = 0;
+    for (char *c = text; *c != '\0'; c++) lines += *c == '\n';
+    ASSERT_TRUE(lines == 2);
+    free(text);
+    return true;
+}
+
+bool test_allocations_are_counted_once_enabled() {
+    count_allocations();
+    long before = allocation_count();
+    for (int i = 0; i < 10; i++) xfree(xalloc(8, "Interpreter Error: Fail to allocate memory for test blocks.\n"));
+    ASSERT_TRUE(allocation_count() - before == 10);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_statements_jumps_and_calls_are_counted);
+    RUN_TEST(test_phases_add_up_and_print_on_one_line);
+    RUN_TEST(test_allocations_are_counted_once_enabled);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include "test_harness.h"
+#include "engine.h"
+#include "functions.h"
+#include "sampler.h"
+#include <signal.h>
+#include <stdlib.h>
+
+static Pinch_Func call_of(const char *name) {
+    Pinch_Func func = {0};
+    func.quick = QUICK_GENERIC;
+    func.builtin = find_builtin(name);
+    return func;
+}
+
+bool test_signals_count_the_published_stack() {
+    // Too slow to fire during the test, samples are raised by hand
+    ASSERT_TRUE(start_sampling(1));
+    Pinch_Func add = call_of("ADD");
+    Pinch_Func mul = call_of("MUL");
+    sample_statement(7);
+    sample_push(&add);
+    sample_push(&mul);
+    for (int i = 0; i < 3; i++) raise(SIGPROF);
+    sample_pop();
+    raise(SIGPROF);
+    sample_pop();
+    sample_statement(0);
+    raise(SIGPROF);
+    stop_sampling();
+    ASSERT_TRUE(sample_count() == 5);
+
+    FILE *out = tmpfile();
+    write_folded_stacks(out);
+    char *folded = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strstr(folded, "line 7;ADD;MUL 3\n") != NULL);
+    ASSERT_TRUE(strstr(folded, "line 7;ADD 1\n") != NULL);
+    ASSERT_TRUE(strstr(folded, "(outside statements) 1\n") != NULL);
+    free(folded);
+
+    out = tmpfile();
+    print_sample_profile(out, SAMPLE_REPORT_LINES);
+    char *report = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strstr(report, "Sample profile: 5 sample(s) at 1 Hz of CPU time.\n") != NULL);
+    ASSERT_TRUE(strstr(report, "         4    80.0%   7\n") != NULL);
+    free(report);
+    return true;
+}
+
+bool test_stacks_deeper_than_kept_are_cut_off() {
+    ASSERT_TRUE(start_sampling(1));
+    Pinch_Func sub = call_of("SUB");
+    sample_statement(1);
+    for (int i = 0; i < SAMPLE_MAX_DEPTH + 2; i++) sample_push(&sub);
+    raise(SIGPROF);
+    for (int i = 0; i < SAMPLE_MAX_DEPTH + 2; i++) sample_pop();
+    sample_statement(0);
+    stop_sampling();
+
+    FILE *out = tmpfile();
+    write_folded_stacks(out);
+    char *folded = read_stream(out);
+    fclose(out);
+    char expected[256] = "line 1";
+    for (int i = 0; i < SAMPLE_MAX_DEPTH; i++) strcat(expected, ";SUB");
+    strcat(expected, " 1\n");
+    ASSERT_TRUE(strcmp(folded, expected) == 0);
+    free(folded);
+    return true;
+}
+
+bool test_running_programs_are_sampled_by_line() {
+    Program *program = load_program("0 -> i\n(i -> ADD <- (1 -> MUL <- 1)) -> i\nJUMP_IF <- [(i -> LT <- 20000), 1<=, =>1]\n");
+    PreparedProgram *prepared = prepare_program(find_engine("jit"), program, &(EngineOptions){0});
+    ASSERT_TRUE(start_sampling(SAMPLE_MAX_HZ));
+    // Run until the timer has fired often enough, however coarse it is
+    for (int run = 0; run < 1000 && sample_count() < 20; run++) {
+        MachineState *state = new_machine_state();
+        ASSERT_TRUE(run_program(prepared, state));
+        free_state(state);
+    }
+    stop_sampling();
+    ASSERT_TRUE(sample_count() >= 20);
+
+    FILE *out = tmpfile();
+    write_folded_stacks(out);
+    char *folded = read_stream(out);
+    fclose(out);
+    ASSERT_TRUE(strstr(folded, "line 2") != NULL);
+    ASSERT_TRUE(strstr(folded, "line 3") != NULL);
+    free(folded);
+    free_prepared(prepared);
+    free_program(program);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_signals_count_the_published_stack);
+    RUN_TEST(test_stacks_deeper_than_kept_are_cut_off);
+    RUN_TEST(test_running_programs_are_sampled_by_line);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
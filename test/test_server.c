@@ -0,0 +1,187 @@
+#include "test_harness.h"
+#include "server.h"
+#include "sha256.h"
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static char socket_path[64];
+
+typedef struct {
+    int fd;
+    FILE *replies;
+} Client;
+
+typedef struct {
+    char output[256];
+    char errors[512];
+    char status[16];
+    char hash[SHA256_HEX_LENGTH + 1];
+} Reply;
+
+static Server *start(int cache_entries) {
+    snprintf(socket_path, sizeof(socket_path), "/tmp/pinch_test_%d.sock", (int)getpid());
+    ServerOptions options = {0};
+    options.engine = default_engine();
+    options.workers = 2;
+    options.cache_entries = cache_entries;
+    options.time_limit_ms = 100;
+    options.memory_limit = 1 << 20;
+    return server_start(socket_path, &options);
+}
+
+static bool connect_client(Client *client) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr*)&address, sizeof(address)) != 0) return false;
+    client->replies = fdopen(dup(client->fd), "r");
+    return client->replies != NULL;
+}
+
+static void close_client(Client *client) {
+    fclose(client->replies);
+    close(client->fd);
+}
+
+static void append_frame(FILE *replies, char *to, size_t size, size_t length) {
+    size_t used = strlen(to);
+    for (size_t i = 0; i < length; i++) {
+        int c = fgetc(replies);
+        if (used + 1 < size) to[used++] = (char)c;
+    }
+    to[used] = '\0';
+}
+
+// Send a request and collect its frames up to DONE
+static Reply request(Client *client, const char *text) {
+    Reply reply = {"", "", "", ""};
+    send(client->fd, text, strlen(text), MSG_NOSIGNAL);
+    char line[128];
+    while (fgets(line, sizeof(line), client->replies) != NULL) {
+        size_t length;
+        if (sscanf(line, "OUT %zu", &length) == 1) {
+            append_frame(client->replies, reply.output, sizeof(reply.output), length);
+        } else if (sscanf(line, "ERR %zu", &length) == 1) {
+            append_frame(client->replies, reply.errors, sizeof(reply.errors), length);
+        } else if (sscanf(line, "DONE %15s %64s", reply.status, reply.hash) == 2) {
+            break;
+        }
+    }
+    return reply;
+}
+
+static Reply send_source(Client *client, const char *source, const char *variables) {
+    char text[1024];
+    snprintf(text, sizeof(text), "SOURCE %zu\n%s%sRUN\n", strlen(source), source, variables);
+    return request(client, text);
+}
+
+static const char *scale = "(price -> MUL <- rate)\n(label -> UPPER)\n";
+
+bool test_programs_are_cached_by_hash() {
+    Server *server = start(0);
+    ASSERT_TRUE(server != NULL);
+    Client client;
+    ASSERT_TRUE(connect_client(&client));
+
+    Reply first = send_source(&client, scale, "NUMBER price 21\nNUMBER rate 2\nTEXT label big one\n");
+    ASSERT_TRUE(strcmp(first.status, "ok") == 0);
+    ASSERT_TRUE(strcmp(first.output, "42\nBIG ONE\n") == 0);
+    char expected[SHA256_HEX_LENGTH + 1];
+    sha256_hex(scale, strlen(scale), expected);
+    ASSERT_TRUE(strcmp(first.hash, expected) == 0);
+
+    char text[256];
+    snprintf(text, sizeof(text), "HASH %s\nNUMBER price 1.5\nNUMBER rate 4\nTEXT label x\nRUN\n", first.hash);
+    Reply second = request(&client, text);
+    ASSERT_TRUE(strcmp(second.status, "ok") == 0);
+    ASSERT_TRUE(strcmp(second.output, "6\nX\n") == 0);
+
+    // Variables of the previous request are gone
+    snprintf(text, sizeof(text), "HASH %s\nNUMBER price 1\nRUN\n", first.hash);
+    Reply third = request(&client, text);
+    ASSERT_TRUE(strcmp(third.status, "failed") == 0);
+    ASSERT_TRUE(strstr(third.errors, "Undefined variable 'rate'") != NULL);
+    ASSERT_TRUE(strstr(third.errors, "Execution halted at statement 1.") != NULL);
+
+    Reply unknown = request(&client, "HASH 0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\nRUN\n");
+    ASSERT_TRUE(strcmp(unknown.status, "unknown") == 0);
+    Reply syntax = send_source(&client, "(a -> ADD <- )\n", "");
+    ASSERT_TRUE(strcmp(syntax.status, "syntax") == 0);
+    ASSERT_TRUE(strstr(syntax.errors, "Syntax Error on line 1.") != NULL);
+    Reply invalid = send_source(&client, scale, "NUMBER Price 1\n");
+    ASSERT_TRUE(strcmp(invalid.status, "invalid") == 0);
+
+    close_client(&client);
+    ServerStats stats = server_stats(server);
+    server_stop(server);
+    ASSERT_TRUE(stats.compiled == 1 && stats.cache_hits == 3 && stats.requests == 6);
+    ASSERT_TRUE(access(socket_path, F_OK) != 0);
+    return true;
+}
+
+bool test_limits_stop_one_request() {
+    Server *server = start(0);
+    ASSERT_TRUE(server != NULL);
+    Client client;
+    ASSERT_TRUE(connect_client(&client));
+
+    // A numeric loop that runs as native code
+    Reply spin = send_source(&client, "0 -> i\n(i -> ADD <- 1) -> i\nJUMP <- [1<=]\n", "");
+    ASSERT_TRUE(strcmp(spin.status, "timeout") == 0);
+    ASSERT_TRUE(strstr(spin.errors, "Execution interrupted") != NULL);
+
+    Reply grow = send_source(&client, "\"ab\" -> s\n(s -> CONCAT <- s) -> s\nJUMP <- [1<=]\n", "");
+    ASSERT_TRUE(strcmp(grow.status, "memory") == 0);
+    ASSERT_TRUE(strstr(grow.errors, "Memory limit exceeded") != NULL);
+
+    // The connection and the worker are fine afterwards
+    Reply next = send_source(&client, scale, "NUMBER price 2\nNUMBER rate 3\nTEXT label a\n");
+    ASSERT_TRUE(strcmp(next.status, "ok") == 0);
+    ASSERT_TRUE(strcmp(next.output, "6\nA\n") == 0);
+
+    close_client(&client);
+    ServerStats stats = server_stats(server);
+    server_stop(server);
+    ASSERT_TRUE(stats.timeouts == 1 && stats.memory_exceeded == 1);
+    return true;
+}
+
+bool test_least_recently_used_program_is_evicted() {
+    Server *server = start(2);
+    ASSERT_TRUE(server != NULL);
+    Client client;
+    ASSERT_TRUE(connect_client(&client));
+
+    Reply a = send_source(&client, "1\n", "");
+    Reply b = send_source(&client, "2\n", "");
+    char text[128];
+    snprintf(text, sizeof(text), "HASH %s\nRUN\n", a.hash);
+    ASSERT_TRUE(strcmp(request(&client, text).status, "ok") == 0);
+    send_source(&client, "3\n", "");
+
+    // b was used least recently
+    snprintf(text, sizeof(text), "HASH %s\nRUN\n", b.hash);
+    ASSERT_TRUE(strcmp(request(&client, text).status, "unknown") == 0);
+    snprintf(text, sizeof(text), "HASH %s\nRUN\n", a.hash);
+    Reply again = request(&client, text);
+    ASSERT_TRUE(strcmp(again.status, "ok") == 0);
+    ASSERT_TRUE(strcmp(again.output, "1\n") == 0);
+
+    close_client(&client);
+    ServerStats stats = server_stats(server);
+    server_stop(server);
+    ASSERT_TRUE(stats.evicted == 1);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_programs_are_cached_by_hash);
+    RUN_TEST(test_limits_stop_one_request);
+    RUN_TEST(test_least_recently_used_program_is_evicted);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
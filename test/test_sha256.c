@@ -0,0 +1,36 @@
+#include "test_harness.h"
+#include "sha256.h"
+#include <stdlib.h>
+
+static bool digest_is(const char *data, size_t length, const char *expected) {
+    char hex[SHA256_HEX_LENGTH + 1];
+    sha256_hex(data, length, hex);
+    return strcmp(hex, expected) == 0;
+}
+
+bool test_known_digests() {
+    ASSERT_TRUE(digest_is("", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    ASSERT_TRUE(digest_is("abc", 3, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    ASSERT_TRUE(digest_is(two_blocks, strlen(two_blocks), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+    return true;
+}
+
+bool test_padding_at_block_edges() {
+    // 55 bytes still fit the length in their block, 56 and 64 need another
+    char *a = malloc(1000000);
+    memset(a, 'a', 1000000);
+    ASSERT_TRUE(digest_is(a, 55, "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318"));
+    ASSERT_TRUE(digest_is(a, 56, "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a"));
+    ASSERT_TRUE(digest_is(a, 64, "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"));
+    ASSERT_TRUE(digest_is(a, 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+    free(a);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_known_digests);
+    RUN_TEST(test_padding_at_block_edges);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
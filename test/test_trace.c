@@ -0,0 +1,89 @@
+#include "test_harness.h"
+#include "trace.h"
+#include "engine.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    size_t read = fread(text, 1, size, file);
+    text[read] = '\0';
+    fclose(file);
+    return text;
+}
+
+static int count_of(const char *text, const char *needle) {
+    int count = 0;
+    for (const char *at = strstr(text, needle); at != NULL; at = strstr(at + 1, needle)) count++;
+    return count;
+}
+
+// Run a 100 iteration loop with tracing on and return the trace
+static char *trace_loop(const char *engine, int sample_every) {
+    char path[] = "/tmp/pinch_trace_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    Program *program = load_program("0 -> i\n(i -> ADD <- 1) -> i\nSLEEP <- 0\nJUMP_IF <- [(i -> LT <- 100), 2<=, =>1]\n");
+    PreparedProgram *prepared = prepare_program(find_engine(engine), program, &(EngineOptions){0});
+    MachineState *state = new_machine_state();
+    start_trace(path, sample_every);
+    bool success = run_program(prepared, state);
+    stop_trace();
+    free_state(state);
+    free_prepared(prepared);
+    free_program(program);
+
+    char *trace = read_file(path);
+    remove(path);
+    return success ? trace : NULL;
+}
+
+bool test_statements_calls_jumps_and_waits_are_traced() {
+    char *trace = trace_loop("tree", 1);
+    ASSERT_TRUE(trace != NULL);
+    const char *header = "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    ASSERT_TRUE(strncmp(trace, header, strlen(header)) == 0);
+    ASSERT_TRUE(strstr(trace, "\n]}\n") != NULL);
+    ASSERT_TRUE(count_of(trace, "\"name\": \"line 2\", \"cat\": \"statement\"") == 100);
+    ASSERT_TRUE(count_of(trace, "\"args\": {\"statement\": 4}") == 100);
+    ASSERT_TRUE(count_of(trace, "\"name\": \"ADD\", \"cat\": \"builtin\"") == 100);
+    ASSERT_TRUE(count_of(trace, "\"name\": \"JUMP_IF\", \"cat\": \"builtin\"") == 100);
+    ASSERT_TRUE(count_of(trace, "\"cat\": \"wait\"") == 100);
+    // 99 jumps back to statement 2 and one past the end
+    ASSERT_TRUE(count_of(trace, "\"args\": {\"from\": 4, \"to\": 2}") == 99);
+    ASSERT_TRUE(count_of(trace, "\"args\": {\"from\": 4, \"to\": 5}") == 1);
+    ASSERT_TRUE(count_of(trace, "\"ph\": \"M\"") == 1);
+    free(trace);
+    return true;
+}
+
+bool test_sampling_keeps_one_statement_in_n() {
+    char *trace = trace_loop("tree", 10);
+    ASSERT_TRUE(trace != NULL);
+    // 301 statements run, the calls of unsampled ones are left out too
+    ASSERT_TRUE(count_of(trace, "\"cat\": \"statement\"") == 31);
+    ASSERT_TRUE(count_of(trace, "\"cat\": \"builtin\"") <= 2 * 31);
+    free(trace);
+    return true;
+}
+
+bool test_loops_stay_interpreted_while_tracing() {
+    char *trace = trace_loop("jit", 1);
+    ASSERT_TRUE(trace != NULL);
+    ASSERT_TRUE(count_of(trace, "\"name\": \"line 2\", \"cat\": \"statement\"") == 100);
+    free(trace);
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_statements_calls_jumps_and_waits_are_traced);
+    RUN_TEST(test_sampling_keeps_one_statement_in_n);
+    RUN_TEST(test_loops_stay_interpreted_while_tracing);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
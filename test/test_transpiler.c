@@ -0,0 +1,86 @@
+#include "test_harness.h"
+#include "parser.h"
+#include "transpiler.h"
+#include <stdlib.h>
+
+#define MAX_TEST_STATEMENTS 16
+
+static Statement *statements[MAX_TEST_STATEMENTS];
+static int stmt_count;
+static char *code;
+
+// Parse a NULL-terminated list of lines and translate them into C
+static bool emit_lines(char **lines) {
+    stmt_count = 0;
+    for (int i = 0; lines[i] != NULL; i++) {
+        parse_statement_result res = parse_statement(lines[i]);
+        if (!res.success) return false;
+        statements[stmt_count++] = res.stmt;
+    }
+
+    size_t size;
+    FILE *out = open_memstream(&code, &size);
+    emit_c_program(out, statements, stmt_count, "test.pinch");
+    fclose(out);
+    return true;
+}
+
+static void free_lines() {
+    for (int i = 0; i < stmt_count; i++) {
+        free_statement(statements[i]);
+    }
+    free(code);
+}
+
+#define ASSERT_EMITS(fragment) do { \
+    if (strstr(code, fragment) == NULL) { \
+        printf("\n\033[31m[FAIL]\033[0m Generated C lacks: %s\n", fragment); \
+        free_lines(); \
+        return false; \
+    } \
+} while(0)
+
+bool test_literal_jumps_become_gotos() {
+    char *lines[] = {
+        "0 -> i\n",
+        "(i -> ADD <- 1) -> i\n",
+        "JUMP_IF <- [(i -> LT <- 10), 1<=, =>1]\n",
+        "i\n",
+        NULL
+    };
+    ASSERT_TRUE(emit_lines(lines));
+    ASSERT_EMITS("if (t6 >= 0.5) goto s1;");
+    ASSERT_EMITS("goto s3;");
+    // i only ever holds Numbers, so it is an unboxed local
+    ASSERT_EMITS("double v0 = 0;");
+    ASSERT_EMITS("double t3 = t1 + t2;");
+    ASSERT_TRUE(strstr(code, "dispatch:") == NULL);
+    free_lines();
+    return true;
+}
+
+bool test_mixed_types_stay_boxed() {
+    char *lines[] = {
+        "\"text\" -> t\n",
+        "(t -> CONCAT <- \"\\\") -> t\n",
+        "(IF <- [1, t, 2]) -> u\n",
+        "JUMP <- (IF <- [1, =>1, =>2])\n",
+        NULL
+    };
+    ASSERT_TRUE(emit_lines(lines));
+    ASSERT_EMITS("Value *v0 = NULL;");
+    ASSERT_EMITS("value_from_str(\"\\\\\")");
+    ASSERT_EMITS("call(CONCAT, a");
+    // A computed jump lands through the dispatch switch
+    ASSERT_EMITS("jump(a");
+    ASSERT_EMITS("goto dispatch;");
+    free_lines();
+    return true;
+}
+
+int main() {
+    RUN_TEST(test_literal_jumps_become_gotos);
+    RUN_TEST(test_mixed_types_stay_boxed);
+    PRINT_STATS();
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Compare two "make bench" result files.
+
+    tools/bench_diff.py OLD.tsv NEW.tsv [--threshold PERCENT]
+
+Prints the median ns/op of every benchmark in both files and the change,
+flagging changes beyond the threshold that are also larger than the noise
+(the standard deviations of both runs). Exits with 1 if any benchmark got
+slower by more than the threshold.
+"""
+
+import argparse
+import csv
+import sys
+
+
+def read_results(path):
+    with open(path, newline="") as results:
+        return {row["name"]: row for row in csv.DictReader(results, delimiter="\t")}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0, help="percent change worth flagging")
+    args = parser.parse_args()
+
+    old = read_results(args.old)
+    new = read_results(args.new)
+    slower = 0
+    print("%-36s %12s %12s %9s" % ("benchmark", "old ns/op", "new ns/op", "change"))
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            print("%-36s %s" % (name, "only in " + ("new" if name in new else "old")))
+            continue
+        before = float(old[name]["median_ns"])
+        after = float(new[name]["median_ns"])
+        noise = float(old[name]["stddev_ns"]) + float(new[name]["stddev_ns"])
+        change = 100.0 * (after - before) / before if before > 0 else 0.0
+        flag = ""
+        if abs(change) > args.threshold and abs(after - before) > noise:
+            flag = "  slower" if change > 0 else "  faster"
+            slower += change > 0
+        print("%-36s %12.2f %12.2f %+8.1f%%%s" % (name, before, after, change, flag))
+    return 1 if slower else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
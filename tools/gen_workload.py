@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Generate Pinch programs that scale with a size parameter.
+
+    tools/gen_workload.py WORKLOAD SIZE [-o PATH]
+    tools/gen_workload.py --list
+
+Workloads:
+    straight  SIZE statements without jumps, for load time
+    loop      a JUMP_IF loop of SIZE iterations on Numbers
+    text      a loop of SIZE iterations of CONCAT and FIND on 1 KB of Text
+    vars      SIZE distinct variables assigned and read back, for the hashmap
+    nested    an expression nested SIZE calls deep, evaluated 100 times
+
+Every program prints one value at the end, so runs can be checked against
+each other. Programs contain no blank lines; jump literals count statements.
+"""
+
+import argparse
+import sys
+
+NESTED_ROUNDS = 100
+TEXT_BASE = "abcdefghij" * 100      # No "needle" in it, FIND scans all of it
+
+
+def straight(size):
+    body = ["(a -> ADD <- b) -> c", "(c -> MUL <- 0.5) -> a", "(a -> SUB <- 1.25) -> b", "(b -> ADD <- {k}) -> c"]
+    lines = ["0 -> a", "1 -> b"]
+    lines.extend(body[k % len(body)].format(k=k) for k in range(len(lines), size - 1))
+    lines.append("c")
+    return lines, len(lines)
+
+
+def loop(size):
+    return [
+        "0 -> i",
+        "0 -> acc",
+        "(acc -> ADD <- i) -> acc",
+        "(i -> ADD <- 1) -> i",
+        "JUMP_IF <- [(i -> LT <- %d), 2<=, =>1]" % size,
+        "acc",
+    ], size
+
+
+def text(size):
+    return [
+        '"%s" -> base' % TEXT_BASE,
+        "0 -> i",
+        "0 -> found",
+        '(base -> CONCAT <- "needle") -> hay',
+        '(hay -> FIND <- "needle") -> at',
+        "(found -> ADD <- at) -> found",
+        "(i -> ADD <- 1) -> i",
+        "JUMP_IF <- [(i -> LT <- %d), 4<=, =>1]" % size,
+        "found",
+    ], size
+
+
+def variable_name(k):
+    # Variable names are letters and underscores only, so count in base 26
+    letters = ""
+    while True:
+        letters = chr(ord("a") + k % 26) + letters
+        k //= 26
+        if k == 0:
+            return "v_" + letters
+
+
+def variables(size):
+    lines = ["%d -> %s" % (k, variable_name(k)) for k in range(size)]
+    lines.append("0 -> total")
+    lines.extend("(total -> ADD <- %s) -> total" % variable_name(k) for k in range(size))
+    lines.append("total")
+    return lines, size
+
+
+def nested(size):
+    expression = "(" * size + "x" + " -> ADD <- 1)" * size
+    return [
+        "0 -> x",
+        "0 -> round",
+        "%s -> y" % expression,
+        "(round -> ADD <- 1) -> round",
+        "JUMP_IF <- [(round -> LT <- %d), 2<=, =>1]" % NESTED_ROUNDS,
+        "y",
+    ], size * NESTED_ROUNDS
+
+
+WORKLOADS = {
+    "straight": straight,
+    "loop": loop,
+    "text": text,
+    "vars": variables,
+    "nested": nested,
+}
+
+
+def generate(workload, size):
+    """Return the program source and the units of work it does: statements,
+    iterations, variables or calls."""
+    lines, units = WORKLOADS[workload](size)
+    return "\n".join(lines) + "\n", units
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("workload", nargs="?", choices=sorted(WORKLOADS))
+    parser.add_argument("size", nargs="?", type=int)
+    parser.add_argument("-o", "--output", help="write the program here instead of stdout")
+    parser.add_argument("--list", action="store_true", help="list the workloads")
+    args = parser.parse_args()
+
+    if args.list:
+        print("\n".join(sorted(WORKLOADS)))
+        return 0
+    if args.workload is None or args.size is None or args.size < 1:
+        parser.error("a workload and a positive size are required")
+
+    source, _ = generate(args.workload, args.size)
+    if args.output:
+        with open(args.output, "w") as program:
+            program.write(source)
+    else:
+        sys.stdout.write(source)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
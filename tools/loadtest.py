@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Load test for "pinch --serve".
+
+    tools/loadtest.py SOCKET PROGRAM [--clients N] [--requests N] [name=value ...]
+
+Every client opens one connection, sends the program once and then names it
+by its content hash, running requests back to back. Prints throughput and
+latency percentiles over all requests, plus the statuses that were not ok.
+"""
+
+import argparse
+import hashlib
+import socket
+import threading
+import time
+
+
+def content_hash(source):
+    """SHA-256 in hex, the hash the server reports."""
+    return hashlib.sha256(source).hexdigest()
+
+
+def variable_lines(variables):
+    lines = []
+    for assignment in variables:
+        name, value = assignment.split("=", 1)
+        try:
+            float(value)
+            lines.append("NUMBER %s %s\n" % (name, value))
+        except ValueError:
+            lines.append("TEXT %s %s\n" % (name, value))
+    return "".join(lines).encode()
+
+
+def read_reply(replies):
+    """Skip OUT and ERR frames, return the DONE status."""
+    while True:
+        line = replies.readline()
+        if not line:
+            raise ConnectionError("server closed the connection")
+        kind, _, rest = line.decode().rstrip("\n").partition(" ")
+        if kind in ("OUT", "ERR"):
+            replies.read(int(rest))
+        elif kind == "DONE":
+            return rest.split(" ")[0]
+
+
+def client(path, source, variables, requests, latencies, statuses, lock):
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    connection.connect(path)
+    replies = connection.makefile("rb")
+    first = b"SOURCE %d\n" % len(source) + source + variables + b"RUN\n"
+    again = b"HASH " + content_hash(source).encode() + b"\n" + variables + b"RUN\n"
+
+    mine = []
+    not_ok = {}
+    for i in range(requests):
+        start = time.perf_counter()
+        connection.sendall(first if i == 0 else again)
+        status = read_reply(replies)
+        mine.append(time.perf_counter() - start)
+        if status != "ok":
+            not_ok[status] = not_ok.get(status, 0) + 1
+    connection.close()
+
+    with lock:
+        latencies.extend(mine)
+        for status, count in not_ok.items():
+            statuses[status] = statuses.get(status, 0) + count
+
+
+def percentile(ordered, fraction):
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load test for pinch --serve")
+    parser.add_argument("socket")
+    parser.add_argument("program")
+    parser.add_argument("--clients", type=int, default=8)
+    parser.add_argument("--requests", type=int, default=1000, help="per client")
+    parser.add_argument("variables", nargs="*", help="name=value")
+    args = parser.parse_intermixed_args()
+
+    with open(args.program, "rb") as file:
+        source = file.read()
+    variables = variable_lines(args.variables)
+
+    latencies = []
+    statuses = {}
+    lock = threading.Lock()
+    threads = [threading.Thread(target=client, args=(args.socket, source, variables, args.requests,
+                                                     latencies, statuses, lock))
+               for _ in range(args.clients)]
+    start = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    print("requests    %d in %.2f s" % (len(latencies), elapsed))
+    print("throughput  %.0f requests/s" % (len(latencies) / elapsed))
+    for label, fraction in (("p50", 0.50), ("p90", 0.90), ("p99", 0.99)):
+        print("%-11s %.3f ms" % (label, percentile(latencies, fraction) * 1000))
+    print("max         %.3f ms" % (latencies[-1] * 1000))
+    for status, count in sorted(statuses.items()):
+        print("%-11s %d" % (status, count))
+
+
+if __name__ == "__main__":
+    main()
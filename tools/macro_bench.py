@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Time generated workloads at several sizes and print how they scale.
+
+    tools/macro_bench.py [--pinch PATH] [--workloads NAME,...] [--sizes N,...]
+                         [--scale FACTOR] [--repeat N] [--engine NAME] [--tsv PATH]
+
+For every workload of tools/gen_workload.py and size, two programs are run
+--repeat times each:
+
+    the program itself, timed from outside: start-up, load and execution
+    its load twin, the same program behind a jump past its end, run with
+    --stats=json for the read, parse and prepare times
+
+Load is reported per byte of source and execution (the difference between the
+two runs) per unit of work of the workload. The exponent columns estimate
+k in time ~ size^k from the previous size: 1 is linear. With --tsv the
+medians are also written in the format of "make bench", so two runs can be
+compared with tools/bench_diff.py.
+"""
+
+import argparse
+import json
+import math
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+from gen_workload import WORKLOADS, generate
+
+DEFAULT_SIZES = {
+    "straight": [10000, 100000, 1000000],
+    "loop": [1000000, 10000000, 100000000],
+    "text": [10000, 100000, 1000000],
+    "vars": [1000, 10000, 100000],
+    "nested": [250, 1000, 4000],
+}
+
+
+class RunFailed(Exception):
+    pass
+
+
+def run(command, timeout):
+    start = time.perf_counter()
+    try:
+        finished = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        raise RunFailed("timed out after %gs" % timeout)
+    elapsed = time.perf_counter() - start
+    if finished.returncode != 0:
+        raise RunFailed("exit status %d" % finished.returncode)
+    if finished.stderr:
+        raise RunFailed(finished.stderr.decode(errors="replace").splitlines()[0])
+    return elapsed * 1e9
+
+
+def measure(args, directory, workload, size):
+    source, units = generate(workload, size)
+    statements = source.count("\n")
+    length = len(source)
+    program = os.path.join(directory, "%s_%d.pinch" % (workload, size))
+    twin = os.path.join(directory, "%s_%d_load.pinch" % (workload, size))
+    stats = os.path.join(directory, "stats.json")
+    with open(program, "w") as out:
+        out.write(source)
+    with open(twin, "w") as out:
+        out.write("JUMP <- =>%d\n" % (statements + 1) + source)
+
+    engine = ["--engine=" + args.engine] if args.engine else []
+    totals, twins, loads = [], [], []
+    for _ in range(args.repeat):
+        twins.append(run([args.pinch] + engine + ["--stats=json", "--stats-file=" + stats, twin], args.timeout))
+        with open(stats) as report:
+            summary = json.load(report)
+        loads.append(sum(summary["phases"][phase]["wall_ms"] for phase in ("read", "parse", "prepare")) * 1e6)
+        totals.append(run([args.pinch] + engine + [program], args.timeout))
+
+    # Execution is what the program costs beyond its twin, which loads the same
+    executes = [max(total - statistics.median(twins), 0.0) for total in totals]
+    return {
+        "units": units,
+        "bytes": length,
+        "load": [load / length for load in loads],
+        "execute": [execute / units for execute in executes],
+        "load_ms": statistics.median(loads) / 1e6,
+        "execute_ms": statistics.median(executes) / 1e6,
+        "total_ms": statistics.median(totals) / 1e6,
+    }
+
+
+def exponent(previous, current, key, size_key):
+    # Below a millisecond the noise of starting a process swamps the curve, and
+    # sizes that barely grow (a loop bound gaining a digit) say nothing
+    if previous is None or previous[key] < 1 or current[key] < 1 or current[size_key] < 2 * previous[size_key]:
+        return "-"
+    return "%.2f" % (math.log(current[key] / previous[key]) / math.log(current[size_key] / previous[size_key]))
+
+
+def tsv_row(name, samples, units, repeat):
+    return "%s\t%.2f\t%.2f\t%.2f\t%.2f\t%d\t%d\n" % (
+        name, statistics.median(samples), statistics.mean(samples),
+        statistics.stdev(samples) if len(samples) > 1 else 0.0, min(samples), units, repeat)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--pinch", default="output/pinch", help="interpreter to time")
+    parser.add_argument("--workloads", default=",".join(DEFAULT_SIZES), help="comma separated workloads")
+    parser.add_argument("--sizes", help="comma separated sizes for every workload instead of the defaults")
+    parser.add_argument("--scale", type=float, default=1.0, help="multiply the default sizes")
+    parser.add_argument("--repeat", type=int, default=3, help="runs of each program")
+    parser.add_argument("--engine", help="passed to pinch as --engine")
+    parser.add_argument("--timeout", type=float, default=600, help="seconds before a run counts as failed")
+    parser.add_argument("--tsv", help="also write the results here")
+    args = parser.parse_args()
+
+    workloads = args.workloads.split(",")
+    for workload in workloads:
+        if workload not in WORKLOADS:
+            parser.error("unknown workload '%s', expected one of %s" % (workload, ", ".join(sorted(WORKLOADS))))
+    if args.repeat < 1:
+        parser.error("--repeat must be at least 1")
+
+    rows = []
+    failed = 0
+    with tempfile.TemporaryDirectory(prefix="pinch-macro-") as directory:
+        for workload in workloads:
+            if args.sizes:
+                sizes = [int(size) for size in args.sizes.split(",")]
+            else:
+                sizes = [max(1, int(size * args.scale)) for size in DEFAULT_SIZES[workload]]
+            print("%s:" % workload)
+            print("%12s %12s %10s %8s %9s %10s %10s %9s" % (
+                "size", "source KB", "load ms", "ns/byte", "load exp", "exec ms", "ns/unit", "exec exp"))
+            previous = None
+            for size in sizes:
+                try:
+                    result = measure(args, directory, workload, size)
+                except RunFailed as failure:
+                    print("%12d   failed: %s" % (size, failure))
+                    failed += 1
+                    previous = None
+                    continue
+                print("%12d %12.1f %10.2f %8.1f %9s %10.2f %10.2f %9s" % (
+                    size, result["bytes"] / 1024, result["load_ms"], statistics.median(result["load"]),
+                    exponent(previous, result, "load_ms", "bytes"), result["execute_ms"],
+                    statistics.median(result["execute"]), exponent(previous, result, "execute_ms", "units")))
+                sys.stdout.flush()
+                name = "%s/%d" % (workload, size)
+                rows.append(tsv_row(name + "/load", result["load"], result["bytes"], args.repeat))
+                rows.append(tsv_row(name + "/execute", result["execute"], result["units"], args.repeat))
+                previous = result
+
+    if args.tsv:
+        directory = os.path.dirname(args.tsv)
+        if directory:
+            os.makedirs(directory, exist_ok=True)
+        with open(args.tsv, "w") as results:
+            results.write("name\tmedian_ns\tmean_ns\tstddev_ns\tmin_ns\titerations\trepetitions\n")
+            results.writelines(rows)
+        print("Results written to %s." % args.tsv)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,125 @@
+// Client for "pinch --serve": runs one program on a server
+//
+//     pinch-client SOCKET PROGRAM [name=value ...]
+//
+// Values that read as numbers are sent as Numbers, anything else as Text.
+// The program is named by its content hash first and only sent when the
+// server does not have it cached yet. Output goes to stdout, errors to
+// stderr, and the exit status is 0 only if the program ran to the end.
+
+#include "sha256.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static char *read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fseek(file, 0, SEEK_END);
+    *length = (size_t)ftell(file);
+    rewind(file);
+    char *text = malloc(*length + 1);
+    if (text == NULL || fread(text, 1, *length, file) != *length) {
+        fprintf(stderr, "Error: Could not read file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    text[*length] = '\0';
+    fclose(file);
+    return text;
+}
+
+static void send_text(FILE *requests, const char *text, size_t length) {
+    if (fwrite(text, 1, length, requests) != length) {
+        fprintf(stderr, "Error: Lost the connection to the server.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Send the variables and RUN, then copy frames out until DONE and keep its
+// status (status holds 16 characters)
+static void run(FILE *requests, FILE *replies, int argc, char **argv, char *status) {
+    for (int i = 3; i < argc; i++) {
+        char *equals = strchr(argv[i], '=');
+        if (equals == NULL) {
+            fprintf(stderr, "Variables are given as name=value, not '%s'.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        char *end;
+        strtod(equals + 1, &end);
+        bool number = equals[1] != '\0' && *end == '\0';
+        fprintf(requests, "%s %.*s %s\n", number ? "NUMBER" : "TEXT", (int)(equals - argv[i]), argv[i], equals + 1);
+    }
+    fputs("RUN\n", requests);
+    fflush(requests);
+
+    char line[128];
+    while (fgets(line, sizeof(line), replies) != NULL) {
+        size_t length;
+        char kind[8];
+        if (sscanf(line, "%7s %zu", kind, &length) == 2 && (strcmp(kind, "OUT") == 0 || strcmp(kind, "ERR") == 0)) {
+            FILE *to = strcmp(kind, "OUT") == 0 ? stdout : stderr;
+            char buffer[4096];
+            while (length > 0) {
+                size_t chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+                if (fread(buffer, 1, chunk, replies) != chunk) break;
+                fwrite(buffer, 1, chunk, to);
+                length -= chunk;
+            }
+        } else if (strncmp(line, "DONE ", 5) == 0) {
+            sscanf(line + 5, "%15s", status);
+            return;
+        }
+    }
+    fprintf(stderr, "Error: Lost the connection to the server.\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s SOCKET PROGRAM [name=value ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error: Could not connect to '%s': %s\n", argv[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Separate streams: one FILE cannot switch between reading and writing a socket
+    FILE *replies = fdopen(fd, "r");
+    FILE *requests = fdopen(dup(fd), "w");
+
+    size_t length;
+    char *source = read_file(argv[2], &length);
+    char hash[SHA256_HEX_LENGTH + 1];
+    sha256_hex(source, length, hash);
+
+    char status[16] = "";
+    fprintf(requests, "HASH %s\n", hash);
+    run(requests, replies, argc, argv, status);
+    if (strcmp(status, "unknown") == 0) {
+        fprintf(requests, "SOURCE %zu\n", length);
+        send_text(requests, source, length);
+        run(requests, replies, argc, argv, status);
+    }
+    free(source);
+    fclose(requests);
+    fclose(replies);
+
+    if (strcmp(status, "ok") == 0) return EXIT_SUCCESS;
+    if (strcmp(status, "failed") != 0) {
+        fprintf(stderr, "Request ended with status '%s'.\n", status);
+    }
+    return EXIT_FAILURE;
+}